@@ -192,6 +192,20 @@ enum CgpuImageFormat
   CGPU_IMAGE_FORMAT_D16_UNORM_S8_UINT = 128,
   CGPU_IMAGE_FORMAT_D24_UNORM_S8_UINT = 129,
   CGPU_IMAGE_FORMAT_D32_SFLOAT_S8_UINT = 130,
+  CGPU_IMAGE_FORMAT_BC1_RGB_UNORM_BLOCK = 131,
+  CGPU_IMAGE_FORMAT_BC1_RGB_SRGB_BLOCK = 132,
+  CGPU_IMAGE_FORMAT_BC1_RGBA_UNORM_BLOCK = 133,
+  CGPU_IMAGE_FORMAT_BC1_RGBA_SRGB_BLOCK = 134,
+  CGPU_IMAGE_FORMAT_BC2_UNORM_BLOCK = 135,
+  CGPU_IMAGE_FORMAT_BC2_SRGB_BLOCK = 136,
+  CGPU_IMAGE_FORMAT_BC3_UNORM_BLOCK = 137,
+  CGPU_IMAGE_FORMAT_BC3_SRGB_BLOCK = 138,
+  CGPU_IMAGE_FORMAT_BC4_UNORM_BLOCK = 139,
+  CGPU_IMAGE_FORMAT_BC4_SNORM_BLOCK = 140,
+  CGPU_IMAGE_FORMAT_BC5_UNORM_BLOCK = 141,
+  CGPU_IMAGE_FORMAT_BC5_SNORM_BLOCK = 142,
+  CGPU_IMAGE_FORMAT_BC6H_UFLOAT_BLOCK = 143,
+  CGPU_IMAGE_FORMAT_BC6H_SFLOAT_BLOCK = 144,
   CGPU_IMAGE_FORMAT_BC7_UNORM_BLOCK = 145,
   CGPU_IMAGE_FORMAT_BC7_SRGB_BLOCK = 146,
   CGPU_IMAGE_FORMAT_G8B8G8R8_422_UNORM = 1000156000,
@@ -245,6 +259,17 @@ enum CgpuMemoryAccessFlagBits
   CGPU_MEMORY_ACCESS_FLAG_MEMORY_WRITE   = 0x00010000
 };
 
+enum CgpuComponentSwizzle
+{
+  CGPU_COMPONENT_SWIZZLE_IDENTITY = 0,
+  CGPU_COMPONENT_SWIZZLE_ZERO = 1,
+  CGPU_COMPONENT_SWIZZLE_ONE = 2,
+  CGPU_COMPONENT_SWIZZLE_R = 3,
+  CGPU_COMPONENT_SWIZZLE_G = 4,
+  CGPU_COMPONENT_SWIZZLE_B = 5,
+  CGPU_COMPONENT_SWIZZLE_A = 6
+};
+
 enum CgpuSamplerAddressMode
 {
   CGPU_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE = 0,
@@ -276,14 +301,24 @@ struct CgpuSampler       { uint64_t handle = 0; };
 struct CgpuBlas          { uint64_t handle = 0; };
 struct CgpuTlas          { uint64_t handle = 0; };
 
+struct CgpuComponentMapping
+{
+  CgpuComponentSwizzle r;
+  CgpuComponentSwizzle g;
+  CgpuComponentSwizzle b;
+  CgpuComponentSwizzle a;
+};
+
 struct CgpuImageDesc
 {
   bool is3d;
   uint32_t width;
   uint32_t height;
   uint32_t depth;
+  uint32_t mipLevels;
   CgpuImageFormat format;
   CgpuImageUsageFlags usage;
+  CgpuComponentMapping components; // applied when sampling
 };
 
 struct CgpuBufferBinding
@@ -657,6 +692,7 @@ struct CgpuBufferImageCopyDesc
   uint32_t texelExtentX;
   uint32_t texelExtentY;
   uint32_t texelExtentZ;
+  uint32_t mipLevel;
 };
 
 bool cgpuCmdCopyBufferToImage(
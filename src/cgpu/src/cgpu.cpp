@@ -721,7 +721,7 @@ bool cgpuCreateDevice(CgpuDevice* device)
   deviceFeatures2.features.samplerAnisotropy = VK_TRUE;
   deviceFeatures2.features.textureCompressionETC2 = VK_FALSE;
   deviceFeatures2.features.textureCompressionASTC_LDR = VK_FALSE;
-  deviceFeatures2.features.textureCompressionBC = VK_FALSE;
+  deviceFeatures2.features.textureCompressionBC = idevice->features.textureCompressionBC;
   deviceFeatures2.features.occlusionQueryPrecise = VK_FALSE;
   deviceFeatures2.features.pipelineStatisticsQuery = VK_FALSE;
   deviceFeatures2.features.vertexPipelineStoresAndAtomics = VK_FALSE;
@@ -1172,8 +1172,9 @@ bool cgpuCreateImage(CgpuDevice device,
     CGPU_RETURN_ERROR_INVALID_HANDLE;
   }
 
+  // Linearly tiled images can't have mip levels.
   VkImageTiling vkImageTiling = VK_IMAGE_TILING_OPTIMAL;
-  if (!imageDesc->is3d && ((imageDesc->usage & CGPU_IMAGE_USAGE_FLAG_TRANSFER_SRC) | (imageDesc->usage & CGPU_IMAGE_USAGE_FLAG_TRANSFER_DST)))
+  if (!imageDesc->is3d && imageDesc->mipLevels == 1 && ((imageDesc->usage & CGPU_IMAGE_USAGE_FLAG_TRANSFER_SRC) | (imageDesc->usage & CGPU_IMAGE_USAGE_FLAG_TRANSFER_DST)))
   {
     vkImageTiling = VK_IMAGE_TILING_LINEAR;
   }
@@ -1187,7 +1188,7 @@ bool cgpuCreateImage(CgpuDevice device,
   imageCreateInfo.extent.width = imageDesc->width;
   imageCreateInfo.extent.height = imageDesc->height;
   imageCreateInfo.extent.depth = imageDesc->is3d ? imageDesc->depth : 1;
-  imageCreateInfo.mipLevels = 1;
+  imageCreateInfo.mipLevels = imageDesc->mipLevels;
   imageCreateInfo.arrayLayers = 1;
   imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
   imageCreateInfo.tiling = vkImageTiling;
@@ -1226,13 +1227,13 @@ bool cgpuCreateImage(CgpuDevice device,
   imageViewCreateInfo.image = iimage->image;
   imageViewCreateInfo.viewType = imageDesc->is3d ? VK_IMAGE_VIEW_TYPE_3D : VK_IMAGE_VIEW_TYPE_2D;
   imageViewCreateInfo.format = (VkFormat) imageDesc->format;
-  imageViewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-  imageViewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-  imageViewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-  imageViewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+  imageViewCreateInfo.components.r = (VkComponentSwizzle) imageDesc->components.r;
+  imageViewCreateInfo.components.g = (VkComponentSwizzle) imageDesc->components.g;
+  imageViewCreateInfo.components.b = (VkComponentSwizzle) imageDesc->components.b;
+  imageViewCreateInfo.components.a = (VkComponentSwizzle) imageDesc->components.a;
   imageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
   imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
-  imageViewCreateInfo.subresourceRange.levelCount = 1;
+  imageViewCreateInfo.subresourceRange.levelCount = imageDesc->mipLevels;
   imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
   imageViewCreateInfo.subresourceRange.layerCount = 1;
 
@@ -2561,7 +2562,7 @@ bool cgpuCmdTransitionShaderImageLayouts(CgpuCommandBuffer commandBuffer,
       barrier.image = iimage->image;
       barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
       barrier.subresourceRange.baseMipLevel = 0;
-      barrier.subresourceRange.levelCount = 1;
+      barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
       barrier.subresourceRange.baseArrayLayer = 0;
       barrier.subresourceRange.layerCount = 1;
       barriers.push_back(barrier);
@@ -2905,7 +2906,7 @@ bool cgpuCmdCopyBufferToImage(CgpuCommandBuffer commandBuffer,
     barrier.image = iimage->image;
     barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
     barrier.subresourceRange.baseArrayLayer = 0;
     barrier.subresourceRange.layerCount = 1;
 
@@ -2929,7 +2930,7 @@ bool cgpuCmdCopyBufferToImage(CgpuCommandBuffer commandBuffer,
 
   VkImageSubresourceLayers layers;
   layers.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  layers.mipLevel = 0;
+  layers.mipLevel = desc->mipLevel;
   layers.baseArrayLayer = 0;
   layers.layerCount = 1;
 
@@ -3095,7 +3096,7 @@ bool cgpuCmdPipelineBarrier(CgpuCommandBuffer commandBuffer,
     bVk.image = iimage->image;
     bVk.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     bVk.subresourceRange.baseMipLevel = 0;
-    bVk.subresourceRange.levelCount = 1;
+    bVk.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
     bVk.subresourceRange.baseArrayLayer = 0;
     bVk.subresourceRange.layerCount = 1;
     vkImageMemBarriers.push_back(bVk);
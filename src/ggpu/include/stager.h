@@ -38,13 +38,27 @@ namespace gtl
 
     bool stageToBuffer(const uint8_t* src, uint64_t size, CgpuBuffer dst, uint64_t dstOffset);
 
-    bool stageToImage(const uint8_t* src, uint64_t size, CgpuImage dst, uint32_t width, uint32_t height, uint32_t depth);
+    bool stageToImage(const uint8_t* src, uint64_t size, CgpuImage dst, uint32_t width, uint32_t height, uint32_t depth, uint32_t mipLevel = 0, uint32_t blockDim = 1);
+
+    // Writes tightly packed texels directly into staging memory, saving the intermediate
+    // copy. The size must not exceed getMaxDirectStageSize().
+    using WriteFunc = std::function<bool(uint8_t* dst)>;
+
+    bool stageToImage(const WriteFunc& writeFunc, uint64_t size, CgpuImage dst, uint32_t width, uint32_t height, uint32_t depth, uint32_t mipLevel = 0);
+
+    uint64_t getMaxDirectStageSize() const;
+
+    // Stages tightly packed texels to a sub-region of a 2D image. The size must not
+    // exceed getMaxDirectStageSize().
+    bool stageToImageRegion(const uint8_t* src, uint64_t size, CgpuImage dst, uint32_t offsetX, uint32_t offsetY, uint32_t width, uint32_t height, uint32_t mipLevel = 0);
 
   private:
     using CopyFunc = std::function<bool(uint64_t srcOffset, uint64_t dstOffset, uint64_t size)>;
 
     bool stage(const uint8_t* src, uint64_t size, CopyFunc copyFunc);
 
+    bool stageDirect(const WriteFunc& writeFunc, uint64_t size, CgpuImage dst, const CgpuBufferImageCopyDesc& desc);
+
   private:
     CgpuDevice m_device;
 
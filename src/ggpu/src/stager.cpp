@@ -150,9 +150,10 @@ fail:
     return stage(src, size, copyFunc);
   }
 
-  bool GgpuStager::stageToImage(const uint8_t* src, uint64_t size, CgpuImage dst, uint32_t width, uint32_t height, uint32_t depth)
+  bool GgpuStager::stageToImage(const uint8_t* src, uint64_t size, CgpuImage dst, uint32_t width, uint32_t height, uint32_t depth, uint32_t mipLevel, uint32_t blockDim)
   {
-    uint64_t rowCount = height;
+    // For block-compressed formats, a row consists of a line of blocks.
+    uint64_t rowCount = (height + blockDim - 1) / blockDim;
     uint64_t rowSize = size / rowCount;
 
     if (rowSize > BUFFER_HALF_SIZE)
@@ -160,6 +161,11 @@ fail:
       return false;
     }
 
+    // Buffer offsets of image copies must be a multiple of the texel size,
+    // which is no longer guaranteed now that images of different formats are staged.
+    const uint64_t TEXEL_ALIGNMENT = 16;
+    m_stagedBytes = (m_stagedBytes + TEXEL_ALIGNMENT - 1) & ~(TEXEL_ALIGNMENT - 1);
+
     uint32_t rowsStaged = 0;
 
     while (rowsStaged < rowCount)
@@ -180,15 +186,18 @@ fail:
       uint64_t remainingRowCount = rowCount - rowsStaged;
       uint64_t copyRowCount = std::min(remainingRowCount, maxCopyRowCount);
 
-      auto copyFunc = [this, dst, rowsStaged, width, depth, copyRowCount](uint64_t srcOffset, uint64_t dstOffset, uint64_t size) {
+      auto copyFunc = [this, dst, rowsStaged, width, height, depth, mipLevel, blockDim, copyRowCount](uint64_t srcOffset, uint64_t dstOffset, uint64_t size) {
+        uint32_t texelOffsetY = rowsStaged * blockDim;
+
         CgpuBufferImageCopyDesc desc;
         desc.bufferOffset = srcOffset;
         desc.texelOffsetX = 0;
         desc.texelExtentX = width;
-        desc.texelOffsetY = rowsStaged;
-        desc.texelExtentY = copyRowCount;
+        desc.texelOffsetY = texelOffsetY;
+        desc.texelExtentY = std::min(uint32_t(copyRowCount * blockDim), height - texelOffsetY);
         desc.texelOffsetZ = 0;
         desc.texelExtentZ = depth;
+        desc.mipLevel = mipLevel;
 
         return cgpuCmdCopyBufferToImage(
           m_commandBuffers[m_writeableHalf],
@@ -211,6 +220,44 @@ fail:
     return true;
   }
 
+  bool GgpuStager::stageToImage(const WriteFunc& writeFunc, uint64_t size, CgpuImage dst, uint32_t width, uint32_t height, uint32_t depth, uint32_t mipLevel)
+  {
+    CgpuBufferImageCopyDesc desc;
+    desc.texelOffsetX = 0;
+    desc.texelExtentX = width;
+    desc.texelOffsetY = 0;
+    desc.texelExtentY = height;
+    desc.texelOffsetZ = 0;
+    desc.texelExtentZ = depth;
+    desc.mipLevel = mipLevel;
+
+    return stageDirect(writeFunc, size, dst, desc);
+  }
+
+  bool GgpuStager::stageToImageRegion(const uint8_t* src, uint64_t size, CgpuImage dst, uint32_t offsetX, uint32_t offsetY, uint32_t width, uint32_t height, uint32_t mipLevel)
+  {
+    CgpuBufferImageCopyDesc desc;
+    desc.texelOffsetX = offsetX;
+    desc.texelExtentX = width;
+    desc.texelOffsetY = offsetY;
+    desc.texelExtentY = height;
+    desc.texelOffsetZ = 0;
+    desc.texelExtentZ = 1;
+    desc.mipLevel = mipLevel;
+
+    auto writeFunc = [src, size](uint8_t* dst) {
+      memcpy(dst, src, size);
+      return true;
+    };
+
+    return stageDirect(writeFunc, size, dst, desc);
+  }
+
+  uint64_t GgpuStager::getMaxDirectStageSize() const
+  {
+    return BUFFER_HALF_SIZE;
+  }
+
   bool GgpuStager::stage(const uint8_t* src, uint64_t size, CopyFunc copyFunc)
   {
     uint64_t bytesToStage = size;
@@ -249,4 +296,40 @@ fail:
 
     return true;
   }
+
+  bool GgpuStager::stageDirect(const WriteFunc& writeFunc, uint64_t size, CgpuImage dst, const CgpuBufferImageCopyDesc& desc)
+  {
+    if (size > BUFFER_HALF_SIZE)
+    {
+      return false;
+    }
+
+    const uint64_t TEXEL_ALIGNMENT = 16;
+    m_stagedBytes = (m_stagedBytes + TEXEL_ALIGNMENT - 1) & ~(TEXEL_ALIGNMENT - 1);
+
+    // Unlike copies, writes can't be split across buffer halves.
+    if ((m_stagedBytes + size) > BUFFER_HALF_SIZE && !flush())
+    {
+      return false;
+    }
+
+    uint64_t dstOffset = m_writeableHalf * BUFFER_HALF_SIZE + m_stagedBytes;
+    if (!writeFunc(&m_mappedMem[dstOffset]))
+    {
+      return false;
+    }
+
+    CgpuBufferImageCopyDesc copyDesc = desc;
+    copyDesc.bufferOffset = dstOffset;
+
+    if (!cgpuCmdCopyBufferToImage(m_commandBuffers[m_writeableHalf], m_stagingBuffer, dst, &copyDesc))
+    {
+      return false;
+    }
+
+    m_commandsPending = true;
+    m_stagedBytes += size;
+
+    return m_stagedBytes < BUFFER_HALF_SIZE || flush();
+  }
 }
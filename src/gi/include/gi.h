@@ -43,6 +43,26 @@ enum GiAovId
   GI_AOV_ID_DEBUG_BITANGENTS   = 9
 };
 
+enum GiHdrTextureFormat
+{
+  GI_HDR_TEXTURE_FORMAT_RGBA16F  = 0,
+  GI_HDR_TEXTURE_FORMAT_E5B9G9R9 = 1
+};
+
+enum GiSampler
+{
+  GI_SAMPLER_INDEPENDENT       = 0,
+  GI_SAMPLER_SOBOL             = 1, // Owen-scrambled, decorrelated per pixel
+  GI_SAMPLER_SOBOL_BLUE_NOISE  = 2  // Owen-scrambled, with a blue-noise screen-space dither
+};
+
+enum GiTextureCompression
+{
+  GI_TEXTURE_COMPRESSION_NONE            = 0,
+  GI_TEXTURE_COMPRESSION_BC_FAST         = 1,
+  GI_TEXTURE_COMPRESSION_BC_HIGH_QUALITY = 2
+};
+
 struct GiAsset;
 struct GiGeomCache;
 struct GiMaterial;
@@ -96,14 +116,21 @@ struct GiMeshInstance
 
 struct GiShaderCacheParams
 {
+  bool               adaptiveSampling; // requires progressive accumulation and the color AOV
   GiAovId            aovId;
+  bool               batchMdlCodeGen;
   GiDomeLight*       domeLight;
   bool               domeLightCameraVisibility;
   bool               filterImportanceSampling;
+  bool               lightTree;
   uint32_t           materialCount;
   const GiMaterial** materials;
   bool               nextEventEstimation;
+  bool               pathGuiding; // requires progressive accumulation and the color AOV
   bool               progressiveAccumulation;
+  bool               restir;
+  uint32_t           restirSpatialNeighbors;
+  GiSampler          sampler;
   GiScene*           scene;
 };
 
@@ -111,6 +138,7 @@ struct GiGeomCacheParams
 {
   uint32_t              meshInstanceCount;
   const GiMeshInstance* meshInstances;
+  bool                  nextEventEstimation; // emissive faces and the light tree are only built if set
   GiShaderCache*        shaderCache;
 };
 
@@ -128,6 +156,8 @@ struct GiRenderParams
   float                maxSampleValue;
   float                bgColor[4];
   GiScene*             scene;
+  float                adaptiveSamplingErrorThreshold; // relative standard error of the pixel luminance
+  uint32_t             adaptiveSamplingMaxSpp;
 };
 
 struct GiInitParams
@@ -136,6 +166,33 @@ struct GiInitParams
   const char* shaderPath;
   const std::vector<std::string>& mdlSearchPaths;
   const std::vector<std::string>& mtlxSearchPaths;
+  GiHdrTextureFormat hdrTextureFormat;
+  bool generateTextureMips;
+  uint64_t textureGpuByteBudget; // 0 means unlimited
+  uint64_t textureCpuByteBudget; // decoded images and virtual texture levels kept for reuse; 0 disables
+  GiTextureCompression textureCompression;
+  const char* textureCachePath; // on-disk cache of compressed textures; may be NULL
+  uint32_t maxTextureDimension; // textures are downscaled to fit; 0 means unlimited
+  uint64_t maxTextureByteSize; // per texture, before compression; 0 means unlimited
+  bool deduplicateTextures; // share images with identical file contents
+  uint64_t virtualTexturePoolByteSize; // streams tiles of LDR textures on demand if non-zero
+};
+
+struct GiTextureCacheStats
+{
+  uint64_t hitCount;
+  uint64_t decodedHitCount;
+  uint64_t missCount;
+  uint64_t evictionCount;
+  uint64_t reducedMipCount;
+  uint64_t gpuByteSize;
+  uint64_t cpuByteSize;
+  uint64_t transcodeCacheHitCount;
+  uint64_t compressionByteSavings;
+  uint64_t encodedTexelCount;
+  uint64_t encodeMicroseconds;
+  uint64_t dedupHitCount;
+  uint64_t dedupByteSize;
 };
 
 class GiAssetReader
@@ -169,6 +226,11 @@ bool giShaderCacheNeedsRebuild();
 bool giGeomCacheNeedsRebuild();
 
 void giInvalidateFramebuffer();
+
+// Number of pixels that are sampled by the next adaptive sampling pass; 0 once all have converged.
+uint32_t giGetActivePixelCount();
+
+void giGetTextureCacheStats(GiTextureCacheStats* stats);
 void giInvalidateShaderCache();
 void giInvalidateGeomCache();
 
@@ -180,6 +242,9 @@ void giDestroyScene(GiScene* scene);
 GiSphereLight* giCreateSphereLight(GiScene* scene);
 void giDestroySphereLight(GiScene* scene, GiSphereLight* light);
 void giSetSphereLightPosition(GiSphereLight* light, float* position);
+// A radius of zero makes it a point light, for which the radiance is the radiant intensity.
+void giSetSphereLightRadius(GiSphereLight* light, float radius);
+void giSetSphereLightRadiance(GiSphereLight* light, float* radiance);
 
 GiDomeLight* giCreateDomeLight(GiScene* scene, const char* filePath);
 void giDestroyDomeLight(GiScene* scene, GiDomeLight* light);
@@ -63,6 +63,120 @@ uvec4 rng4d_init(uvec2 pixel_coords, uint frame_num)
 {
     return uvec4(pixel_coords.xy, frame_num, 0);
 }
+
+// Path space is split into 4D sample dimensions: one for the camera ray and several per
+// bounce, so that each decision draws from the same dimension across all samples of a pixel.
+const uint SAMPLE_DIM_CAMERA = 0; // pixel filter, lens
+const uint SAMPLE_DIM_LIGHT = 1;  // light type selection and light sample
+const uint SAMPLE_DIM_RR = 2;     // Russian roulette
+const uint SAMPLE_DIM_BSDF = 3;   // BSDF sample
+const uint SAMPLE_DIMS_PER_BOUNCE = 3;
+
+uint sample_dim(uint bounce, uint dim)
+{
+    return dim + bounce * SAMPLE_DIMS_PER_BOUNCE;
+}
+
+#ifdef SOBOL_SAMPLER
+// Burley 2020. Practical Hash-based Owen Scrambling. JCGT.
+// Generator matrices of Sobol dimensions 2 to 4 (Joe & Kuo); dimension 1 is van der Corput.
+const uint SOBOL_DIRECTIONS[3][32] = {
+    { 0x80000000u, 0xc0000000u, 0xa0000000u, 0xf0000000u, 0x88000000u, 0xcc000000u, 0xaa000000u, 0xff000000u,
+      0x80800000u, 0xc0c00000u, 0xa0a00000u, 0xf0f00000u, 0x88880000u, 0xcccc0000u, 0xaaaa0000u, 0xffff0000u,
+      0x80008000u, 0xc000c000u, 0xa000a000u, 0xf000f000u, 0x88008800u, 0xcc00cc00u, 0xaa00aa00u, 0xff00ff00u,
+      0x80808080u, 0xc0c0c0c0u, 0xa0a0a0a0u, 0xf0f0f0f0u, 0x88888888u, 0xccccccccu, 0xaaaaaaaau, 0xffffffffu },
+    { 0x80000000u, 0xc0000000u, 0x60000000u, 0x90000000u, 0xe8000000u, 0x5c000000u, 0x8e000000u, 0xc5000000u,
+      0x68800000u, 0x9cc00000u, 0xee600000u, 0x55900000u, 0x80680000u, 0xc09c0000u, 0x60ee0000u, 0x90550000u,
+      0xe8808000u, 0x5cc0c000u, 0x8e606000u, 0xc5909000u, 0x6868e800u, 0x9c9c5c00u, 0xeeee8e00u, 0x5555c500u,
+      0x8000e880u, 0xc0005cc0u, 0x60008e60u, 0x9000c590u, 0xe8006868u, 0x5c009c9cu, 0x8e00eeeeu, 0xc5005555u },
+    { 0x80000000u, 0xc0000000u, 0x20000000u, 0x50000000u, 0xf8000000u, 0x74000000u, 0xa2000000u, 0x93000000u,
+      0xd8800000u, 0x25400000u, 0x59e00000u, 0xe6d00000u, 0x78080000u, 0xb40c0000u, 0x82020000u, 0xc3050000u,
+      0x208f8000u, 0x51474000u, 0xfbea2000u, 0x75d93000u, 0xa0858800u, 0x914e5400u, 0xdbe79e00u, 0x25db6d00u,
+      0x58800080u, 0xe54000c0u, 0x79e00020u, 0xb6d00050u, 0x800800f8u, 0xc00c0074u, 0x200200a2u, 0x50050093u }
+};
+
+uvec4 sobol4d(uint index)
+{
+    uvec4 x = uvec4(bitfieldReverse(index), 0u, 0u, 0u);
+
+    for (uint bit = 0; index != 0u; bit++, index >>= 1)
+    {
+        if ((index & 1u) != 0u)
+        {
+            x.y ^= SOBOL_DIRECTIONS[0][bit];
+            x.z ^= SOBOL_DIRECTIONS[1][bit];
+            x.w ^= SOBOL_DIRECTIONS[2][bit];
+        }
+    }
+
+    return x;
+}
+
+uint laine_karras_permutation(uint x, uint seed)
+{
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+uint nested_uniform_scramble(uint x, uint seed)
+{
+    return bitfieldReverse(laine_karras_permutation(bitfieldReverse(x), seed));
+}
+
+uint hash_combine(uint seed, uint v)
+{
+    return seed ^ (v + (seed << 6) + (seed >> 2));
+}
+
+// Dimensions beyond the fourth are padded by shuffling the index with a different seed.
+uvec4 shuffled_scrambled_sobol4d(uint index, uint seed)
+{
+    uvec4 x = sobol4d(nested_uniform_scramble(index, seed));
+
+    for (uint d = 0; d < 4; d++)
+    {
+        x[d] = nested_uniform_scramble(x[d], hash_combine(seed, d));
+    }
+
+    return x;
+}
+
+uint morton_encode(uvec2 p)
+{
+    p &= 0xFFFFu;
+    p = (p | (p << 8)) & 0x00FF00FFu;
+    p = (p | (p << 4)) & 0x0F0F0F0Fu;
+    p = (p | (p << 2)) & 0x33333333u;
+    p = (p | (p << 1)) & 0x55555555u;
+    return p.x | (p.y << 1);
+}
+
+// rng_state holds the pixel coordinates and the sample index.
+vec4 rng4d_sample(inout uvec4 rng_state, uint dimension)
+{
+#ifdef BLUE_NOISE_DITHER
+    // All pixels share the sequence, shifted toroidally by a screen-space dither. Following
+    // Ahmed & Wonka 2020, the dither is the Z-order index of the pixel in another scrambled
+    // sequence, which stratifies the shifts of neighboring pixels and turns the error into blue noise.
+    uint seed = hash_pcg4d(uvec4(dimension, 0u, 0u, 0u)).x;
+    uvec4 dither = shuffled_scrambled_sobol4d(morton_encode(rng_state.xy), hash_combine(seed, 0x9e3779b9u));
+    return uvec4AsVec4(shuffled_scrambled_sobol4d(rng_state.z, seed) + dither);
+#else
+    uint seed = hash_pcg4d(uvec4(rng_state.xy, dimension, 0u)).x;
+    return uvec4AsVec4(shuffled_scrambled_sobol4d(rng_state.z, seed));
+#endif
+}
+#else
+// Independent samples don't depend on the dimension.
+vec4 rng4d_sample(inout uvec4 rng_state, uint dimension)
+{
+    return rng4d_next(rng_state);
+}
+#endif
 #else
 // Hash prospector parametrization found by GH user TheIronBorn:
 // https://github.com/skeeto/hash-prospector#discovered-hash-functions
@@ -195,4 +309,12 @@ vec3 sample_hemisphere(vec2 xi)
     );
 }
 
+// Veach's power heuristic with an exponent of two. Written in terms of the pdf ratio
+// so that large pdfs don't overflow. pdf_a must be positive.
+float mis_power_heuristic(float pdf_a, float pdf_b)
+{
+    float r = pdf_b / pdf_a;
+    return 1.0 / (1.0 + r * r);
+}
+
 #endif
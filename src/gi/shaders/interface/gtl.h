@@ -44,6 +44,9 @@
 #define SI_BINDING_INDEX(NAME, IDX) \
   constexpr static uint32_t BINDING_INDEX_##NAME = IDX;
 
+#define SI_CONSTANT(NAME, VALUE) \
+  constexpr static uint32_t NAME = VALUE;
+
 #else
 
 #define SI_INT        int
@@ -61,6 +64,9 @@
 #define SI_BINDING_INDEX(NAME,IDX) \
   const uint BINDING_INDEX_##NAME = IDX;
 
+#define SI_CONSTANT(NAME,VALUE) \
+  const uint NAME = VALUE;
+
 #endif
 
 #endif
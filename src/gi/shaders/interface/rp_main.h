@@ -37,6 +37,100 @@ struct Face
   SI_UINT v_2;
 };
 
+struct AliasEntry
+{
+  SI_FLOAT prob;  // of keeping this entry instead of its alias
+  SI_UINT  alias;
+  SI_FLOAT pdf;   // selection probability times entry count
+};
+
+// World space triangle with its entry of the power-weighted alias table.
+struct EmissiveFace
+{
+  SI_VEC3  p0;
+  SI_FLOAT prob;
+  SI_VEC3  p1;
+  SI_UINT  alias;
+  SI_VEC3  p2;
+  SI_FLOAT pdf;
+  SI_UINT  lightTreeBits; // child taken at each level on the way to the face's leaf
+  SI_FLOAT emissionLuminance; // 1 if not constant
+  SI_UINT  padding[2];
+};
+
+// Inner nodes have two adjacent children; leaves hold a single emissive face.
+struct LightTreeNode
+{
+  SI_VEC3  boundsMin;
+  SI_FLOAT power;
+  SI_VEC3  boundsMax;
+  SI_UINT  index;        // of the first child, or of the face if LIGHT_TREE_LEAF_BIT is set
+  SI_VEC3  coneAxis;
+  SI_FLOAT coneCosTheta; // bounds the normals around the axis
+};
+
+// Sphere lights with a radius of zero are point lights. Their radiance is the radiant intensity.
+struct SphereLight
+{
+  SI_VEC3  position;
+  SI_FLOAT radius;
+  SI_VEC3  radiance;
+  SI_FLOAT padding;
+};
+
+// Light sample chosen by spatiotemporal resampling of the direct lighting at a primary hit.
+struct Reservoir
+{
+  SI_VEC3  lightPoint;  // on the light, or the direction of the dome light
+  SI_UINT  lightId;     // type in the upper two bits, face or sphere index below
+  SI_VEC3  position;    // of the shading point
+  SI_FLOAT weight;      // unbiased contribution weight, 0 if occluded
+  SI_VEC3  normal;
+  SI_FLOAT sampleCount; // number of candidates the sample represents
+};
+
+// Running luminance moments of the samples of a pixel, used to estimate its error.
+struct PixelStats
+{
+  SI_FLOAT lumSum;
+  SI_FLOAT lumSqSum;
+  SI_UINT  sampleCount;
+  SI_UINT  padding;
+};
+
+// Path guiding: a binary tree partitions space, each of its leaves holds a quadtree over the
+// square of cylindrical direction coordinates with the incident radiance of each quadrant.
+struct GuidingSpatialNode
+{
+  SI_UINT  axis;  // GUIDING_SPATIAL_LEAF for leaves
+  SI_UINT  index; // of the first of two adjacent children, or of the leaf's directional root
+  SI_FLOAT split; // world space position along the axis
+  SI_UINT  padding;
+};
+
+struct GuidingDirectionalNode
+{
+  SI_FLOAT energies[4]; // quadrant index is u-bit | (v-bit << 1)
+  SI_UINT  children[4]; // 0 for leaves
+};
+
+// Radiance incident at a path vertex along the direction that was sampled with the given pdf.
+struct GuidingRecord
+{
+  SI_VEC3  position;
+  SI_FLOAT radiance; // luminance
+  SI_VEC3  direction;
+  SI_FLOAT pdf;
+};
+
+struct GuidingRecordHeader
+{
+  SI_UINT  count;       // of attempted writes, may exceed the capacity
+  SI_UINT  capacity;
+  SI_FLOAT probability; // of a path vertex being recorded
+  SI_UINT  padding;
+};
+
 struct PushConstants
 {
   SI_VEC3  cameraPosition;
@@ -55,7 +149,7 @@ struct PushConstants
   SI_VEC3  domeLightTransformCol1;
   SI_FLOAT rrInvMinTermProb;
   SI_VEC3  domeLightTransformCol2;
-  // 1 float remaining
+  SI_UINT  activePixelCount; // launch size with adaptive sampling
 };
 
 SI_BINDING_INDEX(OUT_PIXELS,     0)
@@ -66,6 +160,36 @@ SI_BINDING_INDEX(SAMPLER,        4)
 SI_BINDING_INDEX(TEXTURES_2D,    5)
 SI_BINDING_INDEX(TEXTURES_3D,    6)
 SI_BINDING_INDEX(SCENE_AS,       7)
+SI_BINDING_INDEX(VT_PAGE_TABLE,  8)
+SI_BINDING_INDEX(VT_FEEDBACK,    9)
+SI_BINDING_INDEX(VT_TILE_POOL,   10)
+SI_BINDING_INDEX(DOME_LIGHT_ALIAS_TABLE, 11)
+SI_BINDING_INDEX(EMISSIVE_INSTANCES, 12)
+SI_BINDING_INDEX(LIGHT_TREE_NODES, 13)
+SI_BINDING_INDEX(SPHERE_LIGHTS,    14)
+SI_BINDING_INDEX(RESTIR_RESERVOIRS_PREV, 15)
+SI_BINDING_INDEX(RESTIR_RESERVOIRS,      16)
+SI_BINDING_INDEX(ACTIVE_PIXELS,          17)
+SI_BINDING_INDEX(PIXEL_STATS,            18)
+SI_BINDING_INDEX(GUIDING_SPATIAL_NODES,     19)
+SI_BINDING_INDEX(GUIDING_DIRECTIONAL_NODES, 20)
+SI_BINDING_INDEX(GUIDING_RECORDS,           21)
+
+// Virtual textures are split into tiles of VT_TILE_SIZE^2 texels per mip level. Tiles are
+// stored in slots of the physical tile pool, with a border for bilinear filtering.
+SI_CONSTANT(VT_TILE_SIZE,    128)
+SI_CONSTANT(VT_TILE_BORDER,  1)
+SI_CONSTANT(VT_SLOT_SIZE,    130)
+SI_CONSTANT(VT_NON_RESIDENT, 0xFFFFFFFFu)
+
+// The dome light is importance sampled by choosing one of these equirectangular cells,
+// independent of the texture resolution.
+SI_CONSTANT(DOME_LIGHT_SAMPLING_WIDTH,  1024)
+SI_CONSTANT(DOME_LIGHT_SAMPLING_HEIGHT, 512)
+
+SI_CONSTANT(LIGHT_TREE_LEAF_BIT, 0x80000000u)
+
+SI_CONSTANT(GUIDING_SPATIAL_LEAF, 3)
 
 SI_NAMESPACE_END()
 
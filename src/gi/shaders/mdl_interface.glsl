@@ -32,6 +32,9 @@ float apply_wrap_and_crop(float coord, int wrap, vec2 crop, int res)
     return coord * (crop.y - crop.x) + crop.x;
 }
 
+// Resolution-independent part of the texture LOD, set up along with the shading state.
+float tex_lod_base = -FLOAT_MAX;
+
 bool tex_texture_isvalid(int tex)
 {
     return tex != 0;
@@ -48,7 +51,7 @@ vec4 tex_lookup_float4_3d(int tex, vec3 coord, int wrap_u, int wrap_v, int wrap_
         return vec4(0, 0, 0, 0);
     }
 
-    uint array_idx = TEXTURE_INDEX_OFFSET_3D + tex - 1;
+    uint array_idx = TEXTURE_INDICES[tex];
 
     int mipmap_level = 0;
     ivec3 res = textureSize(textures_3d[array_idx], mipmap_level);
@@ -93,7 +96,7 @@ vec4 tex_texel_float4_3d(int tex, ivec3 coord, float frame)
         return vec4(0, 0, 0, 0);
     }
 
-    uint array_idx = TEXTURE_INDEX_OFFSET_3D + tex - 1;
+    uint array_idx = TEXTURE_INDICES[tex];
 
     int mipmap_level = 0;
     ivec3 res = textureSize(textures_3d[array_idx], mipmap_level);
@@ -130,6 +133,66 @@ vec3 tex_texel_color_3d(int tex, ivec3 coord, float frame)
     return tex_texel_float3_3d(tex, coord, frame);
 }
 
+#if defined(VIRTUAL_TEXTURING) && (TEXTURE_COUNT_2D > 0)
+// Returns the page table record of a virtual texture, or 0 for regular textures.
+uint vt_get_record(uint array_idx)
+{
+    return vt_page_table[array_idx];
+}
+
+ivec2 vt_get_resolution(uint record)
+{
+    uint packed_dims = vt_page_table[record];
+    return ivec2(packed_dims & 0xFFFFu, packed_dims >> 16);
+}
+
+void vt_request_tile(uint entry)
+{
+    uint word = entry >> 5;
+    uint bit = 1u << (entry & 31u);
+
+    // Most tiles are accessed many times per pass; only the first access needs the atomic.
+    if ((vt_feedback[word] & bit) == 0)
+    {
+        atomicOr(vt_feedback[word], bit);
+    }
+}
+
+// Samples the nearest mip level of a virtual texture. If the tile is not resident, coarser
+// levels are used instead. All tiles that are visited get requested by the feedback buffer.
+vec4 vt_sample(uint record, vec2 coord, float lod)
+{
+    uvec2 res = uvec2(vt_get_resolution(record));
+    uint level_count = vt_page_table[record + 1];
+
+    [[loop]]
+    for (uint level = min(uint(lod + 0.5), level_count - 1); level < level_count; level++)
+    {
+        uvec2 level_res = max(res >> level, uvec2(1));
+        vec2 texel = coord * vec2(level_res);
+        uvec2 tile = min(uvec2(texel), level_res - 1) / VT_TILE_SIZE;
+
+        uint tile_count_x = (level_res.x + VT_TILE_SIZE - 1) / VT_TILE_SIZE;
+        uint entry = vt_page_table[record + 2 + level] + tile.y * tile_count_x + tile.x;
+
+        vt_request_tile(entry);
+
+        uint slot = vt_page_table[entry];
+        if (slot == VT_NON_RESIDENT)
+        {
+            continue;
+        }
+
+        vec2 slot_origin = vec2(uvec2(slot & 0xFFFFu, slot >> 16) * VT_SLOT_SIZE + VT_TILE_BORDER);
+        vec2 pool_coord = (slot_origin + texel - vec2(tile * VT_TILE_SIZE)) / vec2(textureSize(vt_tile_pool, 0));
+
+        return textureLod(sampler2D(vt_tile_pool, tex_sampler), pool_coord, 0.0);
+    }
+
+    return vec4(0, 0, 0, 0);
+}
+#endif
+
 vec4 tex_lookup_float4_2d(int tex, vec2 coord, int wrap_u, int wrap_v, vec2 crop_u, vec2 crop_v, float frame)
 {
 #if TEXTURE_COUNT_2D > 0
@@ -140,14 +203,28 @@ vec4 tex_lookup_float4_2d(int tex, vec2 coord, int wrap_u, int wrap_v, vec2 crop
         return vec4(0, 0, 0, 0);
     }
 
-    uint array_idx = TEXTURE_INDEX_OFFSET_2D + tex - 1;
+    uint array_idx = TEXTURE_INDICES[tex];
+
+#ifdef VIRTUAL_TEXTURING
+    uint vt_record = vt_get_record(array_idx);
+    if (vt_record != 0)
+    {
+        ivec2 vt_res = vt_get_resolution(vt_record);
+        coord.x = apply_wrap_and_crop(coord.x, wrap_u, crop_u, vt_res.x);
+        coord.y = apply_wrap_and_crop(coord.y, wrap_v, crop_v, vt_res.y);
+        coord -= floor(coord); // tiles are addressed in [0, 1)
+
+        float vt_lod = max(0.0, tex_lod_base + 0.5 * log2(float(vt_res.x) * float(vt_res.y)));
+        return vt_sample(vt_record, coord, vt_lod);
+    }
+#endif
 
     int mipmap_level = 0;
     ivec2 res = textureSize(textures_2d[array_idx], mipmap_level);
     coord.x = apply_wrap_and_crop(coord.x, wrap_u, crop_u, res.x);
     coord.y = apply_wrap_and_crop(coord.y, wrap_v, crop_v, res.y);
 
-    float lod = 0.0;
+    float lod = max(0.0, tex_lod_base + 0.5 * log2(float(res.x) * float(res.y)));
     ASSERT(array_idx < TEXTURE_COUNT_2D, "Error: invalid texture index\n");
     return textureLod(sampler2D(textures_2d[array_idx], tex_sampler), coord, lod);
 #else
@@ -184,7 +261,22 @@ vec4 tex_texel_float4_2d(int tex, ivec2 coord, ivec2 uv_tile, float frame)
         return vec4(0, 0, 0, 0);
     }
 
-    uint array_idx = TEXTURE_INDEX_OFFSET_2D + tex - 1;
+    uint array_idx = TEXTURE_INDICES[tex];
+
+#ifdef VIRTUAL_TEXTURING
+    uint vt_record = vt_get_record(array_idx);
+    if (vt_record != 0)
+    {
+        ivec2 vt_res = vt_get_resolution(vt_record);
+        if (coord.x < 0 || coord.x >= vt_res.x || coord.y < 0 || coord.y >= vt_res.y)
+        {
+            return vec4(0, 0, 0, 0);
+        }
+
+        // Bilinear filtering at the texel center returns the texel itself.
+        return vt_sample(vt_record, (vec2(coord) + 0.5) / vec2(vt_res), 0.0);
+    }
+#endif
 
     int mipmap_level = 0;
     ivec2 res = textureSize(textures_2d[array_idx], mipmap_level);
@@ -229,10 +321,18 @@ ivec2 tex_resolution_2d(int tex, ivec2 uv_tile, float frame)
         return ivec2(0, 0);
     }
 
-    uint array_idx = TEXTURE_INDEX_OFFSET_2D + tex - 1;
+    uint array_idx = TEXTURE_INDICES[tex];
 
     ASSERT(array_idx < TEXTURE_COUNT_2D, "Error: invalid texture index\n");
 
+#ifdef VIRTUAL_TEXTURING
+    uint vt_record = vt_get_record(array_idx);
+    if (vt_record != 0)
+    {
+        return vt_get_resolution(vt_record);
+    }
+#endif
+
     int mipmap_level = 0;
     return textureSize(textures_2d[array_idx], mipmap_level);
 #else
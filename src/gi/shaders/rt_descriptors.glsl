@@ -6,7 +6,42 @@ layout(binding = BINDING_INDEX_OUT_PIXELS, std430) buffer PixelsBuffer { vec4 pi
 layout(binding = BINDING_INDEX_FACES, std430) readonly buffer FacesBuffer { Face faces[]; };
 
 #ifdef NEXT_EVENT_ESTIMATION
-//layout(binding = BINDING_INDEX_EMISSIVE_FACES, std430) readonly buffer EmissiveFacesBuffer { uint emissive_face_indices[]; };
+layout(binding = BINDING_INDEX_EMISSIVE_FACES, std430) readonly buffer EmissiveFacesBuffer { EmissiveFace emissive_faces[]; };
+
+// Index of the first emissive face of each TLAS instance, UINT32_MAX if not emissive.
+layout(binding = BINDING_INDEX_EMISSIVE_INSTANCES, std430) readonly buffer EmissiveInstancesBuffer { uint emissive_instance_offsets[]; };
+
+layout(binding = BINDING_INDEX_LIGHT_TREE_NODES, std430) readonly buffer LightTreeNodesBuffer { LightTreeNode light_tree_nodes[]; };
+#endif
+
+#ifdef SPHERE_LIGHTS
+layout(binding = BINDING_INDEX_SPHERE_LIGHTS, std430) readonly buffer SphereLightsBuffer { SphereLight sphere_lights[]; };
+#endif
+
+#ifdef RESTIR
+// Reservoirs of the previous pass are read, those of the current pass are written.
+layout(binding = BINDING_INDEX_RESTIR_RESERVOIRS_PREV, std430) readonly buffer RestirReservoirsPrevBuffer { Reservoir restir_reservoirs_prev[]; };
+layout(binding = BINDING_INDEX_RESTIR_RESERVOIRS, std430) buffer RestirReservoirsBuffer { Reservoir restir_reservoirs[]; };
+#endif
+
+#ifdef ADAPTIVE_SAMPLING
+// Pixel indices of the compacted launch; only the first PC.activePixelCount entries are valid.
+layout(binding = BINDING_INDEX_ACTIVE_PIXELS, std430) readonly buffer ActivePixelsBuffer { uint active_pixels[]; };
+
+layout(binding = BINDING_INDEX_PIXEL_STATS, std430) buffer PixelStatsBuffer { PixelStats pixel_stats[]; };
+#endif
+
+#ifdef PATH_GUIDING
+// Spatial binary tree with a directional quadtree in each leaf, learned from previous passes.
+layout(binding = BINDING_INDEX_GUIDING_SPATIAL_NODES, std430) readonly buffer GuidingSpatialNodesBuffer { GuidingSpatialNode guiding_spatial_nodes[]; };
+layout(binding = BINDING_INDEX_GUIDING_DIRECTIONAL_NODES, std430) readonly buffer GuidingDirectionalNodesBuffer { GuidingDirectionalNode guiding_directional_nodes[]; };
+
+// Path vertices of this pass, read back to refine the trees.
+layout(binding = BINDING_INDEX_GUIDING_RECORDS, std430) buffer GuidingRecordsBuffer
+{
+    GuidingRecordHeader guiding_record_header;
+    GuidingRecord guiding_records[];
+};
 #endif
 
 layout(binding = BINDING_INDEX_VERTICES, std430) readonly buffer VerticesBuffer { FVertex vertices[]; };
@@ -23,6 +58,22 @@ layout(binding = BINDING_INDEX_TEXTURES_2D) uniform texture2D textures_2d[TEXTUR
 layout(binding = BINDING_INDEX_TEXTURES_3D) uniform texture3D textures_3d[TEXTURE_COUNT_3D];
 #endif
 
+#if defined(VIRTUAL_TEXTURING) && (TEXTURE_COUNT_2D > 0)
+// The first TEXTURE_COUNT_2D entries hold the record offset of each 2D texture (0 if
+// not virtual). A record consists of the packed dimensions, the mip level count and
+// the offset of each level's tile entries. Tile entries hold the pool slot or VT_NON_RESIDENT.
+layout(binding = BINDING_INDEX_VT_PAGE_TABLE, std430) readonly buffer VtPageTableBuffer { uint vt_page_table[]; };
+
+// One bit per tile entry of the page table, set for all tiles accessed in a pass.
+layout(binding = BINDING_INDEX_VT_FEEDBACK, std430) buffer VtFeedbackBuffer { uint vt_feedback[]; };
+
+layout(binding = BINDING_INDEX_VT_TILE_POOL) uniform texture2D vt_tile_pool;
+#endif
+
+#ifdef DOMELIGHT_ENABLED
+layout(binding = BINDING_INDEX_DOME_LIGHT_ALIAS_TABLE, std430) readonly buffer DomeLightAliasTableBuffer { AliasEntry dome_light_alias_table[]; };
+#endif
+
 layout(binding = BINDING_INDEX_SCENE_AS) uniform accelerationStructureEXT sceneAS;
 
 layout(push_constant) uniform PushConstantBlock { PushConstants PC; };
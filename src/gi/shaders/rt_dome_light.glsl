@@ -0,0 +1,70 @@
+#ifdef DOMELIGHT_ENABLED
+
+// Equirectangular mapping of directions in dome light space.
+vec2 dome_light_dir_to_uv(vec3 dir)
+{
+    float u = (atan(dir.z, dir.x) + 0.5 * PI) / (2.0 * PI);
+    float v = acos(clamp(dir.y, -1.0, 1.0)) / PI;
+    return vec2(u, v);
+}
+
+vec3 dome_light_uv_to_dir(vec2 uv)
+{
+    float phi = uv.x * 2.0 * PI - 0.5 * PI;
+    float theta = uv.y * PI;
+    float sin_theta = sin(theta);
+    return vec3(sin_theta * cos(phi), cos(theta), sin_theta * sin(phi));
+}
+
+mat3 dome_light_transform()
+{
+    return mat3(PC.domeLightTransformCol0, PC.domeLightTransformCol1, PC.domeLightTransformCol2);
+}
+
+vec3 dome_light_radiance(vec2 uv)
+{
+    const uint lodLevel = 0;
+    const uint domeLightTexIndex = 0;
+    return textureLod(sampler2D(textures_2d[domeLightTexIndex], tex_sampler), uv, lodLevel).rgb;
+}
+
+// Converts the density of a sampling cell to solid angle. The Jacobian of the
+// equirectangular mapping is 2 * PI^2 * sin(theta).
+float dome_light_pdf(uint cell_index, float v)
+{
+    float sin_theta = sin(v * PI);
+    float pdf_uv = dome_light_alias_table[cell_index].pdf;
+    return (sin_theta > 0.0) ? (pdf_uv / (2.0 * PI * PI * sin_theta)) : 0.0;
+}
+
+float dome_light_pdf(vec2 uv)
+{
+    uv -= floor(uv);
+    uvec2 size = uvec2(DOME_LIGHT_SAMPLING_WIDTH, DOME_LIGHT_SAMPLING_HEIGHT);
+    uvec2 cell = min(uvec2(uv * vec2(size)), size - 1u);
+    return dome_light_pdf(cell.y * size.x + cell.x, uv.y);
+}
+
+// Chooses a cell of the alias table and a uniformly distributed position inside of it.
+// Returns the radiance, the world space direction and its solid angle pdf.
+vec3 dome_light_sample(vec4 xi, out vec3 dir, out float pdf)
+{
+    const uint cell_count = DOME_LIGHT_SAMPLING_WIDTH * DOME_LIGHT_SAMPLING_HEIGHT;
+
+    uint cell_index = min(uint(xi.x * float(cell_count)), cell_count - 1u);
+    AliasEntry entry = dome_light_alias_table[cell_index];
+    if (xi.y >= entry.prob)
+    {
+        cell_index = entry.alias;
+    }
+
+    uvec2 cell = uvec2(cell_index % DOME_LIGHT_SAMPLING_WIDTH, cell_index / DOME_LIGHT_SAMPLING_WIDTH);
+    vec2 uv = (vec2(cell) + xi.zw) / vec2(DOME_LIGHT_SAMPLING_WIDTH, DOME_LIGHT_SAMPLING_HEIGHT);
+
+    pdf = dome_light_pdf(cell_index, uv.y);
+    dir = normalize(inverse(dome_light_transform()) * dome_light_uv_to_dir(uv));
+
+    return dome_light_radiance(uv);
+}
+
+#endif
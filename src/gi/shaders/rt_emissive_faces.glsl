@@ -0,0 +1,183 @@
+#ifdef NEXT_EVENT_ESTIMATION
+
+// Returns UINT32_MAX if the hit surface is not emissive.
+uint emissive_face_index(uint instance_index, uint primitive_index)
+{
+    uint offset = emissive_instance_offsets[instance_index];
+    return (offset == UINT32_MAX) ? UINT32_MAX : (offset + primitive_index);
+}
+
+#ifdef LIGHT_TREE
+// Conty Estevez and Kulla. 2018. Importance Sampling of Many Lights with Adaptive Tree Splitting.
+// The receiver's normal is not taken into account so that the importance can be evaluated
+// again from the ray origin alone when the face is hit.
+float light_tree_importance(LightTreeNode node, vec3 p)
+{
+    vec3 center = 0.5 * (node.boundsMin + node.boundsMax);
+    vec3 to_point = p - center;
+    float dist_sq = dot(to_point, to_point);
+    vec3 half_extent = 0.5 * (node.boundsMax - node.boundsMin);
+    float radius_sq = dot(half_extent, half_extent);
+
+    // Points within the bounding sphere may be lit from any direction.
+    if (dist_sq <= radius_sq)
+    {
+        return node.power / max(radius_sq, FLOAT_MIN);
+    }
+
+    float cos_theta = dot(node.coneAxis, to_point * inversesqrt(dist_sq));
+    float theta = acos(clamp(cos_theta, -1.0, 1.0));
+    float theta_o = acos(clamp(node.coneCosTheta, -1.0, 1.0));
+    float theta_u = asin(sqrt(radius_sq / dist_sq));
+
+    // Faces emit into the hemisphere of their normal.
+    float theta_p = max(0.0, theta - theta_o - theta_u);
+    if (theta_p >= 0.5 * PI)
+    {
+        return 0.0;
+    }
+
+    return node.power * cos(theta_p) / dist_sq;
+}
+
+// Probability of the first child, zero if neither child is important.
+float light_tree_child_prob(uint child_index, vec3 p, out bool is_important)
+{
+    float i0 = light_tree_importance(light_tree_nodes[child_index + 0], p);
+    float i1 = light_tree_importance(light_tree_nodes[child_index + 1], p);
+    float total = i0 + i1;
+
+    is_important = (total > 0.0);
+    return is_important ? (i0 / total) : 0.0;
+}
+#endif
+
+// Probability of choosing the face for a light sample at the origin.
+float emissive_face_selection_pdf(uint face_index, vec3 origin)
+{
+    EmissiveFace face = emissive_faces[face_index];
+
+#ifdef LIGHT_TREE
+    // Follow the path to the face's leaf.
+    uint bits = face.lightTreeBits;
+    uint node_index = 0;
+    float selection_pdf = 1.0;
+
+    while ((light_tree_nodes[node_index].index & LIGHT_TREE_LEAF_BIT) == 0)
+    {
+        uint child_index = light_tree_nodes[node_index].index;
+
+        bool is_important;
+        float p0 = light_tree_child_prob(child_index, origin, is_important);
+        if (!is_important)
+        {
+            return 0.0;
+        }
+
+        bool take_second = ((bits & 1u) != 0);
+        selection_pdf *= take_second ? (1.0 - p0) : p0;
+        node_index = child_index + uint(take_second);
+        bits >>= 1;
+    }
+
+    return selection_pdf;
+#else
+    return face.pdf / float(emissive_faces.length());
+#endif
+}
+
+// Chooses a face by its importance, or proportional to its emitted power. Returns UINT32_MAX
+// if there is no face to choose.
+uint emissive_face_select(vec2 xi, vec3 origin, out float selection_pdf)
+{
+#ifdef LIGHT_TREE
+    uint node_index = 0;
+    selection_pdf = 1.0;
+
+    // The random number is rescaled after each decision.
+    while ((light_tree_nodes[node_index].index & LIGHT_TREE_LEAF_BIT) == 0)
+    {
+        uint child_index = light_tree_nodes[node_index].index;
+
+        bool is_important;
+        float p0 = light_tree_child_prob(child_index, origin, is_important);
+        if (!is_important)
+        {
+            selection_pdf = 0.0;
+            return UINT32_MAX;
+        }
+
+        if (xi.x < p0)
+        {
+            xi.x /= p0;
+            selection_pdf *= p0;
+            node_index = child_index;
+        }
+        else
+        {
+            xi.x = (xi.x - p0) / (1.0 - p0);
+            selection_pdf *= (1.0 - p0);
+            node_index = child_index + 1;
+        }
+    }
+
+    return light_tree_nodes[node_index].index & ~LIGHT_TREE_LEAF_BIT;
+#else
+    uint face_count = uint(emissive_faces.length());
+
+    uint face_index = min(uint(xi.x * float(face_count)), face_count - 1u);
+    if (xi.y >= emissive_faces[face_index].prob)
+    {
+        face_index = emissive_faces[face_index].alias;
+    }
+
+    selection_pdf = emissive_faces[face_index].pdf / float(face_count);
+    return face_index;
+#endif
+}
+
+// Converts the area density of a uniformly sampled point on the face to solid angle.
+float emissive_face_pdf(EmissiveFace face, float selection_pdf, vec3 dir, float dist_sq)
+{
+    vec3 n = cross(face.p1 - face.p0, face.p2 - face.p0);
+    float double_area = length(n);
+    if (double_area <= 0.0)
+    {
+        return 0.0;
+    }
+
+    float cos_theta = abs(dot(n, dir)) / double_area;
+
+    return (cos_theta > 0.0) ? (selection_pdf * dist_sq * 2.0 / (double_area * cos_theta)) : 0.0;
+}
+
+// Chooses a face and a uniformly distributed point on it. Returns the face index,
+// the point, the direction from the origin and its solid angle pdf.
+uint emissive_face_sample(vec4 xi, vec3 origin, out vec3 p, out vec3 dir, out float pdf)
+{
+    float selection_pdf;
+    uint face_index = emissive_face_select(xi.xy, origin, selection_pdf);
+    if (face_index == UINT32_MAX)
+    {
+        p = origin;
+        dir = vec3(0.0, 1.0, 0.0);
+        pdf = 0.0;
+        return UINT32_MAX;
+    }
+
+    EmissiveFace face = emissive_faces[face_index];
+
+    // RT Gems, Shirley. Chapter 16 Sampling Transformations Zoo.
+    float su = sqrt(xi.z);
+    p = (1.0 - su) * face.p0 + su * (1.0 - xi.w) * face.p1 + su * xi.w * face.p2;
+
+    vec3 to_light = p - origin;
+    float dist_sq = dot(to_light, to_light);
+
+    dir = (dist_sq > 0.0) ? (to_light * inversesqrt(dist_sq)) : vec3(0.0, 1.0, 0.0);
+    pdf = (dist_sq > 0.0) ? emissive_face_pdf(face, selection_pdf, dir, dist_sq) : 0.0;
+
+    return face_index;
+}
+
+#endif
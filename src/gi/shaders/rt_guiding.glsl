@@ -0,0 +1,136 @@
+#ifdef PATH_GUIDING
+
+// Müller et al. 2017. Practical Path Guiding for Efficient Light-Transport Simulation.
+// Directions are importance sampled from the incident radiance learned by the host in
+// previous passes, and combined with BSDF samples by one-sample MIS.
+
+const float GUIDING_SELECTION_PROB = 0.5;
+const uint GUIDING_MAX_PATH_VERTICES = 4; // recorded per path
+
+// Directions are mapped to the unit square with the equal-area cylindrical projection,
+// so that densities per steradian are those of the square divided by 4 PI.
+vec2 guiding_dir_to_square(vec3 dir)
+{
+    float phi = atan(dir.y, dir.x);
+    phi = (phi < 0.0) ? (phi + 2.0 * PI) : phi;
+    return min(vec2(clamp(dir.z, -1.0, 1.0) * 0.5 + 0.5, phi / (2.0 * PI)), vec2(0.99999994));
+}
+
+vec3 guiding_square_to_dir(vec2 p)
+{
+    float cos_theta = 2.0 * p.x - 1.0;
+    float sin_theta = sqrt(max(0.0, 1.0 - cos_theta * cos_theta));
+    float phi = 2.0 * PI * p.y;
+    return vec3(sin_theta * cos(phi), sin_theta * sin(phi), cos_theta);
+}
+
+float guiding_total_energy(GuidingDirectionalNode node)
+{
+    return node.energies[0] + node.energies[1] + node.energies[2] + node.energies[3];
+}
+
+// Returns the root of the directional tree of the position, UINT32_MAX if it has no energy.
+uint guiding_find_tree(vec3 position)
+{
+    GuidingSpatialNode node = guiding_spatial_nodes[0];
+
+    [[loop]]
+    while (node.axis != GUIDING_SPATIAL_LEAF)
+    {
+        uint child_offset = (position[node.axis] < node.split) ? 0u : 1u;
+        node = guiding_spatial_nodes[node.index + child_offset];
+    }
+
+    return (guiding_total_energy(guiding_directional_nodes[node.index]) > 0.0) ? node.index : UINT32_MAX;
+}
+
+float guiding_pdf(uint tree, vec3 dir)
+{
+    vec2 p = guiding_dir_to_square(dir);
+    float pdf = 1.0 / (4.0 * PI);
+    uint node_index = tree;
+
+    [[loop]]
+    while (true)
+    {
+        GuidingDirectionalNode node = guiding_directional_nodes[node_index];
+
+        float total = guiding_total_energy(node);
+        if (total <= 0.0)
+        {
+            return 0.0;
+        }
+
+        uvec2 bits = uvec2(greaterThanEqual(p, vec2(0.5)));
+        uint q = bits.x | (bits.y << 1);
+        pdf *= 4.0 * node.energies[q] / total;
+
+        if (node.children[q] == 0u || pdf <= 0.0)
+        {
+            return pdf;
+        }
+
+        p = p * 2.0 - vec2(bits);
+        node_index = node.children[q];
+    }
+}
+
+// Descends the quadtree by choosing the half along the first axis, then the quadrant within it.
+// Random numbers are rescaled to be reused at the next level.
+vec3 guiding_sample(uint tree, vec2 xi, out float pdf)
+{
+    vec2 origin = vec2(0.0);
+    float size = 1.0;
+    pdf = 1.0 / (4.0 * PI);
+    uint node_index = tree;
+
+    [[loop]]
+    while (true)
+    {
+        GuidingDirectionalNode node = guiding_directional_nodes[node_index];
+
+        float total = guiding_total_energy(node);
+        float lower_u = node.energies[0] + node.energies[2];
+        float prob_u = lower_u / total;
+
+        uvec2 bits;
+        bits.x = (xi.x < prob_u) ? 0u : 1u;
+        xi.x = (bits.x == 0u) ? (xi.x / prob_u) : ((xi.x - prob_u) / (1.0 - prob_u));
+
+        float half_total = (bits.x == 0u) ? lower_u : (total - lower_u);
+        float prob_v = node.energies[bits.x] / half_total;
+
+        bits.y = (xi.y < prob_v) ? 0u : 1u;
+        xi.y = (bits.y == 0u) ? (xi.y / prob_v) : ((xi.y - prob_v) / (1.0 - prob_v));
+        xi = min(xi, vec2(0.99999994));
+
+        uint q = bits.x | (bits.y << 1);
+        pdf *= 4.0 * node.energies[q] / total;
+
+        size *= 0.5;
+        origin += vec2(bits) * size;
+
+        if (node.children[q] == 0u)
+        {
+            break;
+        }
+
+        node_index = node.children[q];
+    }
+
+    return guiding_square_to_dir(origin + xi * size);
+}
+
+// Writes beyond the capacity are dropped, but still counted so that the host can
+// adapt the record probability of the next pass.
+void guiding_add_record(GuidingRecord record)
+{
+    uint index = atomicAdd(guiding_record_header.count, 1u);
+
+    if (index < guiding_record_header.capacity)
+    {
+        guiding_records[index] = record;
+    }
+}
+
+#endif
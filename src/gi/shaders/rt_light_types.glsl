@@ -0,0 +1,28 @@
+// One light sample is taken per bounce, of a uniformly chosen light type.
+#ifdef DOMELIGHT_ENABLED
+const uint DOME_LIGHT_TYPE_COUNT = 1;
+#else
+const uint DOME_LIGHT_TYPE_COUNT = 0;
+#endif
+#ifdef NEXT_EVENT_ESTIMATION
+const uint EMISSIVE_FACE_TYPE_COUNT = 1;
+#else
+const uint EMISSIVE_FACE_TYPE_COUNT = 0;
+#endif
+#ifdef SPHERE_LIGHTS
+const uint SPHERE_LIGHT_TYPE_COUNT = 1;
+#else
+const uint SPHERE_LIGHT_TYPE_COUNT = 0;
+#endif
+
+const uint LIGHT_TYPE_COUNT = DOME_LIGHT_TYPE_COUNT + EMISSIVE_FACE_TYPE_COUNT + SPHERE_LIGHT_TYPE_COUNT;
+
+// Indices of the enabled light types.
+const uint LIGHT_TYPE_DOME = 0;
+const uint LIGHT_TYPE_EMISSIVE_FACE = DOME_LIGHT_TYPE_COUNT;
+const uint LIGHT_TYPE_SPHERE = DOME_LIGHT_TYPE_COUNT + EMISSIVE_FACE_TYPE_COUNT;
+
+const float LIGHT_TYPE_SELECTION_PROB = (LIGHT_TYPE_COUNT > 0) ? (1.0 / float(LIGHT_TYPE_COUNT)) : 0.0;
+const float DOME_LIGHT_SELECTION_PROB = float(DOME_LIGHT_TYPE_COUNT) * LIGHT_TYPE_SELECTION_PROB;
+const float EMISSIVE_FACE_SELECTION_PROB = float(EMISSIVE_FACE_TYPE_COUNT) * LIGHT_TYPE_SELECTION_PROB;
+const float SPHERE_LIGHT_SELECTION_PROB = float(SPHERE_LIGHT_TYPE_COUNT) * LIGHT_TYPE_SELECTION_PROB;
@@ -7,7 +7,8 @@ struct ShadeRayPayload
                                    // 1xxxxxxxxxxxxxxx bool inside
                                    // x111111111111111 uint bounce
     /* inout */ f16vec3 radiance;
-    /* - */     uint16_t padding;
+    /* in */    float16_t cone_spread;
+    /* inout */ float cone_width;
 #ifdef RAND_4D
     /* inout */ uvec4 rng_state;
 #else
@@ -15,6 +16,15 @@ struct ShadeRayPayload
 #endif
     /* out */   vec3 ray_origin;
     /* out */   vec3 ray_dir;
+    /* out */   float bsdf_pdf; // of ray_dir for MIS, 0 for specular events, negated if direct
+                                // lighting was resampled
+    /* out */   f16vec3 nee_radiance; // unoccluded light sample contribution, 0 if none
+    /* out */   vec3 nee_origin;
+    /* out */   vec3 nee_dir;
+    /* out */   float nee_dist; // of the shadow ray
+    /* inout */ uint nee_face; // emissive face of the light sample, UINT32_MAX for the dome light.
+                               // If set when shading, only the emission of that face is evaluated
+                               // and multiplied with nee_radiance.
 };
 
 struct ShadowRayPayload
@@ -0,0 +1,262 @@
+#ifdef RESTIR
+
+// Bitterli et al. 2020. Spatiotemporal reservoir resampling for real-time ray tracing
+// with dynamic direct lighting. Reuse happens across passes of progressive accumulation,
+// during which the camera doesn't move. Samples are combined with the biased 1/M weights.
+
+const uint RESTIR_CANDIDATE_COUNT = 8;
+const float RESTIR_MAX_HISTORY = 20.0 * float(RESTIR_CANDIDATE_COUNT);
+const float RESTIR_SPATIAL_RADIUS = 30.0; // in pixels
+
+const uint RESTIR_LIGHT_DOME = 0;
+const uint RESTIR_LIGHT_EMISSIVE_FACE = 1;
+const uint RESTIR_LIGHT_SPHERE = 2;
+
+struct RestirSample
+{
+    vec3 light_point;
+    uint light_id;
+    float target; // at the current shading point
+};
+
+// The launch is compacted with adaptive sampling, so it doesn't map to pixels directly.
+uvec2 restir_pixel_pos()
+{
+#ifdef ADAPTIVE_SAMPLING
+    uint pixel_index = active_pixels[gl_LaunchIDEXT.y * gl_LaunchSizeEXT.x + gl_LaunchIDEXT.x];
+    uint image_width = PC.imageDims & 0xFFFFu;
+    return uvec2(pixel_index % image_width, pixel_index / image_width);
+#else
+    return gl_LaunchIDEXT.xy;
+#endif
+}
+
+vec4 restir_rand4()
+{
+#ifdef RAND_4D
+    return rng4d_next(rayPayload.rng_state);
+#else
+    return vec4(rng_next(rayPayload.rng_state), rng_next(rayPayload.rng_state),
+                rng_next(rayPayload.rng_state), rng_next(rayPayload.rng_state));
+#endif
+}
+
+// Unshadowed light arriving at the shading point. The geometry term converts the solid angle
+// to the measure of the light point, so that samples of other shading points can be reused.
+// Emissive faces are approximated by their constant emission luminance.
+bool restir_eval_light(uint light_id, vec3 light_point, vec3 p,
+                       out vec3 dir, out float dist, out vec3 radiance, out float geometry)
+{
+    uint light_type = light_id >> 30;
+    uint light_index = light_id & 0x3FFFFFFFu;
+
+    dir = vec3(0.0, 1.0, 0.0);
+    dist = FLOAT_MAX;
+    radiance = vec3(0.0);
+    geometry = 0.0;
+
+#ifdef DOMELIGHT_ENABLED
+    if (light_type == RESTIR_LIGHT_DOME)
+    {
+        dir = light_point;
+        radiance = dome_light_radiance(dome_light_dir_to_uv(normalize(dome_light_transform() * dir)));
+        geometry = 1.0;
+        return true;
+    }
+#endif
+
+    vec3 to_light = light_point - p;
+    float dist_sq = dot(to_light, to_light);
+    if (dist_sq <= 0.0)
+    {
+        return false;
+    }
+
+    dist = sqrt(dist_sq);
+    dir = to_light / dist;
+
+#ifdef NEXT_EVENT_ESTIMATION
+    if (light_type == RESTIR_LIGHT_EMISSIVE_FACE)
+    {
+        EmissiveFace face = emissive_faces[light_index];
+        vec3 n = cross(face.p1 - face.p0, face.p2 - face.p0);
+        float double_area = length(n);
+        if (double_area <= 0.0)
+        {
+            return false;
+        }
+
+        radiance = vec3(face.emissionLuminance);
+        geometry = abs(dot(n, dir)) / (double_area * dist_sq);
+        return true;
+    }
+#endif
+#ifdef SPHERE_LIGHTS
+    if (light_type == RESTIR_LIGHT_SPHERE)
+    {
+        SphereLight light = sphere_lights[light_index];
+
+        radiance = light.radiance;
+        geometry = (light.radius > 0.0) ? (max(0.0, -dot((light_point - light.position) / light.radius, dir)) / dist_sq)
+                                        : (1.0 / dist_sq);
+        return true;
+    }
+#endif
+
+    return false;
+}
+
+// Luminance of the unshadowed contribution in the measure of the light point.
+float restir_target(inout State shading_state, vec3 k1, float ior1, float ior2, uint light_id, vec3 light_point,
+                    out float geometry)
+{
+    vec3 dir;
+    float dist;
+    vec3 radiance;
+    if (!restir_eval_light(light_id, light_point, shading_state.position, dir, dist, radiance, geometry) || geometry <= 0.0)
+    {
+        return 0.0;
+    }
+
+    Bsdf_evaluate_data bsdf_eval_data;
+    bsdf_eval_data.ior1 = vec3(ior1);
+    bsdf_eval_data.ior2 = vec3(ior2);
+    bsdf_eval_data.k1 = k1;
+    bsdf_eval_data.k2 = dir;
+    mdl_bsdf_scattering_evaluate(bsdf_eval_data, shading_state);
+
+    vec3 bsdf = bsdf_eval_data.bsdf_diffuse + bsdf_eval_data.bsdf_glossy;
+
+    return max(0.0, dot(bsdf * radiance, vec3(0.2126, 0.7152, 0.0722))) * geometry;
+}
+
+void restir_update(inout RestirSample r, inout float weight_sum, inout float sample_count,
+                   vec3 light_point, uint light_id, float target, float weight, float count, float xi)
+{
+    weight_sum += weight;
+    sample_count += count;
+
+    if (weight > 0.0 && xi * weight_sum < weight)
+    {
+        r.light_point = light_point;
+        r.light_id = light_id;
+        r.target = target;
+    }
+}
+
+// Resamples the light sample of a primary hit from new candidates and from the reservoirs of
+// the previous pass at the same pixel and at random neighbors. The result is stored in the
+// reservoir of the current pass; the raygen shader resets its weight if the sample is occluded.
+Reservoir restir_resample(inout State shading_state, vec3 normal, vec3 k1, float ior1, float ior2)
+{
+    RestirSample r = RestirSample(vec3(0.0), 0u, 0.0);
+    float weight_sum = 0.0;
+    float sample_count = 0.0;
+
+    vec3 p = shading_state.position;
+
+    // Candidates are drawn from the regular light sampling distributions.
+    for (uint i = 0; i < RESTIR_CANDIDATE_COUNT; i++)
+    {
+        vec4 xi = restir_rand4();
+        float xi_select = restir_rand4().x;
+
+        uint light_type = min(uint(xi.x * float(LIGHT_TYPE_COUNT)), LIGHT_TYPE_COUNT - 1u);
+        xi.x = xi.x * float(LIGHT_TYPE_COUNT) - float(light_type);
+
+        vec3 light_point = vec3(0.0);
+        vec3 light_dir;
+        float light_pdf = 0.0;
+        uint light_id = 0;
+
+#ifdef DOMELIGHT_ENABLED
+        if (light_type == LIGHT_TYPE_DOME)
+        {
+            dome_light_sample(xi, light_dir, light_pdf);
+            light_pdf *= DOME_LIGHT_SELECTION_PROB;
+            light_point = light_dir;
+            light_id = (RESTIR_LIGHT_DOME << 30);
+        }
+#endif
+#ifdef NEXT_EVENT_ESTIMATION
+        if (light_type == LIGHT_TYPE_EMISSIVE_FACE)
+        {
+            uint face_index = emissive_face_sample(xi, p, light_point, light_dir, light_pdf);
+            light_pdf *= EMISSIVE_FACE_SELECTION_PROB;
+            light_id = (RESTIR_LIGHT_EMISSIVE_FACE << 30) | face_index;
+        }
+#endif
+#ifdef SPHERE_LIGHTS
+        if (light_type == LIGHT_TYPE_SPHERE)
+        {
+            uint light_index;
+            float light_dist;
+            sphere_light_sample(xi, p, light_index, light_dir, light_dist, light_pdf);
+            light_pdf *= SPHERE_LIGHT_SELECTION_PROB;
+            light_point = p + light_dir * light_dist;
+            light_id = (RESTIR_LIGHT_SPHERE << 30) | light_index;
+        }
+#endif
+
+        float target = 0.0;
+        float weight = 0.0;
+        if (light_pdf > 0.0)
+        {
+            float geometry;
+            target = restir_target(shading_state, k1, ior1, ior2, light_id, light_point, geometry);
+
+            // The sampling pdf is converted to the measure of the target function.
+            weight = (target > 0.0) ? (target / (light_pdf * geometry)) : 0.0;
+        }
+
+        restir_update(r, weight_sum, sample_count, light_point, light_id, target, weight, 1.0, xi_select);
+    }
+
+    // Reservoirs of the previous pass are invalid if accumulation restarted.
+    if (PC.sampleOffset > 0)
+    {
+        ivec2 pixel_pos = ivec2(restir_pixel_pos());
+        ivec2 image_size = ivec2(PC.imageDims & 0xFFFFu, PC.imageDims >> 16);
+        float camera_dist = distance(p, PC.cameraPosition);
+
+        for (uint i = 0; i <= uint(RESTIR_SPATIAL_NEIGHBORS); i++)
+        {
+            vec4 xi = restir_rand4();
+
+            ivec2 neighbor_pos = pixel_pos;
+            if (i > 0)
+            {
+                float radius = RESTIR_SPATIAL_RADIUS * sqrt(xi.x);
+                float phi = 2.0 * PI * xi.y;
+                neighbor_pos = clamp(pixel_pos + ivec2(round(vec2(cos(phi), sin(phi)) * radius)), ivec2(0), image_size - 1);
+            }
+
+            Reservoir prev = restir_reservoirs_prev[neighbor_pos.y * image_size.x + neighbor_pos.x];
+
+            // Samples are only valid for similar surfaces.
+            if (prev.sampleCount <= 0.0 || dot(prev.normal, normal) < 0.9 ||
+                abs(distance(prev.position, PC.cameraPosition) - camera_dist) > 0.1 * camera_dist)
+            {
+                continue;
+            }
+
+            // Occluded samples still count, which darkens the result where lights are blocked.
+            float count = min(prev.sampleCount, RESTIR_MAX_HISTORY);
+            float geometry;
+            float target = (prev.weight > 0.0) ? restir_target(shading_state, k1, ior1, ior2, prev.lightId, prev.lightPoint, geometry) : 0.0;
+
+            restir_update(r, weight_sum, sample_count, prev.lightPoint, prev.lightId, target, target * prev.weight * count, count, xi.z);
+        }
+    }
+
+    Reservoir reservoir;
+    reservoir.lightPoint = r.light_point;
+    reservoir.lightId = r.light_id;
+    reservoir.position = p;
+    reservoir.weight = (r.target > 0.0) ? (weight_sum / (sample_count * r.target)) : 0.0;
+    reservoir.normal = normal;
+    reservoir.sampleCount = sample_count;
+    return reservoir;
+}
+
+#endif
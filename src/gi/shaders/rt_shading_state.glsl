@@ -1,4 +1,4 @@
-void setup_mdl_shading_state(in uint hit_face_idx, in vec2 hit_bc, out State state)
+void setup_mdl_shading_state(in uint hit_face_idx, in vec2 hit_bc, in float cone_width, out State state)
 {
     vec3 bc = vec3(1.0 - hit_bc.x - hit_bc.y, hit_bc.x, hit_bc.y);
 
@@ -53,6 +53,23 @@ void setup_mdl_shading_state(in uint hit_face_idx, in vec2 hit_bc, out State sta
     vec2 uv_2 = vec2(v_2.field2.z, v_2.field2.w);
     vec2 uv = bc.x * uv_0 + bc.y * uv_1 + bc.z * uv_2;
 
+    // Ray cone texture LOD; the texture size dependent term is added on lookup.
+    // Akenine-Moller et al. 2021, Improved Shader and Texture Level of Detail Using Ray Cones
+    vec3 world_e_1 = vec3(gl_ObjectToWorldEXT * vec4(p_1 - p_0, 0.0));
+    vec3 world_e_2 = vec3(gl_ObjectToWorldEXT * vec4(p_2 - p_0, 0.0));
+    float world_area = length(cross(world_e_1, world_e_2));
+
+    vec2 uv_e_1 = uv_1 - uv_0;
+    vec2 uv_e_2 = uv_2 - uv_0;
+    float uv_area = abs(uv_e_1.x * uv_e_2.y - uv_e_1.y * uv_e_2.x);
+
+    tex_lod_base = -FLOAT_MAX;
+    if (cone_width > 0.0 && uv_area > 0.0 && world_area > 0.0)
+    {
+        float cos_theta = max(abs(dot(geomNormal, gl_WorldRayDirectionEXT)), 1e-4);
+        tex_lod_base = 0.5 * log2(uv_area / world_area) + log2(cone_width / cos_theta);
+    }
+
     // State
     state.normal = normal;
     state.geom_normal = geomNormal;
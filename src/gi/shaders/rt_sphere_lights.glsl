@@ -0,0 +1,136 @@
+#ifdef SPHERE_LIGHTS
+
+// Chooses a sphere light uniformly and a direction within the cone it subtends. Returns the
+// radiance arriving at the origin, the light index, the distance to the sampled point and the
+// solid angle pdf.
+vec3 sphere_light_sample(vec4 xi, vec3 origin, out uint light_index, out vec3 dir, out float dist, out float pdf)
+{
+    uint light_count = uint(sphere_lights.length());
+    light_index = min(uint(xi.x * float(light_count)), light_count - 1u);
+    SphereLight light = sphere_lights[light_index];
+    float selection_pdf = 1.0 / float(light_count);
+
+    dir = vec3(0.0, 1.0, 0.0);
+    dist = 0.0;
+    pdf = 0.0;
+
+    vec3 to_center = light.position - origin;
+    float dist_sq = dot(to_center, to_center);
+    float radius_sq = light.radius * light.radius;
+
+    // Points within the sphere are not lit.
+    if (dist_sq <= radius_sq)
+    {
+        return vec3(0.0);
+    }
+
+    float center_dist = sqrt(dist_sq);
+    vec3 w = to_center / center_dist;
+
+    // Point lights store their radiant intensity.
+    if (radius_sq == 0.0)
+    {
+        dir = w;
+        dist = center_dist;
+        pdf = selection_pdf;
+        return light.radiance / dist_sq;
+    }
+
+    // PBRT v4, 6.2.4 Sampling Spheres.
+    float sin_theta_max_sq = radius_sq / dist_sq;
+    float cos_theta_max = sqrt(max(0.0, 1.0 - sin_theta_max_sq));
+    float one_minus_cos_theta_max = 1.0 - cos_theta_max;
+
+    float cos_theta = (cos_theta_max - 1.0) * xi.y + 1.0;
+    float sin_theta_sq = max(0.0, 1.0 - cos_theta * cos_theta);
+
+    // Use the Taylor expansion for small cones, sin^2(1.5 deg).
+    if (sin_theta_max_sq < 0.00068523)
+    {
+        sin_theta_sq = sin_theta_max_sq * xi.y;
+        cos_theta = sqrt(1.0 - sin_theta_sq);
+        one_minus_cos_theta_max = sin_theta_max_sq * 0.5;
+    }
+
+    float sin_theta = sqrt(sin_theta_sq);
+    float phi = 2.0 * PI * xi.z;
+
+    vec3 b1, b2;
+    orthonormal_basis(w, b1, b2);
+
+    dir = normalize(b1 * (sin_theta * cos(phi)) + b2 * (sin_theta * sin(phi)) + w * cos_theta);
+    dist = max(0.0, center_dist * cos_theta - sqrt(max(0.0, radius_sq - dist_sq * sin_theta_sq)));
+    pdf = selection_pdf / (2.0 * PI * one_minus_cos_theta_max);
+
+    return light.radiance;
+}
+
+// Solid angle pdf of sphere_light_sample() for a direction towards the light.
+float sphere_light_pdf(uint light_index, vec3 origin)
+{
+    SphereLight light = sphere_lights[light_index];
+
+    vec3 to_center = light.position - origin;
+    float dist_sq = dot(to_center, to_center);
+    float radius_sq = light.radius * light.radius;
+
+    if (dist_sq <= radius_sq || radius_sq == 0.0)
+    {
+        return 0.0;
+    }
+
+    float sin_theta_max_sq = radius_sq / dist_sq;
+    float one_minus_cos_theta_max = 1.0 - sqrt(max(0.0, 1.0 - sin_theta_max_sq));
+
+    if (sin_theta_max_sq < 0.00068523)
+    {
+        one_minus_cos_theta_max = sin_theta_max_sq * 0.5;
+    }
+
+    return 1.0 / (float(sphere_lights.length()) * 2.0 * PI * one_minus_cos_theta_max);
+}
+
+// Returns the index of the closest sphere light hit by the ray and its distance in units of
+// the direction's length, or UINT32_MAX and FLOAT_MAX. Point lights and spheres containing the
+// origin can't be hit. The lights are tested one by one, which is cheap for the few sphere
+// lights of a scene compared to tracing procedural geometry.
+uint sphere_light_intersect(vec3 origin, vec3 dir, out float t_hit)
+{
+    uint hit_index = UINT32_MAX;
+    t_hit = FLOAT_MAX;
+
+    float dir_len = length(dir);
+    vec3 d = dir / dir_len;
+
+    uint light_count = uint(sphere_lights.length());
+
+    [[loop]]
+    for (uint i = 0; i < light_count; i++)
+    {
+        SphereLight light = sphere_lights[i];
+
+        vec3 to_center = light.position - origin;
+        float radius_sq = light.radius * light.radius;
+
+        // Ray Tracing Gems, Haines et al. Chapter 7 Precision Improvements for Ray/Sphere Intersection.
+        float t_center = dot(to_center, d);
+        vec3 to_axis = to_center - t_center * d;
+        float axis_dist_sq = dot(to_axis, to_axis);
+
+        if (radius_sq == 0.0 || t_center <= 0.0 || axis_dist_sq >= radius_sq || dot(to_center, to_center) <= radius_sq)
+        {
+            continue;
+        }
+
+        float t = (t_center - sqrt(radius_sq - axis_dist_sq)) / dir_len;
+        if (t < t_hit)
+        {
+            t_hit = t;
+            hit_index = i;
+        }
+    }
+
+    return hit_index;
+}
+
+#endif
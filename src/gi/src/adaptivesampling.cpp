@@ -0,0 +1,59 @@
+//
+// Copyright (C) 2019-2022 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+#include "adaptivesampling.h"
+
+#include <algorithm>
+#include <math.h>
+
+namespace Rp = gtl::shader_interface::rp_main;
+
+namespace gi
+{
+  void updateActivePixels(const Rp::PixelStats* stats, float errorThreshold, uint32_t maxSpp, std::vector<uint32_t>& activePixels)
+  {
+    size_t activeCount = 0;
+
+    for (uint32_t pixelIndex : activePixels)
+    {
+      const Rp::PixelStats& pixelStats = stats[pixelIndex];
+
+      uint32_t n = pixelStats.sampleCount;
+      if (n >= maxSpp)
+      {
+        continue;
+      }
+
+      if (n >= ADAPTIVE_SAMPLING_MIN_SPP)
+      {
+        float mean = pixelStats.lumSum / float(n);
+        float variance = std::max(0.0f, pixelStats.lumSqSum / float(n) - mean * mean) * float(n) / float(n - 1);
+        float error = sqrtf(variance / float(n)) / std::max(mean, 1e-3f); // black pixels converge
+
+        if (error < errorThreshold)
+        {
+          continue;
+        }
+      }
+
+      activePixels[activeCount++] = pixelIndex;
+    }
+
+    activePixels.resize(activeCount);
+  }
+}
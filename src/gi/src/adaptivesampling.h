@@ -0,0 +1,37 @@
+//
+// Copyright (C) 2019-2022 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+#include <vector>
+
+#include "interface/rp_main.h"
+
+namespace gi
+{
+  const uint32_t ADAPTIVE_SAMPLING_MIN_SPP = 16; // before the error estimate is trusted
+
+  // Removes the pixels that reached the maximum sample count or whose relative standard
+  // error of the mean luminance fell below the threshold. The remaining pixels keep their
+  // order. Pixels with fewer than ADAPTIVE_SAMPLING_MIN_SPP samples are kept as long as
+  // the maximum sample count allows.
+  void updateActivePixels(const gtl::shader_interface::rp_main::PixelStats* stats,
+                          float errorThreshold,
+                          uint32_t maxSpp,
+                          std::vector<uint32_t>& activePixels);
+}
@@ -0,0 +1,65 @@
+//
+// Copyright (C) 2019-2022 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+#include "boxfilter.h"
+
+namespace gi
+{
+  void boxFilterRow(const glm::vec4* srcRow0, const glm::vec4* srcRow1, uint32_t srcWidth, float rowWeight, glm::vec4* dstRow)
+  {
+    uint32_t pairCount = srcWidth >> 1;
+
+    if (pairCount == 0)
+    {
+      dstRow[0] = (srcRow0[0] + srcRow1[0]) * rowWeight;
+      return;
+    }
+
+    // The loop runs over contiguous floats, four (one RGBA texel) at a time, so that
+    // it is vectorized by the compiler.
+    const float* s0 = &srcRow0[0].x;
+    const float* s1 = &srcRow1[0].x;
+    float* d = &dstRow[0].x;
+    float weight = rowWeight * 0.5f;
+
+    for (size_t x = 0; x < pairCount; x++)
+    {
+      // Loading all components before storing lets the compiler vectorize without alias checks.
+      float sum[4];
+      for (size_t c = 0; c < 4; c++)
+      {
+        sum[c] = (s0[x * 8 + c] + s0[x * 8 + 4 + c]) + (s1[x * 8 + c] + s1[x * 8 + 4 + c]);
+      }
+      for (size_t c = 0; c < 4; c++)
+      {
+        d[x * 4 + c] = sum[c] * weight;
+      }
+    }
+
+    if (srcWidth & 1)
+    {
+      size_t x = pairCount - 1;
+      size_t x0 = x * 2;
+
+      glm::vec4 sum = (srcRow0[x0] + srcRow0[x0 + 1] + srcRow0[x0 + 2]) +
+                      (srcRow1[x0] + srcRow1[x0 + 1] + srcRow1[x0 + 2]);
+
+      dstRow[x] = sum * (rowWeight / 3.0f);
+    }
+  }
+}
@@ -0,0 +1,77 @@
+//
+// Copyright (C) 2019-2022 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+#include <algorithm>
+#include <stdint.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace gi
+{
+  // Box-filters two source rows into one destination row and scales the sums of each
+  // column by rowWeight. For odd widths, the last destination texel covers three columns.
+  void boxFilterRow(const glm::vec4* srcRow0, const glm::vec4* srcRow1, uint32_t srcWidth, float rowWeight, glm::vec4* dstRow);
+
+  // Halves an image with a 2x2 box filter; used for all generated mip levels. For odd
+  // dimensions, the last destination row and column average three source texels, so
+  // that every source texel contributes. readRow(y, scratch) returns source row y, either
+  // unpacked into the scratch row or in place; writeRow(y, row) stores destination row y.
+  template<typename ReadRowFunc, typename WriteRowFunc>
+  void downsampleBox(uint32_t srcWidth, uint32_t srcHeight, ReadRowFunc readRow, WriteRowFunc writeRow)
+  {
+    uint32_t dstWidth = std::max(srcWidth >> 1, 1u);
+    uint32_t dstHeight = std::max(srcHeight >> 1, 1u);
+
+    std::vector<glm::vec4> scratch(size_t(srcWidth) * 3 + dstWidth);
+    glm::vec4* scratchRow0 = &scratch[0];
+    glm::vec4* scratchRow1 = &scratch[size_t(srcWidth)];
+    glm::vec4* scratchRow2 = &scratch[size_t(srcWidth) * 2];
+    glm::vec4* dstRow = &scratch[size_t(srcWidth) * 3];
+
+    for (uint32_t y = 0; y < dstHeight; y++)
+    {
+      const glm::vec4* srcRow0 = readRow(y * 2, scratchRow0);
+      const glm::vec4* srcRow1 = srcRow0;
+      float rowWeight = 0.5f;
+
+      if (srcHeight > 1)
+      {
+        srcRow1 = readRow(y * 2 + 1, scratchRow1);
+      }
+
+      if (srcHeight > 1 && (srcHeight & 1) && (y + 1) == dstHeight)
+      {
+        const glm::vec4* srcRow2 = readRow(y * 2 + 2, scratchRow2);
+
+        for (uint32_t x = 0; x < srcWidth; x++)
+        {
+          scratchRow2[x] = srcRow1[x] + srcRow2[x];
+        }
+
+        srcRow1 = scratchRow2;
+        rowWeight = 1.0f / 3.0f;
+      }
+
+      boxFilterRow(srcRow0, srcRow1, srcWidth, rowWeight, dstRow);
+      writeRow(y, dstRow);
+    }
+  }
+}
@@ -18,6 +18,10 @@
 #include "gi.h"
 
 #include "texsys.h"
+#include "vtsys.h"
+#include "lightsampling.h"
+#include "guiding.h"
+#include "adaptivesampling.h"
 #include "turbo.h"
 #include "assetReader.h"
 
@@ -25,6 +29,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
+#include <inttypes.h>
 #include <vector>
 #include <unordered_map>
 #include <algorithm>
@@ -33,10 +38,12 @@
 #include <optional>
 #include <unordered_set>
 #include <mutex>
+#include <numeric>
 #include <assert.h>
 
 #include <stager.h>
 #include <cgpu.h>
+#include <imgio.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #ifndef NDEBUG
@@ -52,6 +59,8 @@ using namespace gi;
 namespace Rp = gtl::shader_interface::rp_main;
 
 const float BYTES_TO_MIB = 1.0f / (1024.0f * 1024.0f);
+const uint32_t GUIDING_RECORD_CAPACITY = 1 << 18; // per pass
+const uint64_t GUIDING_RECORD_BUFFER_SIZE = sizeof(Rp::GuidingRecordHeader) + uint64_t(GUIDING_RECORD_CAPACITY) * sizeof(Rp::GuidingRecord);
 
 struct GiGpuBufferView
 {
@@ -63,9 +72,13 @@ struct GiGeomCache
 {
   std::vector<CgpuBlas> blases;
   CgpuBuffer            buffer;
+  GiGpuBufferView       emissiveFaceBufferView = {};
+  GiGpuBufferView       emissiveInstanceBufferView = {};
+  GiGpuBufferView       lightTreeNodeBufferView = {};
   GiGpuBufferView       faceBufferView = {};
   CgpuTlas              tlas;
   GiGpuBufferView       vertexBufferView = {};
+  bool                  nextEventEstimation = false;
 };
 
 struct GiShaderCache
@@ -79,7 +92,13 @@ struct GiShaderCache
   CgpuPipeline                   pipeline;
   bool                           hasPipelineClosestHitShader = false;
   bool                           hasPipelineAnyHitShader = false;
+  bool                           nextEventEstimation = false;
+  bool                           restir = false;
+  bool                           adaptiveSampling = false;
+  bool                           pathGuiding = false;
+  bool                           sphereLightsEnabled = false;
   CgpuShader                     rgenShader;
+  std::unique_ptr<gi::VirtualTexSys> vtSys;
 };
 
 struct GiMaterial
@@ -96,14 +115,24 @@ struct GiMesh
 
 struct GiSphereLight
 {
-  glm::vec3 position;
+  GiScene* scene;
+  glm::vec3 position{0.0f};
+  float radius = 0.5f;
+  glm::vec3 radiance{1.0f};
 };
 
 struct GiScene
 {
   std::unordered_set<GiSphereLight*> lights;
   std::mutex mutex;
+  // Parameter changes are uploaded on the next render without rebuilding any cache.
+  std::atomic_bool sphereLightsDirty = true;
+  CgpuBuffer sphereLightBuffer;
+  uint64_t sphereLightBufferSize = 0;
+  uint32_t sphereLightCount = 0;
   CgpuImage domeLightTexture;
+  CgpuBuffer domeLightAliasTable;
+  std::string domeLightAliasTableFilePath; // of the image the sampling data was built from
   glm::mat3 domeLightTransform;
   GiDomeLight* domeLight; // weak ptr
 };
@@ -123,11 +152,30 @@ std::unique_ptr<sg::ShaderGen> s_shaderGen;
 std::unique_ptr<GiMmapAssetReader> s_mmapAssetReader;
 std::unique_ptr<GiAggregateAssetReader> s_aggregateAssetReader;
 std::unique_ptr<gi::TexSys> s_texSys;
+std::optional<gi::VirtualTexSys::InitParams> s_vtSysParams; // set if virtual texturing is enabled
 CgpuBuffer s_outputBuffer;
 CgpuBuffer s_outputStagingBuffer;
 uint32_t s_outputBufferWidth = 0;
 uint32_t s_outputBufferHeight = 0;
 uint32_t s_sampleOffset = 0;
+CgpuBuffer s_reservoirBuffers[2]; // written and read in alternating passes
+uint64_t s_reservoirBufferSize = 0;
+uint32_t s_reservoirBufferIndex = 0;
+CgpuBuffer s_pixelStatsBuffer;
+CgpuBuffer s_pixelStatsStagingBuffer;
+CgpuBuffer s_activePixelBuffer;
+uint32_t s_adaptiveSamplingPixelCount = 0;
+std::vector<uint32_t> s_activePixels; // to be sampled by the next pass
+std::unique_ptr<gi::GuidingField> s_guidingField; // learned while samples accumulate
+CgpuBuffer s_guidingRecordBuffer;
+CgpuBuffer s_guidingRecordStagingBuffer;
+CgpuBuffer s_guidingSpatialNodeBuffer;
+CgpuBuffer s_guidingDirectionalNodeBuffer;
+uint64_t s_guidingSpatialNodeBufferSize = 0;
+uint64_t s_guidingDirectionalNodeBufferSize = 0;
+float s_guidingRecordProbability = 1.0f;
+uint32_t s_guidingIterationLength = 1; // in passes, doubles with every iteration
+uint32_t s_guidingIterationPassCount = 0;
 std::atomic_bool s_forceShaderCacheInvalid = false;
 std::atomic_bool s_forceGeomCacheInvalid = false;
 
@@ -251,7 +299,39 @@ GiStatus giInitialize(const GiInitParams* params)
   s_aggregateAssetReader = std::make_unique<GiAggregateAssetReader>();
   s_aggregateAssetReader->addAssetReader(s_mmapAssetReader.get());
 
-  s_texSys = std::make_unique<gi::TexSys>(s_device, *s_aggregateAssetReader, *s_stager);
+  gi::TexSys::InitParams texSysParams = {
+    .hdrImageFormat = (params->hdrTextureFormat == GI_HDR_TEXTURE_FORMAT_E5B9G9R9) ?
+      CGPU_IMAGE_FORMAT_E5B9G9R9_UFLOAT_PACK32 : CGPU_IMAGE_FORMAT_R16G16B16A16_SFLOAT,
+    .generateMips = params->generateTextureMips,
+    .gpuByteBudget = params->textureGpuByteBudget,
+    .cpuByteBudget = params->textureCpuByteBudget,
+    .compressTextures = params->textureCompression != GI_TEXTURE_COMPRESSION_NONE,
+    .highQualityCompression = params->textureCompression == GI_TEXTURE_COMPRESSION_BC_HIGH_QUALITY,
+    .transcodeCachePath = params->textureCachePath ? params->textureCachePath : "",
+    .maxDimension = params->maxTextureDimension,
+    .maxByteSize = params->maxTextureByteSize,
+    .deduplicateImages = params->deduplicateTextures,
+    .blockCompressionSupported = s_deviceFeatures.textureCompressionBC
+  };
+
+  if (texSysParams.compressTextures && !s_deviceFeatures.textureCompressionBC)
+  {
+    fprintf(stderr, "warning: texture compression disabled - device feature missing\n");
+    texSysParams.compressTextures = false;
+  }
+
+  s_texSys = std::make_unique<gi::TexSys>(s_device, *s_aggregateAssetReader, *s_stager, texSysParams);
+
+  s_vtSysParams.reset();
+  if (params->virtualTexturePoolByteSize > 0)
+  {
+    s_vtSysParams = gi::VirtualTexSys::InitParams{
+      .poolByteSize = params->virtualTexturePoolByteSize,
+      .maxPoolDimension = s_deviceProperties.maxImageDimension2D,
+      .maxDimension = params->maxTextureDimension,
+      .cpuByteBudget = params->textureCpuByteBudget
+    };
+  }
 
 #ifndef NDEBUG
   s_fileWatcher = std::make_unique<efsw::FileWatcher>();
@@ -262,6 +342,197 @@ GiStatus giInitialize(const GiInitParams* params)
   return GI_OK;
 }
 
+bool _giResizeReservoirBuffers(uint64_t bufferSize)
+{
+  s_reservoirBufferSize = 0;
+  s_reservoirBufferIndex = 0;
+
+  for (CgpuBuffer& buffer : s_reservoirBuffers)
+  {
+    if (buffer.handle)
+    {
+      cgpuDestroyBuffer(s_device, buffer);
+      buffer.handle = 0;
+    }
+  }
+
+  if (bufferSize == 0)
+  {
+    return true;
+  }
+
+  for (CgpuBuffer& buffer : s_reservoirBuffers)
+  {
+    if (!cgpuCreateBuffer(s_device,
+                          CGPU_BUFFER_USAGE_FLAG_STORAGE_BUFFER,
+                          CGPU_MEMORY_PROPERTY_FLAG_DEVICE_LOCAL,
+                          bufferSize,
+                          &buffer))
+    {
+      return false;
+    }
+  }
+
+  s_reservoirBufferSize = bufferSize;
+  return true;
+}
+
+bool _giResizeAdaptiveSamplingBuffers(uint32_t pixelCount)
+{
+  s_adaptiveSamplingPixelCount = 0;
+  s_activePixels.clear();
+
+  for (CgpuBuffer* buffer : { &s_pixelStatsBuffer, &s_pixelStatsStagingBuffer, &s_activePixelBuffer })
+  {
+    if (buffer->handle)
+    {
+      cgpuDestroyBuffer(s_device, *buffer);
+      buffer->handle = 0;
+    }
+  }
+
+  if (pixelCount == 0)
+  {
+    return true;
+  }
+
+  uint64_t statsBufferSize = uint64_t(pixelCount) * sizeof(Rp::PixelStats);
+
+  if (!cgpuCreateBuffer(s_device,
+                        CGPU_BUFFER_USAGE_FLAG_STORAGE_BUFFER | CGPU_BUFFER_USAGE_FLAG_TRANSFER_SRC,
+                        CGPU_MEMORY_PROPERTY_FLAG_DEVICE_LOCAL,
+                        statsBufferSize,
+                        &s_pixelStatsBuffer))
+  {
+    return false;
+  }
+
+  if (!cgpuCreateBuffer(s_device,
+                        CGPU_BUFFER_USAGE_FLAG_TRANSFER_DST,
+                        CGPU_MEMORY_PROPERTY_FLAG_HOST_VISIBLE | CGPU_MEMORY_PROPERTY_FLAG_HOST_CACHED,
+                        statsBufferSize,
+                        &s_pixelStatsStagingBuffer))
+  {
+    return false;
+  }
+
+  if (!cgpuCreateBuffer(s_device,
+                        CGPU_BUFFER_USAGE_FLAG_STORAGE_BUFFER | CGPU_BUFFER_USAGE_FLAG_TRANSFER_DST,
+                        CGPU_MEMORY_PROPERTY_FLAG_DEVICE_LOCAL,
+                        uint64_t(pixelCount) * sizeof(uint32_t),
+                        &s_activePixelBuffer))
+  {
+    return false;
+  }
+
+  s_adaptiveSamplingPixelCount = pixelCount;
+  return true;
+}
+
+bool _giResizeGuidingBuffers(bool enabled)
+{
+  s_guidingField.reset();
+  s_guidingSpatialNodeBufferSize = 0;
+  s_guidingDirectionalNodeBufferSize = 0;
+
+  for (CgpuBuffer* buffer : { &s_guidingRecordBuffer, &s_guidingRecordStagingBuffer, &s_guidingSpatialNodeBuffer, &s_guidingDirectionalNodeBuffer })
+  {
+    if (buffer->handle)
+    {
+      cgpuDestroyBuffer(s_device, *buffer);
+      buffer->handle = 0;
+    }
+  }
+
+  if (!enabled)
+  {
+    return true;
+  }
+
+  if (!cgpuCreateBuffer(s_device,
+                        CGPU_BUFFER_USAGE_FLAG_STORAGE_BUFFER | CGPU_BUFFER_USAGE_FLAG_TRANSFER_SRC | CGPU_BUFFER_USAGE_FLAG_TRANSFER_DST,
+                        CGPU_MEMORY_PROPERTY_FLAG_DEVICE_LOCAL,
+                        GUIDING_RECORD_BUFFER_SIZE,
+                        &s_guidingRecordBuffer))
+  {
+    return false;
+  }
+
+  if (!cgpuCreateBuffer(s_device,
+                        CGPU_BUFFER_USAGE_FLAG_TRANSFER_DST,
+                        CGPU_MEMORY_PROPERTY_FLAG_HOST_VISIBLE | CGPU_MEMORY_PROPERTY_FLAG_HOST_CACHED,
+                        GUIDING_RECORD_BUFFER_SIZE,
+                        &s_guidingRecordStagingBuffer))
+  {
+    return false;
+  }
+
+  return true;
+}
+
+// The tree buffers only grow while guiding is enabled.
+bool _giUploadGuidingField()
+{
+  std::vector<Rp::GuidingSpatialNode> spatialNodes;
+  std::vector<Rp::GuidingDirectionalNode> directionalNodes;
+  s_guidingField->exportNodes(spatialNodes, directionalNodes);
+
+  const auto uploadNodes = [](const uint8_t* data, uint64_t size, CgpuBuffer& buffer, uint64_t& bufferSize) {
+    if (size > bufferSize)
+    {
+      if (buffer.handle)
+      {
+        cgpuDestroyBuffer(s_device, buffer);
+        buffer.handle = 0;
+        bufferSize = 0;
+      }
+
+      if (!cgpuCreateBuffer(s_device,
+                            CGPU_BUFFER_USAGE_FLAG_STORAGE_BUFFER | CGPU_BUFFER_USAGE_FLAG_TRANSFER_DST,
+                            CGPU_MEMORY_PROPERTY_FLAG_DEVICE_LOCAL,
+                            size,
+                            &buffer))
+      {
+        return false;
+      }
+
+      bufferSize = size;
+    }
+
+    return s_stager->stageToBuffer(data, size, buffer, 0);
+  };
+
+  return uploadNodes((const uint8_t*) spatialNodes.data(), spatialNodes.size() * sizeof(Rp::GuidingSpatialNode),
+                     s_guidingSpatialNodeBuffer, s_guidingSpatialNodeBufferSize) &&
+         uploadNodes((const uint8_t*) directionalNodes.data(), directionalNodes.size() * sizeof(Rp::GuidingDirectionalNode),
+                     s_guidingDirectionalNodeBuffer, s_guidingDirectionalNodeBufferSize);
+}
+
+// Iterations double in length, so that each distribution is learned from as many passes as
+// all previous ones together. The refined field is uploaded for the next pass.
+bool _giUpdateGuidingField(const Rp::GuidingRecordHeader* header, const Rp::GuidingRecord* records)
+{
+  s_guidingField->addRecords(records, std::min(header->count, GUIDING_RECORD_CAPACITY));
+
+  // Keep the expected record count of the next pass below the capacity.
+  if (header->count > 0)
+  {
+    float probability = s_guidingRecordProbability * 0.9f * float(GUIDING_RECORD_CAPACITY) / float(header->count);
+    s_guidingRecordProbability = std::min(probability, 1.0f);
+  }
+
+  if (++s_guidingIterationPassCount < s_guidingIterationLength)
+  {
+    return true;
+  }
+
+  s_guidingField->refine(s_guidingIterationLength);
+  s_guidingIterationLength *= 2;
+  s_guidingIterationPassCount = 0;
+
+  return _giUploadGuidingField();
+}
+
 void giTerminate()
 {
 #ifndef NDEBUG
@@ -270,6 +541,9 @@ void giTerminate()
   s_aggregateAssetReader.reset();
   s_mmapAssetReader.reset();
   _giResizeOutputBuffer(0, 0, 0);
+  _giResizeReservoirBuffers(0);
+  _giResizeAdaptiveSamplingBuffers(0);
+  _giResizeGuidingBuffers(false);
   if (s_texSys)
   {
     s_texSys->destroy();
@@ -369,7 +643,10 @@ bool _giBuildGeometryStructures(const GiGeomCacheParams* params,
                                 std::vector<CgpuBlas>& blases,
                                 std::vector<CgpuBlasInstance>& blasInstances,
                                 std::vector<Rp::FVertex>& allVertices,
-                                std::vector<Rp::Face>& allFaces)
+                                std::vector<Rp::Face>& allFaces,
+                                std::vector<Rp::EmissiveFace>& emissiveFaces,
+                                std::vector<uint32_t>& emissiveInstanceOffsets,
+                                std::vector<Rp::LightTreeNode>& lightTreeNodes)
 {
   struct ProtoBlasInstance
   {
@@ -378,6 +655,7 @@ bool _giBuildGeometryStructures(const GiGeomCacheParams* params,
     uint32_t materialIndex;
   };
   std::unordered_map<const GiMesh*, ProtoBlasInstance> protoBlasInstances;
+  std::vector<float> emissiveFaceWeights;
 
   for (uint32_t m = 0; m < params->meshInstanceCount; m++)
   {
@@ -493,8 +771,71 @@ bool _giBuildGeometryStructures(const GiGeomCacheParams* params,
     memcpy(blasInstance.transform, instance->transform, sizeof(float) * 12);
 
     blasInstances.push_back(blasInstance);
+
+    // Emissive faces are only sampled by next event estimation.
+    if (!params->nextEventEstimation)
+    {
+      continue;
+    }
+
+    // Emissive faces are stored in world space, per instance.
+    const sg::Material* sgMat = mesh->material->sgMat;
+    if (!s_shaderGen->isMaterialEmissive(sgMat))
+    {
+      emissiveInstanceOffsets.push_back(UINT32_MAX);
+      continue;
+    }
+
+    emissiveInstanceOffsets.push_back(uint32_t(emissiveFaces.size()));
+
+    float emissionLuminance = s_shaderGen->getMaterialEmissionLuminance(sgMat);
+    glm::mat4x3 transform = glm::transpose(glm::make_mat3x4(&instance->transform[0][0]));
+
+    for (const GiFace& face : mesh->faces)
+    {
+      glm::vec3 p0 = transform * glm::vec4(glm::make_vec3(mesh->vertices[face.v_i[0]].pos), 1.0f);
+      glm::vec3 p1 = transform * glm::vec4(glm::make_vec3(mesh->vertices[face.v_i[1]].pos), 1.0f);
+      glm::vec3 p2 = transform * glm::vec4(glm::make_vec3(mesh->vertices[face.v_i[2]].pos), 1.0f);
+
+      float area = 0.5f * glm::length(glm::cross(p1 - p0, p2 - p0));
+      emissiveFaceWeights.push_back(area * emissionLuminance);
+
+      emissiveFaces.push_back(Rp::EmissiveFace{ .p0 = p0, .p1 = p1, .p2 = p2, .emissionLuminance = emissionLuminance });
+    }
+  }
+
+  // Storage buffers can't be empty. Faces with a pdf of zero are never sampled.
+  if (emissiveFaces.empty())
+  {
+    emissiveFaces.push_back(Rp::EmissiveFace{});
+    emissiveFaceWeights.push_back(0.0f);
+  }
+  if (emissiveInstanceOffsets.empty())
+  {
+    emissiveInstanceOffsets.push_back(UINT32_MAX);
+  }
+
+  {
+    std::vector<Rp::AliasEntry> aliasTable;
+    if (!gi::buildAliasTable(emissiveFaceWeights, aliasTable))
+    {
+      // Uniform sampling is not wanted if there is no emitted power.
+      for (Rp::AliasEntry& entry : aliasTable)
+      {
+        entry.pdf = 0.0f;
+      }
+    }
+
+    for (size_t i = 0; i < emissiveFaces.size(); i++)
+    {
+      emissiveFaces[i].prob = aliasTable[i].prob;
+      emissiveFaces[i].alias = aliasTable[i].alias;
+      emissiveFaces[i].pdf = aliasTable[i].pdf;
+    }
   }
 
+  gi::buildLightTree(emissiveFaceWeights, emissiveFaces, lightTreeNodes);
+
   return true;
 
 fail_cleanup:
@@ -523,14 +864,20 @@ GiGeomCache* giCreateGeomCache(const GiGeomCacheParams* params)
   std::vector<CgpuBlasInstance> blas_instances;
   std::vector<Rp::FVertex> allVertices;
   std::vector<Rp::Face> allFaces;
+  std::vector<Rp::EmissiveFace> emissiveFaces;
+  std::vector<uint32_t> emissiveInstanceOffsets;
+  std::vector<Rp::LightTreeNode> lightTreeNodes;
 
-  if (!_giBuildGeometryStructures(params, blases, blas_instances, allVertices, allFaces))
+  if (!_giBuildGeometryStructures(params, blases, blas_instances, allVertices, allFaces, emissiveFaces, emissiveInstanceOffsets, lightTreeNodes))
     goto cleanup;
 
   if (!cgpuCreateTlas(s_device, blas_instances.size(), blas_instances.data(), &tlas))
     goto cleanup;
 
   // Upload vertex & index buffers to single GPU buffer.
+  GiGpuBufferView emissiveFaceBufferView;
+  GiGpuBufferView emissiveInstanceBufferView;
+  GiGpuBufferView lightTreeNodeBufferView;
   GiGpuBufferView faceBufferView;
   GiGpuBufferView vertexBufferView;
   {
@@ -539,13 +886,21 @@ GiGeomCache* giCreateGeomCache(const GiGeomCacheParams* params)
 
     faceBufferView.size = allFaces.size() * sizeof(Rp::Face);
     vertexBufferView.size = allVertices.size() * sizeof(Rp::FVertex);
+    emissiveFaceBufferView.size = emissiveFaces.size() * sizeof(Rp::EmissiveFace);
+    emissiveInstanceBufferView.size = emissiveInstanceOffsets.size() * sizeof(uint32_t);
+    lightTreeNodeBufferView.size = lightTreeNodes.size() * sizeof(Rp::LightTreeNode);
 
     faceBufferView.offset = giAlignBuffer(offset_align, faceBufferView.size, &buf_size);
     vertexBufferView.offset = giAlignBuffer(offset_align, vertexBufferView.size, &buf_size);
+    emissiveFaceBufferView.offset = giAlignBuffer(offset_align, emissiveFaceBufferView.size, &buf_size);
+    emissiveInstanceBufferView.offset = giAlignBuffer(offset_align, emissiveInstanceBufferView.size, &buf_size);
+    lightTreeNodeBufferView.offset = giAlignBuffer(offset_align, lightTreeNodeBufferView.size, &buf_size);
 
     printf("total geom buffer size: %.2fMiB\n", buf_size * BYTES_TO_MIB);
     printf("> %.2fMiB faces\n", faceBufferView.size * BYTES_TO_MIB);
     printf("> %.2fMiB vertices\n", vertexBufferView.size * BYTES_TO_MIB);
+    printf("> %.2fMiB emissive faces\n", (emissiveFaceBufferView.size + emissiveInstanceBufferView.size) * BYTES_TO_MIB);
+    printf("> %.2fMiB light tree\n", lightTreeNodeBufferView.size * BYTES_TO_MIB);
     fflush(stdout);
 
     CgpuBufferUsageFlags bufferUsage = CGPU_BUFFER_USAGE_FLAG_STORAGE_BUFFER | CGPU_BUFFER_USAGE_FLAG_TRANSFER_DST;
@@ -558,6 +913,12 @@ GiGeomCache* giCreateGeomCache(const GiGeomCacheParams* params)
       goto cleanup;
     if (!s_stager->stageToBuffer((uint8_t*)allVertices.data(), vertexBufferView.size, buffer, vertexBufferView.offset))
       goto cleanup;
+    if (!s_stager->stageToBuffer((uint8_t*)emissiveFaces.data(), emissiveFaceBufferView.size, buffer, emissiveFaceBufferView.offset))
+      goto cleanup;
+    if (!s_stager->stageToBuffer((uint8_t*)emissiveInstanceOffsets.data(), emissiveInstanceBufferView.size, buffer, emissiveInstanceBufferView.offset))
+      goto cleanup;
+    if (!s_stager->stageToBuffer((uint8_t*)lightTreeNodes.data(), lightTreeNodeBufferView.size, buffer, lightTreeNodeBufferView.offset))
+      goto cleanup;
   }
 
   // Fill cache struct.
@@ -565,8 +926,12 @@ GiGeomCache* giCreateGeomCache(const GiGeomCacheParams* params)
   cache->tlas = tlas;
   cache->blases = blases;
   cache->buffer = buffer;
+  cache->emissiveFaceBufferView = emissiveFaceBufferView;
+  cache->emissiveInstanceBufferView = emissiveInstanceBufferView;
+  cache->lightTreeNodeBufferView = lightTreeNodeBufferView;
   cache->faceBufferView = faceBufferView;
   cache->vertexBufferView = vertexBufferView;
+  cache->nextEventEstimation = params->nextEventEstimation;
 
 cleanup:
   if (!cache)
@@ -609,6 +974,64 @@ bool giGeomCacheNeedsRebuild()
   return s_forceGeomCacheInvalid;
 }
 
+// Dome lights are recreated on transform changes, so the sampling data is kept
+// with the scene and only rebuilt if the image changes.
+bool _giCreateDomeLightAliasTable(const char* filePath, GiScene* scene)
+{
+  if (scene->domeLightAliasTable.handle)
+  {
+    cgpuDestroyBuffer(s_device, scene->domeLightAliasTable);
+    scene->domeLightAliasTable.handle = 0;
+  }
+  scene->domeLightAliasTableFilePath.clear();
+
+  // The sampling distribution doesn't need the full resolution of large images.
+  const uint32_t maxDimension = Rp::DOME_LIGHT_SAMPLING_WIDTH * 2;
+
+  imgio_img img = {};
+  bool decoded = false;
+
+  GiAsset* asset = s_aggregateAssetReader->open(filePath);
+  if (asset)
+  {
+    decoded = imgio_load_img_scaled(s_aggregateAssetReader->data(asset), s_aggregateAssetReader->size(asset), maxDimension, &img) == IMGIO_OK;
+    s_aggregateAssetReader->close(asset);
+  }
+
+  // Unsupported images are sampled uniformly.
+  std::vector<Rp::AliasEntry> aliasTable;
+  if (!gi::buildDomeLightAliasTable(img, aliasTable))
+  {
+    fprintf(stderr, "unable to importance sample dome light texture at %s\n", filePath);
+  }
+
+  if (decoded)
+  {
+    imgio_free_img(&img);
+  }
+
+  uint64_t size = aliasTable.size() * sizeof(Rp::AliasEntry);
+
+  if (!cgpuCreateBuffer(s_device,
+                        CGPU_BUFFER_USAGE_FLAG_STORAGE_BUFFER | CGPU_BUFFER_USAGE_FLAG_TRANSFER_DST,
+                        CGPU_MEMORY_PROPERTY_FLAG_DEVICE_LOCAL,
+                        size,
+                        &scene->domeLightAliasTable))
+  {
+    return false;
+  }
+
+  if (!s_stager->stageToBuffer((const uint8_t*) aliasTable.data(), size, scene->domeLightAliasTable, 0))
+  {
+    cgpuDestroyBuffer(s_device, scene->domeLightAliasTable);
+    scene->domeLightAliasTable.handle = 0;
+    return false;
+  }
+
+  scene->domeLightAliasTableFilePath = filePath;
+  return true;
+}
+
 GiShaderCache* giCreateShaderCache(const GiShaderCacheParams* params)
 {
   s_forceShaderCacheInvalid = false;
@@ -634,6 +1057,7 @@ GiShaderCache* giCreateShaderCache(const GiShaderCacheParams* params)
   std::vector<CgpuImage> images_3d;
   std::vector<CgpuRtHitGroup> hitGroups;
   std::vector<sg::TextureResource> textureResources;
+  std::unique_ptr<gi::VirtualTexSys> vtSys;
   uint32_t texCount2d = 0;
   uint32_t texCount3d = 0;
   bool hasPipelineClosestHitShader = false;
@@ -645,7 +1069,7 @@ GiShaderCache* giCreateShaderCache(const GiShaderCacheParams* params)
   {
     if (scene->domeLightTexture.handle)
     {
-      s_texSys->evictAndDestroyCachedImage(scene->domeLightTexture);
+      s_texSys->releaseImage(scene->domeLightTexture);
       scene->domeLightTexture.handle = 0;
     }
     scene->domeLight = nullptr;
@@ -661,6 +1085,13 @@ GiShaderCache* giCreateShaderCache(const GiShaderCacheParams* params)
       {
         fprintf(stderr, "unable to load dome light texture at %s\n", filePath);
       }
+      else if (scene->domeLightAliasTableFilePath != filePath &&
+               !_giCreateDomeLightAliasTable(filePath, scene))
+      {
+        fprintf(stderr, "unable to create dome light sampling data\n");
+        s_texSys->releaseImage(scene->domeLightTexture);
+        scene->domeLightTexture.handle = 0;
+      }
       else
       {
         scene->domeLightTransform = domeLight->transform;
@@ -671,6 +1102,34 @@ GiShaderCache* giCreateShaderCache(const GiShaderCacheParams* params)
 
   bool domeLightEnabled = bool(scene->domeLight);
 
+  // Emissive faces are only sampled if there are emissive materials.
+  bool nextEventEstimation = false;
+  for (uint32_t i = 0; i < params->materialCount && params->nextEventEstimation; i++)
+  {
+    nextEventEstimation |= s_shaderGen->isMaterialEmissive(params->materials[i]->sgMat);
+  }
+
+  // Like the dome light, sphere lights are sampled explicitly regardless of the emissive face
+  // setting. Point lights can only be reached this way.
+  bool sphereLightsEnabled = false;
+  {
+    std::lock_guard guard(scene->mutex);
+    sphereLightsEnabled = !scene->lights.empty();
+  }
+  scene->sphereLightsDirty = true;
+
+  // Light sample resampling requires at least one light to sample.
+  bool restir = params->restir && (domeLightEnabled || nextEventEstimation || sphereLightsEnabled);
+
+  // The per-pixel error is only meaningful for the accumulated color.
+  bool adaptiveSampling = params->adaptiveSampling && params->progressiveAccumulation && params->aovId == GI_AOV_ID_COLOR;
+
+  // The guiding distribution is learned over the passes of the accumulated color.
+  bool pathGuiding = params->pathGuiding && params->progressiveAccumulation && params->aovId == GI_AOV_ID_COLOR;
+
+  bool sobolSampler = params->sampler != GI_SAMPLER_INDEPENDENT;
+  bool blueNoiseDither = params->sampler == GI_SAMPLER_SOBOL_BLUE_NOISE;
+
   // Create per-material closest-hit shaders.
   //
   // This is done in multiple phases: first, GLSL is generated from MDL, and
@@ -689,8 +1148,7 @@ GiShaderCache* giCreateShaderCache(const GiShaderCacheParams* params)
     struct HitShaderCompInfo
     {
       sg::ShaderGen::MaterialGlslGenInfo genInfo;
-      uint32_t texOffset2d = 0;
-      uint32_t texOffset3d = 0;
+      std::vector<uint32_t> textureIndices;
       std::vector<uint8_t> spv;
       std::vector<uint8_t> shadowSpv;
     };
@@ -698,6 +1156,7 @@ GiShaderCache* giCreateShaderCache(const GiShaderCacheParams* params)
     {
       HitShaderCompInfo closestHitInfo;
       std::optional<HitShaderCompInfo> anyHitInfo;
+      bool sharesClosestHitResources = false;
     };
 
     std::vector<HitGroupCompInfo> hitGroupCompInfos;
@@ -710,30 +1169,58 @@ GiShaderCache* giCreateShaderCache(const GiShaderCacheParams* params)
       const GiMaterial* mat = params->materials[i];
 
       HitGroupCompInfo groupInfo;
+      bool isOpaque = s_shaderGen->isMaterialOpaque(mat->sgMat);
+
+      if (params->batchMdlCodeGen)
       {
+        // Shading and opacity functions share one link unit, GLSL source and set of textures.
         sg::ShaderGen::MaterialGlslGenInfo genInfo;
-        if (!s_shaderGen->generateMaterialShadingGenInfo(mat->sgMat, genInfo))
+        sg::ShaderGen::MaterialGlslGenInfo opacityGenInfo;
+        if (!s_shaderGen->generateMaterialGenInfo(mat->sgMat, genInfo, isOpaque ? nullptr : &opacityGenInfo))
         {
           threadWorkFailed = true;
           continue;
         }
 
+        if (!isOpaque)
+        {
+          HitShaderCompInfo hitInfo;
+          hitInfo.genInfo = std::move(opacityGenInfo);
+          groupInfo.anyHitInfo = std::move(hitInfo);
+          groupInfo.sharesClosestHitResources = true;
+        }
+
         HitShaderCompInfo hitInfo;
-        hitInfo.genInfo = genInfo;
-        groupInfo.closestHitInfo = hitInfo;
+        hitInfo.genInfo = std::move(genInfo);
+        groupInfo.closestHitInfo = std::move(hitInfo);
       }
-      if (!s_shaderGen->isMaterialOpaque(mat->sgMat))
+      else
       {
-        sg::ShaderGen::MaterialGlslGenInfo genInfo;
-        if (!s_shaderGen->generateMaterialOpacityGenInfo(mat->sgMat, genInfo))
         {
-          threadWorkFailed = true;
-          continue;
+          sg::ShaderGen::MaterialGlslGenInfo genInfo;
+          if (!s_shaderGen->generateMaterialShadingGenInfo(mat->sgMat, genInfo))
+          {
+            threadWorkFailed = true;
+            continue;
+          }
+
+          HitShaderCompInfo hitInfo;
+          hitInfo.genInfo = genInfo;
+          groupInfo.closestHitInfo = hitInfo;
         }
+        if (!isOpaque)
+        {
+          sg::ShaderGen::MaterialGlslGenInfo genInfo;
+          if (!s_shaderGen->generateMaterialOpacityGenInfo(mat->sgMat, genInfo))
+          {
+            threadWorkFailed = true;
+            continue;
+          }
 
-        HitShaderCompInfo hitInfo;
-        hitInfo.genInfo = genInfo;
-        groupInfo.anyHitInfo = hitInfo;
+          HitShaderCompInfo hitInfo;
+          hitInfo.genInfo = genInfo;
+          groupInfo.anyHitInfo = hitInfo;
+        }
       }
 
       hitGroupCompInfos[i] = groupInfo;
@@ -743,39 +1230,112 @@ GiShaderCache* giCreateShaderCache(const GiShaderCacheParams* params)
       goto cleanup;
     }
 
-    // 2. Sum up texture resources & calculate per-material index offsets.
+    // 2. Sum up texture resources & build per-material texture index tables. MDL's
+    //    BSDF data textures are identical for all materials and only bound once.
     texCount2d += int(domeLightEnabled);
 
-    for (HitGroupCompInfo& groupInfo : hitGroupCompInfos)
+    std::unordered_map<uint32_t, uint32_t> bsdfDataTextureIndices;
+    uint32_t sharedBsdfDataTextureCount = 0;
+
+    auto assignTextureIndices = [&](HitShaderCompInfo& compInfo)
     {
-      HitShaderCompInfo& closestHitShaderCompInfo = groupInfo.closestHitInfo;
-      closestHitShaderCompInfo.texOffset2d = texCount2d;
-      closestHitShaderCompInfo.texOffset3d = texCount3d;
+      compInfo.textureIndices.push_back(0); // invalid texture
 
-      for (const sg::TextureResource& tr : closestHitShaderCompInfo.genInfo.textureResources)
+      for (const sg::TextureResource& tr : compInfo.genInfo.textureResources)
       {
-        (tr.is3dImage ? texCount3d : texCount2d)++;
+        if (tr.bsdfDataKind != 0)
+        {
+          auto indexIt = bsdfDataTextureIndices.find(tr.bsdfDataKind);
+          if (indexIt != bsdfDataTextureIndices.end())
+          {
+            compInfo.textureIndices.push_back(indexIt->second);
+            sharedBsdfDataTextureCount++;
+            continue;
+          }
+          bsdfDataTextureIndices[tr.bsdfDataKind] = texCount3d;
+        }
+
+        compInfo.textureIndices.push_back((tr.is3dImage ? texCount3d : texCount2d)++);
         textureResources.push_back(tr);
       }
+    };
+
+    for (HitGroupCompInfo& groupInfo : hitGroupCompInfos)
+    {
+      HitShaderCompInfo& closestHitShaderCompInfo = groupInfo.closestHitInfo;
+      assignTextureIndices(closestHitShaderCompInfo);
 
       if (groupInfo.anyHitInfo)
       {
         HitShaderCompInfo& anyHitShaderCompInfo = *groupInfo.anyHitInfo;
-        anyHitShaderCompInfo.texOffset2d = texCount2d;
-        anyHitShaderCompInfo.texOffset3d = texCount3d;
 
-        for (const sg::TextureResource& tr : anyHitShaderCompInfo.genInfo.textureResources)
+        if (groupInfo.sharesClosestHitResources)
         {
-          (tr.is3dImage ? texCount3d : texCount2d)++;
-          textureResources.push_back(tr);
+          anyHitShaderCompInfo.textureIndices = closestHitShaderCompInfo.textureIndices;
+        }
+        else
+        {
+          assignTextureIndices(anyHitShaderCompInfo);
         }
 
         hasPipelineAnyHitShader |= true;
       }
     }
 
+    if (sharedBsdfDataTextureCount > 0)
+    {
+      printf("reusing %u shared BSDF data textures\n", sharedBsdfDataTextureCount);
+    }
+
+    // Virtual textures are bound as 1x1 placeholders, so that the texture array layout
+    // stays the same. Their tiles are streamed on demand instead.
+    if (s_vtSysParams && texCount2d > 0)
+    {
+      vtSys = std::make_unique<gi::VirtualTexSys>(s_device, *s_aggregateAssetReader, *s_stager, *s_vtSysParams);
+      vtSys->init(texCount2d);
+
+      uint32_t arrayIndex = int(domeLightEnabled);
+      for (sg::TextureResource& tr : textureResources)
+      {
+        if (tr.is3dImage)
+        {
+          continue;
+        }
+
+        if (!tr.filePath.empty() && vtSys->addTexture(arrayIndex, tr.filePath))
+        {
+          tr.filePath.clear();
+          tr.width = 1;
+          tr.height = 1;
+          tr.depth = 1;
+          tr.data.assign(4, 0);
+        }
+        arrayIndex++;
+      }
+
+      if (vtSys->getTextureCount() == 0)
+      {
+        vtSys.reset();
+      }
+      else if (!vtSys->commit())
+      {
+        goto cleanup;
+      }
+    }
+
     hasPipelineClosestHitShader = hitGroupCompInfos.size() > 0;
 
+    uint32_t opaqueMaterialCount = 0;
+    uint32_t foldedOpaqueMaterialCount = 0;
+    for (uint32_t i = 0; i < params->materialCount; i++)
+    {
+      const sg::Material* sgMat = params->materials[i]->sgMat;
+      opaqueMaterialCount += int(s_shaderGen->isMaterialOpaque(sgMat));
+      foldedOpaqueMaterialCount += int(s_shaderGen->isMaterialOpacityFolded(sgMat));
+    }
+    printf("%u opaque materials (%u reclassified by cutout opacity folding)\n",
+      opaqueMaterialCount, foldedOpaqueMaterialCount);
+
     // 3. Generate final hit shader GLSL sources.
     threadWorkFailed = false;
 #pragma omp parallel for
@@ -786,14 +1346,24 @@ GiShaderCache* giCreateShaderCache(const GiShaderCacheParams* params)
       // Closest hit
       {
         sg::ShaderGen::ClosestHitShaderParams hitParams;
+        hitParams.adaptiveSampling = adaptiveSampling;
         hitParams.aovId = params->aovId;
         hitParams.baseFileName = "rt_main.chit";
+        hitParams.blueNoiseDither = blueNoiseDither;
+        hitParams.domeLightEnabled = domeLightEnabled;
         hitParams.isOpaque = s_shaderGen->isMaterialOpaque(params->materials[i]->sgMat);
+        hitParams.lightTree = params->lightTree;
+        hitParams.nextEventEstimation = nextEventEstimation;
+        hitParams.pathGuiding = pathGuiding;
+        hitParams.restir = restir;
+        hitParams.restirSpatialNeighbors = params->restirSpatialNeighbors;
         hitParams.shadingGlsl = compInfo.closestHitInfo.genInfo.glslSource;
-        hitParams.textureIndexOffset2d = compInfo.closestHitInfo.texOffset2d;
-        hitParams.textureIndexOffset3d = compInfo.closestHitInfo.texOffset3d;
+        hitParams.sobolSampler = sobolSampler;
+        hitParams.sphereLightsEnabled = sphereLightsEnabled;
+        hitParams.textureIndices = compInfo.closestHitInfo.textureIndices;
         hitParams.texCount2d = texCount2d;
         hitParams.texCount3d = texCount3d;
+        hitParams.virtualTexturing = bool(vtSys);
 
         if (!s_shaderGen->generateClosestHitSpirv(hitParams, compInfo.closestHitInfo.spv))
         {
@@ -809,10 +1379,10 @@ GiShaderCache* giCreateShaderCache(const GiShaderCacheParams* params)
         hitParams.aovId = params->aovId;
         hitParams.baseFileName = "rt_main.ahit";
         hitParams.opacityEvalGlsl = compInfo.anyHitInfo->genInfo.glslSource;
-        hitParams.textureIndexOffset2d = compInfo.anyHitInfo->texOffset2d;
-        hitParams.textureIndexOffset3d = compInfo.anyHitInfo->texOffset3d;
+        hitParams.textureIndices = compInfo.anyHitInfo->textureIndices;
         hitParams.texCount2d = texCount2d;
         hitParams.texCount3d = texCount3d;
+        hitParams.virtualTexturing = bool(vtSys);
 
         hitParams.shadowTest = false;
         if (!s_shaderGen->generateAnyHitSpirv(hitParams, compInfo.anyHitInfo->spv))
@@ -901,15 +1471,24 @@ GiShaderCache* giCreateShaderCache(const GiShaderCacheParams* params)
   // Create ray generation shader.
   {
     sg::ShaderGen::RaygenShaderParams rgenParams;
+    rgenParams.adaptiveSampling = adaptiveSampling;
     rgenParams.aovId = params->aovId;
+    rgenParams.blueNoiseDither = blueNoiseDither;
+    rgenParams.domeLightEnabled = domeLightEnabled;
     rgenParams.filterImportanceSampling = params->filterImportanceSampling;
     rgenParams.materialCount = params->materialCount;
-    rgenParams.nextEventEstimation = params->nextEventEstimation;
+    rgenParams.nextEventEstimation = nextEventEstimation;
+    rgenParams.pathGuiding = pathGuiding;
     rgenParams.progressiveAccumulation = params->progressiveAccumulation;
     rgenParams.reorderInvocations = s_deviceFeatures.rayTracingInvocationReorder;
+    rgenParams.restir = restir;
+    rgenParams.restirSpatialNeighbors = params->restirSpatialNeighbors;
     rgenParams.shaderClockExts = clockCyclesAov;
+    rgenParams.sobolSampler = sobolSampler;
+    rgenParams.sphereLightsEnabled = sphereLightsEnabled;
     rgenParams.texCount2d = texCount2d;
     rgenParams.texCount3d = texCount3d;
+    rgenParams.virtualTexturing = bool(vtSys);
 
     std::vector<uint8_t> rgenSpirv;
     if (!s_shaderGen->generateRgenSpirv("rt_main.rgen", rgenParams, rgenSpirv))
@@ -928,8 +1507,11 @@ GiShaderCache* giCreateShaderCache(const GiShaderCacheParams* params)
     sg::ShaderGen::MissShaderParams missParams;
     missParams.domeLightEnabled = domeLightEnabled;
     missParams.domeLightCameraVisibility = params->domeLightCameraVisibility;
+    missParams.nextEventEstimation = nextEventEstimation;
+    missParams.sphereLightsEnabled = sphereLightsEnabled;
     missParams.texCount2d = texCount2d;
     missParams.texCount3d = texCount3d;
+    missParams.virtualTexturing = bool(vtSys);
 
     // regular miss shader
     {
@@ -974,6 +1556,28 @@ GiShaderCache* giCreateShaderCache(const GiShaderCacheParams* params)
   assert(images_2d.size() == (texCount2d - int(domeLightEnabled)));
   assert(images_3d.size() == texCount3d);
 
+  {
+    GiTextureCacheStats stats;
+    s_texSys->getStats(stats);
+
+    printf("texture cache: %" PRIu64 " hits, %" PRIu64 " decoded hits, %" PRIu64 " misses, %" PRIu64 " evictions, %.2fMiB GPU, %.2fMiB CPU\n",
+      stats.hitCount, stats.decodedHitCount, stats.missCount, stats.evictionCount,
+      stats.gpuByteSize * BYTES_TO_MIB, stats.cpuByteSize * BYTES_TO_MIB);
+
+    if (stats.dedupHitCount > 0)
+    {
+      printf("texture deduplication: %" PRIu64 " duplicates, %.2fMiB GPU saved\n",
+        stats.dedupHitCount, stats.dedupByteSize * BYTES_TO_MIB);
+    }
+
+    if (stats.encodedTexelCount > 0 || stats.transcodeCacheHitCount > 0)
+    {
+      printf("texture compression: %.2fMiB GPU saved, %" PRIu64 " disk cache hits, %.1f MTexel/s encode throughput\n",
+        stats.compressionByteSavings * BYTES_TO_MIB, stats.transcodeCacheHitCount,
+        stats.encodeMicroseconds > 0 ? float(stats.encodedTexelCount) / float(stats.encodeMicroseconds) : 0.0f);
+    }
+  }
+
   // Create RT pipeline.
   {
     printf("creating RT pipeline..\n");
@@ -1007,12 +1611,22 @@ GiShaderCache* giCreateShaderCache(const GiShaderCacheParams* params)
   cache->rgenShader = rgenShader;
   cache->hasPipelineClosestHitShader = hasPipelineClosestHitShader;
   cache->hasPipelineAnyHitShader = hasPipelineAnyHitShader;
+  cache->nextEventEstimation = nextEventEstimation;
+  cache->restir = restir;
+  cache->adaptiveSampling = adaptiveSampling;
+  cache->pathGuiding = pathGuiding;
+  cache->sphereLightsEnabled = sphereLightsEnabled;
+  cache->vtSys = std::move(vtSys);
 
 cleanup:
   if (!cache)
   {
-    s_texSys->destroyUncachedImages(images_2d);
-    s_texSys->destroyUncachedImages(images_3d);
+    if (vtSys)
+    {
+      vtSys->destroy();
+    }
+    s_texSys->releaseImages(images_2d);
+    s_texSys->releaseImages(images_3d);
     if (rgenShader.handle)
     {
       cgpuDestroyShader(s_device, rgenShader);
@@ -1035,8 +1649,8 @@ cleanup:
 
 void giDestroyShaderCache(GiShaderCache* cache)
 {
-  s_texSys->destroyUncachedImages(cache->images2d);
-  s_texSys->destroyUncachedImages(cache->images3d);
+  s_texSys->releaseImages(cache->images2d);
+  s_texSys->releaseImages(cache->images3d);
   cgpuDestroyShader(s_device, cache->rgenShader);
   for (CgpuShader shader : cache->missShaders)
   {
@@ -1047,14 +1661,28 @@ void giDestroyShaderCache(GiShaderCache* cache)
     cgpuDestroyShader(s_device, shader);
   }
   cgpuDestroyPipeline(s_device, cache->pipeline);
+  if (cache->vtSys)
+  {
+    cache->vtSys->destroy();
+  }
   delete cache;
 }
 
+uint32_t giGetActivePixelCount()
+{
+  return uint32_t(s_activePixels.size());
+}
+
 void giInvalidateFramebuffer()
 {
   s_sampleOffset = 0;
 }
 
+void giGetTextureCacheStats(GiTextureCacheStats* stats)
+{
+  s_texSys->getStats(*stats);
+}
+
 void giInvalidateShaderCache()
 {
   s_forceShaderCacheInvalid = true;
@@ -1065,14 +1693,164 @@ void giInvalidateGeomCache()
   s_forceGeomCacheInvalid = true;
 }
 
-int giRender(const GiRenderParams* params, float* rgbaImg)
+bool _giUploadSphereLights(GiScene* scene)
 {
-  s_stager->flush();
+  std::vector<Rp::SphereLight> lights;
+  {
+    std::lock_guard guard(scene->mutex);
+
+    lights.reserve(scene->lights.size());
+    for (const GiSphereLight* light : scene->lights)
+    {
+      lights.push_back(Rp::SphereLight{ .position = light->position, .radius = light->radius, .radiance = light->radiance });
+    }
+  }
+
+  // Storage buffers can't be empty. The placeholder emits no light.
+  if (lights.empty())
+  {
+    lights.push_back(Rp::SphereLight{});
+  }
+
+  uint64_t size = lights.size() * sizeof(Rp::SphereLight);
+
+  if (size > scene->sphereLightBufferSize)
+  {
+    if (scene->sphereLightBuffer.handle)
+    {
+      cgpuDestroyBuffer(s_device, scene->sphereLightBuffer);
+      scene->sphereLightBuffer.handle = 0;
+      scene->sphereLightBufferSize = 0;
+    }
+
+    if (!cgpuCreateBuffer(s_device,
+                          CGPU_BUFFER_USAGE_FLAG_STORAGE_BUFFER | CGPU_BUFFER_USAGE_FLAG_TRANSFER_DST,
+                          CGPU_MEMORY_PROPERTY_FLAG_DEVICE_LOCAL,
+                          size,
+                          &scene->sphereLightBuffer))
+    {
+      return false;
+    }
+
+    scene->sphereLightBufferSize = size;
+  }
+
+  if (!s_stager->stageToBuffer((const uint8_t*) lights.data(), size, scene->sphereLightBuffer, 0))
+  {
+    return false;
+  }
+
+  scene->sphereLightCount = uint32_t(lights.size());
+  return true;
+}
 
+int giRender(const GiRenderParams* params, float* rgbaImg)
+{
   const GiGeomCache* geom_cache = params->geomCache;
   const GiShaderCache* shader_cache = params->shaderCache;
   GiScene* scene = params->scene;
 
+  if (shader_cache->nextEventEstimation && !geom_cache->nextEventEstimation)
+  {
+    fprintf(stderr, "geom cache lacks emissive faces for next event estimation\n");
+    return GI_ERROR;
+  }
+
+  if (shader_cache->sphereLightsEnabled && scene->sphereLightsDirty.exchange(false) && !_giUploadSphereLights(scene))
+  {
+    fprintf(stderr, "unable to upload sphere lights\n");
+    scene->sphereLightsDirty = true;
+    return GI_ERROR;
+  }
+
+  // Reservoirs of a previous pass are only reused while samples accumulate.
+  uint64_t reservoirBufferSize = shader_cache->restir ? uint64_t(params->imageWidth) * params->imageHeight * sizeof(Rp::Reservoir) : 0;
+  if (reservoirBufferSize != s_reservoirBufferSize)
+  {
+    s_sampleOffset = 0;
+
+    if (!_giResizeReservoirBuffers(reservoirBufferSize))
+    {
+      fprintf(stderr, "unable to allocate ReSTIR reservoirs\n");
+      _giResizeReservoirBuffers(0);
+      return GI_ERROR;
+    }
+  }
+
+  // Converged pixels are compacted away from the launch.
+  uint32_t adaptiveSamplingPixelCount = shader_cache->adaptiveSampling ? params->imageWidth * params->imageHeight : 0;
+  if (adaptiveSamplingPixelCount != s_adaptiveSamplingPixelCount)
+  {
+    s_sampleOffset = 0;
+
+    if (!_giResizeAdaptiveSamplingBuffers(adaptiveSamplingPixelCount))
+    {
+      fprintf(stderr, "unable to allocate adaptive sampling buffers\n");
+      _giResizeAdaptiveSamplingBuffers(0);
+      return GI_ERROR;
+    }
+  }
+
+  if (shader_cache->adaptiveSampling)
+  {
+    if (s_sampleOffset == 0)
+    {
+      s_activePixels.resize(adaptiveSamplingPixelCount);
+      std::iota(s_activePixels.begin(), s_activePixels.end(), 0u);
+    }
+
+    if (!s_activePixels.empty() &&
+        !s_stager->stageToBuffer((const uint8_t*) s_activePixels.data(), s_activePixels.size() * sizeof(uint32_t), s_activePixelBuffer, 0))
+    {
+      fprintf(stderr, "unable to upload active pixels\n");
+      return GI_ERROR;
+    }
+  }
+
+  if (shader_cache->pathGuiding != bool(s_guidingRecordBuffer.handle) &&
+      !_giResizeGuidingBuffers(shader_cache->pathGuiding))
+  {
+    fprintf(stderr, "unable to allocate path guiding buffers\n");
+    _giResizeGuidingBuffers(false);
+    return GI_ERROR;
+  }
+
+  if (shader_cache->pathGuiding)
+  {
+    // The guiding field is learned anew whenever accumulation restarts.
+    if (s_sampleOffset == 0 || !s_guidingField)
+    {
+      s_guidingField = std::make_unique<gi::GuidingField>(gi::GuidingField::InitParams{
+        .directionalSplitFraction = 0.01f,
+        .maxDirectionalDepth = 20,
+        .spatialSplitThreshold = 4000.0f
+      });
+      s_guidingRecordProbability = 1.0f;
+      s_guidingIterationLength = 1;
+      s_guidingIterationPassCount = 0;
+
+      if (!_giUploadGuidingField())
+      {
+        fprintf(stderr, "unable to upload path guiding field\n");
+        return GI_ERROR;
+      }
+    }
+
+    Rp::GuidingRecordHeader header = {
+      .count       = 0,
+      .capacity    = GUIDING_RECORD_CAPACITY,
+      .probability = s_guidingRecordProbability
+    };
+
+    if (!s_stager->stageToBuffer((const uint8_t*) &header, sizeof(header), s_guidingRecordBuffer, 0))
+    {
+      fprintf(stderr, "unable to reset path guiding records\n");
+      return GI_ERROR;
+    }
+  }
+
+  s_stager->flush();
+
   // Init state for goto error handling.
   int result = GI_ERROR;
 
@@ -1123,22 +1901,57 @@ int giRender(const GiRenderParams* params, float* rgbaImg)
     .domeLightTransformCol1      = scene->domeLightTransform[1],
     .rrInvMinTermProb            = params->rrInvMinTermProb,
     .domeLightTransformCol2      = scene->domeLightTransform[2],
+    .activePixelCount            = uint32_t(s_activePixels.size()),
   };
 
   std::vector<CgpuBufferBinding> buffers;
-  buffers.reserve(16);
+  buffers.reserve(24);
 
   buffers.push_back({ Rp::BINDING_INDEX_OUT_PIXELS, 0, s_outputBuffer, 0, outputBufferSize });
   buffers.push_back({ Rp::BINDING_INDEX_FACES, 0, geom_cache->buffer, geom_cache->faceBufferView.offset, geom_cache->faceBufferView.size });
-  // TODO: set sphere light buffer
-  //if (shader_cache->nee_enabled)
-  //{
-  //  buffers.push_back({ Rp::BINDING_INDEX_EMISSIVE_FACES, 0, geom_cache->buffer, /* ... */ });
-  //}
+  if (shader_cache->nextEventEstimation)
+  {
+    buffers.push_back({ Rp::BINDING_INDEX_EMISSIVE_FACES, 0, geom_cache->buffer, geom_cache->emissiveFaceBufferView.offset, geom_cache->emissiveFaceBufferView.size });
+    buffers.push_back({ Rp::BINDING_INDEX_EMISSIVE_INSTANCES, 0, geom_cache->buffer, geom_cache->emissiveInstanceBufferView.offset, geom_cache->emissiveInstanceBufferView.size });
+    buffers.push_back({ Rp::BINDING_INDEX_LIGHT_TREE_NODES, 0, geom_cache->buffer, geom_cache->lightTreeNodeBufferView.offset, geom_cache->lightTreeNodeBufferView.size });
+  }
   buffers.push_back({ Rp::BINDING_INDEX_VERTICES, 0, geom_cache->buffer, geom_cache->vertexBufferView.offset, geom_cache->vertexBufferView.size });
+  if (shader_cache->sphereLightsEnabled)
+  {
+    buffers.push_back({ Rp::BINDING_INDEX_SPHERE_LIGHTS, 0, scene->sphereLightBuffer, 0, scene->sphereLightCount * sizeof(Rp::SphereLight) });
+  }
+  if (shader_cache->restir)
+  {
+    buffers.push_back({ Rp::BINDING_INDEX_RESTIR_RESERVOIRS_PREV, 0, s_reservoirBuffers[s_reservoirBufferIndex ^ 1], 0, s_reservoirBufferSize });
+    buffers.push_back({ Rp::BINDING_INDEX_RESTIR_RESERVOIRS, 0, s_reservoirBuffers[s_reservoirBufferIndex], 0, s_reservoirBufferSize });
+  }
+  if (shader_cache->adaptiveSampling)
+  {
+    buffers.push_back({ Rp::BINDING_INDEX_ACTIVE_PIXELS, 0, s_activePixelBuffer, 0, uint64_t(adaptiveSamplingPixelCount) * sizeof(uint32_t) });
+    buffers.push_back({ Rp::BINDING_INDEX_PIXEL_STATS, 0, s_pixelStatsBuffer, 0, uint64_t(adaptiveSamplingPixelCount) * sizeof(Rp::PixelStats) });
+  }
+  if (shader_cache->pathGuiding)
+  {
+    buffers.push_back({ Rp::BINDING_INDEX_GUIDING_SPATIAL_NODES, 0, s_guidingSpatialNodeBuffer, 0, s_guidingSpatialNodeBufferSize });
+    buffers.push_back({ Rp::BINDING_INDEX_GUIDING_DIRECTIONAL_NODES, 0, s_guidingDirectionalNodeBuffer, 0, s_guidingDirectionalNodeBufferSize });
+    buffers.push_back({ Rp::BINDING_INDEX_GUIDING_RECORDS, 0, s_guidingRecordBuffer, 0, GUIDING_RECORD_BUFFER_SIZE });
+  }
 
   bool domeLightEnabled = bool(scene->domeLight);
-  size_t imageCount = shader_cache->images2d.size() + shader_cache->images3d.size() + int(domeLightEnabled);
+  if (domeLightEnabled)
+  {
+    uint64_t aliasTableSize = uint64_t(Rp::DOME_LIGHT_SAMPLING_WIDTH) * Rp::DOME_LIGHT_SAMPLING_HEIGHT * sizeof(Rp::AliasEntry);
+    buffers.push_back({ Rp::BINDING_INDEX_DOME_LIGHT_ALIAS_TABLE, 0, scene->domeLightAliasTable, 0, aliasTableSize });
+  }
+
+  gi::VirtualTexSys* vtSys = shader_cache->vtSys.get();
+  if (vtSys)
+  {
+    buffers.push_back({ Rp::BINDING_INDEX_VT_PAGE_TABLE, 0, vtSys->getPageTableBuffer(), 0, vtSys->getPageTableByteSize() });
+    buffers.push_back({ Rp::BINDING_INDEX_VT_FEEDBACK, 0, vtSys->getFeedbackBuffer(), 0, vtSys->getFeedbackByteSize() });
+  }
+
+  size_t imageCount = shader_cache->images2d.size() + shader_cache->images3d.size() + int(domeLightEnabled) + int(bool(vtSys));
 
   std::vector<CgpuImageBinding> images;
   images.reserve(imageCount);
@@ -1157,6 +1970,10 @@ int giRender(const GiRenderParams* params, float* rgbaImg)
   {
     images.push_back({ Rp::BINDING_INDEX_TEXTURES_3D, i, shader_cache->images3d[i] });
   }
+  if (vtSys)
+  {
+    images.push_back({ Rp::BINDING_INDEX_VT_TILE_POOL, 0, vtSys->getTilePool() });
+  }
 
   CgpuTlasBinding as = { Rp::BINDING_INDEX_SCENE_AS, 0, geom_cache->tlas };
 
@@ -1180,6 +1997,9 @@ int giRender(const GiRenderParams* params, float* rgbaImg)
   if (!cgpuCmdTransitionShaderImageLayouts(command_buffer, shader_cache->rgenShader, images.size(), images.data()))
     goto cleanup;
 
+  if (vtSys && !vtSys->recordFeedbackReset(command_buffer))
+    goto cleanup;
+
   if (!cgpuCmdUpdateBindings(command_buffer, shader_cache->pipeline, &bindings))
     goto cleanup;
 
@@ -1196,25 +2016,58 @@ int giRender(const GiRenderParams* params, float* rgbaImg)
       goto cleanup;
   }
 
-  if (!cgpuCmdTraceRays(command_buffer, shader_cache->pipeline, params->imageWidth, params->imageHeight))
-    goto cleanup;
+  // Active pixels are laid out in rows of the image width.
+  {
+    uint32_t launchHeight = params->imageHeight;
+    if (shader_cache->adaptiveSampling)
+    {
+      launchHeight = (uint32_t(s_activePixels.size()) + params->imageWidth - 1) / params->imageWidth;
+    }
+
+    if (launchHeight > 0 && !cgpuCmdTraceRays(command_buffer, shader_cache->pipeline, params->imageWidth, launchHeight))
+      goto cleanup;
+  }
 
   // Copy output buffer to staging buffer.
   {
-    CgpuBufferMemoryBarrier barrier;
-    barrier.srcAccessFlags = CGPU_MEMORY_ACCESS_FLAG_SHADER_WRITE;
-    barrier.dstAccessFlags = CGPU_MEMORY_ACCESS_FLAG_TRANSFER_READ;
-    barrier.buffer = s_outputBuffer;
-    barrier.offset = 0;
-    barrier.size = CGPU_WHOLE_SIZE;
+    CgpuBufferMemoryBarrier barriers[3];
+    for (uint32_t i = 0; i < 3; i++)
+    {
+      barriers[i].srcAccessFlags = CGPU_MEMORY_ACCESS_FLAG_SHADER_WRITE;
+      barriers[i].dstAccessFlags = CGPU_MEMORY_ACCESS_FLAG_TRANSFER_READ;
+      barriers[i].offset = 0;
+      barriers[i].size = CGPU_WHOLE_SIZE;
+    }
 
-    if (!cgpuCmdPipelineBarrier(command_buffer, 0, nullptr, 1, &barrier, 0, nullptr))
+    uint32_t barrierCount = 0;
+    barriers[barrierCount++].buffer = s_outputBuffer;
+    if (shader_cache->adaptiveSampling)
+    {
+      barriers[barrierCount++].buffer = s_pixelStatsBuffer;
+    }
+    if (shader_cache->pathGuiding)
+    {
+      barriers[barrierCount++].buffer = s_guidingRecordBuffer;
+    }
+
+    if (!cgpuCmdPipelineBarrier(command_buffer, 0, nullptr, barrierCount, barriers, 0, nullptr))
       goto cleanup;
   }
 
   if (!cgpuCmdCopyBuffer(command_buffer, s_outputBuffer, 0, s_outputStagingBuffer, 0, outputBufferSize))
     goto cleanup;
 
+  if (shader_cache->adaptiveSampling &&
+      !cgpuCmdCopyBuffer(command_buffer, s_pixelStatsBuffer, 0, s_pixelStatsStagingBuffer, 0, uint64_t(adaptiveSamplingPixelCount) * sizeof(Rp::PixelStats)))
+    goto cleanup;
+
+  if (shader_cache->pathGuiding &&
+      !cgpuCmdCopyBuffer(command_buffer, s_guidingRecordBuffer, 0, s_guidingRecordStagingBuffer, 0, GUIDING_RECORD_BUFFER_SIZE))
+    goto cleanup;
+
+  if (vtSys && !vtSys->recordFeedbackReadback(command_buffer))
+    goto cleanup;
+
   // Submit command buffer.
   if (!cgpuEndCommandBuffer(command_buffer))
     goto cleanup;
@@ -1244,6 +2097,33 @@ int giRender(const GiRenderParams* params, float* rgbaImg)
   if (!cgpuUnmapBuffer(s_device, s_outputStagingBuffer))
     goto cleanup;
 
+  // Determine the pixels of the next pass.
+  if (shader_cache->adaptiveSampling)
+  {
+    Rp::PixelStats* mappedStats;
+    if (!cgpuMapBuffer(s_device, s_pixelStatsStagingBuffer, (void**) &mappedStats))
+      goto cleanup;
+
+    updateActivePixels(mappedStats, params->adaptiveSamplingErrorThreshold, params->adaptiveSamplingMaxSpp, s_activePixels);
+
+    if (!cgpuUnmapBuffer(s_device, s_pixelStatsStagingBuffer))
+      goto cleanup;
+  }
+
+  // Learn the guiding field from the path vertices of this pass.
+  if (shader_cache->pathGuiding)
+  {
+    uint8_t* mappedRecords;
+    if (!cgpuMapBuffer(s_device, s_guidingRecordStagingBuffer, (void**) &mappedRecords))
+      goto cleanup;
+
+    bool updated = _giUpdateGuidingField((const Rp::GuidingRecordHeader*) mappedRecords,
+                                         (const Rp::GuidingRecord*) &mappedRecords[sizeof(Rp::GuidingRecordHeader)]);
+
+    if (!cgpuUnmapBuffer(s_device, s_guidingRecordStagingBuffer) || !updated)
+      goto cleanup;
+  }
+
   // Normalize debug AOV heatmaps.
   if (shader_cache->aovId == GI_AOV_ID_DEBUG_CLOCK_CYCLES)
   {
@@ -1263,6 +2143,14 @@ int giRender(const GiRenderParams* params, float* rgbaImg)
   }
 
   s_sampleOffset += params->spp;
+  s_reservoirBufferIndex ^= 1;
+
+  // Stream the tiles requested by this pass. They are uploaded with the next one, which
+  // restarts accumulation so that samples of lower-resolution fallbacks don't persist.
+  if (vtSys && vtSys->update())
+  {
+    s_sampleOffset = 0;
+  }
 
   result = GI_OK;
 
@@ -1275,26 +2163,38 @@ cleanup:
 
 GiScene* giCreateScene()
 {
-  return new GiScene;
+  return new GiScene();
 }
 
 void giDestroyScene(GiScene* scene)
 {
   if (scene->domeLight)
   {
-    s_texSys->evictAndDestroyCachedImage(scene->domeLightTexture);
+    s_texSys->releaseImage(scene->domeLightTexture);
     scene->domeLightTexture.handle = 0;
   }
+  if (scene->domeLightAliasTable.handle)
+  {
+    cgpuDestroyBuffer(s_device, scene->domeLightAliasTable);
+    scene->domeLightAliasTable.handle = 0;
+  }
+  if (scene->sphereLightBuffer.handle)
+  {
+    cgpuDestroyBuffer(s_device, scene->sphereLightBuffer);
+    scene->sphereLightBuffer.handle = 0;
+  }
   delete scene;
 }
 
 GiSphereLight* giCreateSphereLight(GiScene* scene)
 {
   auto light = new GiSphereLight;
+  light->scene = scene;
   {
     std::lock_guard guard(scene->mutex);
     scene->lights.insert(light);
   }
+  scene->sphereLightsDirty = true;
   return light;
 }
 
@@ -1304,12 +2204,26 @@ void giDestroySphereLight(GiScene* scene, GiSphereLight* light)
     std::lock_guard guard(scene->mutex);
     scene->lights.erase(light);
   }
+  scene->sphereLightsDirty = true;
   delete light;
 }
 
 void giSetSphereLightPosition(GiSphereLight* light, float* pos)
 {
   light->position = glm::make_vec3(pos);
+  light->scene->sphereLightsDirty = true;
+}
+
+void giSetSphereLightRadius(GiSphereLight* light, float radius)
+{
+  light->radius = radius;
+  light->scene->sphereLightsDirty = true;
+}
+
+void giSetSphereLightRadiance(GiSphereLight* light, float* radiance)
+{
+  light->radiance = glm::make_vec3(radiance);
+  light->scene->sphereLightsDirty = true;
 }
 
 GiDomeLight* giCreateDomeLight(GiScene* scene, const char* filePath)
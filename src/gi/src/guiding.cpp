@@ -0,0 +1,350 @@
+//
+// Copyright (C) 2019-2022 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+#include "guiding.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+
+namespace Rp = gtl::shader_interface::rp_main;
+
+const float PI = 3.14159265358979323846f;
+
+namespace detail
+{
+  // Directions are mapped to the unit square with the equal-area cylindrical projection,
+  // so that densities per steradian are those of the square divided by 4 PI.
+  glm::vec2 directionToSquare(const glm::vec3& direction)
+  {
+    float cosTheta = std::clamp(direction.z, -1.0f, 1.0f);
+    float phi = atan2f(direction.y, direction.x);
+    if (phi < 0.0f)
+    {
+      phi += 2.0f * PI;
+    }
+    return glm::min(glm::vec2(cosTheta * 0.5f + 0.5f, phi / (2.0f * PI)), glm::vec2(1.0f - FLT_EPSILON));
+  }
+
+  uint32_t quadrantIndex(const glm::vec2& p)
+  {
+    return uint32_t(p.x >= 0.5f) | (uint32_t(p.y >= 0.5f) << 1);
+  }
+
+  float totalEnergy(const Rp::GuidingDirectionalNode& node)
+  {
+    return node.energies[0] + node.energies[1] + node.energies[2] + node.energies[3];
+  }
+
+  // Energies of inner nodes are the sums of their subtrees.
+  void splatEnergy(std::vector<Rp::GuidingDirectionalNode>& tree, glm::vec2 p, float energy)
+  {
+    uint32_t nodeIndex = 0;
+    while (true)
+    {
+      Rp::GuidingDirectionalNode& node = tree[nodeIndex];
+      uint32_t q = quadrantIndex(p);
+      node.energies[q] += energy;
+
+      if (node.children[q] == 0)
+      {
+        break;
+      }
+
+      p = p * 2.0f - glm::vec2(float(q & 1), float(q >> 1));
+      nodeIndex = node.children[q];
+    }
+  }
+
+  float treePdf(const std::vector<Rp::GuidingDirectionalNode>& tree, glm::vec2 p)
+  {
+    float pdf = 1.0f / (4.0f * PI);
+
+    uint32_t nodeIndex = 0;
+    while (true)
+    {
+      const Rp::GuidingDirectionalNode& node = tree[nodeIndex];
+      float total = totalEnergy(node);
+      if (total <= 0.0f)
+      {
+        return 0.0f;
+      }
+
+      uint32_t q = quadrantIndex(p);
+      pdf *= 4.0f * node.energies[q] / total;
+
+      if (node.children[q] == 0 || pdf <= 0.0f)
+      {
+        return pdf;
+      }
+
+      p = p * 2.0f - glm::vec2(float(q & 1), float(q >> 1));
+      nodeIndex = node.children[q];
+    }
+  }
+
+  // Subdivides the quadrants that hold more than the given fraction of the energy and collapses
+  // the others. Quadrants that are newly subdivided distribute their energy evenly. The
+  // resulting tree has no energy.
+  std::vector<Rp::GuidingDirectionalNode> rebuildTree(const std::vector<Rp::GuidingDirectionalNode>& tree,
+                                                      float splitFraction,
+                                                      uint32_t maxDepth)
+  {
+    struct StackEntry
+    {
+      uint32_t nodeIndex;
+      uint32_t srcNodeIndex; // UINT32_MAX if the source is a leaf
+      float srcEnergy; // of the source quadrant
+      uint32_t depth;
+    };
+
+    std::vector<Rp::GuidingDirectionalNode> result(1);
+
+    float total = totalEnergy(tree[0]);
+    if (total <= 0.0f)
+    {
+      return result;
+    }
+
+    std::vector<StackEntry> stack;
+    stack.push_back(StackEntry{ .nodeIndex = 0, .srcNodeIndex = 0, .srcEnergy = total, .depth = 1 });
+
+    while (!stack.empty())
+    {
+      StackEntry entry = stack.back();
+      stack.pop_back();
+
+      if (entry.depth >= maxDepth)
+      {
+        continue;
+      }
+
+      for (uint32_t q = 0; q < 4; q++)
+      {
+        bool hasSrcNode = entry.srcNodeIndex != UINT32_MAX;
+        float energy = hasSrcNode ? tree[entry.srcNodeIndex].energies[q] : (entry.srcEnergy * 0.25f);
+
+        if (energy / total <= splitFraction)
+        {
+          continue;
+        }
+
+        uint32_t childIndex = uint32_t(result.size());
+        result.push_back(Rp::GuidingDirectionalNode{});
+        result[entry.nodeIndex].children[q] = childIndex;
+
+        uint32_t srcChildIndex = hasSrcNode ? tree[entry.srcNodeIndex].children[q] : 0;
+
+        stack.push_back(StackEntry{
+          .nodeIndex = childIndex,
+          .srcNodeIndex = (srcChildIndex != 0) ? srcChildIndex : UINT32_MAX,
+          .srcEnergy = energy,
+          .depth = entry.depth + 1
+        });
+      }
+    }
+
+    return result;
+  }
+}
+
+namespace gi
+{
+  GuidingField::GuidingField(const InitParams& params)
+    : m_params(params)
+    , m_boundsMin(FLT_MAX)
+    , m_boundsMax(-FLT_MAX)
+  {
+    m_spatialNodes.push_back(SpatialNode{ .axis = Rp::GUIDING_SPATIAL_LEAF, .index = 0, .split = 0.0f });
+    m_spatialLeaves.push_back(SpatialLeaf{
+      .samplingTree = DirectionalTree(1),
+      .buildingTree = DirectionalTree(1),
+      .recordCount = 0
+    });
+  }
+
+  void GuidingField::addRecords(const Rp::GuidingRecord* records, size_t count)
+  {
+    for (size_t i = 0; i < count; i++)
+    {
+      const Rp::GuidingRecord& record = records[i];
+
+      if (!(record.pdf > 0.0f) || !isfinite(record.radiance) || record.radiance < 0.0f ||
+          glm::any(glm::isnan(record.position)) || glm::any(glm::isinf(record.position)))
+      {
+        continue;
+      }
+
+      if (m_iterationCount == 0)
+      {
+        m_boundsMin = glm::min(m_boundsMin, record.position);
+        m_boundsMax = glm::max(m_boundsMax, record.position);
+      }
+
+      SpatialLeaf& leaf = m_spatialLeaves[findLeaf(record.position)];
+      leaf.recordCount++;
+
+      // Monte Carlo estimate of the radiance integrated over the quadrant.
+      float energy = record.radiance / record.pdf;
+      if (energy > 0.0f && isfinite(energy))
+      {
+        detail::splatEnergy(leaf.buildingTree, detail::directionToSquare(record.direction), energy);
+      }
+    }
+  }
+
+  void GuidingField::refine(uint32_t passCount)
+  {
+    if (m_boundsMin.x <= m_boundsMax.x)
+    {
+      splitSpatialLeaves(passCount);
+    }
+
+    for (SpatialLeaf& leaf : m_spatialLeaves)
+    {
+      leaf.samplingTree = std::move(leaf.buildingTree);
+      leaf.buildingTree = detail::rebuildTree(leaf.samplingTree, m_params.directionalSplitFraction, m_params.maxDirectionalDepth);
+      leaf.recordCount = 0;
+    }
+
+    m_iterationCount++;
+  }
+
+  uint32_t GuidingField::getIterationCount() const
+  {
+    return m_iterationCount;
+  }
+
+  float GuidingField::pdf(const glm::vec3& position, const glm::vec3& direction) const
+  {
+    const SpatialLeaf& leaf = m_spatialLeaves[findLeaf(position)];
+
+    return detail::treePdf(leaf.samplingTree, detail::directionToSquare(direction));
+  }
+
+  void GuidingField::exportNodes(std::vector<Rp::GuidingSpatialNode>& spatialNodes,
+                                 std::vector<Rp::GuidingDirectionalNode>& directionalNodes) const
+  {
+    std::vector<uint32_t> rootIndices;
+    rootIndices.reserve(m_spatialLeaves.size());
+
+    directionalNodes.clear();
+    for (const SpatialLeaf& leaf : m_spatialLeaves)
+    {
+      uint32_t rootIndex = uint32_t(directionalNodes.size());
+      rootIndices.push_back(rootIndex);
+
+      for (Rp::GuidingDirectionalNode node : leaf.samplingTree)
+      {
+        for (uint32_t& child : node.children)
+        {
+          child = (child != 0) ? (child + rootIndex) : 0;
+        }
+        directionalNodes.push_back(node);
+      }
+    }
+
+    spatialNodes.clear();
+    spatialNodes.reserve(m_spatialNodes.size());
+    for (const SpatialNode& node : m_spatialNodes)
+    {
+      bool isLeaf = (node.axis == Rp::GUIDING_SPATIAL_LEAF);
+
+      spatialNodes.push_back(Rp::GuidingSpatialNode{
+        .axis = node.axis,
+        .index = isLeaf ? rootIndices[node.index] : node.index,
+        .split = node.split
+      });
+    }
+  }
+
+  uint32_t GuidingField::findLeaf(const glm::vec3& position) const
+  {
+    uint32_t nodeIndex = 0;
+    while (m_spatialNodes[nodeIndex].axis != Rp::GUIDING_SPATIAL_LEAF)
+    {
+      const SpatialNode& node = m_spatialNodes[nodeIndex];
+      nodeIndex = node.index + ((position[node.axis] < node.split) ? 0 : 1);
+    }
+    return m_spatialNodes[nodeIndex].index;
+  }
+
+  // Leaves are halved at their center along the axis of their depth while they have received
+  // too many records. Since the record count grows with the iteration length, the threshold
+  // grows with its square root, which balances spatial and directional resolution.
+  void GuidingField::splitSpatialLeaves(uint32_t passCount)
+  {
+    struct StackEntry
+    {
+      uint32_t nodeIndex;
+      glm::vec3 boundsMin;
+      glm::vec3 boundsMax;
+      uint32_t depth;
+    };
+
+    float threshold = m_params.spatialSplitThreshold * sqrtf(float(passCount));
+
+    std::vector<StackEntry> stack;
+    stack.push_back(StackEntry{ .nodeIndex = 0, .boundsMin = m_boundsMin, .boundsMax = m_boundsMax, .depth = 0 });
+
+    while (!stack.empty())
+    {
+      StackEntry entry = stack.back();
+      stack.pop_back();
+
+      uint32_t axis = entry.depth % 3;
+      float split = (entry.boundsMin[axis] + entry.boundsMax[axis]) * 0.5f;
+
+      glm::vec3 childBoundsMax = entry.boundsMax;
+      childBoundsMax[axis] = split;
+      glm::vec3 childBoundsMin = entry.boundsMin;
+      childBoundsMin[axis] = split;
+
+      if (m_spatialNodes[entry.nodeIndex].axis != Rp::GUIDING_SPATIAL_LEAF)
+      {
+        uint32_t childIndex = m_spatialNodes[entry.nodeIndex].index;
+        stack.push_back(StackEntry{ .nodeIndex = childIndex, .boundsMin = entry.boundsMin, .boundsMax = childBoundsMax, .depth = entry.depth + 1 });
+        stack.push_back(StackEntry{ .nodeIndex = childIndex + 1, .boundsMin = childBoundsMin, .boundsMax = entry.boundsMax, .depth = entry.depth + 1 });
+        continue;
+      }
+
+      uint32_t leafIndex = m_spatialNodes[entry.nodeIndex].index;
+      if (float(m_spatialLeaves[leafIndex].recordCount) <= threshold)
+      {
+        continue;
+      }
+
+      // The records are assumed to be distributed evenly among the children, which start
+      // with the distributions of their parent.
+      SpatialLeaf& leaf = m_spatialLeaves[leafIndex];
+      leaf.recordCount /= 2;
+
+      uint32_t newLeafIndex = uint32_t(m_spatialLeaves.size());
+      m_spatialLeaves.push_back(m_spatialLeaves[leafIndex]);
+
+      uint32_t childIndex = uint32_t(m_spatialNodes.size());
+      m_spatialNodes.push_back(SpatialNode{ .axis = Rp::GUIDING_SPATIAL_LEAF, .index = leafIndex, .split = 0.0f });
+      m_spatialNodes.push_back(SpatialNode{ .axis = Rp::GUIDING_SPATIAL_LEAF, .index = newLeafIndex, .split = 0.0f });
+      m_spatialNodes[entry.nodeIndex] = SpatialNode{ .axis = axis, .index = childIndex, .split = split };
+
+      stack.push_back(StackEntry{ .nodeIndex = childIndex, .boundsMin = entry.boundsMin, .boundsMax = childBoundsMax, .depth = entry.depth + 1 });
+      stack.push_back(StackEntry{ .nodeIndex = childIndex + 1, .boundsMin = childBoundsMin, .boundsMax = entry.boundsMax, .depth = entry.depth + 1 });
+    }
+  }
+}
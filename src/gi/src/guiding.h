@@ -0,0 +1,96 @@
+//
+// Copyright (C) 2019-2022 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "interface/rp_main.h"
+
+namespace gi
+{
+  // Learns the distribution of incident radiance from path vertex records for path guiding,
+  // following "Practical Path Guiding for Efficient Light-Transport Simulation" (Müller et al. 2017).
+  // A binary tree subdivides space; each of its leaves holds a directional quadtree that is
+  // sampled during the current iteration, and one that accumulates the records of it.
+  // Both trees are adapted to the recorded distribution at the end of an iteration.
+  class GuidingField
+  {
+  public:
+    struct InitParams
+    {
+      float directionalSplitFraction; // of the tree's energy beyond which a quadrant is subdivided
+      uint32_t maxDirectionalDepth;
+      float spatialSplitThreshold; // record count of a leaf, scaled by the root of the iteration length
+    };
+
+  public:
+    explicit GuidingField(const InitParams& params);
+
+  public:
+    // Accumulates the records into the directional trees of the current iteration.
+    void addRecords(const gtl::shader_interface::rp_main::GuidingRecord* records, size_t count);
+
+    // Ends the current iteration, which spanned the given number of passes. Its records
+    // become the sampling distribution and determine the subdivision of the next iteration.
+    void refine(uint32_t passCount);
+
+    uint32_t getIterationCount() const;
+
+    // Per steradian, 0 if there is no radiance to guide towards at the position.
+    float pdf(const glm::vec3& position, const glm::vec3& direction) const;
+
+    // Flattens the sampling trees into the layout of the shader. The directional root of each
+    // spatial leaf follows the nodes of the previous leaf's tree.
+    void exportNodes(std::vector<gtl::shader_interface::rp_main::GuidingSpatialNode>& spatialNodes,
+                     std::vector<gtl::shader_interface::rp_main::GuidingDirectionalNode>& directionalNodes) const;
+
+  private:
+    using DirectionalTree = std::vector<gtl::shader_interface::rp_main::GuidingDirectionalNode>; // root first
+
+    struct SpatialNode
+    {
+      uint32_t axis; // GUIDING_SPATIAL_LEAF for leaves
+      uint32_t index; // of the first of two adjacent children, or of the leaf
+      float split;
+    };
+
+    struct SpatialLeaf
+    {
+      DirectionalTree samplingTree;
+      DirectionalTree buildingTree;
+      uint32_t recordCount; // of the current iteration
+    };
+
+  private:
+    uint32_t findLeaf(const glm::vec3& position) const;
+
+    void splitSpatialLeaves(uint32_t passCount);
+
+  private:
+    InitParams m_params;
+    uint32_t m_iterationCount = 0;
+    // Spatial subdivision starts at the bounds of the records of the first iteration.
+    glm::vec3 m_boundsMin;
+    glm::vec3 m_boundsMax;
+    std::vector<SpatialNode> m_spatialNodes;
+    std::vector<SpatialLeaf> m_spatialLeaves;
+  };
+}
@@ -0,0 +1,352 @@
+//
+// Copyright (C) 2019-2022 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "lightsampling.h"
+
+#include <imgio.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+namespace Rp = gtl::shader_interface::rp_main;
+
+const float PI = 3.14159265358979323846f;
+
+namespace detail
+{
+  float readLuminance(const imgio_img& img, size_t texelIndex)
+  {
+    glm::vec3 rgb;
+
+    switch (img.format)
+    {
+    case IMGIO_FORMAT_RGBA8_UNORM: {
+      uint32_t u;
+      memcpy(&u, &img.data[texelIndex * sizeof(u)], sizeof(u));
+      rgb = glm::vec3(glm::unpackUnorm4x8(u));
+      break;
+    }
+    case IMGIO_FORMAT_RGBA16_FLOAT: {
+      uint64_t h;
+      memcpy(&h, &img.data[texelIndex * sizeof(h)], sizeof(h));
+      rgb = glm::vec3(glm::unpackHalf4x16(h));
+      break;
+    }
+    case IMGIO_FORMAT_RGBA32_FLOAT: {
+      const float* f = &((const float*) img.data)[texelIndex * 4];
+      rgb = glm::vec3(f[0], f[1], f[2]);
+      break;
+    }
+    case IMGIO_FORMAT_R8_UNORM:
+      return img.data[texelIndex] / 255.0f;
+    case IMGIO_FORMAT_RG8_UNORM:
+      return img.data[texelIndex * 2] / 255.0f;
+    case IMGIO_FORMAT_R16_UNORM: {
+      uint16_t u;
+      memcpy(&u, &img.data[texelIndex * sizeof(u)], sizeof(u));
+      return glm::unpackUnorm1x16(u);
+    }
+    case IMGIO_FORMAT_R16_FLOAT: {
+      uint16_t h;
+      memcpy(&h, &img.data[texelIndex * sizeof(h)], sizeof(h));
+      return glm::unpackHalf1x16(h);
+    }
+    default:
+      return 0.0f;
+    }
+
+    return glm::dot(rgb, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+  }
+
+  struct LightCone
+  {
+    glm::vec3 axis;
+    float theta; // PI if unbounded
+  };
+
+  // Conty Estevez and Kulla. 2018. Importance Sampling of Many Lights with Adaptive Tree Splitting.
+  LightCone mergeLightCones(LightCone a, LightCone b)
+  {
+    if (b.theta > a.theta)
+    {
+      std::swap(a, b);
+    }
+
+    float thetaD = acosf(std::clamp(glm::dot(a.axis, b.axis), -1.0f, 1.0f));
+    if (std::min(thetaD + b.theta, PI) <= a.theta)
+    {
+      return a;
+    }
+
+    float theta = (a.theta + thetaD + b.theta) * 0.5f;
+    if (theta >= PI)
+    {
+      return LightCone{ .axis = a.axis, .theta = PI };
+    }
+
+    glm::vec3 k = glm::cross(a.axis, b.axis);
+    float kLen = glm::length(k);
+    if (kLen < 1e-6f)
+    {
+      return LightCone{ .axis = a.axis, .theta = PI };
+    }
+    k /= kLen;
+
+    // Rotate the axis towards the other one. The rotation axis is orthogonal to it.
+    float thetaR = theta - a.theta;
+    glm::vec3 axis = a.axis * cosf(thetaR) + glm::cross(k, a.axis) * sinf(thetaR);
+
+    return LightCone{ .axis = glm::normalize(axis), .theta = theta };
+  }
+
+  struct LightTreeBuildContext
+  {
+    const std::vector<float>& powers;
+    std::vector<Rp::EmissiveFace>& faces;
+    std::vector<Rp::LightTreeNode>& nodes;
+    std::vector<LightCone> cones; // per node
+    std::vector<glm::vec3> centroids; // per face
+  };
+
+  void buildLightTreeNode(LightTreeBuildContext& ctx, uint32_t* faceIndices, uint32_t faceCount,
+                          uint32_t nodeIndex, uint32_t depth, uint32_t bits)
+  {
+    if (faceCount == 1)
+    {
+      uint32_t faceIndex = faceIndices[0];
+      Rp::EmissiveFace& face = ctx.faces[faceIndex];
+      face.lightTreeBits = bits;
+
+      glm::vec3 n = glm::cross(face.p1 - face.p0, face.p2 - face.p0);
+      float nLen = glm::length(n);
+
+      // Degenerate faces have no power and therefore never influence the cones.
+      LightCone cone{ .axis = (nLen > 0.0f) ? (n / nLen) : glm::vec3(0.0f, 0.0f, 1.0f), .theta = 0.0f };
+      ctx.cones[nodeIndex] = cone;
+
+      ctx.nodes[nodeIndex] = Rp::LightTreeNode{
+        .boundsMin = glm::min(face.p0, glm::min(face.p1, face.p2)),
+        .power = ctx.powers[faceIndex],
+        .boundsMax = glm::max(face.p0, glm::max(face.p1, face.p2)),
+        .index = faceIndex | Rp::LIGHT_TREE_LEAF_BIT,
+        .coneAxis = cone.axis,
+        .coneCosTheta = 1.0f
+      };
+      return;
+    }
+
+    // Split at the median centroid along the axis of largest extent.
+    glm::vec3 centroidMin(FLT_MAX);
+    glm::vec3 centroidMax(-FLT_MAX);
+    for (uint32_t i = 0; i < faceCount; i++)
+    {
+      centroidMin = glm::min(centroidMin, ctx.centroids[faceIndices[i]]);
+      centroidMax = glm::max(centroidMax, ctx.centroids[faceIndices[i]]);
+    }
+
+    glm::vec3 extent = centroidMax - centroidMin;
+    int axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : ((extent.y > extent.z) ? 1 : 2);
+
+    uint32_t half = faceCount / 2;
+    std::nth_element(faceIndices, faceIndices + half, faceIndices + faceCount, [&](uint32_t a, uint32_t b) {
+      return ctx.centroids[a][axis] < ctx.centroids[b][axis];
+    });
+
+    uint32_t childIndex = uint32_t(ctx.nodes.size());
+    ctx.nodes.resize(ctx.nodes.size() + 2);
+    ctx.cones.resize(ctx.nodes.size());
+
+    buildLightTreeNode(ctx, faceIndices, half, childIndex, depth + 1, bits);
+    buildLightTreeNode(ctx, faceIndices + half, faceCount - half, childIndex + 1, depth + 1, bits | (1u << depth));
+
+    const Rp::LightTreeNode& c0 = ctx.nodes[childIndex];
+    const Rp::LightTreeNode& c1 = ctx.nodes[childIndex + 1];
+
+    // Children without power must not widen the cone.
+    LightCone cone;
+    if (c0.power <= 0.0f)
+    {
+      cone = ctx.cones[childIndex + 1];
+    }
+    else if (c1.power <= 0.0f)
+    {
+      cone = ctx.cones[childIndex];
+    }
+    else
+    {
+      cone = mergeLightCones(ctx.cones[childIndex], ctx.cones[childIndex + 1]);
+    }
+    ctx.cones[nodeIndex] = cone;
+
+    ctx.nodes[nodeIndex] = Rp::LightTreeNode{
+      .boundsMin = glm::min(c0.boundsMin, c1.boundsMin),
+      .power = c0.power + c1.power,
+      .boundsMax = glm::max(c0.boundsMax, c1.boundsMax),
+      .index = childIndex,
+      .coneAxis = cone.axis,
+      .coneCosTheta = cosf(cone.theta)
+    };
+  }
+}
+
+namespace gi
+{
+  bool buildAliasTable(const std::vector<float>& weights, std::vector<Rp::AliasEntry>& table)
+  {
+    size_t count = weights.size();
+    table.resize(count);
+
+    double weightSum = 0.0;
+    for (float w : weights)
+    {
+      weightSum += w;
+    }
+
+    if (weightSum <= 0.0 || !isfinite(weightSum))
+    {
+      for (size_t i = 0; i < count; i++)
+      {
+        table[i] = { .prob = 1.0f, .alias = uint32_t(i), .pdf = 1.0f };
+      }
+      return false;
+    }
+
+    // Probabilities are scaled to an average of one. Entries below one are filled up
+    // with an alias that has excess probability.
+    std::vector<double> scaled(count);
+    std::vector<uint32_t> small;
+    std::vector<uint32_t> large;
+
+    for (size_t i = 0; i < count; i++)
+    {
+      scaled[i] = weights[i] * double(count) / weightSum;
+      table[i].pdf = float(scaled[i]);
+
+      (scaled[i] < 1.0 ? small : large).push_back(uint32_t(i));
+    }
+
+    while (!small.empty() && !large.empty())
+    {
+      uint32_t s = small.back();
+      small.pop_back();
+      uint32_t l = large.back();
+
+      table[s].prob = float(scaled[s]);
+      table[s].alias = l;
+
+      scaled[l] -= 1.0 - scaled[s];
+      if (scaled[l] < 1.0)
+      {
+        large.pop_back();
+        small.push_back(l);
+      }
+    }
+
+    // Remaining entries are one up to rounding errors.
+    for (uint32_t i : large)
+    {
+      table[i].prob = 1.0f;
+      table[i].alias = i;
+    }
+    for (uint32_t i : small)
+    {
+      table[i].prob = 1.0f;
+      table[i].alias = i;
+    }
+
+    return true;
+  }
+
+  bool buildDomeLightAliasTable(const imgio_img& img, std::vector<Rp::AliasEntry>& table)
+  {
+    const uint32_t width = Rp::DOME_LIGHT_SAMPLING_WIDTH;
+    const uint32_t height = Rp::DOME_LIGHT_SAMPLING_HEIGHT;
+
+    std::vector<float> weights(width * height, 1.0f);
+
+    if (img.width == 0 || img.height == 0 || imgio_is_block_compressed(img.format))
+    {
+      buildAliasTable(weights, table);
+      return false;
+    }
+
+    // Cells either average multiple texels or replicate one, matching nearest filtering.
+#pragma omp parallel for
+    for (int y = 0; y < int(height); y++)
+    {
+      uint32_t y0 = uint32_t(uint64_t(y) * img.height / height);
+      uint32_t y1 = std::max(y0 + 1, uint32_t(uint64_t(y + 1) * img.height / height));
+
+      // Rows towards the poles subtend less solid angle.
+      float sinTheta = sinf((y + 0.5f) / height * PI);
+
+      for (uint32_t x = 0; x < width; x++)
+      {
+        uint32_t x0 = uint32_t(uint64_t(x) * img.width / width);
+        uint32_t x1 = std::max(x0 + 1, uint32_t(uint64_t(x + 1) * img.width / width));
+
+        double luminanceSum = 0.0;
+        for (uint32_t ty = y0; ty < y1; ty++)
+        {
+          for (uint32_t tx = x0; tx < x1; tx++)
+          {
+            float luminance = detail::readLuminance(img, size_t(ty) * img.width + tx);
+
+            luminanceSum += isfinite(luminance) ? std::max(luminance, 0.0f) : 0.0f;
+          }
+        }
+
+        float avgLuminance = float(luminanceSum / ((y1 - y0) * (x1 - x0)));
+        weights[y * width + x] = avgLuminance * sinTheta;
+      }
+    }
+
+    return buildAliasTable(weights, table);
+  }
+
+  void buildLightTree(const std::vector<float>& powers,
+                      std::vector<Rp::EmissiveFace>& faces,
+                      std::vector<Rp::LightTreeNode>& nodes)
+  {
+    uint32_t faceCount = uint32_t(faces.size());
+    assert(faceCount > 0 && powers.size() == faceCount);
+
+    nodes.clear();
+    nodes.reserve(faceCount * 2 - 1);
+    nodes.resize(1);
+
+    detail::LightTreeBuildContext ctx{ .powers = powers, .faces = faces, .nodes = nodes };
+    ctx.cones.resize(1);
+    ctx.centroids.resize(faceCount);
+
+    std::vector<uint32_t> faceIndices(faceCount);
+    for (uint32_t i = 0; i < faceCount; i++)
+    {
+      const Rp::EmissiveFace& face = faces[i];
+      ctx.centroids[i] = (face.p0 + face.p1 + face.p2) * (1.0f / 3.0f);
+      faceIndices[i] = i;
+    }
+
+    detail::buildLightTreeNode(ctx, faceIndices.data(), faceCount, 0, 0, 0);
+  }
+}
@@ -0,0 +1,47 @@
+//
+// Copyright (C) 2019-2022 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <vector>
+
+#include <img.h>
+
+#include "interface/rp_main.h"
+
+namespace gi
+{
+  // Builds an alias table for constant-time sampling of a discrete distribution using
+  // Vose's method. Returns false if all weights are zero, in which case the table
+  // samples uniformly.
+  bool buildAliasTable(const std::vector<float>& weights,
+                       std::vector<gtl::shader_interface::rp_main::AliasEntry>& table);
+
+  // Builds the sampling distribution of an equirectangular dome light image. Cells are
+  // weighted by their average luminance and the solid angle they subtend. Returns false
+  // if the image can't be read, in which case the table samples uniformly.
+  bool buildDomeLightAliasTable(const imgio_img& img,
+                                std::vector<gtl::shader_interface::rp_main::AliasEntry>& table);
+
+  // Builds a bounding volume hierarchy over the emissive faces with a cone bounding the
+  // normals of each node, for sampling faces by their importance to a shading point.
+  // Faces are split at the median so that the path to each leaf fits into the
+  // lightTreeBits of the face. Power is given per face.
+  void buildLightTree(const std::vector<float>& powers,
+                      std::vector<gtl::shader_interface::rp_main::EmissiveFace>& faces,
+                      std::vector<gtl::shader_interface::rp_main::LightTreeNode>& nodes);
+}
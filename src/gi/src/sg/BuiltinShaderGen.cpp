@@ -0,0 +1,287 @@
+//
+// Copyright (C) 2023 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+#include "BuiltinShaderGen.h"
+
+#include "GlslSourceStitcher.h"
+
+#include <string.h>
+#include <assert.h>
+
+namespace gi::sg
+{
+  void appendCommonDefines(GlslSourceStitcher& stitcher, uint32_t texCount2d, uint32_t texCount3d, bool virtualTexturing)
+  {
+#if defined(NDEBUG) || defined(__APPLE__)
+    stitcher.appendDefine("NDEBUG");
+#endif
+
+    stitcher.appendDefine("TEXTURE_COUNT_2D", (int32_t) texCount2d);
+    stitcher.appendDefine("TEXTURE_COUNT_3D", (int32_t) texCount3d);
+
+    if (virtualTexturing)
+    {
+      stitcher.appendDefine("VIRTUAL_TEXTURING");
+    }
+  }
+
+  void _appendTextureCountDefines(GlslSourceStitcher& stitcher, uint32_t texCount2d, uint32_t texCount3d, bool virtualTexturing, bool texCountPlaceholders)
+  {
+    if (texCountPlaceholders)
+    {
+      texCount2d = (texCount2d > 0) ? TEXTURE_COUNT_2D_PLACEHOLDER : 0;
+      texCount3d = (texCount3d > 0) ? TEXTURE_COUNT_3D_PLACEHOLDER : 0;
+    }
+
+    appendCommonDefines(stitcher, texCount2d, texCount3d, virtualTexturing);
+  }
+
+  bool generateRgenGlsl(const fs::path& shaderPath,
+                        std::string_view fileName,
+                        const RaygenShaderParams& params,
+                        bool texCountPlaceholders,
+                        std::string& source)
+  {
+    GlslSourceStitcher stitcher;
+    stitcher.appendVersion();
+
+    if (params.shaderClockExts)
+    {
+      stitcher.appendRequiredExtension("GL_EXT_shader_explicit_arithmetic_types_int64");
+      stitcher.appendRequiredExtension("GL_ARB_shader_clock");
+    }
+    if (params.reorderInvocations)
+    {
+      stitcher.appendRequiredExtension("GL_NV_shader_invocation_reorder");
+      // For hit shader invocation reordering hint
+      stitcher.appendRequiredExtension("GL_EXT_buffer_reference");
+      stitcher.appendRequiredExtension("GL_EXT_buffer_reference_uvec2");
+
+      uint32_t reoderHintValueCount = params.materialCount + 1/* no hit */;
+      int32_t reorderHintBitCount = 0;
+
+      while (reoderHintValueCount >>= 1)
+      {
+        reorderHintBitCount++;
+      }
+
+      stitcher.appendDefine("REORDER_INVOCATIONS");
+      stitcher.appendDefine("REORDER_HINT_BIT_COUNT", reorderHintBitCount);
+    }
+
+    _appendTextureCountDefines(stitcher, params.texCount2d, params.texCount3d, params.virtualTexturing, texCountPlaceholders);
+
+    if (params.adaptiveSampling)
+    {
+      stitcher.appendDefine("ADAPTIVE_SAMPLING");
+    }
+    if (params.blueNoiseDither)
+    {
+      stitcher.appendDefine("BLUE_NOISE_DITHER");
+    }
+    if (params.domeLightEnabled)
+    {
+      stitcher.appendDefine("DOMELIGHT_ENABLED");
+    }
+    if (params.filterImportanceSampling)
+    {
+      stitcher.appendDefine("FILTER_IMPORTANCE_SAMPLING");
+    }
+    if (params.nextEventEstimation)
+    {
+      stitcher.appendDefine("NEXT_EVENT_ESTIMATION", params.aovId);
+    }
+    if (params.pathGuiding)
+    {
+      stitcher.appendDefine("PATH_GUIDING");
+    }
+    if (params.progressiveAccumulation)
+    {
+      stitcher.appendDefine("PROGRESSIVE_ACCUMULATION");
+    }
+    if (params.restir)
+    {
+      stitcher.appendDefine("RESTIR");
+      stitcher.appendDefine("RESTIR_SPATIAL_NEIGHBORS", int32_t(params.restirSpatialNeighbors));
+    }
+    if (params.sobolSampler)
+    {
+      stitcher.appendDefine("SOBOL_SAMPLER");
+    }
+    if (params.sphereLightsEnabled)
+    {
+      stitcher.appendDefine("SPHERE_LIGHTS");
+    }
+
+    stitcher.appendDefine("AOV_ID", params.aovId);
+
+    fs::path filePath = shaderPath / fileName;
+    if (!stitcher.appendSourceFile(filePath))
+    {
+      return false;
+    }
+
+    source = stitcher.source();
+    return true;
+  }
+
+  bool generateMissGlsl(const fs::path& shaderPath,
+                        std::string_view fileName,
+                        const MissShaderParams& params,
+                        bool texCountPlaceholders,
+                        std::string& source)
+  {
+    GlslSourceStitcher stitcher;
+    stitcher.appendVersion();
+
+    _appendTextureCountDefines(stitcher, params.texCount2d, params.texCount3d, params.virtualTexturing, texCountPlaceholders);
+
+    if (params.domeLightEnabled)
+    {
+      stitcher.appendDefine("DOMELIGHT_ENABLED");
+    }
+    if (params.domeLightCameraVisibility)
+    {
+      stitcher.appendDefine("DOMELIGHT_CAMERA_VISIBLE");
+    }
+    if (params.nextEventEstimation)
+    {
+      stitcher.appendDefine("NEXT_EVENT_ESTIMATION");
+    }
+    if (params.sphereLightsEnabled)
+    {
+      stitcher.appendDefine("SPHERE_LIGHTS");
+    }
+
+    fs::path filePath = shaderPath / fileName;
+    if (!stitcher.appendSourceFile(filePath))
+    {
+      return false;
+    }
+
+    source = stitcher.source();
+    return true;
+  }
+
+  uint64_t hashShaderSource(std::string_view source)
+  {
+    // 64-bit FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (char c : source)
+    {
+      hash ^= (uint8_t) c;
+      hash *= 0x100000001b3ull;
+    }
+    return hash;
+  }
+
+  void patchTextureCountPlaceholders(std::vector<uint8_t>& spv,
+                                     uint32_t binding2d, uint32_t texCount2d,
+                                     uint32_t binding3d, uint32_t texCount3d)
+  {
+    const uint32_t SPV_HEADER_WORD_COUNT = 5;
+    const uint32_t SPV_OP_TYPE_ARRAY = 28;
+    const uint32_t SPV_OP_TYPE_POINTER = 32;
+    const uint32_t SPV_OP_CONSTANT = 43;
+    const uint32_t SPV_OP_VARIABLE = 59;
+    const uint32_t SPV_OP_DECORATE = 71;
+    const uint32_t SPV_DECORATION_BINDING = 33;
+
+    uint32_t* words = (uint32_t*) spv.data();
+    size_t wordCount = spv.size() / sizeof(uint32_t);
+
+    auto forEachInstruction = [&](auto callback) {
+      for (size_t i = SPV_HEADER_WORD_COUNT; i < wordCount;)
+      {
+        uint32_t opcode = words[i] & 0xFFFFu;
+        uint32_t instrWordCount = words[i] >> 16;
+
+        if (instrWordCount == 0 || (i + instrWordCount) > wordCount)
+        {
+          break;
+        }
+
+        callback(opcode, instrWordCount, &words[i]);
+
+        i += instrWordCount;
+      }
+    };
+
+    // The placeholders may also be the value of unrelated constants. Only the length operands
+    // of the texture array types are patched, which we find by following the binding decorations:
+    // variable -> pointer type -> array type -> length constant.
+    uint32_t varId2d = 0, varId3d = 0;
+    forEachInstruction([&](uint32_t opcode, uint32_t instrWordCount, const uint32_t* instr) {
+      // OpDecorate: target id, decoration, literal
+      if (opcode == SPV_OP_DECORATE && instrWordCount == 4 && instr[2] == SPV_DECORATION_BINDING)
+      {
+        if (instr[3] == binding2d) varId2d = instr[1];
+        if (instr[3] == binding3d) varId3d = instr[1];
+      }
+    });
+
+    // OpVariable: result type, result id, storage class
+    uint32_t ptrTypeId2d = 0, ptrTypeId3d = 0;
+    forEachInstruction([&](uint32_t opcode, uint32_t instrWordCount, const uint32_t* instr) {
+      if (opcode == SPV_OP_VARIABLE && instrWordCount >= 4)
+      {
+        if (varId2d && instr[2] == varId2d) ptrTypeId2d = instr[1];
+        if (varId3d && instr[2] == varId3d) ptrTypeId3d = instr[1];
+      }
+    });
+
+    // OpTypePointer: result id, storage class, pointee type
+    uint32_t arrayTypeId2d = 0, arrayTypeId3d = 0;
+    forEachInstruction([&](uint32_t opcode, uint32_t instrWordCount, const uint32_t* instr) {
+      if (opcode == SPV_OP_TYPE_POINTER && instrWordCount == 4)
+      {
+        if (ptrTypeId2d && instr[1] == ptrTypeId2d) arrayTypeId2d = instr[3];
+        if (ptrTypeId3d && instr[1] == ptrTypeId3d) arrayTypeId3d = instr[3];
+      }
+    });
+
+    // OpTypeArray: result id, element type, length id
+    uint32_t lengthId2d = 0, lengthId3d = 0;
+    forEachInstruction([&](uint32_t opcode, uint32_t instrWordCount, const uint32_t* instr) {
+      if (opcode == SPV_OP_TYPE_ARRAY && instrWordCount == 4)
+      {
+        if (arrayTypeId2d && instr[1] == arrayTypeId2d) lengthId2d = instr[3];
+        if (arrayTypeId3d && instr[1] == arrayTypeId3d) lengthId3d = instr[3];
+      }
+    });
+
+    // OpConstant: result type, result id, 32-bit literal
+    forEachInstruction([&](uint32_t opcode, uint32_t instrWordCount, uint32_t* instr) {
+      if (opcode != SPV_OP_CONSTANT || instrWordCount != 4)
+      {
+        return;
+      }
+
+      if (lengthId2d && instr[2] == lengthId2d)
+      {
+        assert(instr[3] == TEXTURE_COUNT_2D_PLACEHOLDER);
+        instr[3] = texCount2d;
+      }
+      else if (lengthId3d && instr[2] == lengthId3d)
+      {
+        assert(instr[3] == TEXTURE_COUNT_3D_PLACEHOLDER);
+        instr[3] = texCount3d;
+      }
+    });
+  }
+}
@@ -0,0 +1,93 @@
+//
+// Copyright (C) 2023 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace gi::sg
+{
+  class GlslSourceStitcher;
+
+  struct RaygenShaderParams
+  {
+    bool adaptiveSampling;
+    int32_t aovId;
+    bool blueNoiseDither;
+    bool domeLightEnabled;
+    bool filterImportanceSampling;
+    uint32_t materialCount;
+    bool nextEventEstimation;
+    bool pathGuiding;
+    bool progressiveAccumulation;
+    bool reorderInvocations;
+    bool restir;
+    uint32_t restirSpatialNeighbors;
+    bool shaderClockExts;
+    bool sobolSampler;
+    bool sphereLightsEnabled;
+    uint32_t texCount2d;
+    uint32_t texCount3d;
+    bool virtualTexturing;
+  };
+
+  struct MissShaderParams
+  {
+    bool domeLightEnabled;
+    bool domeLightCameraVisibility;
+    bool nextEventEstimation;
+    bool sphereLightsEnabled;
+    uint32_t texCount2d;
+    uint32_t texCount3d;
+    bool virtualTexturing;
+  };
+
+  // Texture counts only determine descriptor array sizes. Sources generated with
+  // placeholders instead of the actual counts are therefore shared by all scenes
+  // and can be compiled ahead of time.
+  const uint32_t TEXTURE_COUNT_2D_PLACEHOLDER = 65521;
+  const uint32_t TEXTURE_COUNT_3D_PLACEHOLDER = 65519;
+
+  // Virtual texturing changes the descriptor layout and therefore applies to all stages.
+  void appendCommonDefines(GlslSourceStitcher& stitcher, uint32_t texCount2d, uint32_t texCount3d, bool virtualTexturing);
+
+  bool generateRgenGlsl(const fs::path& shaderPath,
+                        std::string_view fileName,
+                        const RaygenShaderParams& params,
+                        bool texCountPlaceholders,
+                        std::string& source);
+
+  bool generateMissGlsl(const fs::path& shaderPath,
+                        std::string_view fileName,
+                        const MissShaderParams& params,
+                        bool texCountPlaceholders,
+                        std::string& source);
+
+  uint64_t hashShaderSource(std::string_view source);
+
+  // Replaces the placeholder lengths of the texture arrays declared at the given bindings.
+  void patchTextureCountPlaceholders(std::vector<uint8_t>& spv,
+                                     uint32_t binding2d, uint32_t texCount2d,
+                                     uint32_t binding3d, uint32_t texCount3d);
+}
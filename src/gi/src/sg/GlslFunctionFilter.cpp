@@ -0,0 +1,195 @@
+//
+// Copyright (C) 2023 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "GlslFunctionFilter.h"
+
+#include <algorithm>
+#include <cctype>
+#include <vector>
+
+namespace gi::sg
+{
+  std::string stripUnreachableGlslFunctions(std::string_view glslSource, std::string_view entryPoint)
+  {
+    struct Chunk
+    {
+      size_t begin;
+      size_t end;
+      std::string_view funcName; // empty if the chunk is not a function definition
+    };
+
+    auto isIdentChar = [](char c) { return std::isalnum((unsigned char) c) || c == '_'; };
+
+    std::vector<Chunk> chunks;
+    size_t chunkBegin = 0;
+    size_t headerEnd = std::string_view::npos; // position of the first '{' of the current chunk
+    int depth = 0;
+
+    auto finishChunk = [&](size_t end, bool isFunction) {
+      std::string_view name;
+      if (isFunction)
+      {
+        std::string_view header = glslSource.substr(chunkBegin, headerEnd - chunkBegin);
+        size_t nameEnd = header.find('(');
+        while (nameEnd > 0 && std::isspace((unsigned char) header[nameEnd - 1])) nameEnd--;
+        size_t nameBegin = nameEnd;
+        while (nameBegin > 0 && isIdentChar(header[nameBegin - 1])) nameBegin--;
+        name = header.substr(nameBegin, nameEnd - nameBegin);
+      }
+      chunks.push_back(Chunk{ chunkBegin, end, name });
+      chunkBegin = end;
+      headerEnd = std::string_view::npos;
+    };
+
+    bool lineStart = true;
+    for (size_t i = 0; i < glslSource.size(); i++)
+    {
+      char c = glslSource[i];
+
+      if (c == '/' && i + 1 < glslSource.size() && glslSource[i + 1] == '/')
+      {
+        i = std::min(glslSource.find('\n', i), glslSource.size() - 1);
+        lineStart = true;
+        continue;
+      }
+      if (c == '/' && i + 1 < glslSource.size() && glslSource[i + 1] == '*')
+      {
+        i = std::min(glslSource.find("*/", i + 2), glslSource.size() - 2) + 1;
+        continue;
+      }
+      if (c == '#' && lineStart && depth == 0)
+      {
+        // Preprocessor directives are kept as separate chunks.
+        if (chunkBegin < i)
+        {
+          finishChunk(i, false);
+        }
+        i = std::min(glslSource.find('\n', i), glslSource.size() - 1);
+        finishChunk(i + 1, false);
+        continue;
+      }
+
+      if (c == '\n')
+      {
+        lineStart = true;
+        continue;
+      }
+      if (!std::isspace((unsigned char) c))
+      {
+        lineStart = false;
+      }
+
+      if (c == '{')
+      {
+        if (depth == 0 && headerEnd == std::string_view::npos)
+        {
+          headerEnd = i;
+        }
+        depth++;
+      }
+      else if (c == '}' && depth > 0)
+      {
+        depth--;
+
+        if (depth == 0)
+        {
+          // A function body directly follows the closing parenthesis of the parameter list.
+          std::string_view header = glslSource.substr(chunkBegin, headerEnd - chunkBegin);
+          size_t last = header.find_last_not_of(" \t\r\n");
+          bool isFunction = last != std::string_view::npos && header[last] == ')' && header.find('=') == std::string_view::npos;
+
+          if (isFunction)
+          {
+            finishChunk(i + 1, true);
+          }
+        }
+      }
+      else if (c == ';' && depth == 0)
+      {
+        finishChunk(i + 1, false);
+      }
+    }
+    if (chunkBegin < glslSource.size())
+    {
+      finishChunk(glslSource.size(), false);
+    }
+
+    // Mark all overloads of every function name referenced from a reachable function body.
+    std::vector<bool> reachable(chunks.size(), false);
+    std::vector<std::string_view> pending{ entryPoint };
+    std::vector<std::string_view> visited;
+
+    while (!pending.empty())
+    {
+      std::string_view name = pending.back();
+      pending.pop_back();
+
+      if (std::find(visited.begin(), visited.end(), name) != visited.end())
+      {
+        continue;
+      }
+      visited.push_back(name);
+
+      for (size_t c = 0; c < chunks.size(); c++)
+      {
+        const Chunk& chunk = chunks[c];
+        if (chunk.funcName != name)
+        {
+          continue;
+        }
+        reachable[c] = true;
+
+        std::string_view body = glslSource.substr(chunk.begin, chunk.end - chunk.begin);
+        for (size_t i = 0; i < body.size();)
+        {
+          if (body.substr(i, 2) == "//")
+          {
+            i = body.find('\n', i);
+            continue;
+          }
+          if (body.substr(i, 2) == "/*")
+          {
+            i = body.find("*/", i + 2);
+            i = (i == std::string_view::npos) ? body.size() : i + 2;
+            continue;
+          }
+          if (!isIdentChar(body[i]) || std::isdigit((unsigned char) body[i]))
+          {
+            i++;
+            continue;
+          }
+          size_t identBegin = i;
+          while (i < body.size() && isIdentChar(body[i])) i++;
+          pending.push_back(body.substr(identBegin, i - identBegin));
+        }
+      }
+    }
+
+    std::string result;
+    result.reserve(glslSource.size());
+    for (size_t c = 0; c < chunks.size(); c++)
+    {
+      const Chunk& chunk = chunks[c];
+      if (!chunk.funcName.empty() && !reachable[c])
+      {
+        continue;
+      }
+      result.append(glslSource.substr(chunk.begin, chunk.end - chunk.begin));
+    }
+    return result;
+  }
+}
@@ -0,0 +1,30 @@
+//
+// Copyright (C) 2023 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace gi::sg
+{
+  // Removes function definitions which can not be reached from the entry point. The MDL
+  // GLSL backend emits all functions of a link unit into one source string; for shaders
+  // that only call a subset (such as the any-hit shader) this avoids compiling the rest.
+  // Prototypes, structs and global declarations are always kept.
+  std::string stripUnreachableGlslFunctions(std::string_view glslSource, std::string_view entryPoint);
+}
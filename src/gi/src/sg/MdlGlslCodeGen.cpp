@@ -35,6 +35,20 @@ namespace gi::sg
   const char* CUTOUT_OPACITY_FUNC_NAME = "mdl_cutout_opacity";
   const char* MATERIAL_STATE_NAME = "State";
 
+  void _appendShadingFunctionDescs(std::vector<mi::neuraylib::Target_function_description>& genFunctions)
+  {
+    genFunctions.push_back(mi::neuraylib::Target_function_description("surface.scattering", SCATTERING_FUNC_NAME));
+    genFunctions.push_back(mi::neuraylib::Target_function_description("surface.emission.emission", EMISSION_FUNC_NAME));
+    genFunctions.push_back(mi::neuraylib::Target_function_description("surface.emission.intensity", EMISSION_INTENSITY_FUNC_NAME));
+    genFunctions.push_back(mi::neuraylib::Target_function_description("thin_walled", THIN_WALLED_FUNC_NAME));
+    genFunctions.push_back(mi::neuraylib::Target_function_description("volume.absorption_coefficient", VOLUME_ABSORPTION_FUNC_NAME));
+  }
+
+  void _appendOpacityFunctionDescs(std::vector<mi::neuraylib::Target_function_description>& genFunctions)
+  {
+    genFunctions.push_back(mi::neuraylib::Target_function_description("geometry.cutout_opacity", CUTOUT_OPACITY_FUNC_NAME));
+  }
+
   bool MdlGlslCodeGen::init(MdlRuntime& runtime)
   {
     mi::base::Handle<mi::neuraylib::IMdl_backend_api> backendApi(runtime.getBackendApi());
@@ -63,11 +77,7 @@ namespace gi::sg
                                               MdlGlslCodeGenResult& result)
   {
     std::vector<mi::neuraylib::Target_function_description> genFunctions;
-    genFunctions.push_back(mi::neuraylib::Target_function_description("surface.scattering", SCATTERING_FUNC_NAME));
-    genFunctions.push_back(mi::neuraylib::Target_function_description("surface.emission.emission", EMISSION_FUNC_NAME));
-    genFunctions.push_back(mi::neuraylib::Target_function_description("surface.emission.intensity", EMISSION_INTENSITY_FUNC_NAME));
-    genFunctions.push_back(mi::neuraylib::Target_function_description("thin_walled", THIN_WALLED_FUNC_NAME));
-    genFunctions.push_back(mi::neuraylib::Target_function_description("volume.absorption_coefficient", VOLUME_ABSORPTION_FUNC_NAME));
+    _appendShadingFunctionDescs(genFunctions);
 
     return generateGlslWithDfs(material, genFunctions, result.glslSource, result.textureResources);
   }
@@ -76,7 +86,23 @@ namespace gi::sg
                                               MdlGlslCodeGenResult& result)
   {
     std::vector<mi::neuraylib::Target_function_description> genFunctions;
-    genFunctions.push_back(mi::neuraylib::Target_function_description("geometry.cutout_opacity", CUTOUT_OPACITY_FUNC_NAME));
+    _appendOpacityFunctionDescs(genFunctions);
+
+    return generateGlslWithDfs(material, genFunctions, result.glslSource, result.textureResources);
+  }
+
+  bool MdlGlslCodeGen::genMaterialCode(const mi::neuraylib::ICompiled_material* material,
+                                       bool genOpacity,
+                                       MdlGlslCodeGenResult& result)
+  {
+    // All functions end up in the same link unit, so the backend is only invoked once
+    // and the runtime helper code and texture resources are emitted a single time.
+    std::vector<mi::neuraylib::Target_function_description> genFunctions;
+    _appendShadingFunctionDescs(genFunctions);
+    if (genOpacity)
+    {
+      _appendOpacityFunctionDescs(genFunctions);
+    }
 
     return generateGlslWithDfs(material, genFunctions, result.glslSource, result.textureResources);
   }
@@ -152,6 +178,7 @@ namespace gi::sg
       textureResource.height = 1;
       textureResource.depth = 1;
       textureResource.data.resize(4, 0); // fall back to 1x1 black pixel
+      textureResource.bsdfDataKind = 0;
 
       switch (targetCode->get_texture_shape(i))
       {
@@ -171,6 +198,7 @@ namespace gi::sg
         assert(dataPtr);
 
         textureResource.is3dImage = true;
+        textureResource.bsdfDataKind = (uint32_t) targetCode->get_texture_df_data_kind(i);
         textureResource.width = (uint32_t) width;
         textureResource.height = (uint32_t) height;
         textureResource.depth = (uint32_t) depth;
@@ -35,6 +35,9 @@
 
 namespace gi::sg
 {
+  // Name of the generated cutout opacity function, which is the entry point of any-hit shaders.
+  extern const char* CUTOUT_OPACITY_FUNC_NAME;
+
   struct MdlGlslCodeGenResult
   {
     std::string glslSource;
@@ -52,6 +55,11 @@ namespace gi::sg
     bool genMaterialOpacityCode(const mi::neuraylib::ICompiled_material* material,
                                 MdlGlslCodeGenResult& result);
 
+    // Generates shading and, optionally, opacity functions using a single link unit.
+    bool genMaterialCode(const mi::neuraylib::ICompiled_material* material,
+                         bool genOpacity,
+                         MdlGlslCodeGenResult& result);
+
   private:
     bool generateGlslWithDfs(const mi::neuraylib::ICompiled_material* compiledMaterial,
                              std::vector<mi::neuraylib::Target_function_description>& genFunctions,
@@ -0,0 +1,45 @@
+//
+// Copyright (C) 2023 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+#include "ShaderBundle.h"
+
+namespace gi::sg
+{
+#ifdef GATLING_SHADER_BUNDLE
+  // Defined in the source file generated by gi-shader-bundler.
+  extern const BundledShader BUNDLED_SHADERS[];
+  extern const size_t BUNDLED_SHADER_COUNT;
+#endif
+
+  const BundledShader* findBundledShader(uint64_t sourceHash)
+  {
+#ifdef GATLING_SHADER_BUNDLE
+    for (size_t i = 0; i < BUNDLED_SHADER_COUNT; i++)
+    {
+      const BundledShader& shader = BUNDLED_SHADERS[i];
+
+      if (shader.sourceHash == sourceHash)
+      {
+        return &shader;
+      }
+    }
+#endif
+
+    return nullptr;
+  }
+}
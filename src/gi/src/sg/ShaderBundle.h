@@ -0,0 +1,35 @@
+//
+// Copyright (C) 2023 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace gi::sg
+{
+  struct BundledShader
+  {
+    uint64_t sourceHash;
+    const uint8_t* spv;
+    size_t spvSize;
+  };
+
+  // Returns SPIR-V precompiled at build time for the source with the given hash, if any.
+  const BundledShader* findBundledShader(uint64_t sourceHash);
+}
@@ -23,6 +23,10 @@
 #include "MdlGlslCodeGen.h"
 #include "GlslangShaderCompiler.h"
 #include "GlslSourceStitcher.h"
+#include "GlslFunctionFilter.h"
+#include "ShaderBundle.h"
+
+#include "interface/rp_main.h"
 
 #include <string>
 #include <sstream>
@@ -30,6 +34,9 @@
 #include <iomanip>
 #include <fstream>
 #include <cassert>
+#include <cstdlib>
+
+namespace Rp = gtl::shader_interface::rp_main;
 
 namespace gi::sg
 {
@@ -37,7 +44,9 @@ namespace gi::sg
   {
     mi::base::Handle<mi::neuraylib::ICompiled_material> compiledMaterial;
     bool isEmissive;
+    float emissionLuminance; // 1 if the intensity is not constant
     bool isOpaque;
+    bool isOpacityFolded; // opaque only because the cutout opacity folded to 1
     std::string resourcePathPrefix;
   };
 
@@ -67,6 +76,11 @@ namespace gi::sg
     }
     m_shaderCompiler = new sg::GlslangShaderCompiler(m_shaderPath);
 
+#ifdef NDEBUG
+    // Debug builds reload shaders from the source tree, which the bundle would mask.
+    m_useShaderBundle = !getenv("GATLING_DISABLE_SHADER_BUNDLE");
+#endif
+
     return true;
   }
 
@@ -80,13 +94,13 @@ namespace gi::sg
     delete m_mdlRuntime;
   }
 
-  bool _sgIsMaterialEmissive(mi::base::Handle<mi::neuraylib::ICompiled_material> compiledMaterial)
+  bool _sgGetConstantEmissionIntensity(mi::base::Handle<mi::neuraylib::ICompiled_material> compiledMaterial, float intensity[3])
   {
     mi::base::Handle<const mi::neuraylib::IExpression> expr(compiledMaterial->lookup_sub_expression("surface.emission.intensity"));
 
     if (expr->get_kind() != mi::neuraylib::IExpression::Kind::EK_CONSTANT)
     {
-      return true;
+      return false;
     }
 
     mi::base::Handle<const mi::neuraylib::IExpression_constant> constExpr(expr.get_interface<const mi::neuraylib::IExpression_constant>());
@@ -95,7 +109,7 @@ namespace gi::sg
     if (value->get_kind() != mi::neuraylib::IValue::Kind::VK_COLOR)
     {
       assert(false);
-      return true;
+      return false;
     }
 
     mi::base::Handle<const mi::neuraylib::IValue_color> color(value.get_interface<const mi::neuraylib::IValue_color>());
@@ -103,15 +117,31 @@ namespace gi::sg
     if (color->get_size() != 3)
     {
       assert(false);
-      return true;
+      return false;
     }
 
-    mi::base::Handle<const mi::neuraylib::IValue_float> v0(color->get_value(0));
-    mi::base::Handle<const mi::neuraylib::IValue_float> v1(color->get_value(1));
-    mi::base::Handle<const mi::neuraylib::IValue_float> v2(color->get_value(2));
+    for (mi::Size i = 0; i < 3; i++)
+    {
+      mi::base::Handle<const mi::neuraylib::IValue_float> v(color->get_value(i));
+      intensity[i] = v->get_value();
+    }
+    return true;
+  }
+
+  // Materials with varying emission intensity are conservatively treated as emissive.
+  void _sgClassifyMaterialEmission(Material* m)
+  {
+    float intensity[3];
+    if (!_sgGetConstantEmissionIntensity(m->compiledMaterial, intensity))
+    {
+      m->isEmissive = true;
+      m->emissionLuminance = 1.0f;
+      return;
+    }
 
     const float eps = 1e-7f;
-    return v0->get_value() > eps || v1->get_value() > eps || v2->get_value() > eps;
+    m->isEmissive = intensity[0] > eps || intensity[1] > eps || intensity[2] > eps;
+    m->emissionLuminance = 0.2126f * intensity[0] + 0.7152f * intensity[1] + 0.0722f * intensity[2];
   }
 
   bool _sgIsMaterialOpaque(mi::base::Handle<mi::neuraylib::ICompiled_material> compiledMaterial)
@@ -119,6 +149,20 @@ namespace gi::sg
     return compiledMaterial->get_opacity() == mi::neuraylib::OPACITY_OPAQUE;
   }
 
+  // The MDL SDK folds the cutout opacity expression of the compiled material. If it
+  // is constant and 1, the material never needs an any-hit shader.
+  bool _sgIsCutoutOpacityConstantOne(mi::base::Handle<mi::neuraylib::ICompiled_material> compiledMaterial)
+  {
+    mi::Float32 cutoutOpacity;
+    return compiledMaterial->get_cutout_opacity(&cutoutOpacity) && cutoutOpacity >= 1.0f;
+  }
+
+  void _sgClassifyMaterialOpacity(Material* m, bool isOpaque)
+  {
+    m->isOpacityFolded = !isOpaque && _sgIsCutoutOpacityConstantOne(m->compiledMaterial);
+    m->isOpaque = isOpaque || m->isOpacityFolded;
+  }
+
   Material* ShaderGen::createMaterialFromMtlxStr(std::string_view docStr)
   {
     std::string mdlSrc;
@@ -137,8 +181,8 @@ namespace gi::sg
 
     Material* m = new Material();
     m->compiledMaterial = compiledMaterial;
-    m->isEmissive = _sgIsMaterialEmissive(compiledMaterial);
-    m->isOpaque = isOpaque;
+    _sgClassifyMaterialEmission(m);
+    _sgClassifyMaterialOpacity(m, isOpaque);
     return m;
   }
 
@@ -161,8 +205,8 @@ namespace gi::sg
 
     Material* m = new Material();
     m->compiledMaterial = compiledMaterial;
-    m->isEmissive = _sgIsMaterialEmissive(compiledMaterial);
-    m->isOpaque = isOpaque;
+    _sgClassifyMaterialEmission(m);
+    _sgClassifyMaterialOpacity(m, isOpaque);
     return m;
   }
 
@@ -178,8 +222,8 @@ namespace gi::sg
 
     Material* m = new Material();
     m->compiledMaterial = compiledMaterial;
-    m->isEmissive = _sgIsMaterialEmissive(compiledMaterial);
-    m->isOpaque = _sgIsMaterialOpaque(compiledMaterial);
+    _sgClassifyMaterialEmission(m);
+    _sgClassifyMaterialOpacity(m, _sgIsMaterialOpaque(compiledMaterial));
     m->resourcePathPrefix = resourcePathPrefix;
     return m;
   }
@@ -194,126 +238,107 @@ namespace gi::sg
     return mat->isEmissive;
   }
 
+  float ShaderGen::getMaterialEmissionLuminance(const Material* mat)
+  {
+    return mat->emissionLuminance;
+  }
+
   bool ShaderGen::isMaterialOpaque(const Material* mat)
   {
     return mat->isOpaque;
   }
 
-  void _sgGenerateCommonDefines(GlslSourceStitcher& stitcher, uint32_t texCount2d, uint32_t texCount3d)
+  bool ShaderGen::isMaterialOpacityFolded(const Material* mat)
   {
-#if defined(NDEBUG) || defined(__APPLE__)
-    stitcher.appendDefine("NDEBUG");
-#endif
-
-    stitcher.appendDefine("TEXTURE_COUNT_2D", (int32_t) texCount2d);
-    stitcher.appendDefine("TEXTURE_COUNT_3D", (int32_t) texCount3d);
+    return mat->isOpacityFolded;
   }
 
-  bool ShaderGen::generateRgenSpirv(std::string_view fileName, const RaygenShaderParams& params, std::vector<uint8_t>& spv)
+  // Maps MDL texture indices to descriptor array indices. Entry 0 is the invalid texture.
+  std::string _sgGenerateTextureIndexTable(const std::vector<uint32_t>& textureIndices)
   {
-    GlslSourceStitcher stitcher;
-    stitcher.appendVersion();
-
-    if (params.shaderClockExts)
+    std::stringstream ss;
+    ss << "const uint TEXTURE_INDICES[] = uint[](0";
+    for (size_t i = 1; i < textureIndices.size(); i++)
     {
-      stitcher.appendRequiredExtension("GL_EXT_shader_explicit_arithmetic_types_int64");
-      stitcher.appendRequiredExtension("GL_ARB_shader_clock");
+      ss << ", " << textureIndices[i];
     }
-    if (params.reorderInvocations)
-    {
-      stitcher.appendRequiredExtension("GL_NV_shader_invocation_reorder");
-      // For hit shader invocation reordering hint
-      stitcher.appendRequiredExtension("GL_EXT_buffer_reference");
-      stitcher.appendRequiredExtension("GL_EXT_buffer_reference_uvec2");
-
-      uint32_t reoderHintValueCount = params.materialCount + 1/* no hit */;
-      int32_t reorderHintBitCount = 0;
-
-      while (reoderHintValueCount >>= 1)
-      {
-        reorderHintBitCount++;
-      }
+    ss << ");\n";
+    return ss.str();
+  }
 
-      stitcher.appendDefine("REORDER_INVOCATIONS");
-      stitcher.appendDefine("REORDER_HINT_BIT_COUNT", reorderHintBitCount);
+  bool ShaderGen::findBundledSpirv(std::string_view source, uint32_t texCount2d, uint32_t texCount3d, std::vector<uint8_t>& spv)
+  {
+    if (!m_useShaderBundle)
+    {
+      return false;
     }
 
-    _sgGenerateCommonDefines(stitcher, params.texCount2d, params.texCount3d);
-
-    if (params.filterImportanceSampling)
+    const BundledShader* bundledShader = findBundledShader(hashShaderSource(source));
+    if (!bundledShader)
     {
-      stitcher.appendDefine("FILTER_IMPORTANCE_SAMPLING");
+      return false;
     }
-    if (params.nextEventEstimation)
+
+    spv.assign(bundledShader->spv, bundledShader->spv + bundledShader->spvSize);
+    patchTextureCountPlaceholders(spv,
+                                  Rp::BINDING_INDEX_TEXTURES_2D, texCount2d,
+                                  Rp::BINDING_INDEX_TEXTURES_3D, texCount3d);
+    return true;
+  }
+
+  bool ShaderGen::generateRgenSpirv(std::string_view fileName, const RaygenShaderParams& params, std::vector<uint8_t>& spv)
+  {
+    std::string source;
+    if (!generateRgenGlsl(m_shaderPath, fileName, params, true, source))
     {
-      stitcher.appendDefine("NEXT_EVENT_ESTIMATION", params.aovId);
+      return false;
     }
-    if (params.progressiveAccumulation)
+
+    if (findBundledSpirv(source, params.texCount2d, params.texCount3d, spv))
     {
-      stitcher.appendDefine("PROGRESSIVE_ACCUMULATION");
+      return true;
     }
 
-    stitcher.appendDefine("AOV_ID", params.aovId);
-
-    fs::path filePath = m_shaderPath / fileName;
-    if (!stitcher.appendSourceFile(filePath))
+    if (!generateRgenGlsl(m_shaderPath, fileName, params, false, source))
     {
       return false;
     }
 
-    std::string source = stitcher.source();
     return m_shaderCompiler->compileGlslToSpv(GlslangShaderCompiler::ShaderStage::RayGen, source, spv);
   }
 
   bool ShaderGen::generateMissSpirv(std::string_view fileName, const MissShaderParams& params, std::vector<uint8_t>& spv)
   {
-    GlslSourceStitcher stitcher;
-    stitcher.appendVersion();
-
-    _sgGenerateCommonDefines(stitcher, params.texCount2d, params.texCount3d);
-
-    if (params.domeLightEnabled)
+    std::string source;
+    if (!generateMissGlsl(m_shaderPath, fileName, params, true, source))
     {
-      stitcher.appendDefine("DOMELIGHT_ENABLED");
+      return false;
     }
-    if (params.domeLightCameraVisibility)
+
+    if (findBundledSpirv(source, params.texCount2d, params.texCount3d, spv))
     {
-      stitcher.appendDefine("DOMELIGHT_CAMERA_VISIBLE");
+      return true;
     }
 
-    fs::path filePath = m_shaderPath / fileName;
-    if (!stitcher.appendSourceFile(filePath))
+    if (!generateMissGlsl(m_shaderPath, fileName, params, false, source))
     {
       return false;
     }
 
-    std::string source = stitcher.source();
     return m_shaderCompiler->compileGlslToSpv(GlslangShaderCompiler::ShaderStage::Miss, source, spv);
   }
 
-  bool _genInfoFromCodeGenResult(const MdlGlslCodeGenResult& codeGenResult,
-                                 const std::string& resourcePathPrefix,
-                                 fs::path shaderPath,
-                                 ShaderGen::MaterialGlslGenInfo& genInfo)
+  std::string _trimMdlGlslSource(const std::string& glslSource)
   {
-    // Append resource path prefix for file-backed MDL modules.
-    genInfo.textureResources = codeGenResult.textureResources;
-
-    if (!resourcePathPrefix.empty())
-    {
-      for (sg::TextureResource& texRes : genInfo.textureResources)
-      {
-        texRes.filePath = resourcePathPrefix + texRes.filePath;
-      }
-    }
-
     // Remove MDL struct definitions because they're too bloated. We know more about the
     // data from which the code is generated from and can reduce the memory footprint.
-    std::string glslSource = codeGenResult.glslSource;
     size_t mdlCodeOffset = glslSource.find("// user defined structs");
     assert(mdlCodeOffset != std::string::npos);
-    glslSource = glslSource.substr(mdlCodeOffset, glslSource.size() - mdlCodeOffset);
+    return glslSource.substr(mdlCodeOffset, glslSource.size() - mdlCodeOffset);
+  }
 
+  bool _stitchMaterialGlslSource(const fs::path& shaderPath, std::string_view mdlGlslSource, std::string& glslSource)
+  {
     GlslSourceStitcher stitcher;
     if (!stitcher.appendSourceFile(shaderPath / "mdl_types.glsl"))
     {
@@ -323,13 +348,34 @@ namespace gi::sg
     {
       return false;
     }
-    stitcher.appendString(glslSource);
+    stitcher.appendString(mdlGlslSource);
 
-    genInfo.glslSource = stitcher.source();
+    glslSource = stitcher.source();
 
     return true;
   }
 
+  bool _genInfoFromCodeGenResult(const MdlGlslCodeGenResult& codeGenResult,
+                                 const std::string& resourcePathPrefix,
+                                 fs::path shaderPath,
+                                 ShaderGen::MaterialGlslGenInfo& genInfo)
+  {
+    // Append resource path prefix for file-backed MDL modules.
+    genInfo.textureResources = codeGenResult.textureResources;
+
+    if (!resourcePathPrefix.empty())
+    {
+      for (sg::TextureResource& texRes : genInfo.textureResources)
+      {
+        texRes.filePath = resourcePathPrefix + texRes.filePath;
+      }
+    }
+
+    std::string glslSource = _trimMdlGlslSource(codeGenResult.glslSource);
+
+    return _stitchMaterialGlslSource(shaderPath, glslSource, genInfo.glslSource);
+  }
+
   bool ShaderGen::generateMaterialShadingGenInfo(const Material* material, MaterialGlslGenInfo& genInfo)
   {
     const mi::neuraylib::ICompiled_material* compiledMaterial = material->compiledMaterial.get();
@@ -356,20 +402,89 @@ namespace gi::sg
     return _genInfoFromCodeGenResult(codeGenResult, material->resourcePathPrefix, m_shaderPath, genInfo);
   }
 
+  bool ShaderGen::generateMaterialGenInfo(const Material* material,
+                                          MaterialGlslGenInfo& shadingGenInfo,
+                                          MaterialGlslGenInfo* opacityGenInfo)
+  {
+    const mi::neuraylib::ICompiled_material* compiledMaterial = material->compiledMaterial.get();
+
+    bool includeOpacity = (opacityGenInfo != nullptr);
+
+    MdlGlslCodeGenResult codeGenResult;
+    if (!m_mdlGlslCodeGen->genMaterialCode(compiledMaterial, includeOpacity, codeGenResult))
+    {
+      return false;
+    }
+
+    if (!_genInfoFromCodeGenResult(codeGenResult, material->resourcePathPrefix, m_shaderPath, shadingGenInfo))
+    {
+      return false;
+    }
+
+    if (!includeOpacity)
+    {
+      return true;
+    }
+
+    // The any-hit shader only needs the opacity function and its callees. Texture indices
+    // are shared with the shading code, since both were generated from the same link unit.
+    std::string glslSource = _trimMdlGlslSource(codeGenResult.glslSource);
+    glslSource = stripUnreachableGlslFunctions(glslSource, CUTOUT_OPACITY_FUNC_NAME);
+
+    opacityGenInfo->textureResources = shadingGenInfo.textureResources;
+
+    return _stitchMaterialGlslSource(m_shaderPath, glslSource, opacityGenInfo->glslSource);
+  }
+
   bool ShaderGen::generateClosestHitSpirv(const ClosestHitShaderParams& params, std::vector<uint8_t>& spv)
   {
     GlslSourceStitcher stitcher;
     stitcher.appendVersion();
 
-    _sgGenerateCommonDefines(stitcher, params.texCount2d, params.texCount3d);
+    appendCommonDefines(stitcher, params.texCount2d, params.texCount3d, params.virtualTexturing);
 
+    if (params.adaptiveSampling)
+    {
+      stitcher.appendDefine("ADAPTIVE_SAMPLING");
+    }
     stitcher.appendDefine("AOV_ID", params.aovId);
-    stitcher.appendDefine("TEXTURE_INDEX_OFFSET_2D", (int32_t) params.textureIndexOffset2d);
-    stitcher.appendDefine("TEXTURE_INDEX_OFFSET_3D", (int32_t) params.textureIndexOffset3d);
+    if (params.blueNoiseDither)
+    {
+      stitcher.appendDefine("BLUE_NOISE_DITHER");
+    }
+    if (params.domeLightEnabled)
+    {
+      stitcher.appendDefine("DOMELIGHT_ENABLED");
+    }
     if (params.isOpaque)
     {
       stitcher.appendDefine("IS_OPAQUE", params.aovId);
     }
+    if (params.lightTree)
+    {
+      stitcher.appendDefine("LIGHT_TREE");
+    }
+    if (params.nextEventEstimation)
+    {
+      stitcher.appendDefine("NEXT_EVENT_ESTIMATION");
+    }
+    if (params.pathGuiding)
+    {
+      stitcher.appendDefine("PATH_GUIDING");
+    }
+    if (params.restir)
+    {
+      stitcher.appendDefine("RESTIR");
+      stitcher.appendDefine("RESTIR_SPATIAL_NEIGHBORS", int32_t(params.restirSpatialNeighbors));
+    }
+    if (params.sobolSampler)
+    {
+      stitcher.appendDefine("SOBOL_SAMPLER");
+    }
+    if (params.sphereLightsEnabled)
+    {
+      stitcher.appendDefine("SPHERE_LIGHTS");
+    }
 
     fs::path filePath = m_shaderPath / params.baseFileName;
     if (!stitcher.appendSourceFile(filePath))
@@ -377,7 +492,9 @@ namespace gi::sg
       return false;
     }
 
-    stitcher.replaceFirst("#pragma MDL_GENERATED_CODE", params.shadingGlsl);
+    std::string mdlGlsl = _sgGenerateTextureIndexTable(params.textureIndices);
+    mdlGlsl += params.shadingGlsl;
+    stitcher.replaceFirst("#pragma MDL_GENERATED_CODE", mdlGlsl);
 
     std::string source = stitcher.source();
     return m_shaderCompiler->compileGlslToSpv(GlslangShaderCompiler::ShaderStage::ClosestHit, source, spv);
@@ -388,11 +505,9 @@ namespace gi::sg
     GlslSourceStitcher stitcher;
     stitcher.appendVersion();
 
-    _sgGenerateCommonDefines(stitcher, params.texCount2d, params.texCount3d);
+    appendCommonDefines(stitcher, params.texCount2d, params.texCount3d, params.virtualTexturing);
 
     stitcher.appendDefine("AOV_ID", params.aovId);
-    stitcher.appendDefine("TEXTURE_INDEX_OFFSET_2D", (int32_t) params.textureIndexOffset2d);
-    stitcher.appendDefine("TEXTURE_INDEX_OFFSET_3D", (int32_t) params.textureIndexOffset3d);
     if (params.shadowTest)
     {
       stitcher.appendDefine("SHADOW_TEST");
@@ -404,7 +519,9 @@ namespace gi::sg
       return false;
     }
 
-    stitcher.replaceFirst("#pragma MDL_GENERATED_CODE", params.opacityEvalGlsl);
+    std::string mdlGlsl = _sgGenerateTextureIndexTable(params.textureIndices);
+    mdlGlsl += params.opacityEvalGlsl;
+    stitcher.replaceFirst("#pragma MDL_GENERATED_CODE", mdlGlsl);
 
     std::string source = stitcher.source();
     return m_shaderCompiler->compileGlslToSpv(GlslangShaderCompiler::ShaderStage::AnyHit, source, spv);
@@ -25,6 +25,8 @@
 #include <filesystem>
 #include <MaterialXCore/Document.h>
 
+#include "BuiltinShaderGen.h"
+
 namespace fs = std::filesystem;
 
 namespace gi::sg
@@ -40,6 +42,7 @@ namespace gi::sg
     uint32_t depth;
     std::vector<uint8_t> data;
     std::string filePath;
+    uint32_t bsdfDataKind; // non-zero for built-in MDL BSDF data, which is identical across materials
   };
 
   class ShaderGen
@@ -63,7 +66,10 @@ namespace gi::sg
     Material* createMaterialFromMdlFile(std::string_view filePath, std::string_view subIdentifier);
     void destroyMaterial(Material* mat);
     bool isMaterialEmissive(const Material* mat);
+    // Estimate of the emitted power per area, used to weight light sources.
+    float getMaterialEmissionLuminance(const Material* mat);
     bool isMaterialOpaque(const Material* mat);
+    bool isMaterialOpacityFolded(const Material* mat);
 
   public:
     struct MaterialGlslGenInfo
@@ -74,36 +80,34 @@ namespace gi::sg
 
     bool generateMaterialShadingGenInfo(const Material* material, MaterialGlslGenInfo& genInfo);
     bool generateMaterialOpacityGenInfo(const Material* material, MaterialGlslGenInfo& genInfo);
+    // Shading and opacity code share one link unit. Pass a null opacityGenInfo for opaque materials.
+    bool generateMaterialGenInfo(const Material* material,
+                                 MaterialGlslGenInfo& shadingGenInfo,
+                                 MaterialGlslGenInfo* opacityGenInfo);
+
+    using RaygenShaderParams = sg::RaygenShaderParams;
+    using MissShaderParams = sg::MissShaderParams;
 
-    struct RaygenShaderParams
-    {
-      int32_t aovId;
-      bool filterImportanceSampling;
-      uint32_t materialCount;
-      bool nextEventEstimation;
-      bool progressiveAccumulation;
-      bool reorderInvocations;
-      bool shaderClockExts;
-      uint32_t texCount2d;
-      uint32_t texCount3d;
-    };
-    struct MissShaderParams
-    {
-      bool domeLightEnabled;
-      bool domeLightCameraVisibility;
-      uint32_t texCount2d;
-      uint32_t texCount3d;
-    };
     struct ClosestHitShaderParams
     {
+      bool adaptiveSampling;
       int32_t aovId;
       std::string_view baseFileName;
+      bool blueNoiseDither;
+      bool domeLightEnabled;
       bool isOpaque;
+      bool lightTree;
+      bool nextEventEstimation;
+      bool pathGuiding;
+      bool restir;
+      uint32_t restirSpatialNeighbors;
       std::string_view shadingGlsl;
-      uint32_t textureIndexOffset2d;
-      uint32_t textureIndexOffset3d;
+      bool sobolSampler;
+      bool sphereLightsEnabled;
+      std::vector<uint32_t> textureIndices;
       uint32_t texCount2d;
       uint32_t texCount3d;
+      bool virtualTexturing;
     };
     struct AnyHitShaderParams
     {
@@ -111,10 +115,10 @@ namespace gi::sg
       std::string_view baseFileName;
       std::string_view opacityEvalGlsl;
       bool shadowTest;
-      uint32_t textureIndexOffset2d;
-      uint32_t textureIndexOffset3d;
+      std::vector<uint32_t> textureIndices;
       uint32_t texCount2d;
       uint32_t texCount3d;
+      bool virtualTexturing;
     };
 
     bool generateRgenSpirv(std::string_view fileName, const RaygenShaderParams& params, std::vector<uint8_t>& spv);
@@ -122,6 +126,9 @@ namespace gi::sg
     bool generateClosestHitSpirv(const ClosestHitShaderParams& params, std::vector<uint8_t>& spv);
     bool generateAnyHitSpirv(const AnyHitShaderParams& params, std::vector<uint8_t>& spv);
 
+  private:
+    bool findBundledSpirv(std::string_view source, uint32_t texCount2d, uint32_t texCount3d, std::vector<uint8_t>& spv);
+
   private:
     class MdlRuntime* m_mdlRuntime = nullptr;
     class MdlMaterialCompiler* m_mdlMaterialCompiler = nullptr;
@@ -129,5 +136,6 @@ namespace gi::sg
     class MtlxMdlCodeGen* m_mtlxMdlCodeGen = nullptr;
     class GlslangShaderCompiler* m_shaderCompiler = nullptr;
     fs::path m_shaderPath;
+    bool m_useShaderBundle = false;
   };
 }
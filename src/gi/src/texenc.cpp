@@ -0,0 +1,417 @@
+//
+// Copyright (C) 2019-2022 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+#include "texenc.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+namespace detail
+{
+  const uint32_t BLOCK_DIM = 4;
+  const uint32_t BLOCK_TEXEL_COUNT = 16;
+  const uint32_t BLOCK_BYTE_SIZE = 16;
+
+  // Interpolation weights of 4-bit indices, shared by BC6H and BC7.
+  const int32_t BC_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+  struct QuantizedEndpoint
+  {
+    glm::ivec4 bits;  // as stored in the block
+    glm::ivec4 value; // as reconstructed by the decoder
+    uint32_t pBit;
+  };
+
+  class BlockWriter
+  {
+  public:
+    BlockWriter(uint8_t* dst)
+      : m_dst(dst)
+    {
+      memset(m_dst, 0, BLOCK_BYTE_SIZE);
+    }
+
+    void write(uint32_t value, uint32_t bitCount)
+    {
+      for (uint32_t i = 0; i < bitCount; i++, m_bitOffset++)
+      {
+        if ((value >> i) & 1)
+        {
+          m_dst[m_bitOffset >> 3] |= uint8_t(1u << (m_bitOffset & 7));
+        }
+      }
+    }
+
+    // The MSB of the first (anchor) index is implicitly zero and not stored.
+    void writeIndices(const uint32_t indices[BLOCK_TEXEL_COUNT])
+    {
+      write(indices[0], 3);
+
+      for (uint32_t i = 1; i < BLOCK_TEXEL_COUNT; i++)
+      {
+        write(indices[i], 4);
+      }
+    }
+
+  private:
+    uint8_t* m_dst;
+    uint32_t m_bitOffset = 0;
+  };
+
+  struct Bc7Codec
+  {
+    static constexpr float MAX_VALUE = 255.0f;
+
+    // Mode 6: 7 bits per channel and a unique p-bit per endpoint, which we pick to minimize the error.
+    static QuantizedEndpoint quantize(const glm::vec4& v)
+    {
+      QuantizedEndpoint best;
+      float bestError = FLT_MAX;
+
+      for (uint32_t p = 0; p < 2; p++)
+      {
+        QuantizedEndpoint e;
+        e.pBit = p;
+
+        float error = 0.0f;
+        for (int c = 0; c < 4; c++)
+        {
+          e.bits[c] = std::clamp(int32_t(roundf((v[c] - float(p)) * 0.5f)), 0, 127);
+          e.value[c] = (e.bits[c] << 1) | int32_t(p);
+
+          float d = float(e.value[c]) - v[c];
+          error += d * d;
+        }
+
+        if (error < bestError)
+        {
+          best = e;
+          bestError = error;
+        }
+      }
+
+      return best;
+    }
+
+    static void writeBlock(const QuantizedEndpoint& e0, const QuantizedEndpoint& e1, const uint32_t indices[BLOCK_TEXEL_COUNT], uint8_t* dst)
+    {
+      BlockWriter writer(dst);
+      writer.write(1u << 6, 7); // mode 6
+
+      for (int c = 0; c < 4; c++)
+      {
+        writer.write(e0.bits[c], 7);
+        writer.write(e1.bits[c], 7);
+      }
+
+      writer.write(e0.pBit, 1);
+      writer.write(e1.pBit, 1);
+      writer.writeIndices(indices);
+    }
+  };
+
+  struct Bc6hCodec
+  {
+    static constexpr float MAX_VALUE = 65535.0f;
+
+    static int32_t unquantize(int32_t q)
+    {
+      if (q == 0)
+      {
+        return 0;
+      }
+      if (q == 1023)
+      {
+        return 0xFFFF;
+      }
+      return ((q << 16) + 0x8000) >> 10;
+    }
+
+    // Mode 11: 10 bits per channel, no delta encoding.
+    static QuantizedEndpoint quantize(const glm::vec4& v)
+    {
+      QuantizedEndpoint e = {};
+
+      for (int c = 0; c < 3; c++)
+      {
+        e.bits[c] = std::clamp(int32_t(roundf((v[c] - 32.0f) / 64.0f)), 0, 1023);
+        e.value[c] = unquantize(e.bits[c]);
+      }
+
+      return e;
+    }
+
+    static void writeBlock(const QuantizedEndpoint& e0, const QuantizedEndpoint& e1, const uint32_t indices[BLOCK_TEXEL_COUNT], uint8_t* dst)
+    {
+      BlockWriter writer(dst);
+      writer.write(0x03, 5); // mode 11
+
+      for (int c = 0; c < 3; c++)
+      {
+        writer.write(e0.bits[c], 10);
+      }
+      for (int c = 0; c < 3; c++)
+      {
+        writer.write(e1.bits[c], 10);
+      }
+
+      writer.writeIndices(indices);
+    }
+  };
+
+  float assignIndices(const glm::vec4 texels[BLOCK_TEXEL_COUNT],
+                      const QuantizedEndpoint& e0,
+                      const QuantizedEndpoint& e1,
+                      uint32_t indices[BLOCK_TEXEL_COUNT])
+  {
+    glm::vec4 palette[16];
+    for (uint32_t i = 0; i < 16; i++)
+    {
+      int32_t w = BC_WEIGHTS[i];
+      palette[i] = glm::vec4(((64 - w) * e0.value + w * e1.value + 32) >> 6);
+    }
+
+    float totalError = 0.0f;
+
+    for (uint32_t t = 0; t < BLOCK_TEXEL_COUNT; t++)
+    {
+      float bestError = FLT_MAX;
+
+      for (uint32_t i = 0; i < 16; i++)
+      {
+        glm::vec4 d = palette[i] - texels[t];
+        float error = glm::dot(d, d);
+
+        if (error < bestError)
+        {
+          bestError = error;
+          indices[t] = i;
+        }
+      }
+
+      totalError += bestError;
+    }
+
+    return totalError;
+  }
+
+  template<typename Codec>
+  void encodeBlock(const glm::vec4 texels[BLOCK_TEXEL_COUNT], bool highQuality, uint8_t* dst)
+  {
+    glm::vec4 mean(0.0f);
+    glm::vec4 minValue(FLT_MAX);
+    glm::vec4 maxValue(-FLT_MAX);
+
+    for (uint32_t t = 0; t < BLOCK_TEXEL_COUNT; t++)
+    {
+      mean += texels[t];
+      minValue = glm::min(minValue, texels[t]);
+      maxValue = glm::max(maxValue, texels[t]);
+    }
+    mean /= float(BLOCK_TEXEL_COUNT);
+
+    glm::mat4 covariance(0.0f);
+    for (uint32_t t = 0; t < BLOCK_TEXEL_COUNT; t++)
+    {
+      glm::vec4 d = texels[t] - mean;
+      covariance += glm::outerProduct(d, d);
+    }
+
+    // Find the principal axis by power iteration, starting with the bounding box diagonal.
+    glm::vec4 axis = maxValue - minValue;
+    for (uint32_t i = 0; i < 8; i++)
+    {
+      glm::vec4 nextAxis = covariance * axis;
+
+      float length = glm::length(nextAxis);
+      if (length < 1e-6f)
+      {
+        break;
+      }
+
+      axis = nextAxis / length;
+    }
+
+    float axisLength = glm::length(axis);
+    axis = (axisLength > 0.0f) ? (axis / axisLength) : glm::vec4(0.0f);
+
+    float tMin = FLT_MAX;
+    float tMax = -FLT_MAX;
+    for (uint32_t t = 0; t < BLOCK_TEXEL_COUNT; t++)
+    {
+      float proj = glm::dot(texels[t] - mean, axis);
+      tMin = std::min(tMin, proj);
+      tMax = std::max(tMax, proj);
+    }
+
+    QuantizedEndpoint e0 = Codec::quantize(glm::clamp(mean + axis * tMin, 0.0f, Codec::MAX_VALUE));
+    QuantizedEndpoint e1 = Codec::quantize(glm::clamp(mean + axis * tMax, 0.0f, Codec::MAX_VALUE));
+
+    uint32_t indices[BLOCK_TEXEL_COUNT];
+    float error = assignIndices(texels, e0, e1, indices);
+
+    // Refine the endpoints with a least-squares fit to the interpolation weights.
+    for (uint32_t iteration = 0; highQuality && iteration < 2; iteration++)
+    {
+      float aa = 0.0f;
+      float ab = 0.0f;
+      float bb = 0.0f;
+      glm::vec4 ax(0.0f);
+      glm::vec4 bx(0.0f);
+
+      for (uint32_t t = 0; t < BLOCK_TEXEL_COUNT; t++)
+      {
+        float b = float(BC_WEIGHTS[indices[t]]) / 64.0f;
+        float a = 1.0f - b;
+
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        ax += a * texels[t];
+        bx += b * texels[t];
+      }
+
+      float det = aa * bb - ab * ab;
+      if (fabsf(det) < 1e-6f)
+      {
+        break;
+      }
+
+      glm::vec4 lo = (ax * bb - bx * ab) / det;
+      glm::vec4 hi = (bx * aa - ax * ab) / det;
+
+      QuantizedEndpoint newE0 = Codec::quantize(glm::clamp(lo, 0.0f, Codec::MAX_VALUE));
+      QuantizedEndpoint newE1 = Codec::quantize(glm::clamp(hi, 0.0f, Codec::MAX_VALUE));
+
+      uint32_t newIndices[BLOCK_TEXEL_COUNT];
+      float newError = assignIndices(texels, newE0, newE1, newIndices);
+
+      if (newError >= error)
+      {
+        break;
+      }
+
+      e0 = newE0;
+      e1 = newE1;
+      memcpy(indices, newIndices, sizeof(indices));
+      error = newError;
+    }
+
+    // The weights are symmetric, so swapping the endpoints and inverting the
+    // indices clears the MSB of the anchor index.
+    if (indices[0] >= 8)
+    {
+      std::swap(e0, e1);
+
+      for (uint32_t t = 0; t < BLOCK_TEXEL_COUNT; t++)
+      {
+        indices[t] = 15 - indices[t];
+      }
+    }
+
+    Codec::writeBlock(e0, e1, indices, dst);
+  }
+
+  template<typename Codec, typename ReadFunc>
+  void encodeImage(uint32_t width, uint32_t height, bool highQuality, ReadFunc readFunc, std::vector<uint8_t>& blocks)
+  {
+    uint32_t blockCountX = (width + BLOCK_DIM - 1) / BLOCK_DIM;
+    uint32_t blockCountY = (height + BLOCK_DIM - 1) / BLOCK_DIM;
+
+    blocks.resize(size_t(blockCountX) * blockCountY * BLOCK_BYTE_SIZE);
+
+#pragma omp parallel for schedule(dynamic)
+    for (int64_t by = 0; by < int64_t(blockCountY); by++)
+    {
+      for (uint32_t bx = 0; bx < blockCountX; bx++)
+      {
+        // Texels outside of the image are clamped to the edge.
+        glm::vec4 texels[BLOCK_TEXEL_COUNT];
+
+        for (uint32_t y = 0; y < BLOCK_DIM; y++)
+        {
+          uint32_t texelY = std::min(uint32_t(by) * BLOCK_DIM + y, height - 1);
+
+          for (uint32_t x = 0; x < BLOCK_DIM; x++)
+          {
+            uint32_t texelX = std::min(bx * BLOCK_DIM + x, width - 1);
+            texels[x + y * BLOCK_DIM] = readFunc(texelX, texelY);
+          }
+        }
+
+        uint8_t* block = &blocks[(bx + size_t(by) * blockCountX) * BLOCK_BYTE_SIZE];
+        encodeBlock<Codec>(texels, highQuality, block);
+      }
+    }
+  }
+}
+
+namespace gi
+{
+  void encodeBc7(const uint8_t* texels, uint32_t width, uint32_t height, bool highQuality, std::vector<uint8_t>& blocks)
+  {
+    auto readFunc = [texels, width](uint32_t x, uint32_t y) {
+      const uint8_t* texel = &texels[(x + size_t(y) * width) * 4];
+      return glm::vec4(texel[0], texel[1], texel[2], texel[3]);
+    };
+
+    detail::encodeImage<detail::Bc7Codec>(width, height, highQuality, readFunc, blocks);
+  }
+
+  void encodeBc6h(const uint8_t* texels, uint32_t width, uint32_t height, bool highQuality, std::vector<uint8_t>& blocks)
+  {
+    auto readFunc = [texels, width](uint32_t x, uint32_t y) {
+      glm::vec4 value(0.0f);
+
+      for (int c = 0; c < 3; c++)
+      {
+        uint16_t half;
+        memcpy(&half, &texels[(x + size_t(y) * width) * 8 + c * 2], sizeof(half));
+
+        // Negative values are clamped to zero and non-finite values to the largest half.
+        if (half & 0x8000)
+        {
+          half = 0;
+        }
+        else if (half > 0x7BFF)
+        {
+          half = 0x7BFF;
+        }
+
+        // The decoder scales interpolated endpoints by 31/64 to obtain the half bits,
+        // so we fit the endpoints to the inversely scaled bits.
+        value[c] = float(half) * (64.0f / 31.0f);
+      }
+
+      return value;
+    };
+
+    detail::encodeImage<detail::Bc6hCodec>(width, height, highQuality, readFunc, blocks);
+  }
+
+  uint64_t getBcImageSize(uint32_t width, uint32_t height)
+  {
+    uint64_t blockCountX = (width + detail::BLOCK_DIM - 1) / detail::BLOCK_DIM;
+    uint64_t blockCountY = (height + detail::BLOCK_DIM - 1) / detail::BLOCK_DIM;
+    return blockCountX * blockCountY * detail::BLOCK_BYTE_SIZE;
+  }
+}
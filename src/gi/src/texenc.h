@@ -0,0 +1,38 @@
+//
+// Copyright (C) 2019-2022 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+namespace gi
+{
+  // Block compression of 2D images on the CPU. Each 4x4 texel block is fit with a single
+  // endpoint pair along its principal axis (BC7 mode 6, BC6H mode 11). The high quality
+  // setting additionally refines the endpoints with a least-squares fit to the chosen indices.
+  // Blocks are encoded in parallel if OpenMP is available.
+
+  // Encodes RGBA8 texels to BC7 blocks.
+  void encodeBc7(const uint8_t* texels, uint32_t width, uint32_t height, bool highQuality, std::vector<uint8_t>& blocks);
+
+  // Encodes RGBA16F texels to unsigned BC6H blocks. Negative values are clamped and alpha is dropped.
+  void encodeBc6h(const uint8_t* texels, uint32_t width, uint32_t height, bool highQuality, std::vector<uint8_t>& blocks);
+
+  uint64_t getBcImageSize(uint32_t width, uint32_t height);
+}
@@ -17,6 +17,8 @@
 
 #include "texsys.h"
 
+#include "texenc.h"
+#include "boxfilter.h"
 #include "mmap.h"
 #include "gi.h"
 
@@ -24,99 +26,1254 @@
 #include <stager.h>
 #include <imgio.h>
 
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <filesystem>
+#include <thread>
+#include <unordered_set>
 #include <assert.h>
 #include <inttypes.h>
+#include <string.h>
+
+using namespace gtl;
+
+const float BYTES_TO_MIB = 1.0f / (1024.0f * 1024.0f);
+
+// At most two batches of decoded images are held in memory at a time.
+const size_t DECODE_BATCH_SIZE = 16;
+
+const uint32_t TRANSCODE_CACHE_MAGIC = 0x31435447; // 'GTC1'
+const uint32_t TRANSCODE_CACHE_VERSION = 2;
+const uint32_t TRANSCODE_CACHE_MAX_LEVEL_COUNT = 32;
+
+namespace detail
+{
+  struct TranscodeCacheHeader
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t format;
+    uint32_t levelCount;
+  };
+
+  struct TranscodeCacheLevelHeader
+  {
+    uint32_t width;
+    uint32_t height;
+    uint64_t size;
+  };
+
+  bool isBlockCompressed(CgpuImageFormat format)
+  {
+    return format >= CGPU_IMAGE_FORMAT_BC1_RGB_UNORM_BLOCK && format <= CGPU_IMAGE_FORMAT_BC7_SRGB_BLOCK;
+  }
+
+  // Pre-compressed images (KTX2, DDS) are uploaded as stored, returns UNDEFINED otherwise.
+  CgpuImageFormat getBlockCompressedImageFormat(imgio_format format)
+  {
+    switch (format)
+    {
+    case IMGIO_FORMAT_BC1_RGB_UNORM:
+      return CGPU_IMAGE_FORMAT_BC1_RGB_UNORM_BLOCK;
+    case IMGIO_FORMAT_BC1_RGBA_UNORM:
+      return CGPU_IMAGE_FORMAT_BC1_RGBA_UNORM_BLOCK;
+    case IMGIO_FORMAT_BC2_UNORM:
+      return CGPU_IMAGE_FORMAT_BC2_UNORM_BLOCK;
+    case IMGIO_FORMAT_BC3_UNORM:
+      return CGPU_IMAGE_FORMAT_BC3_UNORM_BLOCK;
+    case IMGIO_FORMAT_BC4_UNORM:
+      return CGPU_IMAGE_FORMAT_BC4_UNORM_BLOCK;
+    case IMGIO_FORMAT_BC5_UNORM:
+      return CGPU_IMAGE_FORMAT_BC5_UNORM_BLOCK;
+    case IMGIO_FORMAT_BC6H_UFLOAT:
+      return CGPU_IMAGE_FORMAT_BC6H_UFLOAT_BLOCK;
+    case IMGIO_FORMAT_BC7_UNORM:
+      return CGPU_IMAGE_FORMAT_BC7_UNORM_BLOCK;
+    default:
+      return CGPU_IMAGE_FORMAT_UNDEFINED;
+    }
+  }
+
+  // Fast non-cryptographic hash that consumes 8 bytes per step, followed by the
+  // MurmurHash3 finalizer.
+  uint64_t hashBytes(const uint8_t* data, size_t size, uint64_t hash = 0xcbf29ce484222325)
+  {
+    size_t i = 0;
+    for (; (i + 8) <= size; i += 8)
+    {
+      uint64_t word;
+      memcpy(&word, &data[i], sizeof(word));
+      hash = (hash ^ word) * 0x9e3779b97f4a7c15;
+      hash ^= hash >> 29;
+    }
+    for (; i < size; i++)
+    {
+      hash = (hash ^ data[i]) * 0x100000001b3;
+    }
+
+    hash ^= size;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccd;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53;
+    hash ^= hash >> 33;
+    return hash;
+  }
+
+  std::string makeContentKey(uint64_t hash)
+  {
+    char key[24];
+    snprintf(key, sizeof(key), "#%016" PRIx64, hash);
+    return key;
+  }
+
+  uint32_t getTexelSize(CgpuImageFormat format)
+  {
+    switch (format)
+    {
+    case CGPU_IMAGE_FORMAT_R16G16B16A16_SFLOAT:
+      return 8;
+    case CGPU_IMAGE_FORMAT_R8G8B8A8_UNORM:
+    case CGPU_IMAGE_FORMAT_E5B9G9R9_UFLOAT_PACK32:
+      return 4;
+    case CGPU_IMAGE_FORMAT_R8G8_UNORM:
+    case CGPU_IMAGE_FORMAT_R16_UNORM:
+    case CGPU_IMAGE_FORMAT_R16_SFLOAT:
+      return 2;
+    case CGPU_IMAGE_FORMAT_R8_UNORM:
+      return 1;
+    default:
+      assert(false);
+      return 0;
+    }
+  }
+
+  template<imgio_format Format>
+  glm::vec4 readTexel(const uint8_t* data, size_t texelIndex)
+  {
+    if constexpr (Format == IMGIO_FORMAT_RGBA8_UNORM)
+    {
+      uint32_t u;
+      memcpy(&u, &data[texelIndex * sizeof(u)], sizeof(u));
+      return glm::unpackUnorm4x8(u);
+    }
+    else if constexpr (Format == IMGIO_FORMAT_RGBA16_FLOAT)
+    {
+      uint64_t h;
+      memcpy(&h, &data[texelIndex * sizeof(h)], sizeof(h));
+      return glm::unpackHalf4x16(h);
+    }
+    else if constexpr (Format == IMGIO_FORMAT_RGBA32_FLOAT)
+    {
+      const float* f = &((const float*) data)[texelIndex * 4];
+      return glm::vec4(f[0], f[1], f[2], f[3]);
+    }
+    else if constexpr (Format == IMGIO_FORMAT_R8_UNORM)
+    {
+      float l = data[texelIndex] / 255.0f;
+      return glm::vec4(l, l, l, 1.0f);
+    }
+    else if constexpr (Format == IMGIO_FORMAT_RG8_UNORM)
+    {
+      float l = data[texelIndex * 2 + 0] / 255.0f;
+      float a = data[texelIndex * 2 + 1] / 255.0f;
+      return glm::vec4(l, l, l, a);
+    }
+    else if constexpr (Format == IMGIO_FORMAT_R16_UNORM)
+    {
+      uint16_t u;
+      memcpy(&u, &data[texelIndex * sizeof(u)], sizeof(u));
+      float l = glm::unpackUnorm1x16(u);
+      return glm::vec4(l, l, l, 1.0f);
+    }
+    else
+    {
+      static_assert(Format == IMGIO_FORMAT_R16_FLOAT);
+      uint16_t h;
+      memcpy(&h, &data[texelIndex * sizeof(h)], sizeof(h));
+      float l = glm::unpackHalf1x16(h);
+      return glm::vec4(l, l, l, 1.0f);
+    }
+  }
+
+  template<imgio_format Format>
+  void readTexels(const uint8_t* data, size_t firstTexel, size_t texelCount, glm::vec4* dst)
+  {
+    for (size_t i = 0; i < texelCount; i++)
+    {
+      dst[i] = readTexel<Format>(data, firstTexel + i);
+    }
+  }
+
+  // Unpacks a run of texels to floats. The format is dispatched once per run
+  // instead of once per texel, which keeps the inner loop branch-free.
+  void readTexels(const imgio_img& img, size_t firstTexel, size_t texelCount, glm::vec4* dst)
+  {
+    switch (img.format)
+    {
+    case IMGIO_FORMAT_RGBA8_UNORM:
+      return readTexels<IMGIO_FORMAT_RGBA8_UNORM>(img.data, firstTexel, texelCount, dst);
+    case IMGIO_FORMAT_RGBA16_FLOAT:
+      return readTexels<IMGIO_FORMAT_RGBA16_FLOAT>(img.data, firstTexel, texelCount, dst);
+    case IMGIO_FORMAT_RGBA32_FLOAT:
+      return readTexels<IMGIO_FORMAT_RGBA32_FLOAT>(img.data, firstTexel, texelCount, dst);
+    case IMGIO_FORMAT_R8_UNORM:
+      return readTexels<IMGIO_FORMAT_R8_UNORM>(img.data, firstTexel, texelCount, dst);
+    case IMGIO_FORMAT_RG8_UNORM:
+      return readTexels<IMGIO_FORMAT_RG8_UNORM>(img.data, firstTexel, texelCount, dst);
+    case IMGIO_FORMAT_R16_UNORM:
+      return readTexels<IMGIO_FORMAT_R16_UNORM>(img.data, firstTexel, texelCount, dst);
+    case IMGIO_FORMAT_R16_FLOAT:
+      return readTexels<IMGIO_FORMAT_R16_FLOAT>(img.data, firstTexel, texelCount, dst);
+    default:
+      assert(false);
+      std::fill(dst, dst + texelCount, glm::vec4(0.0f));
+    }
+  }
+
+  void packTexels(const glm::vec4* src, size_t texelCount, CgpuImageFormat format, uint8_t* dst)
+  {
+    uint32_t texelSize = getTexelSize(format);
+
+    for (size_t i = 0; i < texelCount; i++)
+    {
+      const glm::vec4& c = src[i];
+      uint8_t* texel = &dst[i * texelSize];
+
+      if (format == CGPU_IMAGE_FORMAT_R8G8B8A8_UNORM)
+      {
+        uint32_t packed = glm::packUnorm4x8(c);
+        memcpy(texel, &packed, sizeof(packed));
+      }
+      else if (format == CGPU_IMAGE_FORMAT_R8_UNORM)
+      {
+        texel[0] = uint8_t(glm::packUnorm4x8(c) & 0xFF);
+      }
+      else if (format == CGPU_IMAGE_FORMAT_R8G8_UNORM)
+      {
+        // Luminance and alpha
+        uint32_t packed = glm::packUnorm4x8(c);
+        texel[0] = uint8_t(packed & 0xFF);
+        texel[1] = uint8_t(packed >> 24);
+      }
+      else if (format == CGPU_IMAGE_FORMAT_R16_UNORM)
+      {
+        uint16_t packed = glm::packUnorm1x16(c.r);
+        memcpy(texel, &packed, sizeof(packed));
+      }
+      else if (format == CGPU_IMAGE_FORMAT_R16_SFLOAT)
+      {
+        uint16_t packed = glm::packHalf1x16(c.r);
+        memcpy(texel, &packed, sizeof(packed));
+      }
+      else if (format == CGPU_IMAGE_FORMAT_E5B9G9R9_UFLOAT_PACK32)
+      {
+        // Negative values can't be represented and alpha is dropped.
+        uint32_t packed = glm::packF3x9_E1x5(glm::max(glm::vec3(c), glm::vec3(0.0f)));
+        memcpy(texel, &packed, sizeof(packed));
+      }
+      else
+      {
+        uint64_t packed = glm::packHalf4x16(c);
+        memcpy(texel, &packed, sizeof(packed));
+      }
+    }
+  }
+
+  void packTexels(const std::vector<glm::vec4>& src, CgpuImageFormat format, std::vector<uint8_t>& dst)
+  {
+    dst.resize(src.size() * getTexelSize(format));
+    packTexels(src.data(), src.size(), format, dst.data());
+  }
+
+  // Images with fewer channels are stored in narrower formats, returns UNDEFINED otherwise.
+  CgpuImageFormat getLuminanceImageFormat(imgio_format format)
+  {
+    switch (format)
+    {
+    case IMGIO_FORMAT_R8_UNORM:
+      return CGPU_IMAGE_FORMAT_R8_UNORM;
+    case IMGIO_FORMAT_RG8_UNORM:
+      return CGPU_IMAGE_FORMAT_R8G8_UNORM;
+    case IMGIO_FORMAT_R16_UNORM:
+      return CGPU_IMAGE_FORMAT_R16_UNORM;
+    case IMGIO_FORMAT_R16_FLOAT:
+      return CGPU_IMAGE_FORMAT_R16_SFLOAT;
+    default:
+      return CGPU_IMAGE_FORMAT_UNDEFINED;
+    }
+  }
+
+  // The swizzle expands luminance (and alpha) to RGBA, so that shaders sample
+  // the same values as from an expanded RGBA image.
+  CgpuComponentMapping getComponentMapping(CgpuImageFormat format)
+  {
+    switch (format)
+    {
+    case CGPU_IMAGE_FORMAT_R8_UNORM:
+    case CGPU_IMAGE_FORMAT_R16_UNORM:
+    case CGPU_IMAGE_FORMAT_R16_SFLOAT:
+    case CGPU_IMAGE_FORMAT_BC4_UNORM_BLOCK:
+      return { CGPU_COMPONENT_SWIZZLE_R, CGPU_COMPONENT_SWIZZLE_R, CGPU_COMPONENT_SWIZZLE_R, CGPU_COMPONENT_SWIZZLE_ONE };
+    case CGPU_IMAGE_FORMAT_R8G8_UNORM:
+      return { CGPU_COMPONENT_SWIZZLE_R, CGPU_COMPONENT_SWIZZLE_R, CGPU_COMPONENT_SWIZZLE_R, CGPU_COMPONENT_SWIZZLE_G };
+    default:
+      return { CGPU_COMPONENT_SWIZZLE_IDENTITY, CGPU_COMPONENT_SWIZZLE_IDENTITY, CGPU_COMPONENT_SWIZZLE_IDENTITY, CGPU_COMPONENT_SWIZZLE_IDENTITY };
+    }
+  }
+
+  bool isTexelConversionRequired(const imgio_img& img, CgpuImageFormat format)
+  {
+    return !((img.format == IMGIO_FORMAT_RGBA8_UNORM && format == CGPU_IMAGE_FORMAT_R8G8B8A8_UNORM) ||
+             (img.format == IMGIO_FORMAT_RGBA16_FLOAT && format == CGPU_IMAGE_FORMAT_R16G16B16A16_SFLOAT) ||
+             (getLuminanceImageFormat(img.format) == format));
+  }
+
+  // Converts the base level texels to the GPU image format. Returns false if the
+  // decoded data can be uploaded as-is.
+  bool convertTexels(const imgio_img& img, CgpuImageFormat format, std::vector<uint8_t>& texels)
+  {
+    if (!isTexelConversionRequired(img, format))
+    {
+      return false;
+    }
+
+    uint32_t texelSize = getTexelSize(format);
+    texels.resize(size_t(img.width) * img.height * texelSize);
+
+    // Texels are unpacked in blocks of rows, so that large (HDR) images don't require
+    // a full-size intermediate of 16 bytes per texel.
+    const int64_t ROW_BLOCK_SIZE = 16;
+    int64_t blockCount = (int64_t(img.height) + ROW_BLOCK_SIZE - 1) / ROW_BLOCK_SIZE;
+
+#pragma omp parallel for
+    for (int64_t b = 0; b < blockCount; b++)
+    {
+      size_t firstTexel = size_t(b * ROW_BLOCK_SIZE) * img.width;
+      size_t rowCount = std::min(ROW_BLOCK_SIZE, int64_t(img.height) - b * ROW_BLOCK_SIZE);
+      size_t texelCount = rowCount * img.width;
+
+      std::vector<glm::vec4> unpacked(texelCount);
+      readTexels(img, firstTexel, texelCount, unpacked.data());
+
+      packTexels(unpacked.data(), texelCount, format, &texels[firstTexel * texelSize]);
+    }
+
+    return true;
+  }
+
+  // Returns the number of times the image needs to be halved to fit the caps (0 means unlimited).
+  uint32_t getSkippedLevelCount(uint32_t width, uint32_t height, uint64_t texelSize, uint32_t maxDimension, uint64_t maxByteSize)
+  {
+    uint32_t count = 0;
+
+    while (width > 1 || height > 1)
+    {
+      bool exceedsDimension = maxDimension > 0 && std::max(width, height) > maxDimension;
+      bool exceedsByteSize = maxByteSize > 0 && (uint64_t(width) * height * texelSize) > maxByteSize;
+
+      if (!exceedsDimension && !exceedsByteSize)
+      {
+        break;
+      }
+
+      width = std::max(width >> 1, 1u);
+      height = std::max(height >> 1, 1u);
+      count++;
+    }
+
+    return count;
+  }
+
+  void downsample(uint32_t srcWidth, uint32_t srcHeight, const std::vector<glm::vec4>& src, std::vector<glm::vec4>& dst)
+  {
+    uint32_t dstWidth = std::max(srcWidth >> 1, 1u);
+    dst.resize(size_t(dstWidth) * std::max(srcHeight >> 1, 1u));
+
+    auto readRow = [&src, srcWidth](uint32_t y, glm::vec4* /*scratch*/) {
+      return &src[size_t(y) * srcWidth];
+    };
+    auto writeRow = [&dst, dstWidth](uint32_t y, const glm::vec4* row) {
+      std::copy(row, row + dstWidth, &dst[size_t(y) * dstWidth]);
+    };
+    gi::downsampleBox(srcWidth, srcHeight, readRow, writeRow);
+  }
+
+  // The base level is unpacked row by row, so that it is never expanded to floats in full.
+  void downsample(const imgio_img& img, std::vector<glm::vec4>& dst)
+  {
+    uint32_t dstWidth = std::max(img.width >> 1, 1u);
+    dst.resize(size_t(dstWidth) * std::max(img.height >> 1, 1u));
+
+    auto readRow = [&img](uint32_t y, glm::vec4* scratch) -> const glm::vec4* {
+      readTexels(img, size_t(y) * img.width, img.width, scratch);
+      return scratch;
+    };
+    auto writeRow = [&dst, dstWidth](uint32_t y, const glm::vec4* row) {
+      std::copy(row, row + dstWidth, &dst[size_t(y) * dstWidth]);
+    };
+    gi::downsampleBox(img.width, img.height, readRow, writeRow);
+  }
+}
+
+namespace gi
+{
+  TexSys::TexSys(CgpuDevice device, GiAssetReader& assetReader, GgpuStager& stager, const InitParams& params)
+    : m_device(device)
+    , m_assetReader(assetReader)
+    , m_stager(stager)
+    , m_params(params)
+  {
+    if (m_params.compressTextures && !m_params.transcodeCachePath.empty())
+    {
+      std::error_code errorCode;
+      std::filesystem::create_directories(m_params.transcodeCachePath, errorCode);
+
+      if (errorCode)
+      {
+        fprintf(stderr, "failed to create texture cache dir %s\n", m_params.transcodeCachePath.c_str());
+        m_params.transcodeCachePath.clear();
+      }
+    }
+  }
+
+  TexSys::~TexSys()
+  {
+    assert(m_imageCache.empty());
+    assert(m_decodedImageCache.empty());
+    assert(m_bsdfDataImageCache.empty());
+  }
+
+  void TexSys::destroy()
+  {
+    for (const auto& pathImagePair : m_imageCache)
+    {
+      cgpuDestroyImage(m_device, pathImagePair.second.image);
+    }
+    m_imageCache.clear();
+    m_imageKeys.clear();
+    m_contentKeys.clear();
+    m_gpuByteSize = 0;
+
+    for (auto& pathImagePair : m_decodedImageCache)
+    {
+      imgio_free_img(&pathImagePair.second.data);
+    }
+    m_decodedImageCache.clear();
+    m_cpuByteSize = 0;
+
+    for (const auto& kindImagePair : m_bsdfDataImageCache)
+    {
+      cgpuDestroyImage(m_device, kindImagePair.second);
+    }
+    m_bsdfDataImageCache.clear();
+  }
+
+  bool TexSys::loadTextureFromFilePath(const char* filePath, CgpuImage& image, bool is3dImage, bool flushImmediately)
+  {
+    uint64_t useTick = ++m_useCounter;
+
+    computeContentKeys({ filePath });
+    std::string cacheKey = getCacheKey(filePath);
+
+    auto cacheResult = m_imageCache.find(cacheKey);
+    if (cacheResult != m_imageCache.end())
+    {
+      CachedImage& cachedImage = cacheResult->second;
+      cachedImage.refCount++;
+      cachedImage.lastUse = useTick;
+      image = cachedImage.image;
+      m_hitCount++;
+      trackDeduplication(cachedImage, filePath);
+      return true;
+    }
+
+    m_missCount++;
+
+    PendingImage pendingImage;
+    pendingImage.filePath = filePath;
+    pendingImage.cacheKey = cacheKey;
+    pendingImage.is3dImage = is3dImage;
+    pendingImage.isDecodedImageCached = false;
+    pendingImage.isUploaded = false;
+
+    auto decodedCacheResult = m_decodedImageCache.find(cacheKey);
+    if (decodedCacheResult != m_decodedImageCache.end())
+    {
+      decodedCacheResult->second.lastUse = useTick;
+      decodedCacheResult->second.pinCount++;
+      pendingImage.imageData = decodedCacheResult->second.data;
+      pendingImage.isDecodedImageCached = true;
+      m_decodedHitCount++;
+    }
+
+    decodeAndPrepareImage(pendingImage);
+    uploadPendingImage(pendingImage);
+
+    if (!pendingImage.isUploaded)
+    {
+      return false;
+    }
+
+    // The reference taken on upload is handed to the caller.
+    image = m_imageCache[cacheKey].image;
+
+    if (flushImmediately)
+    {
+      m_stager.flush();
+    }
+
+    return true;
+  }
+
+  void TexSys::decodeAndPrepareImage(PendingImage& pendingImage) const
+  {
+    pendingImage.isDecoded = false;
+    pendingImage.isDecodeDeferred = false;
+    pendingImage.isPrepared = false;
+
+    const char* filePath = pendingImage.filePath.c_str();
+
+    // Compressed images are looked up by the hash of the file contents, so we need
+    // to read the file even if the decoded image is cached.
+    bool useTranscodeCache = m_params.compressTextures && !pendingImage.is3dImage && !m_params.transcodeCachePath.empty();
+
+    GiAsset* asset = nullptr;
+    if (!pendingImage.isDecodedImageCached || useTranscodeCache)
+    {
+      asset = m_assetReader.open(filePath);
+    }
+
+    const uint8_t* fileData = asset ? (const uint8_t*) m_assetReader.data(asset) : nullptr;
+    size_t fileSize = asset ? m_assetReader.size(asset) : 0;
+
+    std::string transcodeCacheFilePath;
+    if (useTranscodeCache && fileData)
+    {
+      transcodeCacheFilePath = getTranscodeCacheFilePath(fileData, fileSize);
+
+      if (readTranscodedImage(transcodeCacheFilePath, pendingImage.prepared))
+      {
+        printf("compressed image for path %s read from texture cache\n", filePath);
+        m_transcodeCacheHitCount++;
+        pendingImage.isPrepared = true;
+      }
+    }
+
+    // Images that are uploaded as decoded can be decoded straight into staging memory on
+    // upload. Mip generation, compression and the decoded image cache need the texels in
+    // system memory, and the image has to fit into the staging buffer.
+    bool allowDeferredDecode = !pendingImage.is3dImage && !m_params.generateMips &&
+                               !m_params.compressTextures && m_params.cpuByteBudget == 0;
+
+    if (!pendingImage.isPrepared && !pendingImage.isDecodedImageCached && fileData && allowDeferredDecode &&
+        imgio_read_info(fileData, fileSize, m_params.maxDimension, &pendingImage.imageData) == IMGIO_OK)
+    {
+      const imgio_img& info = pendingImage.imageData;
+      uint64_t texelSize = info.size / (uint64_t(info.width) * info.height);
+
+      pendingImage.isDecodeDeferred = info.size <= m_stager.getMaxDirectStageSize() &&
+        detail::getSkippedLevelCount(info.width, info.height, texelSize, m_params.maxDimension, m_params.maxByteSize) == 0;
+    }
+
+    if (!pendingImage.isPrepared && !pendingImage.isDecodedImageCached && !pendingImage.isDecodeDeferred && fileData)
+    {
+      // JPEG and mip-mapped EXR images can be decoded at a reduced resolution.
+      uint32_t maxDimension = pendingImage.is3dImage ? 0 : m_params.maxDimension;
+      pendingImage.isDecoded = imgio_load_img_scaled(fileData, fileSize, maxDimension, &pendingImage.imageData) == IMGIO_OK;
+
+      if (pendingImage.isDecoded)
+      {
+        const imgio_img& imageData = pendingImage.imageData;
+        printf("image read from path %s of size %.2fMiB (%u channels, %u bits, %u levels)\n",
+          filePath, imageData.size * BYTES_TO_MIB, imageData.channel_count, imageData.bit_depth, imageData.level_count);
+      }
+
+      if (pendingImage.isDecoded && imgio_is_block_compressed(pendingImage.imageData.format) && !m_params.blockCompressionSupported)
+      {
+        fprintf(stderr, "unable to load compressed image %s - device feature missing\n", filePath);
+        imgio_free_img(&pendingImage.imageData);
+        pendingImage.isDecoded = false;
+      }
+    }
+
+    if (!pendingImage.isPrepared && (pendingImage.isDecoded || pendingImage.isDecodedImageCached))
+    {
+      prepareImage(pendingImage.imageData, pendingImage.is3dImage, pendingImage.prepared);
+      pendingImage.isPrepared = true;
+
+      // Images that were already compressed on disk don't need to be cached.
+      bool isEncoded = detail::isBlockCompressed(pendingImage.prepared.format) &&
+                       !imgio_is_block_compressed(pendingImage.imageData.format);
+
+      if (!transcodeCacheFilePath.empty() && isEncoded && !writeTranscodedImage(transcodeCacheFilePath, pendingImage.prepared))
+      {
+        fprintf(stderr, "failed to write texture cache file %s\n", transcodeCacheFilePath.c_str());
+      }
+    }
+
+    if (asset)
+    {
+      m_assetReader.close(asset);
+    }
+  }
+
+  std::string TexSys::getTranscodeCacheFilePath(const uint8_t* fileData, size_t fileSize) const
+  {
+    uint64_t hash = detail::hashBytes(fileData, fileSize);
+
+    uint64_t settings[] = {
+      TRANSCODE_CACHE_VERSION, m_params.generateMips, m_params.highQualityCompression, m_params.maxDimension, m_params.maxByteSize
+    };
+    hash = detail::hashBytes((const uint8_t*) settings, sizeof(settings), hash);
+
+    char fileName[32];
+    snprintf(fileName, sizeof(fileName), "%016" PRIx64 ".gtc", hash);
+
+    return (std::filesystem::path(m_params.transcodeCachePath) / fileName).string();
+  }
+
+  bool TexSys::readTranscodedImage(const std::string& filePath, PreparedImage& prepared)
+  {
+    FILE* file = fopen(filePath.c_str(), "rb");
+    if (!file)
+    {
+      return false;
+    }
+
+    detail::TranscodeCacheHeader header;
+    bool result = fread(&header, sizeof(header), 1, file) == 1 &&
+                  header.magic == TRANSCODE_CACHE_MAGIC &&
+                  header.version == TRANSCODE_CACHE_VERSION &&
+                  header.levelCount > 0 &&
+                  header.levelCount <= TRANSCODE_CACHE_MAX_LEVEL_COUNT &&
+                  detail::isBlockCompressed((CgpuImageFormat) header.format);
+
+    if (result)
+    {
+      prepared.is3d = false;
+      prepared.format = (CgpuImageFormat) header.format;
+      prepared.levels.reserve(header.levelCount);
+      prepared.levelStorage.reserve(header.levelCount);
+    }
+
+    for (uint32_t level = 0; result && level < header.levelCount; level++)
+    {
+      detail::TranscodeCacheLevelHeader levelHeader;
+      result = fread(&levelHeader, sizeof(levelHeader), 1, file) == 1 &&
+               levelHeader.size == getBcImageSize(levelHeader.width, levelHeader.height);
+
+      if (!result)
+      {
+        break;
+      }
+
+      std::vector<uint8_t>& texels = prepared.levelStorage.emplace_back(levelHeader.size);
+      result = fread(texels.data(), levelHeader.size, 1, file) == 1;
+
+      prepared.levels.push_back({ levelHeader.width, levelHeader.height, texels.data(), texels.size() });
+    }
+
+    fclose(file);
+
+    if (!result)
+    {
+      fprintf(stderr, "invalid texture cache file %s\n", filePath.c_str());
+      prepared = {};
+    }
+
+    return result;
+  }
+
+  bool TexSys::writeTranscodedImage(const std::string& filePath, const PreparedImage& prepared)
+  {
+    // Files are renamed after writing so that concurrent readers never see partial files.
+    size_t threadHash = std::hash<std::thread::id>{}(std::this_thread::get_id());
+    std::string tmpFilePath = filePath + "." + std::to_string(threadHash) + ".tmp";
+
+    FILE* file = fopen(tmpFilePath.c_str(), "wb");
+    if (!file)
+    {
+      return false;
+    }
+
+    detail::TranscodeCacheHeader header = {
+      .magic = TRANSCODE_CACHE_MAGIC,
+      .version = TRANSCODE_CACHE_VERSION,
+      .format = (uint32_t) prepared.format,
+      .levelCount = (uint32_t) prepared.levels.size()
+    };
+
+    bool result = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    for (const MipLevelData& levelData : prepared.levels)
+    {
+      detail::TranscodeCacheLevelHeader levelHeader = {
+        .width = levelData.width,
+        .height = levelData.height,
+        .size = levelData.size
+      };
+
+      result = result &&
+               fwrite(&levelHeader, sizeof(levelHeader), 1, file) == 1 &&
+               fwrite(levelData.texels, levelData.size, 1, file) == 1;
+    }
+
+    result = (fclose(file) == 0) && result;
+
+    std::error_code errorCode;
+    if (result)
+    {
+      std::filesystem::rename(tmpFilePath, filePath, errorCode);
+      result = !errorCode;
+    }
+    if (!result)
+    {
+      std::filesystem::remove(tmpFilePath, errorCode);
+    }
+
+    return result;
+  }
+
+  void TexSys::uploadPendingImage(PendingImage& pendingImage)
+  {
+    CgpuImage image;
+    uint64_t byteSize;
+
+    if (pendingImage.isDecodeDeferred)
+    {
+      pendingImage.isUploaded = decodeImageIntoStager(pendingImage, image, byteSize);
+    }
+    else if (pendingImage.isPrepared)
+    {
+      // Mip levels may reference the decoded data, so it is freed after staging.
+      bool freeImageData = pendingImage.isDecoded && !cacheDecodedImage(pendingImage.cacheKey, pendingImage.imageData);
+
+      pendingImage.isUploaded = uploadImage(pendingImage.prepared, image, byteSize);
+
+      if (freeImageData)
+      {
+        imgio_free_img(&pendingImage.imageData);
+      }
+      pendingImage.prepared = {};
+    }
+
+    if (pendingImage.isDecodedImageCached)
+    {
+      auto decodedCacheResult = m_decodedImageCache.find(pendingImage.cacheKey);
+      assert(decodedCacheResult != m_decodedImageCache.end());
+      decodedCacheResult->second.pinCount--;
+    }
+
+    if (pendingImage.isUploaded)
+    {
+      insertCachedImage(pendingImage.cacheKey, pendingImage.filePath, image, byteSize);
+    }
+  }
+
+  bool TexSys::decodeImageIntoStager(const PendingImage& pendingImage, CgpuImage& image, uint64_t& byteSize)
+  {
+    const imgio_img& info = pendingImage.imageData;
+    const char* filePath = pendingImage.filePath.c_str();
+
+    GiAsset* asset = m_assetReader.open(filePath);
+    if (!asset)
+    {
+      return false;
+    }
+
+    // There are no mip levels to drop, so we can only evict other images.
+    byteSize = info.size;
+    makeGpuBudgetSpace(byteSize);
+
+    CgpuImageFormat luminanceFormat = detail::getLuminanceImageFormat(info.format);
+    CgpuImageFormat format = (luminanceFormat != CGPU_IMAGE_FORMAT_UNDEFINED) ? luminanceFormat : CGPU_IMAGE_FORMAT_R8G8B8A8_UNORM;
+
+    CgpuImageDesc image_desc = {};
+    image_desc.format = format;
+    image_desc.components = detail::getComponentMapping(format);
+    image_desc.usage = CGPU_IMAGE_USAGE_FLAG_SAMPLED | CGPU_IMAGE_USAGE_FLAG_TRANSFER_DST;
+    image_desc.width = info.width;
+    image_desc.height = info.height;
+    image_desc.depth = 1;
+    image_desc.mipLevels = 1;
+
+    bool result = cgpuCreateImage(m_device, &image_desc, &image);
+
+    if (result)
+    {
+      const void* fileData = m_assetReader.data(asset);
+      size_t fileSize = m_assetReader.size(asset);
+      size_t rowPitch = info.size / info.height;
+
+      auto writeFunc = [this, fileData, fileSize, rowPitch](uint8_t* dst) {
+        return imgio_decode_into(fileData, fileSize, m_params.maxDimension, dst, rowPitch) == IMGIO_OK;
+      };
+
+      result = m_stager.stageToImage(writeFunc, info.size, image, info.width, info.height, 1);
+
+      if (!result)
+      {
+        cgpuDestroyImage(m_device, image);
+      }
+    }
+
+    m_assetReader.close(asset);
+
+    if (result)
+    {
+      printf("image read from path %s of size %.2fMiB decoded into staging memory\n", filePath, info.size * BYTES_TO_MIB);
+    }
+
+    return result;
+  }
+
+  void TexSys::insertCachedImage(const std::string& cacheKey, const std::string& filePath, CgpuImage image, uint64_t byteSize)
+  {
+    m_imageCache[cacheKey] = CachedImage{ image, byteSize, 1, ++m_useCounter, filePath };
+    m_imageKeys[image.handle] = cacheKey;
+    m_gpuByteSize += byteSize;
+  }
+
+  void TexSys::computeContentKeys(const std::vector<std::string>& filePaths)
+  {
+    if (!m_params.deduplicateImages)
+    {
+      return;
+    }
+
+    std::vector<std::string> newFilePaths;
+    for (const std::string& filePath : filePaths)
+    {
+      if (!filePath.empty() && m_contentKeys.count(filePath) == 0)
+      {
+        newFilePaths.push_back(filePath);
+      }
+    }
+
+    std::vector<std::string> contentKeys(newFilePaths.size());
+
+#pragma omp parallel for
+    for (int64_t i = 0; i < int64_t(newFilePaths.size()); i++)
+    {
+      GiAsset* asset = m_assetReader.open(newFilePaths[i].c_str());
+      if (!asset)
+      {
+        continue;
+      }
+
+      const uint8_t* data = (const uint8_t*) m_assetReader.data(asset);
+      if (data)
+      {
+        contentKeys[i] = detail::makeContentKey(detail::hashBytes(data, m_assetReader.size(asset)));
+      }
+
+      m_assetReader.close(asset);
+    }
+
+    // Unreadable files fall back to path-based keys.
+    for (size_t i = 0; i < newFilePaths.size(); i++)
+    {
+      m_contentKeys[newFilePaths[i]] = contentKeys[i].empty() ? newFilePaths[i] : contentKeys[i];
+    }
+  }
+
+  const std::string& TexSys::getCacheKey(const std::string& filePath) const
+  {
+    auto keyResult = m_contentKeys.find(filePath);
+    return (keyResult != m_contentKeys.end()) ? keyResult->second : filePath;
+  }
+
+  void TexSys::trackDeduplication(const CachedImage& cachedImage, const std::string& filePath)
+  {
+    if (cachedImage.filePath != filePath)
+    {
+      m_dedupHitCount++;
+      m_dedupByteSize += cachedImage.byteSize;
+    }
+  }
+
+  void TexSys::prepareImage(const imgio_img& imageData, bool is3dImage, PreparedImage& prepared) const
+  {
+    bool isHdr = imageData.format == IMGIO_FORMAT_RGBA16_FLOAT || imageData.format == IMGIO_FORMAT_RGBA32_FLOAT;
+    CgpuImageFormat luminanceFormat = detail::getLuminanceImageFormat(imageData.format);
+    bool isLuminance = luminanceFormat != CGPU_IMAGE_FORMAT_UNDEFINED;
+
+    // Luminance images are already at least as compact as BC7.
+    bool isCompressed = m_params.compressTextures && !is3dImage && !isLuminance;
+
+    prepared.is3d = is3dImage;
+    prepared.format = isHdr ? m_params.hdrImageFormat : CGPU_IMAGE_FORMAT_R8G8B8A8_UNORM;
+
+    if (isLuminance)
+    {
+      prepared.format = luminanceFormat;
+    }
+
+    // Pre-compressed images and stored mip chains that don't need conversion are
+    // uploaded directly from the file data.
+    CgpuImageFormat blockCompressedFormat = detail::getBlockCompressedImageFormat(imageData.format);
+    bool useStoredLevels = (blockCompressedFormat != CGPU_IMAGE_FORMAT_UNDEFINED) ||
+                           (imageData.level_count > 1 && !isCompressed && !detail::isTexelConversionRequired(imageData, prepared.format));
+
+    if (useStoredLevels)
+    {
+      if (blockCompressedFormat != CGPU_IMAGE_FORMAT_UNDEFINED)
+      {
+        prepared.format = blockCompressedFormat;
+      }
+
+      // Levels exceeding the caps are skipped, but the least detailed one is always kept.
+      uint32_t firstLevel = 0;
+      while (!is3dImage && (firstLevel + 1) < imageData.level_count)
+      {
+        uint32_t width = std::max(imageData.width >> firstLevel, 1u);
+        uint32_t height = std::max(imageData.height >> firstLevel, 1u);
 
-using namespace gtl;
+        bool exceedsDimension = m_params.maxDimension > 0 && std::max(width, height) > m_params.maxDimension;
+        bool exceedsByteSize = m_params.maxByteSize > 0 && imgio_get_level_size(imageData.format, width, height) > m_params.maxByteSize;
 
-const float BYTES_TO_MIB = 1.0f / (1024.0f * 1024.0f);
+        if (!exceedsDimension && !exceedsByteSize)
+        {
+          break;
+        }
 
-namespace detail
-{
-  bool readImage(const char* filePath, GiAssetReader& assetReader, imgio_img* img)
-  {
-    GiAsset* asset = assetReader.open(filePath);
-    if (!asset)
+        firstLevel++;
+      }
+
+      uint32_t lastLevel = (m_params.generateMips && !is3dImage) ? (imageData.level_count - 1) : firstLevel;
+
+      for (uint32_t level = firstLevel; level <= lastLevel; level++)
+      {
+        uint32_t width = std::max(imageData.width >> level, 1u);
+        uint32_t height = std::max(imageData.height >> level, 1u);
+        uint64_t size = imgio_get_level_size(imageData.format, width, height);
+
+        prepared.levels.push_back({ width, height, &imageData.data[imageData.level_offsets[level]], size });
+      }
+
+      if (firstLevel > 0)
+      {
+        printf("skipping %u stored mip levels of %ux%u image\n", firstLevel, imageData.width, imageData.height);
+      }
+
+      return;
+    }
+
+    // Block compression operates on RGBA16F texels for HDR images.
+    if (isCompressed && isHdr)
     {
-      return false;
+      prepared.format = CGPU_IMAGE_FORMAT_R16G16B16A16_SFLOAT;
+    }
+
+    // Images exceeding the resolution or size cap skip their most detailed levels.
+    uint32_t skippedLevelCount = 0;
+    if (!is3dImage)
+    {
+      skippedLevelCount = detail::getSkippedLevelCount(imageData.width, imageData.height, detail::getTexelSize(prepared.format),
+                                                       m_params.maxDimension, m_params.maxByteSize);
+    }
+
+    uint32_t lastLevel = skippedLevelCount;
+    if (m_params.generateMips && !is3dImage)
+    {
+      lastLevel = std::bit_width(std::max(imageData.width, imageData.height)) - 1;
+    }
+
+    uint32_t mipLevelCount = lastLevel - skippedLevelCount + 1;
+    prepared.levels.reserve(mipLevelCount);
+    prepared.levelStorage.reserve(mipLevelCount);
+
+    if (skippedLevelCount == 0)
+    {
+      std::vector<uint8_t> convertedTexels;
+      if (detail::convertTexels(imageData, prepared.format, convertedTexels))
+      {
+        const std::vector<uint8_t>& texels = prepared.levelStorage.emplace_back(std::move(convertedTexels));
+        prepared.levels.push_back({ imageData.width, imageData.height, texels.data(), texels.size() });
+      }
+      else
+      {
+        // Only the base level of stored mip chains is used.
+        uint64_t size = imgio_get_level_size(imageData.format, imageData.width, imageData.height);
+        prepared.levels.push_back({ imageData.width, imageData.height, imageData.data, size });
+      }
     }
 
-    size_t size = assetReader.size(asset);
-    void* data = assetReader.data(asset);
+    // Each mip level is box-filtered from the previous one.
+    std::vector<glm::vec4> mipTexels;
+    std::vector<glm::vec4> prevMipTexels;
+    uint32_t mipWidth = imageData.width;
+    uint32_t mipHeight = imageData.height;
+
+    for (uint32_t level = 1; level <= lastLevel; level++)
+    {
+      if (level == 1)
+      {
+        detail::downsample(imageData, mipTexels);
+      }
+      else
+      {
+        prevMipTexels.swap(mipTexels);
+        detail::downsample(mipWidth, mipHeight, prevMipTexels, mipTexels);
+      }
+
+      mipWidth = std::max(mipWidth >> 1, 1u);
+      mipHeight = std::max(mipHeight >> 1, 1u);
+
+      if (level < skippedLevelCount)
+      {
+        continue;
+      }
+
+      if (level == skippedLevelCount)
+      {
+        printf("downscaling image from %ux%u to %ux%u\n", imageData.width, imageData.height, mipWidth, mipHeight);
+      }
 
-    bool loadResult = data && imgio_load_img(data, size, img) == IMGIO_OK;
+      std::vector<uint8_t>& texels = prepared.levelStorage.emplace_back();
+      detail::packTexels(mipTexels, prepared.format, texels);
+      prepared.levels.push_back({ mipWidth, mipHeight, texels.data(), texels.size() });
+    }
 
-    assetReader.close(asset);
-    return loadResult;
+    if (isCompressed)
+    {
+      compressImage(prepared);
+    }
   }
-}
 
-namespace gi
-{
-  TexSys::TexSys(CgpuDevice device, GiAssetReader& assetReader, GgpuStager& stager)
-    : m_device(device)
-    , m_assetReader(assetReader)
-    , m_stager(stager)
+  void TexSys::compressImage(PreparedImage& prepared) const
   {
+    auto startTime = std::chrono::steady_clock::now();
+
+    bool isHdr = prepared.format == CGPU_IMAGE_FORMAT_R16G16B16A16_SFLOAT;
+    bool highQuality = m_params.highQualityCompression;
+
+    std::vector<std::vector<uint8_t>> levelStorage(prepared.levels.size());
+    uint64_t texelCount = 0;
+
+    for (size_t level = 0; level < prepared.levels.size(); level++)
+    {
+      const MipLevelData& levelData = prepared.levels[level];
+
+      if (isHdr)
+      {
+        encodeBc6h(levelData.texels, levelData.width, levelData.height, highQuality, levelStorage[level]);
+      }
+      else
+      {
+        encodeBc7(levelData.texels, levelData.width, levelData.height, highQuality, levelStorage[level]);
+      }
+
+      texelCount += uint64_t(levelData.width) * levelData.height;
+    }
+
+    prepared.format = isHdr ? CGPU_IMAGE_FORMAT_BC6H_UFLOAT_BLOCK : CGPU_IMAGE_FORMAT_BC7_UNORM_BLOCK;
+    prepared.levelStorage = std::move(levelStorage);
+
+    for (size_t level = 0; level < prepared.levels.size(); level++)
+    {
+      prepared.levels[level].texels = prepared.levelStorage[level].data();
+      prepared.levels[level].size = prepared.levelStorage[level].size();
+    }
+
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime);
+    uint64_t microseconds = std::max(uint64_t(duration.count()), uint64_t(1));
+
+    m_encodedTexelCount += texelCount;
+    m_encodeMicroseconds += microseconds;
+
+    printf("encoded %ux%u image to %s in %.1fms (%.1f MTexel/s)\n",
+      prepared.levels[0].width, prepared.levels[0].height, isHdr ? "BC6H" : "BC7",
+      microseconds / 1000.0f, float(texelCount) / float(microseconds));
   }
 
-  TexSys::~TexSys()
+  bool TexSys::uploadImage(const PreparedImage& prepared, CgpuImage& image, uint64_t& byteSize)
   {
-    assert(m_imageCache.empty());
+    uint32_t mipLevelCount = prepared.levels.size();
+
+    // Under memory pressure, we drop the most detailed mip levels instead of failing.
+    uint32_t baseLevel = 0;
+    while (true)
+    {
+      byteSize = 0;
+      for (uint32_t level = baseLevel; level < mipLevelCount; level++)
+      {
+        byteSize += prepared.levels[level].size;
+      }
+
+      bool isLastLevel = (baseLevel + 1) == mipLevelCount;
+      if (!makeGpuBudgetSpace(byteSize) && !isLastLevel)
+      {
+        baseLevel++;
+        continue;
+      }
+
+      CgpuImageDesc image_desc = {};
+      image_desc.is3d = prepared.is3d;
+      image_desc.format = prepared.format;
+      image_desc.components = detail::getComponentMapping(prepared.format);
+      image_desc.usage = CGPU_IMAGE_USAGE_FLAG_SAMPLED | CGPU_IMAGE_USAGE_FLAG_TRANSFER_DST;
+      image_desc.width = prepared.levels[baseLevel].width;
+      image_desc.height = prepared.levels[baseLevel].height;
+      image_desc.depth = 1;
+      image_desc.mipLevels = mipLevelCount - baseLevel;
+
+      if (cgpuCreateImage(m_device, &image_desc, &image))
+      {
+        break;
+      }
+
+      // The allocation may also fail if the budget exceeds the available memory.
+      bool evictedImages = false;
+      while (evictLeastRecentlyUsedImage())
+      {
+        evictedImages = true;
+      }
+
+      if (evictedImages)
+      {
+        continue;
+      }
+
+      if (isLastLevel)
+      {
+        return false;
+      }
+
+      baseLevel++;
+    }
+
+    if (baseLevel > 0)
+    {
+      printf("texture budget exceeded; skipping %u mip levels\n", baseLevel);
+      m_reducedMipCount++;
+    }
+
+    bool isBlockCompressed = detail::isBlockCompressed(prepared.format);
+
+    if (prepared.format == CGPU_IMAGE_FORMAT_R16G16B16A16_SFLOAT || prepared.format == CGPU_IMAGE_FORMAT_E5B9G9R9_UFLOAT_PACK32)
+    {
+      printf("storing HDR image with %u bytes per texel\n", detail::getTexelSize(prepared.format));
+    }
+
+    uint32_t blockDim = isBlockCompressed ? 4 : 1;
+    uint64_t uncompressedByteSize = 0;
+
+    for (uint32_t level = baseLevel; level < mipLevelCount; level++)
+    {
+      const MipLevelData& levelData = prepared.levels[level];
+
+      if (!m_stager.stageToImage(levelData.texels, levelData.size, image, levelData.width, levelData.height, 1, level - baseLevel, blockDim))
+      {
+        cgpuDestroyImage(m_device, image);
+        return false;
+      }
+
+      // BC6H images are encoded from RGBA16F, BC7 images from RGBA8 texels.
+      uint64_t texelSize = (prepared.format == CGPU_IMAGE_FORMAT_BC6H_UFLOAT_BLOCK) ? 8 : 4;
+      uncompressedByteSize += uint64_t(levelData.width) * levelData.height * texelSize;
+    }
+
+    if (isBlockCompressed && uncompressedByteSize > byteSize)
+    {
+      m_compressionByteSavings += uncompressedByteSize - byteSize;
+    }
+
+    return true;
   }
 
-  void TexSys::destroy()
+  bool TexSys::makeGpuBudgetSpace(uint64_t byteSize)
   {
-    for (const auto& pathImagePair : m_imageCache)
+    if (m_params.gpuByteBudget == 0)
     {
-      cgpuDestroyImage(m_device, pathImagePair.second);
+      return true;
     }
-    m_imageCache.clear();
+
+    while ((m_gpuByteSize + byteSize) > m_params.gpuByteBudget)
+    {
+      if (!evictLeastRecentlyUsedImage())
+      {
+        return false;
+      }
+    }
+
+    return true;
   }
 
-  bool TexSys::loadTextureFromFilePath(const char* filePath, CgpuImage& image, bool is3dImage, bool flushImmediately)
+  bool TexSys::evictLeastRecentlyUsedImage()
   {
-    auto cacheResult = m_imageCache.find(filePath);
-    if (cacheResult != m_imageCache.end())
+    auto lruIt = m_imageCache.end();
+
+    for (auto it = m_imageCache.begin(); it != m_imageCache.end(); it++)
     {
-      image = cacheResult->second;
-      return true;
+      const CachedImage& cachedImage = it->second;
+      if (cachedImage.refCount > 0)
+      {
+        continue;
+      }
+      if (lruIt == m_imageCache.end() || cachedImage.lastUse < lruIt->second.lastUse)
+      {
+        lruIt = it;
+      }
     }
 
-    imgio_img image_data;
-    if (!detail::readImage(filePath, m_assetReader, &image_data))
+    if (lruIt == m_imageCache.end())
     {
       return false;
     }
 
-    printf("image read from path %s of size %.2fMiB\n",
-      filePath, image_data.size * BYTES_TO_MIB);
-
-    CgpuImageDesc image_desc;
-    image_desc.is3d = is3dImage;
-    image_desc.format = CGPU_IMAGE_FORMAT_R8G8B8A8_UNORM;
-    image_desc.usage = CGPU_IMAGE_USAGE_FLAG_SAMPLED | CGPU_IMAGE_USAGE_FLAG_TRANSFER_DST;
-    image_desc.width = image_data.width;
-    image_desc.height = image_data.height;
-    image_desc.depth = 1;
+    CgpuImage image = lruIt->second.image;
+    m_gpuByteSize -= lruIt->second.byteSize;
+    m_imageKeys.erase(image.handle);
+    m_imageCache.erase(lruIt);
+    m_evictionCount++;
 
-    bool creationSuccessful = cgpuCreateImage(m_device, &image_desc, &image) &&
-                              m_stager.stageToImage(image_data.data, image_data.size, image, image_data.width, image_data.height, 1);
+    cgpuDestroyImage(m_device, image);
 
-    imgio_free_img(&image_data);
+    return true;
+  }
 
-    if (!creationSuccessful)
+  bool TexSys::cacheDecodedImage(const std::string& cacheKey, const imgio_img& imageData)
+  {
+    uint64_t budget = m_params.cpuByteBudget;
+    if (budget == 0 || imageData.size > budget)
     {
       return false;
     }
 
-    m_imageCache[filePath] = image;
-
-    if (flushImmediately)
+    while ((m_cpuByteSize + imageData.size) > budget)
     {
-      m_stager.flush();
+      // Images of the batch that is being uploaded may still reference pinned entries.
+      auto lruIt = m_decodedImageCache.end();
+      for (auto it = m_decodedImageCache.begin(); it != m_decodedImageCache.end(); it++)
+      {
+        if (it->second.pinCount > 0)
+        {
+          continue;
+        }
+        if (lruIt == m_decodedImageCache.end() || it->second.lastUse < lruIt->second.lastUse)
+        {
+          lruIt = it;
+        }
+      }
+
+      if (lruIt == m_decodedImageCache.end())
+      {
+        return false;
+      }
+
+      m_cpuByteSize -= lruIt->second.data.size;
+      imgio_free_img(&lruIt->second.data);
+      m_decodedImageCache.erase(lruIt);
     }
 
+    m_decodedImageCache[cacheKey] = CachedDecodedImage{ imageData, ++m_useCounter, 0 };
+    m_cpuByteSize += imageData.size;
+
     return true;
   }
 
@@ -136,6 +1293,94 @@ namespace gi
     images2d.reserve(texCount);
     images3d.reserve(texCount);
 
+    // Images from files are decoded, converted and mip-mapped in parallel. Staging happens
+    // in order on this thread, overlapping with the decoding of the next batch.
+    std::vector<PendingImage> pendingImages;
+    std::unordered_set<std::string> pendingKeys;
+
+    // Cached images in use are pinned so that staging new images doesn't evict them.
+    std::vector<std::string> pinnedKeys;
+
+    std::vector<std::string> filePaths;
+    filePaths.reserve(texCount);
+    for (const sg::TextureResource& textureResource : textureResources)
+    {
+      filePaths.push_back(textureResource.filePath);
+    }
+    computeContentKeys(filePaths);
+
+    for (const sg::TextureResource& textureResource : textureResources)
+    {
+      const std::string& filePath = textureResource.filePath;
+      const std::string& cacheKey = getCacheKey(filePath);
+
+      if (filePath.empty() || pendingKeys.count(cacheKey) > 0)
+      {
+        continue;
+      }
+
+      auto cacheResult = m_imageCache.find(cacheKey);
+      if (cacheResult != m_imageCache.end())
+      {
+        cacheResult->second.refCount++;
+        pinnedKeys.push_back(cacheKey);
+        m_hitCount++;
+        continue;
+      }
+
+      PendingImage pendingImage;
+      pendingImage.filePath = filePath;
+      pendingImage.cacheKey = cacheKey;
+      pendingImage.is3dImage = textureResource.is3dImage;
+      pendingImage.isDecodedImageCached = false;
+      pendingImage.isUploaded = false;
+
+      auto decodedCacheResult = m_decodedImageCache.find(cacheKey);
+      if (decodedCacheResult != m_decodedImageCache.end())
+      {
+        decodedCacheResult->second.lastUse = ++m_useCounter;
+        decodedCacheResult->second.pinCount++;
+        pendingImage.imageData = decodedCacheResult->second.data;
+        pendingImage.isDecodedImageCached = true;
+        m_decodedHitCount++;
+      }
+
+      pendingImages.push_back(std::move(pendingImage));
+      pendingKeys.insert(cacheKey);
+    }
+
+    m_missCount += pendingImages.size();
+
+    size_t batchCount = (pendingImages.size() + DECODE_BATCH_SIZE - 1) / DECODE_BATCH_SIZE;
+
+#pragma omp parallel
+#pragma omp single
+    for (size_t b = 0; b <= batchCount; b++)
+    {
+      if (b < batchCount)
+      {
+        size_t batchEnd = std::min((b + 1) * DECODE_BATCH_SIZE, pendingImages.size());
+
+        for (size_t i = b * DECODE_BATCH_SIZE; i < batchEnd; i++)
+        {
+#pragma omp task
+          decodeAndPrepareImage(pendingImages[i]);
+        }
+      }
+
+      if (b > 0)
+      {
+        size_t batchEnd = std::min(b * DECODE_BATCH_SIZE, pendingImages.size());
+
+        for (size_t i = (b - 1) * DECODE_BATCH_SIZE; i < batchEnd; i++)
+        {
+          uploadPendingImage(pendingImages[i]);
+        }
+      }
+
+#pragma omp taskwait
+    }
+
     bool result;
 
     for (int i = 0; i < texCount; i++)
@@ -146,10 +1391,11 @@ namespace gi
       auto& textureResource = textureResources[i];
       auto& payload = textureResource.data;
 
-      CgpuImageDesc image_desc;
+      CgpuImageDesc image_desc = {};
       image_desc.is3d = textureResource.is3dImage;
       image_desc.format = CGPU_IMAGE_FORMAT_R8G8B8A8_UNORM;
       image_desc.usage = CGPU_IMAGE_USAGE_FLAG_SAMPLED | CGPU_IMAGE_USAGE_FLAG_TRANSFER_DST;
+      image_desc.mipLevels = 1;
 
       auto& imageVector = image_desc.is3d ? images3d : images2d;
 
@@ -165,6 +1411,38 @@ namespace gi
           continue;
         }
 
+        if (textureResource.bsdfDataKind != 0)
+        {
+          auto cacheResult = m_bsdfDataImageCache.find(textureResource.bsdfDataKind);
+          if (cacheResult != m_bsdfDataImageCache.end())
+          {
+            imageVector.push_back(cacheResult->second);
+            continue;
+          }
+        }
+
+        // Inline payloads are deduplicated by their texels and dimensions.
+        std::string payloadKey;
+        if (m_params.deduplicateImages && textureResource.bsdfDataKind == 0)
+        {
+          uint32_t dims[] = { textureResource.width, textureResource.height, textureResource.depth, textureResource.is3dImage };
+          uint64_t hash = detail::hashBytes(payload.data(), payloadSize);
+          hash = detail::hashBytes((const uint8_t*) dims, sizeof(dims), hash);
+          payloadKey = detail::makeContentKey(hash);
+
+          auto cacheResult = m_imageCache.find(payloadKey);
+          if (cacheResult != m_imageCache.end())
+          {
+            CachedImage& cachedImage = cacheResult->second;
+            cachedImage.refCount++;
+            cachedImage.lastUse = ++m_useCounter;
+            m_dedupHitCount++;
+            m_dedupByteSize += cachedImage.byteSize;
+            imageVector.push_back(cachedImage.image);
+            continue;
+          }
+        }
+
         printf("image %d has binary payload of %.2fMiB\n", i, payloadSize * BYTES_TO_MIB);
 
         image_desc.width = textureResource.width;
@@ -177,13 +1455,30 @@ namespace gi
         result = m_stager.stageToImage(payload.data(), payloadSize, image, image_desc.width, image_desc.height, image_desc.depth);
         if (!result) return false;
 
+        if (textureResource.bsdfDataKind != 0)
+        {
+          m_bsdfDataImageCache[textureResource.bsdfDataKind] = image;
+        }
+        else if (!payloadKey.empty())
+        {
+          // The reference taken on insertion pins the image, the one below is the caller's.
+          insertCachedImage(payloadKey, "", image, payloadSize);
+          m_imageCache[payloadKey].refCount++;
+          pinnedKeys.push_back(payloadKey);
+        }
+
         imageVector.push_back(image);
         continue;
       }
 
-      if (loadTextureFromFilePath(filePath, image, textureResource.is3dImage, false))
+      auto cacheResult = m_imageCache.find(getCacheKey(textureResource.filePath));
+      if (cacheResult != m_imageCache.end())
       {
-        imageVector.push_back(image);
+        CachedImage& cachedImage = cacheResult->second;
+        cachedImage.refCount++;
+        cachedImage.lastUse = ++m_useCounter;
+        trackDeduplication(cachedImage, textureResource.filePath);
+        imageVector.push_back(cachedImage.image);
         continue;
       }
 
@@ -202,51 +1497,69 @@ namespace gi
       imageVector.push_back(image);
     }
 
+    // New images were pinned by the reference taken on upload.
+    for (const PendingImage& pendingImage : pendingImages)
+    {
+      if (pendingImage.isUploaded)
+      {
+        pinnedKeys.push_back(pendingImage.cacheKey);
+      }
+    }
+
+    for (const std::string& cacheKey : pinnedKeys)
+    {
+      m_imageCache[cacheKey].refCount--;
+    }
+
     m_stager.flush();
 
     return true;
   }
 
-  void TexSys::destroyUncachedImages(const std::vector<CgpuImage>& images)
+  void TexSys::releaseImage(CgpuImage image)
   {
-    for (CgpuImage image : images)
+    auto keyResult = m_imageKeys.find(image.handle);
+    if (keyResult != m_imageKeys.end())
     {
-      bool isCached = false;
-
-      for (const auto& pathImagePair : m_imageCache)
-      {
-        CgpuImage cachedImage = pathImagePair.second;
-
-        if (cachedImage.handle == image.handle)
-        {
-          isCached = true;
-          break;
-        }
-      }
+      CachedImage& cachedImage = m_imageCache[keyResult->second];
+      assert(cachedImage.refCount > 0);
+      cachedImage.refCount--;
+      return;
+    }
 
-      if (!isCached)
+    for (const auto& kindImagePair : m_bsdfDataImageCache)
+    {
+      if (kindImagePair.second.handle == image.handle)
       {
-        cgpuDestroyImage(m_device, image);
+        return;
       }
     }
+
+    cgpuDestroyImage(m_device, image);
   }
 
-  void TexSys::evictAndDestroyCachedImage(CgpuImage image)
+  void TexSys::releaseImages(const std::vector<CgpuImage>& images)
   {
-    for (auto it = m_imageCache.begin(); it != m_imageCache.end(); it++)
+    for (CgpuImage image : images)
     {
-      if (it->second.handle != image.handle)
-      {
-        continue;
-      }
-
-      m_imageCache.erase(it);
-
-      cgpuDestroyImage(m_device, image);
-
-      return;
+      releaseImage(image);
     }
+  }
 
-    assert(false);
+  void TexSys::getStats(GiTextureCacheStats& stats) const
+  {
+    stats.hitCount = m_hitCount;
+    stats.decodedHitCount = m_decodedHitCount;
+    stats.missCount = m_missCount;
+    stats.evictionCount = m_evictionCount;
+    stats.reducedMipCount = m_reducedMipCount;
+    stats.gpuByteSize = m_gpuByteSize;
+    stats.cpuByteSize = m_cpuByteSize;
+    stats.transcodeCacheHitCount = m_transcodeCacheHitCount;
+    stats.compressionByteSavings = m_compressionByteSavings;
+    stats.encodedTexelCount = m_encodedTexelCount;
+    stats.encodeMicroseconds = m_encodeMicroseconds;
+    stats.dedupHitCount = m_dedupHitCount;
+    stats.dedupByteSize = m_dedupByteSize;
   }
 }
@@ -17,13 +17,16 @@
 
 #pragma once
 
+#include <atomic>
 #include <unordered_map>
 #include <string>
 #include <vector>
 
 #include <cgpu.h>
+#include <img.h>
 
 class GiAssetReader;
+struct GiTextureCacheStats;
 
 namespace gtl
 {
@@ -40,13 +43,30 @@ namespace gi
   class TexSys
   {
   public:
-    TexSys(CgpuDevice device, GiAssetReader& assetReader, gtl::GgpuStager& stager);
+    struct InitParams
+    {
+      CgpuImageFormat hdrImageFormat;
+      bool generateMips;
+      uint64_t gpuByteBudget; // 0 means unlimited
+      uint64_t cpuByteBudget; // 0 disables caching of decoded images
+      bool compressTextures; // BC7 for LDR and BC6H for HDR images
+      bool highQualityCompression;
+      std::string transcodeCachePath; // empty disables the on-disk cache of compressed images
+      uint32_t maxDimension; // 0 means unlimited
+      uint64_t maxByteSize; // per uncompressed image, 0 means unlimited
+      bool deduplicateImages; // by content hash instead of file path
+      bool blockCompressionSupported; // required for pre-compressed KTX2 and DDS images
+    };
+
+  public:
+    TexSys(CgpuDevice device, GiAssetReader& assetReader, gtl::GgpuStager& stager, const InitParams& params);
 
     ~TexSys();
 
     void destroy();
 
   public:
+    // Loaded images are referenced until they are released again.
     bool loadTextureFromFilePath(const char* filePath,
                                  CgpuImage& image,
                                  bool is3dImage = false,
@@ -56,15 +76,124 @@ namespace gi
                               std::vector<CgpuImage>& images2d,
                               std::vector<CgpuImage>& images3d);
 
-    void destroyUncachedImages(const std::vector<CgpuImage>& images);
+    // Unreferenced cached images stay resident until they are evicted;
+    // uncached images are destroyed immediately.
+    void releaseImage(CgpuImage image);
+
+    void releaseImages(const std::vector<CgpuImage>& images);
+
+    void getStats(GiTextureCacheStats& stats) const;
+
+  private:
+    struct CachedImage
+    {
+      CgpuImage image;
+      uint64_t byteSize;
+      uint32_t refCount;
+      uint64_t lastUse;
+      std::string filePath; // of the first request, used to detect duplicates
+    };
+
+    struct CachedDecodedImage
+    {
+      imgio_img data;
+      uint64_t lastUse;
+      // Pending images share the data, so pinned entries are never evicted.
+      uint32_t pinCount;
+    };
+
+    struct MipLevelData
+    {
+      uint32_t width;
+      uint32_t height;
+      const uint8_t* texels;
+      uint64_t size;
+    };
+
+    // Texel data of all mip levels in the GPU image format, ready to be staged.
+    struct PreparedImage
+    {
+      bool is3d;
+      CgpuImageFormat format;
+      std::vector<MipLevelData> levels;
+      std::vector<std::vector<uint8_t>> levelStorage;
+    };
+
+    struct PendingImage
+    {
+      std::string filePath;
+      std::string cacheKey;
+      bool is3dImage;
+      bool isDecodedImageCached;
+      bool isDecoded; // imageData is owned by the pending image
+      bool isDecodeDeferred; // imageData only holds the properties, texels are decoded on upload
+      bool isPrepared;
+      bool isUploaded;
+      imgio_img imageData;
+      PreparedImage prepared;
+    };
+
+  private:
+    void prepareImage(const imgio_img& imageData, bool is3dImage, PreparedImage& prepared) const;
+
+    void decodeAndPrepareImage(PendingImage& pendingImage) const;
+
+    void compressImage(PreparedImage& prepared) const;
+
+    std::string getTranscodeCacheFilePath(const uint8_t* fileData, size_t fileSize) const;
+
+    static bool readTranscodedImage(const std::string& filePath, PreparedImage& prepared);
+
+    static bool writeTranscodedImage(const std::string& filePath, const PreparedImage& prepared);
+
+    void uploadPendingImage(PendingImage& pendingImage);
+
+    bool uploadImage(const PreparedImage& prepared, CgpuImage& image, uint64_t& byteSize);
+
+    // Decodes the image directly into the stager's mapped memory.
+    bool decodeImageIntoStager(const PendingImage& pendingImage, CgpuImage& image, uint64_t& byteSize);
+
+    void insertCachedImage(const std::string& cacheKey, const std::string& filePath, CgpuImage image, uint64_t byteSize);
+
+    // Hashes the contents of files that have not been seen yet if deduplication is enabled.
+    void computeContentKeys(const std::vector<std::string>& filePaths);
+
+    // Images are cached by content key if available, by file path otherwise.
+    const std::string& getCacheKey(const std::string& filePath) const;
+
+    void trackDeduplication(const CachedImage& cachedImage, const std::string& filePath);
+
+    bool makeGpuBudgetSpace(uint64_t byteSize);
+
+    bool evictLeastRecentlyUsedImage();
 
-    void evictAndDestroyCachedImage(CgpuImage image);
+    bool cacheDecodedImage(const std::string& cacheKey, const imgio_img& imageData);
 
   private:
     CgpuDevice m_device;
     GiAssetReader& m_assetReader;
     gtl::GgpuStager& m_stager;
-    // FIXME: implement a proper CPU and GPU-aware cache with eviction strategy
-    std::unordered_map<std::string, CgpuImage> m_imageCache;
+    InitParams m_params;
+    uint64_t m_useCounter = 0;
+    uint64_t m_gpuByteSize = 0;
+    uint64_t m_cpuByteSize = 0;
+    uint64_t m_hitCount = 0;
+    uint64_t m_decodedHitCount = 0;
+    uint64_t m_missCount = 0;
+    uint64_t m_evictionCount = 0;
+    uint64_t m_reducedMipCount = 0;
+    uint64_t m_compressionByteSavings = 0;
+    uint64_t m_dedupHitCount = 0;
+    uint64_t m_dedupByteSize = 0;
+    // Updated from decoding tasks.
+    mutable std::atomic<uint64_t> m_transcodeCacheHitCount = 0;
+    mutable std::atomic<uint64_t> m_encodedTexelCount = 0;
+    mutable std::atomic<uint64_t> m_encodeMicroseconds = 0;
+    std::unordered_map<std::string, CachedImage> m_imageCache;
+    std::unordered_map<uint64_t, std::string> m_imageKeys; // keyed by image handle
+    std::unordered_map<std::string, std::string> m_contentKeys; // keyed by file path
+    std::unordered_map<std::string, CachedDecodedImage> m_decodedImageCache;
+    // MDL BSDF data textures are keyed by their kind and live as long as the device.
+    std::unordered_map<uint32_t, CgpuImage> m_bsdfDataImageCache;
   };
 }
@@ -0,0 +1,710 @@
+//
+// Copyright (C) 2019-2022 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "vtsys.h"
+
+#include "boxfilter.h"
+#include "gi.h"
+
+#include <stager.h>
+#include <imgio.h>
+
+#include "interface/rp_main.h"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+using namespace gtl;
+
+namespace Rp = gtl::shader_interface::rp_main;
+
+const float BYTES_TO_MIB = 1.0f / (1024.0f * 1024.0f);
+
+// Bounds the time spent streaming after a pass. Requests of a texture are always loaded
+// together, since the image needs to be decoded for any of them.
+const uint32_t MAX_TILE_UPLOADS_PER_PASS = 256;
+
+// Bounds the peak memory of a pass, since each decode holds a full-resolution level chain.
+// Textures whose levels are cached don't count; the others are deferred to later passes.
+const uint32_t MAX_TEXTURE_DECODES_PER_PASS = 2;
+
+const uint32_t POOL_TEXEL_SIZE = 4; // RGBA8
+const uint64_t TILE_BYTE_SIZE = uint64_t(Rp::VT_SLOT_SIZE) * Rp::VT_SLOT_SIZE * POOL_TEXEL_SIZE;
+
+// vkCmdUpdateBuffer limit
+const uint64_t MAX_BUFFER_UPDATE_SIZE = 65536;
+
+namespace detail
+{
+  uint32_t getLevelCount(uint32_t width, uint32_t height)
+  {
+    return uint32_t(std::bit_width(std::max(width, height)));
+  }
+
+  uint32_t getTileCount(uint32_t size)
+  {
+    return (size + Rp::VT_TILE_SIZE - 1) / Rp::VT_TILE_SIZE;
+  }
+
+  // Luminance is expanded to RGB, like the component swizzle of regular textures does.
+  // The texels are packed at the start of the buffer and expanded back to front, which
+  // avoids a second full-resolution allocation.
+  void expandToRgba8InPlace(uint8_t* texels, imgio_format format, uint64_t texelCount)
+  {
+    if (format != IMGIO_FORMAT_R8_UNORM && format != IMGIO_FORMAT_RG8_UNORM)
+    {
+      return;
+    }
+
+    for (uint64_t i = texelCount; i-- > 0;)
+    {
+      uint8_t value = (format == IMGIO_FORMAT_R8_UNORM) ? texels[i] : texels[i * 2 + 0];
+      uint8_t alpha = (format == IMGIO_FORMAT_R8_UNORM) ? 255 : texels[i * 2 + 1];
+
+      uint8_t* texel = &texels[i * 4];
+      texel[0] = texel[1] = texel[2] = value;
+      texel[3] = alpha;
+    }
+  }
+
+  uint64_t getLevelsByteSize(const std::vector<std::vector<uint8_t>>& levels)
+  {
+    uint64_t byteSize = 0;
+    for (const std::vector<uint8_t>& level : levels)
+    {
+      byteSize += level.size();
+    }
+    return byteSize;
+  }
+
+  // Uses the same box filter as regular textures, so that both modes produce the same mips.
+  void downsampleLevel(const uint8_t* src, uint32_t srcWidth, uint32_t srcHeight, uint8_t* dst)
+  {
+    uint32_t dstWidth = std::max(srcWidth >> 1, 1u);
+
+    auto readRow = [src, srcWidth](uint32_t y, glm::vec4* scratch) -> const glm::vec4* {
+      const uint8_t* srcRow = &src[size_t(y) * srcWidth * 4];
+      for (uint32_t x = 0; x < srcWidth; x++)
+      {
+        uint32_t packed;
+        memcpy(&packed, &srcRow[x * 4], sizeof(packed));
+        scratch[x] = glm::unpackUnorm4x8(packed);
+      }
+      return scratch;
+    };
+    auto writeRow = [dst, dstWidth](uint32_t y, const glm::vec4* row) {
+      uint8_t* dstRow = &dst[size_t(y) * dstWidth * 4];
+      for (uint32_t x = 0; x < dstWidth; x++)
+      {
+        uint32_t packed = glm::packUnorm4x8(row[x]);
+        memcpy(&dstRow[x * 4], &packed, sizeof(packed));
+      }
+    };
+    gi::downsampleBox(srcWidth, srcHeight, readRow, writeRow);
+  }
+
+  // Texels outside of the level wrap around, matching the repeat address mode of the sampler.
+  void extractTile(const uint8_t* level, uint32_t width, uint32_t height, uint32_t tileX, uint32_t tileY, uint8_t* dst)
+  {
+    int32_t originX = int32_t(tileX * Rp::VT_TILE_SIZE) - int32_t(Rp::VT_TILE_BORDER);
+    int32_t originY = int32_t(tileY * Rp::VT_TILE_SIZE) - int32_t(Rp::VT_TILE_BORDER);
+
+    for (uint32_t y = 0; y < Rp::VT_SLOT_SIZE; y++)
+    {
+      int32_t srcY = (originY + int32_t(y) + int32_t(height)) % int32_t(height);
+
+      for (uint32_t x = 0; x < Rp::VT_SLOT_SIZE; x++)
+      {
+        int32_t srcX = (originX + int32_t(x) + int32_t(width)) % int32_t(width);
+
+        memcpy(&dst[(y * Rp::VT_SLOT_SIZE + x) * 4], &level[(srcY * width + srcX) * 4], 4);
+      }
+    }
+  }
+}
+
+namespace gi
+{
+  VirtualTexSys::VirtualTexSys(CgpuDevice device, GiAssetReader& assetReader, GgpuStager& stager, const InitParams& params)
+    : m_device(device)
+    , m_assetReader(assetReader)
+    , m_stager(stager)
+    , m_params(params)
+  {
+  }
+
+  VirtualTexSys::~VirtualTexSys()
+  {
+    assert(!m_tilePool.handle);
+  }
+
+  void VirtualTexSys::destroy()
+  {
+    if (m_pageTableBuffer.handle)
+    {
+      cgpuDestroyBuffer(m_device, m_pageTableBuffer);
+      m_pageTableBuffer.handle = 0;
+    }
+    if (m_feedbackBuffer.handle)
+    {
+      cgpuDestroyBuffer(m_device, m_feedbackBuffer);
+      m_feedbackBuffer.handle = 0;
+    }
+    if (m_readbackBuffer.handle)
+    {
+      cgpuDestroyBuffer(m_device, m_readbackBuffer);
+      m_readbackBuffer.handle = 0;
+    }
+    if (m_tilePool.handle)
+    {
+      cgpuDestroyImage(m_device, m_tilePool);
+      m_tilePool.handle = 0;
+    }
+  }
+
+  void VirtualTexSys::init(uint32_t texCount2d)
+  {
+    assert(m_textures.empty());
+
+    // Record offsets of the 2D texture array; 0 denotes a regular texture.
+    m_texCount2d = texCount2d;
+    m_pageTable.assign(texCount2d, 0);
+  }
+
+  bool VirtualTexSys::addTexture(uint32_t arrayIndex, const std::string& filePath)
+  {
+    assert(arrayIndex < m_texCount2d);
+
+    GiAsset* asset = m_assetReader.open(filePath.c_str());
+    if (!asset)
+    {
+      return false;
+    }
+
+    // Only PNG and JPEG images provide their properties without being decoded. HDR
+    // images keep their float formats and are loaded regularly.
+    imgio_img info;
+    int result = imgio_read_info(m_assetReader.data(asset), m_assetReader.size(asset), m_params.maxDimension, &info);
+    m_assetReader.close(asset);
+
+    if (result != IMGIO_OK ||
+        (info.format != IMGIO_FORMAT_RGBA8_UNORM && info.format != IMGIO_FORMAT_R8_UNORM && info.format != IMGIO_FORMAT_RG8_UNORM) ||
+        info.width > 0xFFFFu || info.height > 0xFFFFu)
+    {
+      return false;
+    }
+
+    VirtualTexture texture;
+    texture.filePath = filePath;
+    texture.width = info.width;
+    texture.height = info.height;
+    texture.lastLevelUse = 0;
+    texture.failed = false;
+
+    uint32_t levelCount = detail::getLevelCount(info.width, info.height);
+    uint32_t recordOffset = uint32_t(m_pageTable.size());
+
+    m_pageTable[arrayIndex] = recordOffset;
+    m_pageTable.push_back(info.width | (info.height << 16));
+    m_pageTable.push_back(levelCount);
+    m_pageTable.resize(m_pageTable.size() + levelCount);
+
+    for (uint32_t level = 0; level < levelCount; level++)
+    {
+      uint32_t levelWidth = std::max(info.width >> level, 1u);
+      uint32_t levelHeight = std::max(info.height >> level, 1u);
+      uint32_t tileCount = detail::getTileCount(levelWidth) * detail::getTileCount(levelHeight);
+
+      uint32_t firstEntry = uint32_t(m_pageTable.size());
+      m_pageTable[recordOffset + 2 + level] = firstEntry;
+      m_pageTable.resize(firstEntry + tileCount, Rp::VT_NON_RESIDENT);
+
+      texture.levelEntries.push_back(firstEntry);
+    }
+
+    m_textures.push_back(std::move(texture));
+    return true;
+  }
+
+  bool VirtualTexSys::commit()
+  {
+    uint64_t pageTableSize = m_pageTable.size() * sizeof(uint32_t);
+
+    if (!cgpuCreateBuffer(m_device,
+                          CGPU_BUFFER_USAGE_FLAG_STORAGE_BUFFER | CGPU_BUFFER_USAGE_FLAG_TRANSFER_DST,
+                          CGPU_MEMORY_PROPERTY_FLAG_DEVICE_LOCAL,
+                          pageTableSize,
+                          &m_pageTableBuffer))
+    {
+      return false;
+    }
+
+    if (!m_stager.stageToBuffer((const uint8_t*) m_pageTable.data(), pageTableSize, m_pageTableBuffer, 0))
+    {
+      return false;
+    }
+
+    uint64_t feedbackSize = getFeedbackByteSize();
+
+    if (!cgpuCreateBuffer(m_device,
+                          CGPU_BUFFER_USAGE_FLAG_STORAGE_BUFFER | CGPU_BUFFER_USAGE_FLAG_TRANSFER_SRC | CGPU_BUFFER_USAGE_FLAG_TRANSFER_DST,
+                          CGPU_MEMORY_PROPERTY_FLAG_DEVICE_LOCAL,
+                          feedbackSize,
+                          &m_feedbackBuffer))
+    {
+      return false;
+    }
+
+    if (!cgpuCreateBuffer(m_device,
+                          CGPU_BUFFER_USAGE_FLAG_TRANSFER_DST,
+                          CGPU_MEMORY_PROPERTY_FLAG_HOST_VISIBLE | CGPU_MEMORY_PROPERTY_FLAG_HOST_CACHED,
+                          feedbackSize,
+                          &m_readbackBuffer))
+    {
+      return false;
+    }
+
+    m_zeroes.assign(std::min(feedbackSize, MAX_BUFFER_UPDATE_SIZE), 0);
+
+    // The pool is a square grid of slots.
+    uint64_t maxSlotCount = std::max(m_params.poolByteSize / TILE_BYTE_SIZE, uint64_t(1));
+    m_slotsPerRow = std::max(uint32_t(sqrt(double(maxSlotCount))), 1u);
+    m_slotsPerRow = std::min(m_slotsPerRow, m_params.maxPoolDimension / Rp::VT_SLOT_SIZE);
+
+    CgpuImageDesc imageDesc = {};
+    imageDesc.width = m_slotsPerRow * Rp::VT_SLOT_SIZE;
+    imageDesc.height = imageDesc.width;
+    imageDesc.depth = 1;
+    imageDesc.is3d = false;
+    imageDesc.format = CGPU_IMAGE_FORMAT_R8G8B8A8_UNORM;
+    imageDesc.usage = CGPU_IMAGE_USAGE_FLAG_SAMPLED | CGPU_IMAGE_USAGE_FLAG_TRANSFER_DST;
+    imageDesc.mipLevels = 1;
+
+    if (!cgpuCreateImage(m_device, &imageDesc, &m_tilePool))
+    {
+      return false;
+    }
+
+    m_slots.resize(m_slotsPerRow * m_slotsPerRow, Slot{ Rp::VT_NON_RESIDENT, 0 });
+
+    printf("virtual texturing: %zu textures, %zu tile pool slots (%.2fMiB), %.2fMiB page table\n",
+      m_textures.size(), m_slots.size(), m_slots.size() * TILE_BYTE_SIZE * BYTES_TO_MIB, pageTableSize * BYTES_TO_MIB);
+
+    return true;
+  }
+
+  uint32_t VirtualTexSys::getTextureCount() const
+  {
+    return uint32_t(m_textures.size());
+  }
+
+  CgpuBuffer VirtualTexSys::getPageTableBuffer() const
+  {
+    return m_pageTableBuffer;
+  }
+
+  uint64_t VirtualTexSys::getPageTableByteSize() const
+  {
+    return m_pageTable.size() * sizeof(uint32_t);
+  }
+
+  CgpuBuffer VirtualTexSys::getFeedbackBuffer() const
+  {
+    return m_feedbackBuffer;
+  }
+
+  uint64_t VirtualTexSys::getFeedbackByteSize() const
+  {
+    return ((m_pageTable.size() + 31) / 32) * sizeof(uint32_t);
+  }
+
+  CgpuImage VirtualTexSys::getTilePool() const
+  {
+    return m_tilePool;
+  }
+
+  bool VirtualTexSys::recordFeedbackReset(CgpuCommandBuffer commandBuffer)
+  {
+    uint64_t feedbackSize = getFeedbackByteSize();
+
+    for (uint64_t offset = 0; offset < feedbackSize; offset += MAX_BUFFER_UPDATE_SIZE)
+    {
+      uint64_t size = std::min(feedbackSize - offset, MAX_BUFFER_UPDATE_SIZE);
+
+      if (!cgpuCmdUpdateBuffer(commandBuffer, m_zeroes.data(), size, m_feedbackBuffer, offset))
+      {
+        return false;
+      }
+    }
+
+    CgpuBufferMemoryBarrier barrier;
+    barrier.srcAccessFlags = CGPU_MEMORY_ACCESS_FLAG_TRANSFER_WRITE;
+    barrier.dstAccessFlags = CGPU_MEMORY_ACCESS_FLAG_SHADER_READ | CGPU_MEMORY_ACCESS_FLAG_SHADER_WRITE;
+    barrier.buffer = m_feedbackBuffer;
+    barrier.offset = 0;
+    barrier.size = CGPU_WHOLE_SIZE;
+
+    return cgpuCmdPipelineBarrier(commandBuffer, 0, nullptr, 1, &barrier, 0, nullptr);
+  }
+
+  bool VirtualTexSys::recordFeedbackReadback(CgpuCommandBuffer commandBuffer)
+  {
+    CgpuBufferMemoryBarrier barrier;
+    barrier.srcAccessFlags = CGPU_MEMORY_ACCESS_FLAG_SHADER_WRITE;
+    barrier.dstAccessFlags = CGPU_MEMORY_ACCESS_FLAG_TRANSFER_READ;
+    barrier.buffer = m_feedbackBuffer;
+    barrier.offset = 0;
+    barrier.size = CGPU_WHOLE_SIZE;
+
+    if (!cgpuCmdPipelineBarrier(commandBuffer, 0, nullptr, 1, &barrier, 0, nullptr))
+    {
+      return false;
+    }
+
+    return cgpuCmdCopyBuffer(commandBuffer, m_feedbackBuffer, 0, m_readbackBuffer, 0, getFeedbackByteSize());
+  }
+
+  bool VirtualTexSys::findTile(uint32_t entry, uint32_t& textureIndex, uint32_t& level) const
+  {
+    // Textures and their levels occupy ascending page table ranges.
+    auto textureIt = std::upper_bound(m_textures.begin(), m_textures.end(), entry,
+      [](uint32_t e, const VirtualTexture& t) { return e < t.levelEntries[0]; });
+
+    if (textureIt == m_textures.begin())
+    {
+      return false;
+    }
+    textureIt--;
+
+    const std::vector<uint32_t>& levelEntries = textureIt->levelEntries;
+    auto levelIt = std::upper_bound(levelEntries.begin(), levelEntries.end(), entry);
+
+    textureIndex = uint32_t(textureIt - m_textures.begin());
+    level = uint32_t(levelIt - levelEntries.begin()) - 1;
+    return true;
+  }
+
+  bool VirtualTexSys::loadTiles(VirtualTexture& texture, const TileRequest* requests, size_t requestCount, uint8_t* tileData) const
+  {
+    std::vector<std::vector<uint8_t>>& levels = texture.levels;
+
+    if (levels.empty())
+    {
+      GiAsset* asset = m_assetReader.open(texture.filePath.c_str());
+      if (!asset)
+      {
+        return false;
+      }
+
+      const void* fileData = m_assetReader.data(asset);
+      size_t fileSize = m_assetReader.size(asset);
+
+      imgio_img info;
+      bool decoded = false;
+      std::vector<uint8_t> texels;
+
+      if (imgio_read_info(fileData, fileSize, m_params.maxDimension, &info) == IMGIO_OK &&
+          info.width == texture.width && info.height == texture.height)
+      {
+        texels.resize(uint64_t(texture.width) * texture.height * 4);
+
+        size_t rowPitch = imgio_get_level_size(info.format, info.width, info.height) / info.height;
+        decoded = imgio_decode_into(fileData, fileSize, m_params.maxDimension, texels.data(), rowPitch) == IMGIO_OK;
+      }
+
+      m_assetReader.close(asset);
+
+      if (!decoded)
+      {
+        return false;
+      }
+
+      detail::expandToRgba8InPlace(texels.data(), info.format, uint64_t(texture.width) * texture.height);
+      levels.push_back(std::move(texels));
+    }
+
+    uint32_t maxLevel = 0;
+    for (size_t i = 0; i < requestCount; i++)
+    {
+      maxLevel = std::max(maxLevel, requests[i].level);
+    }
+
+    // Only the levels up to the coarsest requested one are generated.
+    for (uint32_t level = uint32_t(levels.size()); level <= maxLevel; level++)
+    {
+      uint32_t srcWidth = std::max(texture.width >> (level - 1), 1u);
+      uint32_t srcHeight = std::max(texture.height >> (level - 1), 1u);
+      uint32_t dstWidth = std::max(texture.width >> level, 1u);
+      uint32_t dstHeight = std::max(texture.height >> level, 1u);
+
+      std::vector<uint8_t> dst(uint64_t(dstWidth) * dstHeight * 4);
+      detail::downsampleLevel(levels[level - 1].data(), srcWidth, srcHeight, dst.data());
+      levels.push_back(std::move(dst));
+    }
+
+    for (size_t i = 0; i < requestCount; i++)
+    {
+      const TileRequest& request = requests[i];
+
+      uint32_t levelWidth = std::max(texture.width >> request.level, 1u);
+      uint32_t levelHeight = std::max(texture.height >> request.level, 1u);
+
+      uint32_t tileIndex = request.entry - texture.levelEntries[request.level];
+      uint32_t tileCountX = detail::getTileCount(levelWidth);
+
+      detail::extractTile(levels[request.level].data(), levelWidth, levelHeight,
+        tileIndex % tileCountX, tileIndex / tileCountX, &tileData[i * TILE_BYTE_SIZE]);
+    }
+
+    return true;
+  }
+
+  void VirtualTexSys::evictLevels()
+  {
+    while (m_cpuByteSize > m_params.cpuByteBudget)
+    {
+      VirtualTexture* lruTexture = nullptr;
+      for (VirtualTexture& texture : m_textures)
+      {
+        if (!texture.levels.empty() && (!lruTexture || texture.lastLevelUse < lruTexture->lastLevelUse))
+        {
+          lruTexture = &texture;
+        }
+      }
+
+      if (!lruTexture)
+      {
+        break;
+      }
+
+      m_cpuByteSize -= detail::getLevelsByteSize(lruTexture->levels);
+      lruTexture->levels.clear();
+      lruTexture->levels.shrink_to_fit();
+    }
+  }
+
+  bool VirtualTexSys::update()
+  {
+    m_passCounter++;
+
+    // Resident tiles are marked as used, missing ones are requested.
+    std::vector<TileRequest> requests;
+    {
+      uint32_t* feedback;
+      if (!cgpuMapBuffer(m_device, m_readbackBuffer, (void**) &feedback))
+      {
+        return false;
+      }
+
+      uint64_t wordCount = getFeedbackByteSize() / sizeof(uint32_t);
+
+      for (uint64_t w = 0; w < wordCount; w++)
+      {
+        for (uint32_t bits = feedback[w]; bits != 0; bits &= bits - 1)
+        {
+          uint32_t entry = uint32_t(w * 32) + std::countr_zero(bits);
+          uint32_t slot = m_pageTable[entry];
+
+          if (slot != Rp::VT_NON_RESIDENT)
+          {
+            m_slots[(slot >> 16) * m_slotsPerRow + (slot & 0xFFFFu)].lastUse = m_passCounter;
+            continue;
+          }
+
+          TileRequest request;
+          request.entry = entry;
+          if (findTile(entry, request.textureIndex, request.level) && !m_textures[request.textureIndex].failed)
+          {
+            requests.push_back(request);
+          }
+        }
+      }
+
+      if (!cgpuUnmapBuffer(m_device, m_readbackBuffer))
+      {
+        return false;
+      }
+    }
+
+    if (requests.empty())
+    {
+      return false;
+    }
+
+    // Coarse levels first, since they serve as a fallback for the detailed ones.
+    std::sort(requests.begin(), requests.end(), [](const TileRequest& a, const TileRequest& b) {
+      return (a.textureIndex != b.textureIndex) ? (a.textureIndex < b.textureIndex) : (a.level > b.level);
+    });
+
+    // Free slots first, then the least recently used ones. Tiles used in the last pass are kept.
+    std::vector<uint32_t> victims;
+    for (uint32_t i = 0; i < m_slots.size(); i++)
+    {
+      if (m_slots[i].lastUse < m_passCounter)
+      {
+        victims.push_back(i);
+      }
+    }
+    std::sort(victims.begin(), victims.end(), [this](uint32_t a, uint32_t b) {
+      bool aFree = m_slots[a].entry == Rp::VT_NON_RESIDENT;
+      bool bFree = m_slots[b].entry == Rp::VT_NON_RESIDENT;
+      return (aFree != bFree) ? aFree : (m_slots[a].lastUse < m_slots[b].lastUse);
+    });
+
+    // Group requests by texture and assign slots within the budget.
+    struct TextureGroup
+    {
+      size_t first;
+      size_t count;
+      bool loaded;
+    };
+
+    std::vector<TextureGroup> groups;
+    size_t assignedCount = 0;
+    uint32_t decodeCount = 0;
+
+    for (size_t i = 0; i < requests.size() && assignedCount < MAX_TILE_UPLOADS_PER_PASS;)
+    {
+      size_t end = i;
+      while (end < requests.size() && requests[end].textureIndex == requests[i].textureIndex)
+      {
+        end++;
+      }
+
+      // Deferred requests are recorded again by the feedback of the next pass.
+      if (m_textures[requests[i].textureIndex].levels.empty())
+      {
+        if (decodeCount == MAX_TEXTURE_DECODES_PER_PASS)
+        {
+          i = end;
+          continue;
+        }
+        decodeCount++;
+      }
+
+      size_t count = std::min(end - i, victims.size() - assignedCount);
+      if (count == 0)
+      {
+        break;
+      }
+
+      for (size_t j = i; j < i + count; j++)
+      {
+        requests[j].slotIndex = victims[assignedCount++];
+      }
+
+      groups.push_back({ i, count, false });
+      i = end;
+    }
+
+    if (groups.empty())
+    {
+      if (!m_poolExhaustionReported)
+      {
+        fprintf(stderr, "warning: virtual texture tile pool exhausted\n");
+        m_poolExhaustionReported = true;
+      }
+      return false;
+    }
+
+    std::vector<uint8_t> tileData(assignedCount * TILE_BYTE_SIZE);
+    std::vector<size_t> tileDataOffsets(groups.size());
+    for (size_t g = 0, offset = 0; g < groups.size(); g++)
+    {
+      tileDataOffsets[g] = offset;
+      offset += groups[g].count;
+    }
+
+#pragma omp parallel for schedule(dynamic)
+    for (int g = 0; g < int(groups.size()); g++)
+    {
+      TextureGroup& group = groups[g];
+      VirtualTexture& texture = m_textures[requests[group.first].textureIndex];
+      uint64_t cachedByteSize = detail::getLevelsByteSize(texture.levels);
+
+      group.loaded = loadTiles(texture, &requests[group.first], group.count, &tileData[tileDataOffsets[g] * TILE_BYTE_SIZE]);
+
+#pragma omp atomic
+      m_cpuByteSize += detail::getLevelsByteSize(texture.levels) - cachedByteSize;
+    }
+
+    for (const TextureGroup& group : groups)
+    {
+      m_textures[requests[group.first].textureIndex].lastLevelUse = m_passCounter;
+    }
+    evictLevels();
+
+    bool residencyChanged = false;
+
+    for (size_t g = 0; g < groups.size(); g++)
+    {
+      const TextureGroup& group = groups[g];
+
+      if (!group.loaded)
+      {
+        VirtualTexture& texture = m_textures[requests[group.first].textureIndex];
+        fprintf(stderr, "failed to load virtual texture tiles from %s\n", texture.filePath.c_str());
+        texture.failed = true;
+        continue;
+      }
+
+      for (size_t i = 0; i < group.count; i++)
+      {
+        const TileRequest& request = requests[group.first + i];
+        Slot& slot = m_slots[request.slotIndex];
+
+        if (slot.entry != Rp::VT_NON_RESIDENT)
+        {
+          m_pageTable[slot.entry] = Rp::VT_NON_RESIDENT;
+
+          if (!m_stager.stageToBuffer((const uint8_t*) &m_pageTable[slot.entry], sizeof(uint32_t), m_pageTableBuffer, slot.entry * sizeof(uint32_t)))
+          {
+            return false;
+          }
+        }
+
+        uint32_t slotX = request.slotIndex % m_slotsPerRow;
+        uint32_t slotY = request.slotIndex / m_slotsPerRow;
+
+        const uint8_t* data = &tileData[(tileDataOffsets[g] + i) * TILE_BYTE_SIZE];
+        if (!m_stager.stageToImageRegion(data, TILE_BYTE_SIZE, m_tilePool, slotX * Rp::VT_SLOT_SIZE, slotY * Rp::VT_SLOT_SIZE, Rp::VT_SLOT_SIZE, Rp::VT_SLOT_SIZE))
+        {
+          return false;
+        }
+
+        m_pageTable[request.entry] = slotX | (slotY << 16);
+
+        if (!m_stager.stageToBuffer((const uint8_t*) &m_pageTable[request.entry], sizeof(uint32_t), m_pageTableBuffer, request.entry * sizeof(uint32_t)))
+        {
+          return false;
+        }
+
+        slot.entry = request.entry;
+        slot.lastUse = m_passCounter;
+        residencyChanged = true;
+      }
+    }
+
+    return residencyChanged;
+  }
+}
@@ -0,0 +1,139 @@
+//
+// Copyright (C) 2019-2022 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <cgpu.h>
+
+class GiAssetReader;
+
+namespace gtl
+{
+  class GgpuStager;
+}
+
+namespace gi
+{
+  // Streams the tiles of virtual textures on demand into a fixed-size physical tile pool.
+  // Shaders translate texture coordinates through a page table in a storage buffer and
+  // record the tiles they access in a feedback buffer, which is processed after each pass.
+  class VirtualTexSys
+  {
+  public:
+    struct InitParams
+    {
+      uint64_t poolByteSize;
+      uint32_t maxPoolDimension;
+      uint32_t maxDimension; // forwarded to the decoder, 0 means unlimited
+      uint64_t cpuByteBudget; // decoded level chains kept between passes; 0 disables
+    };
+
+  public:
+    VirtualTexSys(CgpuDevice device, GiAssetReader& assetReader, gtl::GgpuStager& stager, const InitParams& params);
+
+    ~VirtualTexSys();
+
+    void destroy();
+
+  public:
+    // Reserves the page table entries of the 2D texture array.
+    void init(uint32_t texCount2d);
+
+    // Returns false if the image can't be virtualized and needs to be loaded regularly.
+    bool addTexture(uint32_t arrayIndex, const std::string& filePath);
+
+    // Creates the GPU resources once all textures have been added.
+    bool commit();
+
+    uint32_t getTextureCount() const;
+
+    CgpuBuffer getPageTableBuffer() const;
+    uint64_t getPageTableByteSize() const;
+    CgpuBuffer getFeedbackBuffer() const;
+    uint64_t getFeedbackByteSize() const;
+    CgpuImage getTilePool() const;
+
+  public:
+    // Clears the feedback of the previous pass. Must be recorded before rays are traced.
+    bool recordFeedbackReset(CgpuCommandBuffer commandBuffer);
+
+    // Copies the feedback to host memory. Must be recorded after rays have been traced.
+    bool recordFeedbackReadback(CgpuCommandBuffer commandBuffer);
+
+    // Processes the feedback of a completed pass and stages the requested tiles.
+    // Returns true if tile residency changed, which invalidates accumulated samples.
+    bool update();
+
+  private:
+    struct VirtualTexture
+    {
+      std::string filePath;
+      uint32_t width;
+      uint32_t height;
+      std::vector<uint32_t> levelEntries; // page table offset of each level's first tile
+      std::vector<std::vector<uint8_t>> levels; // decoded RGBA8 levels, empty if not cached
+      uint64_t lastLevelUse;
+      bool failed;
+    };
+
+    struct Slot
+    {
+      uint32_t entry; // VT_NON_RESIDENT if unused
+      uint64_t lastUse;
+    };
+
+    struct TileRequest
+    {
+      uint32_t textureIndex;
+      uint32_t level;
+      uint32_t entry;
+      uint32_t slotIndex;
+    };
+
+  private:
+    bool findTile(uint32_t entry, uint32_t& textureIndex, uint32_t& level) const;
+
+    // Decodes the image unless its levels are cached, generates the missing levels up to the
+    // coarsest requested one and extracts the texels of the requested tiles, including borders.
+    bool loadTiles(VirtualTexture& texture, const TileRequest* requests, size_t requestCount, uint8_t* tileData) const;
+
+    // Drops the least recently used level chains until the CPU byte budget is met.
+    void evictLevels();
+
+  private:
+    CgpuDevice m_device;
+    GiAssetReader& m_assetReader;
+    gtl::GgpuStager& m_stager;
+    InitParams m_params;
+    uint32_t m_texCount2d = 0;
+    uint32_t m_slotsPerRow = 0;
+    uint64_t m_passCounter = 0;
+    uint64_t m_cpuByteSize = 0;
+    bool m_poolExhaustionReported = false;
+    std::vector<uint32_t> m_pageTable;
+    std::vector<VirtualTexture> m_textures;
+    std::vector<Slot> m_slots;
+    std::vector<uint8_t> m_zeroes;
+    CgpuBuffer m_pageTableBuffer;
+    CgpuBuffer m_feedbackBuffer;
+    CgpuBuffer m_readbackBuffer;
+    CgpuImage m_tilePool;
+  };
+}
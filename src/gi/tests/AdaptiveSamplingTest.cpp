@@ -0,0 +1,205 @@
+//
+// Copyright (C) 2019-2022 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+// Checks which pixels adaptive sampling keeps for the next pass: pixels stay active until
+// they reach the minimum sample count, leave at the maximum sample count and otherwise
+// once the relative standard error of their mean luminance drops below the threshold.
+
+#include "adaptivesampling.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <numeric>
+
+namespace Rp = gtl::shader_interface::rp_main;
+
+namespace
+{
+  int s_failureCount = 0;
+
+#define CHECK(COND, ...)                      \
+  if (!(COND))                                \
+  {                                           \
+    fprintf(stderr, "check failed: " __VA_ARGS__); \
+    fprintf(stderr, "\n");                    \
+    s_failureCount++;                         \
+  }
+
+  // Accumulates n samples alternating between mean - deviation and mean + deviation like
+  // the shaders do. The relative standard error is deviation / (mean * sqrt(n - 1)).
+  Rp::PixelStats _MakeStats(uint32_t n, float mean, float deviation)
+  {
+    Rp::PixelStats stats = {};
+    for (uint32_t i = 0; i < n; i++)
+    {
+      float lum = (i % 2 == 0) ? (mean - deviation) : (mean + deviation);
+      stats.lumSum += lum;
+      stats.lumSqSum += lum * lum;
+    }
+    stats.sampleCount = n;
+    return stats;
+  }
+
+  // Deviation for which an even sample count has the given relative standard error.
+  float _GetDeviation(uint32_t n, float mean, float relativeError)
+  {
+    return relativeError * mean * sqrtf(float(n - 1));
+  }
+
+  bool _IsActive(const Rp::PixelStats& stats, float errorThreshold, uint32_t maxSpp)
+  {
+    std::vector<uint32_t> activePixels = { 0 };
+    gi::updateActivePixels(&stats, errorThreshold, maxSpp, activePixels);
+    return !activePixels.empty();
+  }
+
+  void _TestMinSpp()
+  {
+    const uint32_t minSpp = gi::ADAPTIVE_SAMPLING_MIN_SPP;
+
+    // Without enough samples, even a noiseless pixel keeps being sampled.
+    for (uint32_t n = 0; n < minSpp; n++)
+    {
+      CHECK(_IsActive(_MakeStats(n, 0.5f, 0.0f), 0.05f, 1024), "pixel with %u samples converged", n);
+    }
+    CHECK(!_IsActive(_MakeStats(minSpp, 0.5f, 0.0f), 0.05f, 1024), "noiseless pixel with %u samples active", minSpp);
+
+    // The maximum wins over the minimum.
+    CHECK(!_IsActive(_MakeStats(8, 0.5f, 0.0f), 0.05f, 8), "pixel active beyond a maximum of 8 samples");
+    CHECK(_IsActive(_MakeStats(7, 0.5f, 0.0f), 0.05f, 8), "pixel inactive below a maximum of 8 samples");
+  }
+
+  void _TestMaxSpp()
+  {
+    // Noisy pixels stop at the maximum sample count.
+    const uint32_t maxSpp = 64;
+    float deviation = _GetDeviation(maxSpp, 0.5f, 0.5f);
+
+    CHECK(_IsActive(_MakeStats(maxSpp - 2, 0.5f, deviation), 0.01f, maxSpp), "noisy pixel inactive below the maximum");
+    CHECK(!_IsActive(_MakeStats(maxSpp, 0.5f, deviation), 0.01f, maxSpp), "noisy pixel active at the maximum");
+    CHECK(!_IsActive(_MakeStats(maxSpp + 2, 0.5f, deviation), 0.01f, maxSpp), "noisy pixel active beyond the maximum");
+  }
+
+  void _TestErrorThreshold()
+  {
+    const float threshold = 0.02f;
+
+    for (uint32_t n : { 16u, 64u, 1000u })
+    {
+      for (float mean : { 0.01f, 0.5f, 40.0f })
+      {
+        float below = _GetDeviation(n, mean, threshold * 0.9f);
+        float above = _GetDeviation(n, mean, threshold * 1.1f);
+
+        CHECK(!_IsActive(_MakeStats(n, mean, below), threshold, 4096),
+          "pixel with %u samples, mean %g and error below the threshold active", n, mean);
+        CHECK(_IsActive(_MakeStats(n, mean, above), threshold, 4096),
+          "pixel with %u samples, mean %g and error above the threshold inactive", n, mean);
+      }
+    }
+
+    // A threshold of zero leaves only the maximum sample count.
+    CHECK(_IsActive(_MakeStats(256, 0.5f, 0.0f), 0.0f, 4096), "noiseless pixel inactive with zero threshold");
+  }
+
+  void _TestDegenerateStats()
+  {
+    // Black pixels converge instead of dividing by a zero mean.
+    CHECK(!_IsActive(_MakeStats(16, 0.0f, 0.0f), 0.02f, 4096), "black pixel active");
+
+    // Dark noise is measured relative to a luminance of 1e-3: an error of 5e-5 is 5%.
+    CHECK(_IsActive(_MakeStats(16, 1e-5f, _GetDeviation(16, 1e-3f, 0.05f)), 0.02f, 4096), "dark noisy pixel inactive");
+    CHECK(!_IsActive(_MakeStats(16, 1e-5f, _GetDeviation(16, 1e-3f, 0.01f)), 0.02f, 4096), "dark converged pixel active");
+
+    // Float sums of a constant can yield a slightly negative variance, which must not produce a NaN.
+    Rp::PixelStats stats = {};
+    for (uint32_t i = 0; i < 3001; i++)
+    {
+      stats.lumSum += 0.1f;
+      stats.lumSqSum += 0.1f * 0.1f;
+    }
+    stats.sampleCount = 3001;
+    CHECK(!_IsActive(stats, 0.02f, 4096), "constant pixel with rounding errors active");
+  }
+
+  void _TestCompaction()
+  {
+    const uint32_t pixelCount = 1000;
+    const float threshold = 0.02f;
+
+    std::vector<Rp::PixelStats> stats(pixelCount);
+    std::vector<bool> expectActive(pixelCount);
+
+    for (uint32_t i = 0; i < pixelCount; i++)
+    {
+      uint32_t n = 16 + (i % 7) * 2;
+      bool noisy = (i % 3) != 0;
+      stats[i] = _MakeStats(n, 0.5f, _GetDeviation(n, 0.5f, noisy ? 0.05f : 0.001f));
+      expectActive[i] = noisy && n < 26;
+    }
+
+    // Only listed pixels are considered; the others are ignored even if they are noisy.
+    std::vector<uint32_t> activePixels;
+    for (uint32_t i = 0; i < pixelCount; i++)
+    {
+      if (i % 5 != 0)
+      {
+        activePixels.push_back(i);
+      }
+    }
+
+    std::vector<uint32_t> expected;
+    for (uint32_t i : activePixels)
+    {
+      if (expectActive[i])
+      {
+        expected.push_back(i);
+      }
+    }
+
+    gi::updateActivePixels(stats.data(), threshold, 26, activePixels);
+    CHECK(activePixels == expected, "compacted %zu pixels instead of %zu, or changed their order", activePixels.size(), expected.size());
+
+    // Converged pixels stay converged and the remaining ones are kept as they are.
+    std::vector<uint32_t> previous = activePixels;
+    gi::updateActivePixels(stats.data(), threshold, 26, activePixels);
+    CHECK(activePixels == previous, "second update changed the active pixels");
+
+    // Once all pixels reached the maximum, none remain.
+    std::iota(activePixels.begin(), activePixels.end(), 0u);
+    gi::updateActivePixels(stats.data(), threshold, 16, activePixels);
+    CHECK(activePixels.empty(), "%zu pixels active at the maximum sample count", activePixels.size());
+
+    gi::updateActivePixels(stats.data(), threshold, 26, activePixels);
+    CHECK(activePixels.empty(), "empty list grew");
+  }
+}
+
+int main(int argc, const char* argv[])
+{
+  _TestMinSpp();
+  _TestMaxSpp();
+  _TestErrorThreshold();
+  _TestDegenerateStats();
+  _TestCompaction();
+
+  printf("%s\n", (s_failureCount == 0) ? "passed" : "FAILED");
+
+  return (s_failureCount == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
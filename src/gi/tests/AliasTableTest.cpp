@@ -0,0 +1,301 @@
+//
+// Copyright (C) 2019-2022 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+// Checks that alias tables select each entry with the probability of its weight, that
+// degenerate weights fall back to uniform sampling, and that the solid angle pdf the
+// dome light shader evaluates matches the density of the directions it samples.
+
+#include "lightsampling.h"
+#include "DomeLightSampling.h"
+
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <random>
+
+namespace Rp = gtl::shader_interface::rp_main;
+
+using namespace gi::tests;
+
+namespace
+{
+  int s_failureCount = 0;
+
+#define CHECK(COND, ...)                      \
+  if (!(COND))                                \
+  {                                           \
+    fprintf(stderr, "check failed: " __VA_ARGS__); \
+    fprintf(stderr, "\n");                    \
+    s_failureCount++;                         \
+  }
+
+  // Exact selection probabilities of the table when sampled like the shaders do.
+  std::vector<double> _GetSelectionProbs(const std::vector<Rp::AliasEntry>& table)
+  {
+    size_t count = table.size();
+    std::vector<double> probs(count, 0.0);
+
+    for (size_t i = 0; i < count; i++)
+    {
+      const Rp::AliasEntry& entry = table[i];
+      probs[i] += double(entry.prob) / count;
+      probs[entry.alias] += (1.0 - double(entry.prob)) / count;
+    }
+
+    return probs;
+  }
+
+  void _TestWeightsReproduced(const char* name, const std::vector<float>& weights)
+  {
+    std::vector<Rp::AliasEntry> table;
+    bool built = gi::buildAliasTable(weights, table);
+
+    CHECK(built, "%s: table not built", name);
+    CHECK(table.size() == weights.size(), "%s: table size %zu", name, table.size());
+    if (!built || table.size() != weights.size())
+    {
+      return;
+    }
+
+    double weightSum = 0.0;
+    for (float w : weights)
+    {
+      weightSum += w;
+    }
+
+    std::vector<double> probs = _GetSelectionProbs(table);
+
+    for (size_t i = 0; i < weights.size(); i++)
+    {
+      const Rp::AliasEntry& entry = table[i];
+      double expected = weights[i] / weightSum;
+
+      CHECK(entry.prob >= 0.0f && entry.prob <= 1.0f && entry.alias < table.size(),
+        "%s: entry %zu is invalid (prob %f, alias %u)", name, i, entry.prob, entry.alias);
+      CHECK(fabs(probs[i] - expected) <= 1e-5 * expected + 1e-9,
+        "%s: entry %zu is selected with %g instead of %g", name, i, probs[i], expected);
+      CHECK(fabs(entry.pdf - float(expected * weights.size())) <= 1e-5 * expected * weights.size(),
+        "%s: entry %zu has pdf %f instead of %f", name, i, entry.pdf, expected * weights.size());
+
+      // Entries without weight must never be chosen, not even through rounding errors.
+      if (weights[i] == 0.0f)
+      {
+        CHECK(probs[i] == 0.0, "%s: zero-weight entry %zu is selected with %g", name, i, probs[i]);
+      }
+    }
+  }
+
+  void _TestUniformFallback(const char* name, const std::vector<float>& weights)
+  {
+    std::vector<Rp::AliasEntry> table;
+    bool built = gi::buildAliasTable(weights, table);
+
+    CHECK(!built, "%s: table built", name);
+    CHECK(table.size() == weights.size(), "%s: table size %zu", name, table.size());
+
+    for (size_t i = 0; i < table.size(); i++)
+    {
+      CHECK(table[i].prob == 1.0f && table[i].alias == i && table[i].pdf == 1.0f,
+        "%s: entry %zu is not uniform (prob %f, alias %u, pdf %f)", name, i, table[i].prob, table[i].alias, table[i].pdf);
+    }
+  }
+
+  void _TestAliasTables()
+  {
+    std::mt19937 rng(43);
+    std::lognormal_distribution<float> lognormal(0.0f, 2.0f);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+    std::vector<float> weights(10000);
+    for (float& w : weights)
+    {
+      w = lognormal(rng);
+    }
+    _TestWeightsReproduced("lognormal", weights);
+
+    // Sparse weights, like emissive faces among many light sources without power.
+    for (float& w : weights)
+    {
+      w = (uniform(rng) < 0.9f) ? 0.0f : lognormal(rng);
+    }
+    _TestWeightsReproduced("sparse", weights);
+
+    _TestWeightsReproduced("single", { 3.0f });
+    _TestWeightsReproduced("one nonzero", { 0.0f, 0.0f, 5.0f, 0.0f });
+    _TestWeightsReproduced("equal", std::vector<float>(7, 0.25f));
+    _TestWeightsReproduced("extreme range", { 1e-30f, 1.0f, 1e30f, 1e-10f });
+    _TestWeightsReproduced("float overflow", { FLT_MAX, FLT_MAX, 1.0f });
+
+    _TestUniformFallback("empty", {});
+    _TestUniformFallback("all zero", std::vector<float>(5, 0.0f));
+    _TestUniformFallback("infinite", { 1.0f, INFINITY, 2.0f });
+    _TestUniformFallback("NaN", { 1.0f, 2.0f, NAN });
+  }
+
+  // Sky gradient with a small bright sun and a black horizon band. A few texels are
+  // non-finite and must be ignored.
+  float _SkyLuminance(float u, float v)
+  {
+    if (v > 0.48f && v < 0.52f)
+    {
+      return 0.0f;
+    }
+
+    float du = u - 0.3f;
+    float dv = v - 0.25f;
+    if (du * du + dv * dv < 0.0004f)
+    {
+      return 5000.0f;
+    }
+
+    return 0.2f + 2.0f * (1.0f - v) + 0.5f * sinf(u * 20.0f);
+  }
+
+  void _TestDomeLight(uint32_t width, uint32_t height)
+  {
+    std::vector<float> texels(size_t(width) * height * 4);
+    for (uint32_t y = 0; y < height; y++)
+    {
+      for (uint32_t x = 0; x < width; x++)
+      {
+        float luminance = _SkyLuminance((x + 0.5f) / width, (y + 0.5f) / height);
+        float* texel = &texels[(size_t(y) * width + x) * 4];
+        texel[0] = texel[1] = texel[2] = luminance;
+        texel[3] = 1.0f;
+      }
+    }
+    texels[(size_t(height / 3) * width + width / 7) * 4 + 1] = NAN;
+    texels[(size_t(height / 5) * width + width / 2) * 4 + 0] = INFINITY;
+
+    imgio_img img = {};
+    img.width = width;
+    img.height = height;
+    img.format = IMGIO_FORMAT_RGBA32_FLOAT;
+    img.size = texels.size() * sizeof(float);
+    img.data = (uint8_t*) texels.data();
+
+    std::vector<Rp::AliasEntry> table;
+    bool built = gi::buildDomeLightAliasTable(img, table);
+
+    const uint32_t cellCount = Rp::DOME_LIGHT_SAMPLING_WIDTH * Rp::DOME_LIGHT_SAMPLING_HEIGHT;
+    CHECK(built && table.size() == cellCount, "dome light %ux%u: table not built", width, height);
+    if (!built || table.size() != cellCount)
+    {
+      return;
+    }
+
+    // Sample directions like the shader and bin them in bands of equal solid angle.
+    const uint32_t binCountPhi = 16;
+    const uint32_t binCountCosTheta = 8;
+    const uint32_t sampleCount = 1 << 21;
+
+    auto getBin = [](glm::vec3 dir) {
+      float phi = atan2f(dir.z, dir.x) + DOME_LIGHT_PI;
+      uint32_t binX = std::min(uint32_t(phi / (2.0f * DOME_LIGHT_PI) * binCountPhi), binCountPhi - 1);
+      uint32_t binY = std::min(uint32_t((dir.y + 1.0f) * 0.5f * binCountCosTheta), binCountCosTheta - 1);
+      return binY * binCountPhi + binX;
+    };
+
+    std::vector<double> sampledMass(binCountPhi * binCountCosTheta, 0.0);
+    uint32_t pdfMismatchCount = 0;
+    uint32_t blackBandSampleCount = 0;
+
+    std::mt19937 rng(width);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+    for (uint32_t s = 0; s < sampleCount; s++)
+    {
+      glm::vec4 xi(uniform(rng), uniform(rng), uniform(rng), uniform(rng));
+
+      glm::vec2 uv;
+      float pdf;
+      domeLightSample(table, xi, uv, pdf);
+
+      glm::vec3 dir = domeLightUvToDir(uv);
+      sampledMass[getBin(dir)] += 1.0 / sampleCount;
+
+      if (uv.y > 0.49f && uv.y < 0.51f)
+      {
+        blackBandSampleCount++;
+      }
+
+      // Hits evaluate the pdf from the direction again, e.g. for MIS.
+      float hitPdf = domeLightPdf(table, domeLightDirToUv(dir));
+      if (!(pdf > 0.0f) || fabsf(hitPdf - pdf) > 1e-3f * pdf)
+      {
+        pdfMismatchCount++;
+      }
+    }
+
+    // Cell boundaries may round to the neighbouring cell when the direction is mapped back.
+    CHECK(pdfMismatchCount <= sampleCount / 1000,
+      "dome light %ux%u: %u sampled pdfs are zero or differ from the hit pdf", width, height, pdfMismatchCount);
+
+    // Integrate the pdf the shader evaluates over each bin with dω = sinθ dθ dφ. The steps
+    // subdivide the sampling cells, in which the pdf times sinθ is constant.
+    const uint32_t stepCountPhi = Rp::DOME_LIGHT_SAMPLING_WIDTH * 4;
+    const uint32_t stepCountTheta = Rp::DOME_LIGHT_SAMPLING_HEIGHT * 4;
+    const double stepArea = (DOME_LIGHT_PI / stepCountTheta) * (2.0 * DOME_LIGHT_PI / stepCountPhi);
+
+    std::vector<double> integratedMass(sampledMass.size(), 0.0);
+    double totalMass = 0.0;
+
+    for (uint32_t i = 0; i < stepCountTheta; i++)
+    {
+      double theta = (i + 0.5) * DOME_LIGHT_PI / stepCountTheta;
+      float sinTheta = float(sin(theta));
+      float cosTheta = float(cos(theta));
+
+      for (uint32_t j = 0; j < stepCountPhi; j++)
+      {
+        float phi = (j + 0.5f) * 2.0f * DOME_LIGHT_PI / stepCountPhi - DOME_LIGHT_PI;
+        glm::vec3 dir(sinTheta * cosf(phi), cosTheta, sinTheta * sinf(phi));
+
+        double mass = domeLightPdf(table, domeLightDirToUv(dir)) * sinTheta * stepArea;
+        integratedMass[getBin(dir)] += mass;
+        totalMass += mass;
+      }
+    }
+
+    CHECK(fabs(totalMass - 1.0) < 1e-4, "dome light %ux%u: pdf integrates to %f", width, height, totalMass);
+
+    for (size_t b = 0; b < sampledMass.size(); b++)
+    {
+      double p = integratedMass[b];
+      double sigma = sqrt(std::max(p * (1.0 - p), 1e-12) / sampleCount);
+
+      CHECK(fabs(sampledMass[b] - p) <= 5.0 * sigma,
+        "dome light %ux%u: bin %zu is sampled with %f but the pdf integrates to %f", width, height, b, sampledMass[b], p);
+    }
+
+    CHECK(blackBandSampleCount == 0, "dome light %ux%u: black band sampled %u times", width, height, blackBandSampleCount);
+  }
+}
+
+int main(int argc, const char* argv[])
+{
+  _TestAliasTables();
+
+  // Larger images average texels, smaller ones replicate them.
+  _TestDomeLight(Rp::DOME_LIGHT_SAMPLING_WIDTH * 2, Rp::DOME_LIGHT_SAMPLING_HEIGHT * 2);
+  _TestDomeLight(300, 150);
+
+  printf("%s\n", (s_failureCount == 0) ? "passed" : "FAILED");
+
+  return (s_failureCount == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,93 @@
+//
+// Copyright (C) 2019-2022 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+// C++ port of the dome light sampling in rt_dome_light.glsl. It is kept in sync with
+// the shader so that the alias table builder can be tested against the sampling code.
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <math.h>
+
+#include <glm/glm.hpp>
+
+#include "interface/rp_main.h"
+
+namespace gi::tests
+{
+  namespace Rp = gtl::shader_interface::rp_main;
+
+  const float DOME_LIGHT_PI = 3.14159265358979323846f;
+
+  // Matches dome_light_dir_to_uv().
+  inline glm::vec2 domeLightDirToUv(glm::vec3 dir)
+  {
+    float u = (atan2f(dir.z, dir.x) + 0.5f * DOME_LIGHT_PI) / (2.0f * DOME_LIGHT_PI);
+    float v = acosf(std::clamp(dir.y, -1.0f, 1.0f)) / DOME_LIGHT_PI;
+    return glm::vec2(u, v);
+  }
+
+  // Matches dome_light_uv_to_dir().
+  inline glm::vec3 domeLightUvToDir(glm::vec2 uv)
+  {
+    float phi = uv.x * 2.0f * DOME_LIGHT_PI - 0.5f * DOME_LIGHT_PI;
+    float theta = uv.y * DOME_LIGHT_PI;
+    float sinTheta = sinf(theta);
+    return glm::vec3(sinTheta * cosf(phi), cosf(theta), sinTheta * sinf(phi));
+  }
+
+  // Matches dome_light_pdf(uint, float).
+  inline float domeLightPdf(const std::vector<Rp::AliasEntry>& table, uint32_t cellIndex, float v)
+  {
+    float sinTheta = sinf(v * DOME_LIGHT_PI);
+    float pdfUv = table[cellIndex].pdf;
+    return (sinTheta > 0.0f) ? (pdfUv / (2.0f * DOME_LIGHT_PI * DOME_LIGHT_PI * sinTheta)) : 0.0f;
+  }
+
+  // Matches dome_light_pdf(vec2).
+  inline float domeLightPdf(const std::vector<Rp::AliasEntry>& table, glm::vec2 uv)
+  {
+    uv -= glm::floor(uv);
+    uint32_t cellX = std::min(uint32_t(uv.x * float(Rp::DOME_LIGHT_SAMPLING_WIDTH)), Rp::DOME_LIGHT_SAMPLING_WIDTH - 1u);
+    uint32_t cellY = std::min(uint32_t(uv.y * float(Rp::DOME_LIGHT_SAMPLING_HEIGHT)), Rp::DOME_LIGHT_SAMPLING_HEIGHT - 1u);
+    return domeLightPdf(table, cellY * Rp::DOME_LIGHT_SAMPLING_WIDTH + cellX, uv.y);
+  }
+
+  // Matches dome_light_sample() without the dome light transform. Returns the sampled cell.
+  inline uint32_t domeLightSample(const std::vector<Rp::AliasEntry>& table, glm::vec4 xi, glm::vec2& uv, float& pdf)
+  {
+    const uint32_t cellCount = Rp::DOME_LIGHT_SAMPLING_WIDTH * Rp::DOME_LIGHT_SAMPLING_HEIGHT;
+
+    uint32_t cellIndex = std::min(uint32_t(xi.x * float(cellCount)), cellCount - 1u);
+    const Rp::AliasEntry& entry = table[cellIndex];
+    if (xi.y >= entry.prob)
+    {
+      cellIndex = entry.alias;
+    }
+
+    uint32_t cellX = cellIndex % Rp::DOME_LIGHT_SAMPLING_WIDTH;
+    uint32_t cellY = cellIndex / Rp::DOME_LIGHT_SAMPLING_WIDTH;
+    uv = (glm::vec2(float(cellX), float(cellY)) + glm::vec2(xi.z, xi.w)) /
+         glm::vec2(float(Rp::DOME_LIGHT_SAMPLING_WIDTH), float(Rp::DOME_LIGHT_SAMPLING_HEIGHT));
+
+    pdf = domeLightPdf(table, cellIndex, uv.y);
+    return cellIndex;
+  }
+}
@@ -0,0 +1,215 @@
+//
+// Copyright (C) 2019-2022 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+// Checks that only the functions reachable from the entry point are kept when generated
+// MDL code is filtered for the any-hit shader, and that nothing else is touched.
+
+#include "sg/GlslFunctionFilter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+using namespace gi::sg;
+
+namespace
+{
+  int s_failureCount = 0;
+
+#define CHECK(COND, ...)                      \
+  if (!(COND))                                \
+  {                                           \
+    fprintf(stderr, "check failed: " __VA_ARGS__); \
+    fprintf(stderr, "\n");                    \
+    s_failureCount++;                         \
+  }
+
+  // Shaped like the output of the MDL GLSL backend after the struct definitions of the
+  // interface have been trimmed: user structs, read-only data, prototypes, then functions
+  // with #line directives, overloads and comments that contain braces.
+  const char* MDL_GLSL_SOURCE = R"(// user defined structs
+struct Derived_float2 {
+    vec2 val;
+    vec2 dx;
+    vec2 dy;
+};
+
+struct Material_data {
+    float weights[2];
+    vec3 tint;
+};
+
+// globals
+const float mdl_read_only_data[4] = float[](0.0, 1.0, 0.5, 0.25);
+
+// prototypes
+float tex_lookup_float_2d(int tex, vec2 coord, int wrap_u, int wrap_v, vec2 crop_u, vec2 crop_v, float frame);
+vec3 tex_lookup_float3_2d(int tex, vec2 coord, int wrap_u, int wrap_v, vec2 crop_u, vec2 crop_v, float frame);
+void mdl_bsdf_scattering_sample(inout Bsdf_sample_data sret_ptr, in State state);
+float mdl_cutout_opacity(in State state);
+
+// functions
+#line 31 "mdl::base::file_texture"
+Derived_float2 constr_Derived_float2(vec2 val, vec2 dx, vec2 dy)
+{
+    Derived_float2 res;
+    res.val = val;
+    res.dx = dx;
+    res.dy = dy;
+    return res;
+}
+
+// overloads { are } resolved by the compiler
+float apply_gamma(float v, float g)
+{
+    return pow(v, g);
+}
+
+vec3 apply_gamma(vec3 v, float g)
+{
+    return vec3(apply_gamma(v.x, g), apply_gamma(v.y, g), apply_gamma(v.z, g));
+}
+
+float scattering_only_helper(in vec3 n,
+                             in vec3 wi)
+{
+    /* { cutout_alpha( } */
+    return max(dot(n, wi), 0.0);
+}
+
+float cutout_alpha(in State state, in Derived_float2 uv)
+{
+    float a = tex_lookup_float_2d(0, uv.val, 0, 0, vec2(0.0, 1.0), vec2(0.0, 1.0), 0.0);
+    if (a > mdl_read_only_data[2]) {
+        for (int i = 0; i < 2; ++i) { a *= 1.0; }
+    }
+    return apply_gamma(a, 2.2);
+}
+
+void mdl_bsdf_scattering_sample(inout Bsdf_sample_data sret_ptr, in State state)
+{
+    // not called from the opacity function: scattering_only_helper()
+    vec3 tint = apply_gamma(tex_lookup_float3_2d(1, state.text_coords[0].xy, 0, 0, vec2(0.0, 1.0), vec2(0.0, 1.0), 0.0), 2.2);
+    sret_ptr.pdf = scattering_only_helper(state.normal, sret_ptr.k1) * tint.x;
+}
+
+#line 87 "mdl::gatling::cutout"
+float mdl_cutout_opacity(in State state)
+{
+#line 88 "mdl::gatling::cutout"
+    Derived_float2 uv = constr_Derived_float2(state.text_coords[0].xy, vec2(0.0), vec2(0.0));
+    return cutout_alpha(state, uv);
+}
+)";
+
+  bool _Contains(const std::string& s, const char* substring)
+  {
+    return s.find(substring) != std::string::npos;
+  }
+
+  int _BraceBalance(const std::string& s)
+  {
+    int balance = 0;
+    for (char c : s)
+    {
+      balance += (c == '{') - (c == '}');
+    }
+    return balance;
+  }
+
+  void _TestOpacityEntryPoint()
+  {
+    std::string result = stripUnreachableGlslFunctions(MDL_GLSL_SOURCE, "mdl_cutout_opacity");
+
+    // Reachable functions, including both overloads of a called name.
+    CHECK(_Contains(result, "float mdl_cutout_opacity(in State state)\n{"), "entry point removed");
+    CHECK(_Contains(result, "float cutout_alpha(in State state, in Derived_float2 uv)\n{"), "callee removed");
+    CHECK(_Contains(result, "Derived_float2 constr_Derived_float2(vec2 val, vec2 dx, vec2 dy)\n{"), "constructor removed");
+    CHECK(_Contains(result, "float apply_gamma(float v, float g)\n{"), "scalar overload removed");
+    CHECK(_Contains(result, "vec3 apply_gamma(vec3 v, float g)\n{"), "vector overload removed");
+
+    // Functions only referenced from unreachable code or from comments.
+    CHECK(!_Contains(result, "sret_ptr.pdf"), "scattering function kept");
+    CHECK(!_Contains(result, "max(dot(n, wi), 0.0)"), "scattering helper kept");
+
+    // Declarations and directives are kept verbatim.
+    CHECK(_Contains(result, "struct Derived_float2 {\n    vec2 val;\n    vec2 dx;\n    vec2 dy;\n};"), "struct changed");
+    CHECK(_Contains(result, "struct Material_data {\n    float weights[2];\n    vec3 tint;\n};"), "struct changed");
+    CHECK(_Contains(result, "const float mdl_read_only_data[4] = float[](0.0, 1.0, 0.5, 0.25);"), "global changed");
+    CHECK(_Contains(result, "void mdl_bsdf_scattering_sample(inout Bsdf_sample_data sret_ptr, in State state);"), "prototype removed");
+    CHECK(_Contains(result, "#line 31 \"mdl::base::file_texture\"\n"), "directive removed");
+    CHECK(_Contains(result, "#line 87 \"mdl::gatling::cutout\"\n"), "directive removed");
+    CHECK(_Contains(result, "#line 88 \"mdl::gatling::cutout\"\n"), "directive in body removed");
+
+    CHECK(_BraceBalance(result) == 0, "unbalanced braces in result");
+    CHECK(result.find("// user defined structs") == 0, "leading comment removed");
+
+    // Kept text appears in the original order.
+    CHECK(result.find("constr_Derived_float2(vec2") < result.find("float cutout_alpha(") &&
+          result.find("float cutout_alpha(") < result.find("float mdl_cutout_opacity(in State state)\n"),
+          "functions reordered");
+
+    // Filtering again changes nothing.
+    CHECK(stripUnreachableGlslFunctions(result, "mdl_cutout_opacity") == result, "filter is not idempotent");
+  }
+
+  void _TestScatteringEntryPoint()
+  {
+    std::string result = stripUnreachableGlslFunctions(MDL_GLSL_SOURCE, "mdl_bsdf_scattering_sample");
+
+    CHECK(_Contains(result, "sret_ptr.pdf"), "entry point removed");
+    CHECK(_Contains(result, "max(dot(n, wi), 0.0)"), "callee removed");
+    CHECK(_Contains(result, "vec3 apply_gamma(vec3 v, float g)\n{"), "vector overload removed");
+    CHECK(!_Contains(result, "return cutout_alpha(state, uv);"), "opacity function kept");
+    CHECK(!_Contains(result, "tex_lookup_float_2d(0, uv.val"), "opacity helper kept");
+    CHECK(_BraceBalance(result) == 0, "unbalanced braces in result");
+  }
+
+  void _TestUnknownEntryPoint()
+  {
+    std::string result = stripUnreachableGlslFunctions(MDL_GLSL_SOURCE, "mdl_edf_emission");
+
+    CHECK(!_Contains(result, "return"), "function definitions kept");
+    CHECK(_Contains(result, "float mdl_cutout_opacity(in State state);"), "prototype removed");
+    CHECK(_Contains(result, "struct Material_data {"), "struct removed");
+    CHECK(_BraceBalance(result) == 0, "unbalanced braces in result");
+  }
+
+  void _TestUnterminatedInput()
+  {
+    // Must not read out of bounds or loop on truncated input.
+    std::string source = MDL_GLSL_SOURCE;
+    for (size_t length : { size_t(0), size_t(1), source.find("/* { cutout") + 3, source.size() / 2, source.size() - 3 })
+    {
+      std::string result = stripUnreachableGlslFunctions(std::string_view(source).substr(0, length), "mdl_cutout_opacity");
+      CHECK(result.size() <= length, "truncated input of length %zu grew", length);
+    }
+  }
+}
+
+int main(int argc, const char* argv[])
+{
+  _TestOpacityEntryPoint();
+  _TestScatteringEntryPoint();
+  _TestUnknownEntryPoint();
+  _TestUnterminatedInput();
+
+  printf("%s\n", (s_failureCount == 0) ? "passed" : "FAILED");
+
+  return (s_failureCount == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,181 @@
+//
+// Copyright (C) 2019-2022 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+// Trains the guiding field on a synthetic radiance distribution and checks that its
+// pdfs are normalized, that the exported trees sample directions with the pdf the
+// host and the shader evaluate, and that sampling concentrates on the light.
+
+#include "guiding.h"
+#include "GuidingSampling.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <random>
+
+namespace Rp = gtl::shader_interface::rp_main;
+
+using namespace gi::tests;
+
+namespace
+{
+  int s_failureCount = 0;
+
+#define CHECK(COND, ...)                           \
+  if (!(COND))                                     \
+  {                                                \
+    fprintf(stderr, "check failed: " __VA_ARGS__); \
+    fprintf(stderr, "\n");                         \
+    s_failureCount++;                              \
+  }
+
+  const float LIGHT_COS_THETA = 0.95f;
+
+  // Light arrives through a narrow cone whose direction depends on the side of the scene.
+  glm::vec3 _LightDirection(glm::vec3 position)
+  {
+    return (position.x < 0.0f) ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(-1.0f, 0.0f, 0.0f);
+  }
+
+  float _Radiance(glm::vec3 position, glm::vec3 direction)
+  {
+    return (glm::dot(direction, _LightDirection(position)) > LIGHT_COS_THETA) ? 10.0f : 0.01f;
+  }
+
+  void _AddUniformRecords(gi::GuidingField& field, std::mt19937& rng, uint32_t count)
+  {
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+    std::vector<Rp::GuidingRecord> records(count);
+    for (Rp::GuidingRecord& record : records)
+    {
+      record.position = glm::vec3(uniform(rng), uniform(rng), uniform(rng)) * 2.0f - 1.0f;
+      record.direction = guidingSquareToDir(glm::vec2(uniform(rng), uniform(rng)));
+      record.pdf = 1.0f / (4.0f * GUIDING_PI);
+      record.radiance = _Radiance(record.position, record.direction);
+    }
+
+    // Invalid records must be ignored.
+    records[0].pdf = 0.0f;
+    records[1].radiance = -1.0f;
+    records[2].position.x = NAN;
+
+    field.addRecords(records.data(), records.size());
+  }
+
+  double _IntegratePdf(const gi::GuidingField& field, glm::vec3 position)
+  {
+    const uint32_t N = 256;
+
+    double integral = 0.0;
+    for (uint32_t i = 0; i < N; i++)
+    {
+      for (uint32_t j = 0; j < N; j++)
+      {
+        glm::vec3 dir = guidingSquareToDir(glm::vec2((i + 0.5f) / N, (j + 0.5f) / N));
+        integral += field.pdf(position, dir);
+      }
+    }
+
+    return integral * 4.0 * GUIDING_PI / (N * N);
+  }
+
+  void _TestTrainedField(const gi::GuidingField& field, std::mt19937& rng, bool expectConcentration)
+  {
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+    std::vector<Rp::GuidingSpatialNode> spatialNodes;
+    std::vector<Rp::GuidingDirectionalNode> directionalNodes;
+    field.exportNodes(spatialNodes, directionalNodes);
+
+    CHECK(!spatialNodes.empty() && !directionalNodes.empty(), "no nodes exported");
+
+    for (uint32_t i = 0; i < 8; i++)
+    {
+      glm::vec3 position = glm::vec3(uniform(rng), uniform(rng), uniform(rng)) * 1.8f - 0.9f;
+
+      double integral = _IntegratePdf(field, position);
+      CHECK(fabs(integral - 1.0) < 0.02, "pdf integrates to %f", integral);
+
+      uint32_t tree = guidingFindTree(spatialNodes, directionalNodes, position);
+      CHECK(tree != UINT32_MAX, "no tree found for position");
+      if (tree == UINT32_MAX)
+      {
+        continue;
+      }
+
+      const uint32_t sampleCount = 4096;
+      uint32_t lightSampleCount = 0;
+
+      for (uint32_t j = 0; j < sampleCount; j++)
+      {
+        float samplePdf;
+        glm::vec3 dir = guidingSample(directionalNodes, tree, glm::vec2(uniform(rng), uniform(rng)), samplePdf);
+
+        float hostPdf = field.pdf(position, dir);
+        float shaderPdf = guidingPdf(directionalNodes, tree, dir);
+
+        CHECK(samplePdf > 0.0f, "sampled direction has zero pdf");
+        CHECK(fabsf(samplePdf - hostPdf) <= 1e-3f * hostPdf, "sampled pdf %g != host pdf %g", samplePdf, hostPdf);
+        CHECK(fabsf(shaderPdf - hostPdf) <= 1e-3f * hostPdf, "shader pdf %g != host pdf %g", shaderPdf, hostPdf);
+
+        if (glm::dot(dir, _LightDirection(position)) > LIGHT_COS_THETA)
+        {
+          lightSampleCount++;
+        }
+      }
+
+      // The light cone covers 2.5% of the sphere.
+      float lightFraction = float(lightSampleCount) / sampleCount;
+      CHECK(!expectConcentration || lightFraction > 0.5f, "only %.1f%% of samples towards the light", lightFraction * 100.0f);
+    }
+  }
+}
+
+int main(int argc, const char* argv[])
+{
+  gi::GuidingField field(gi::GuidingField::InitParams{
+    .directionalSplitFraction = 0.01f,
+    .maxDirectionalDepth = 20,
+    .spatialSplitThreshold = 4000.0f
+  });
+
+  // Without records there is nothing to guide towards.
+  CHECK(field.getIterationCount() == 0, "initial iteration count is %u", field.getIterationCount());
+  CHECK(field.pdf(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f)) == 0.0f, "untrained field has non-zero pdf");
+
+  std::mt19937 rng(1);
+
+  // Iterations double in length, as in the renderer.
+  for (uint32_t iteration = 0, passCount = 1; iteration < 6; iteration++, passCount *= 2)
+  {
+    for (uint32_t pass = 0; pass < passCount; pass++)
+    {
+      _AddUniformRecords(field, rng, 20000);
+    }
+    field.refine(passCount);
+
+    CHECK(field.getIterationCount() == iteration + 1, "iteration count is %u", field.getIterationCount());
+
+    int failureCount = s_failureCount;
+    _TestTrainedField(field, rng, iteration >= 2);
+
+    printf("iteration %u: %s\n", iteration, (failureCount == s_failureCount) ? "passed" : "FAILED");
+  }
+
+  return (s_failureCount == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,149 @@
+//
+// Copyright (C) 2019-2022 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+// C++ port of the sampling functions in rt_guiding.glsl. It is kept in sync with the
+// shader so that the learner can be tested against the sampling code.
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+
+#include <glm/glm.hpp>
+
+#include "interface/rp_main.h"
+
+namespace gi::tests
+{
+  namespace Rp = gtl::shader_interface::rp_main;
+
+  const float GUIDING_PI = 3.14159265358979323846f;
+
+  inline glm::vec2 guidingDirToSquare(glm::vec3 dir)
+  {
+    float phi = atan2f(dir.y, dir.x);
+    phi = (phi < 0.0f) ? (phi + 2.0f * GUIDING_PI) : phi;
+    return glm::min(glm::vec2(std::clamp(dir.z, -1.0f, 1.0f) * 0.5f + 0.5f, phi / (2.0f * GUIDING_PI)), glm::vec2(0.99999994f));
+  }
+
+  inline glm::vec3 guidingSquareToDir(glm::vec2 p)
+  {
+    float cosTheta = 2.0f * p.x - 1.0f;
+    float sinTheta = sqrtf(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+    float phi = 2.0f * GUIDING_PI * p.y;
+    return glm::vec3(sinTheta * cosf(phi), sinTheta * sinf(phi), cosTheta);
+  }
+
+  inline float guidingTotalEnergy(const Rp::GuidingDirectionalNode& node)
+  {
+    return node.energies[0] + node.energies[1] + node.energies[2] + node.energies[3];
+  }
+
+  // Matches guiding_find_tree().
+  inline uint32_t guidingFindTree(const std::vector<Rp::GuidingSpatialNode>& spatialNodes,
+                                  const std::vector<Rp::GuidingDirectionalNode>& directionalNodes,
+                                  glm::vec3 position)
+  {
+    Rp::GuidingSpatialNode node = spatialNodes[0];
+
+    while (node.axis != Rp::GUIDING_SPATIAL_LEAF)
+    {
+      uint32_t childOffset = (position[node.axis] < node.split) ? 0u : 1u;
+      node = spatialNodes[node.index + childOffset];
+    }
+
+    return (guidingTotalEnergy(directionalNodes[node.index]) > 0.0f) ? node.index : UINT32_MAX;
+  }
+
+  // Matches guiding_pdf().
+  inline float guidingPdf(const std::vector<Rp::GuidingDirectionalNode>& nodes, uint32_t tree, glm::vec3 dir)
+  {
+    glm::vec2 p = guidingDirToSquare(dir);
+    float pdf = 1.0f / (4.0f * GUIDING_PI);
+    uint32_t nodeIndex = tree;
+
+    while (true)
+    {
+      const Rp::GuidingDirectionalNode& node = nodes[nodeIndex];
+
+      float total = guidingTotalEnergy(node);
+      if (total <= 0.0f)
+      {
+        return 0.0f;
+      }
+
+      uint32_t bx = (p.x >= 0.5f) ? 1u : 0u;
+      uint32_t by = (p.y >= 0.5f) ? 1u : 0u;
+      uint32_t q = bx | (by << 1);
+      pdf *= 4.0f * node.energies[q] / total;
+
+      if (node.children[q] == 0u || pdf <= 0.0f)
+      {
+        return pdf;
+      }
+
+      p = p * 2.0f - glm::vec2(float(bx), float(by));
+      nodeIndex = node.children[q];
+    }
+  }
+
+  // Matches guiding_sample().
+  inline glm::vec3 guidingSample(const std::vector<Rp::GuidingDirectionalNode>& nodes, uint32_t tree, glm::vec2 xi, float& pdf)
+  {
+    glm::vec2 origin(0.0f);
+    float size = 1.0f;
+    pdf = 1.0f / (4.0f * GUIDING_PI);
+    uint32_t nodeIndex = tree;
+
+    while (true)
+    {
+      const Rp::GuidingDirectionalNode& node = nodes[nodeIndex];
+
+      float total = guidingTotalEnergy(node);
+      float lowerU = node.energies[0] + node.energies[2];
+      float probU = lowerU / total;
+
+      uint32_t bx = (xi.x < probU) ? 0u : 1u;
+      xi.x = (bx == 0u) ? (xi.x / probU) : ((xi.x - probU) / (1.0f - probU));
+
+      float halfTotal = (bx == 0u) ? lowerU : (total - lowerU);
+      float probV = node.energies[bx] / halfTotal;
+
+      uint32_t by = (xi.y < probV) ? 0u : 1u;
+      xi.y = (by == 0u) ? (xi.y / probV) : ((xi.y - probV) / (1.0f - probV));
+      xi = glm::min(xi, glm::vec2(0.99999994f));
+
+      uint32_t q = bx | (by << 1);
+      pdf *= 4.0f * node.energies[q] / total;
+
+      size *= 0.5f;
+      origin += glm::vec2(float(bx), float(by)) * size;
+
+      if (node.children[q] == 0u)
+      {
+        break;
+      }
+
+      nodeIndex = node.children[q];
+    }
+
+    return guidingSquareToDir(origin + xi * size);
+  }
+}
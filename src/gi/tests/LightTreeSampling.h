@@ -0,0 +1,138 @@
+//
+// Copyright (C) 2019-2022 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+// C++ port of the light tree traversal in rt_emissive_faces.glsl. It is kept in sync
+// with the shader so that the builder can be tested against the sampling code.
+
+#include <vector>
+#include <algorithm>
+#include <float.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <glm/glm.hpp>
+
+#include "interface/rp_main.h"
+
+namespace gi::tests
+{
+  namespace Rp = gtl::shader_interface::rp_main;
+
+  inline float lightTreeImportance(const Rp::LightTreeNode& node, glm::vec3 p)
+  {
+    const float PI = 3.14159265358979323846f;
+
+    glm::vec3 center = 0.5f * (node.boundsMin + node.boundsMax);
+    glm::vec3 toPoint = p - center;
+    float distSq = glm::dot(toPoint, toPoint);
+    glm::vec3 halfExtent = 0.5f * (node.boundsMax - node.boundsMin);
+    float radiusSq = glm::dot(halfExtent, halfExtent);
+
+    if (distSq <= radiusSq)
+    {
+      return node.power / std::max(radiusSq, FLT_MIN);
+    }
+
+    float cosTheta = glm::dot(node.coneAxis, toPoint / sqrtf(distSq));
+    float theta = acosf(std::clamp(cosTheta, -1.0f, 1.0f));
+    float thetaO = acosf(std::clamp(node.coneCosTheta, -1.0f, 1.0f));
+    float thetaU = asinf(sqrtf(radiusSq / distSq));
+
+    float thetaP = std::max(0.0f, theta - thetaO - thetaU);
+    if (thetaP >= 0.5f * PI)
+    {
+      return 0.0f;
+    }
+
+    return node.power * cosf(thetaP) / distSq;
+  }
+
+  inline float lightTreeChildProb(const std::vector<Rp::LightTreeNode>& nodes, uint32_t childIndex, glm::vec3 p, bool& isImportant)
+  {
+    float i0 = lightTreeImportance(nodes[childIndex + 0], p);
+    float i1 = lightTreeImportance(nodes[childIndex + 1], p);
+    float total = i0 + i1;
+
+    isImportant = (total > 0.0f);
+    return isImportant ? (i0 / total) : 0.0f;
+  }
+
+  // Matches emissive_face_selection_pdf().
+  inline float lightTreeSelectionPdf(const std::vector<Rp::LightTreeNode>& nodes, const Rp::EmissiveFace& face, glm::vec3 origin)
+  {
+    uint32_t bits = face.lightTreeBits;
+    uint32_t nodeIndex = 0;
+    float selectionPdf = 1.0f;
+
+    while ((nodes[nodeIndex].index & Rp::LIGHT_TREE_LEAF_BIT) == 0)
+    {
+      uint32_t childIndex = nodes[nodeIndex].index;
+
+      bool isImportant;
+      float p0 = lightTreeChildProb(nodes, childIndex, origin, isImportant);
+      if (!isImportant)
+      {
+        return 0.0f;
+      }
+
+      bool takeSecond = ((bits & 1u) != 0);
+      selectionPdf *= takeSecond ? (1.0f - p0) : p0;
+      nodeIndex = childIndex + uint32_t(takeSecond);
+      bits >>= 1;
+    }
+
+    return selectionPdf;
+  }
+
+  // Matches emissive_face_select(). Returns UINT32_MAX if no face is important.
+  inline uint32_t lightTreeSelect(const std::vector<Rp::LightTreeNode>& nodes, float xi, glm::vec3 origin, float& selectionPdf)
+  {
+    uint32_t nodeIndex = 0;
+    selectionPdf = 1.0f;
+
+    while ((nodes[nodeIndex].index & Rp::LIGHT_TREE_LEAF_BIT) == 0)
+    {
+      uint32_t childIndex = nodes[nodeIndex].index;
+
+      bool isImportant;
+      float p0 = lightTreeChildProb(nodes, childIndex, origin, isImportant);
+      if (!isImportant)
+      {
+        selectionPdf = 0.0f;
+        return UINT32_MAX;
+      }
+
+      if (xi < p0)
+      {
+        xi /= p0;
+        selectionPdf *= p0;
+        nodeIndex = childIndex;
+      }
+      else
+      {
+        xi = (xi - p0) / (1.0f - p0);
+        selectionPdf *= (1.0f - p0);
+        nodeIndex = childIndex + 1;
+      }
+    }
+
+    return nodes[nodeIndex].index & ~Rp::LIGHT_TREE_LEAF_BIT;
+  }
+}
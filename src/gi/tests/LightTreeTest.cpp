@@ -0,0 +1,270 @@
+//
+// Copyright (C) 2019-2022 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+// Checks the invariants of the light tree builder that the hit shader relies on: the
+// cone of each node bounds the normals of its faces, node powers add up, and the pdf
+// of a sampled face matches the one that is evaluated again when the face is hit.
+
+#include "lightsampling.h"
+#include "LightTreeSampling.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <random>
+
+namespace Rp = gtl::shader_interface::rp_main;
+
+using namespace gi::tests;
+
+namespace
+{
+  int s_failureCount = 0;
+
+#define CHECK(COND, ...)                      \
+  if (!(COND))                                \
+  {                                           \
+    fprintf(stderr, "check failed: " __VA_ARGS__); \
+    fprintf(stderr, "\n");                    \
+    s_failureCount++;                         \
+  }
+
+  struct TestScene
+  {
+    std::vector<Rp::EmissiveFace> faces;
+    std::vector<float> powers;
+  };
+
+  // Small triangles scattered in a box. Most face along one of four directions like
+  // windows on facades; some have random orientations, no power or no area.
+  TestScene _MakeScene(uint32_t faceCount, uint32_t seed)
+  {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    std::lognormal_distribution<float> lognormal(0.0f, 1.5f);
+
+    const glm::vec3 facadeNormals[] = {
+      glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+      glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+    };
+
+    TestScene scene;
+    scene.faces.resize(faceCount);
+    scene.powers.resize(faceCount);
+
+    for (uint32_t i = 0; i < faceCount; i++)
+    {
+      glm::vec3 p(uniform(rng) * 100.0f, uniform(rng) * 20.0f, uniform(rng) * 100.0f);
+
+      glm::vec3 n;
+      float kind = uniform(rng);
+      if (kind < 0.8f)
+      {
+        n = facadeNormals[i % 4];
+      }
+      else
+      {
+        n = glm::normalize(glm::vec3(uniform(rng), uniform(rng), uniform(rng)) * 2.0f - 1.0f);
+      }
+
+      // Build a triangle with counter-clockwise winding around the normal.
+      glm::vec3 t = glm::normalize(glm::cross(n, fabsf(n.y) < 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f)));
+      glm::vec3 b = glm::cross(n, t);
+
+      Rp::EmissiveFace& face = scene.faces[i];
+      face = {};
+      face.p0 = p;
+      face.p1 = p + t;
+      face.p2 = p + b;
+
+      if (kind > 0.98f)
+      {
+        face.p2 = face.p1; // degenerate
+      }
+
+      scene.powers[i] = (kind > 0.96f) ? 0.0f : lognormal(rng);
+    }
+
+    return scene;
+  }
+
+  glm::vec3 _FaceNormal(const Rp::EmissiveFace& face)
+  {
+    glm::vec3 n = glm::cross(face.p1 - face.p0, face.p2 - face.p0);
+    float len = glm::length(n);
+    return (len > 0.0f) ? (n / len) : glm::vec3(0.0f);
+  }
+
+  // Returns the power of the subtree and appends its faces.
+  double _CheckNode(const TestScene& scene, const std::vector<Rp::LightTreeNode>& nodes, uint32_t nodeIndex,
+                    std::vector<uint32_t>& faceIndices, uint32_t& leafCount)
+  {
+    const Rp::LightTreeNode& node = nodes[nodeIndex];
+
+    if ((node.index & Rp::LIGHT_TREE_LEAF_BIT) != 0)
+    {
+      uint32_t faceIndex = node.index & ~Rp::LIGHT_TREE_LEAF_BIT;
+      CHECK(faceIndex < scene.faces.size(), "leaf %u references face %u", nodeIndex, faceIndex);
+      CHECK(node.power == scene.powers[faceIndex], "leaf %u power %f != face power %f", nodeIndex, node.power, scene.powers[faceIndex]);
+      faceIndices.push_back(faceIndex);
+      leafCount++;
+      return node.power;
+    }
+
+    uint32_t childIndex = node.index;
+    CHECK(childIndex + 1 < nodes.size() && childIndex > nodeIndex, "node %u has invalid child index %u", nodeIndex, childIndex);
+
+    size_t firstFace = faceIndices.size();
+    double power = _CheckNode(scene, nodes, childIndex, faceIndices, leafCount) +
+                   _CheckNode(scene, nodes, childIndex + 1, faceIndices, leafCount);
+
+    CHECK(fabs(node.power - power) <= 1e-4 * power + 1e-6, "node %u power %f != sum of children %f", nodeIndex, node.power, power);
+
+    for (size_t i = firstFace; i < faceIndices.size(); i++)
+    {
+      const Rp::EmissiveFace& face = scene.faces[faceIndices[i]];
+
+      for (glm::vec3 p : { face.p0, face.p1, face.p2 })
+      {
+        bool inside = glm::all(glm::greaterThanEqual(p, node.boundsMin)) && glm::all(glm::lessThanEqual(p, node.boundsMax));
+        CHECK(inside, "node %u bounds don't contain face %u", nodeIndex, faceIndices[i]);
+      }
+
+      // Faces without power or area never influence the cone.
+      glm::vec3 n = _FaceNormal(face);
+      if (scene.powers[faceIndices[i]] <= 0.0f || glm::length(n) == 0.0f)
+      {
+        continue;
+      }
+
+      float cosAngle = glm::dot(n, node.coneAxis);
+      CHECK(cosAngle >= node.coneCosTheta - 1e-4f, "node %u cone (cos %f) doesn't contain normal of face %u (cos %f)",
+            nodeIndex, node.coneCosTheta, faceIndices[i], cosAngle);
+    }
+
+    return power;
+  }
+
+  void _TestStructure(const TestScene& scene, const std::vector<Rp::LightTreeNode>& nodes)
+  {
+    uint32_t faceCount = uint32_t(scene.faces.size());
+    CHECK(nodes.size() == size_t(faceCount) * 2 - 1, "expected %u nodes, got %zu", faceCount * 2 - 1, nodes.size());
+
+    std::vector<uint32_t> faceIndices;
+    uint32_t leafCount = 0;
+    double power = _CheckNode(scene, nodes, 0, faceIndices, leafCount);
+
+    double totalPower = 0.0;
+    for (float p : scene.powers)
+    {
+      totalPower += p;
+    }
+    CHECK(fabs(power - totalPower) <= 1e-4 * totalPower, "root power %f != total power %f", power, totalPower);
+
+    std::sort(faceIndices.begin(), faceIndices.end());
+    bool isPermutation = (leafCount == faceCount);
+    for (uint32_t i = 0; isPermutation && i < faceCount; i++)
+    {
+      isPermutation = (faceIndices[i] == i);
+    }
+    CHECK(isPermutation, "leaves are not a permutation of the faces");
+
+    // The bits of each face must lead to its leaf.
+    for (uint32_t i = 0; i < faceCount; i++)
+    {
+      uint32_t bits = scene.faces[i].lightTreeBits;
+      uint32_t nodeIndex = 0;
+      uint32_t depth = 0;
+
+      while ((nodes[nodeIndex].index & Rp::LIGHT_TREE_LEAF_BIT) == 0 && depth < 32)
+      {
+        nodeIndex = nodes[nodeIndex].index + (bits & 1u);
+        bits >>= 1;
+        depth++;
+      }
+
+      CHECK(nodes[nodeIndex].index == (i | Rp::LIGHT_TREE_LEAF_BIT), "bits of face %u lead to node %u", i, nodeIndex);
+    }
+  }
+
+  void _TestSelectionPdf(const TestScene& scene, const std::vector<Rp::LightTreeNode>& nodes, uint32_t seed)
+  {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+    for (uint32_t i = 0; i < 64; i++)
+    {
+      glm::vec3 origin(uniform(rng) * 120.0f - 10.0f, uniform(rng) * 30.0f - 5.0f, uniform(rng) * 120.0f - 10.0f);
+
+      // Subtrees facing away from the origin are culled during traversal, so the pdfs may
+      // sum to less than one. Faces that emit towards the origin must never be culled.
+      double pdfSum = 0.0;
+      for (size_t f = 0; f < scene.faces.size(); f++)
+      {
+        const Rp::EmissiveFace& face = scene.faces[f];
+        float pdf = lightTreeSelectionPdf(nodes, face, origin);
+        pdfSum += pdf;
+
+        glm::vec3 n = _FaceNormal(face);
+        bool isFacingOrigin = glm::dot(n, origin - face.p0) > 0.0f || glm::dot(n, origin - face.p1) > 0.0f ||
+                              glm::dot(n, origin - face.p2) > 0.0f;
+
+        CHECK(pdf > 0.0f || scene.powers[f] <= 0.0f || !isFacingOrigin || scene.faces.size() == 1,
+              "face %zu emits towards the origin but can't be selected", f);
+      }
+      CHECK(pdfSum <= 1.0 + 1e-4, "selection pdfs sum to %f", pdfSum);
+
+      for (uint32_t j = 0; j < 256; j++)
+      {
+        float selectionPdf;
+        uint32_t faceIndex = lightTreeSelect(nodes, uniform(rng), origin, selectionPdf);
+        if (faceIndex == UINT32_MAX)
+        {
+          continue;
+        }
+
+        CHECK(scene.powers[faceIndex] > 0.0f, "selected face %u without power", faceIndex);
+
+        float evalPdf = lightTreeSelectionPdf(nodes, scene.faces[faceIndex], origin);
+        CHECK(fabsf(selectionPdf - evalPdf) <= 1e-4f * evalPdf, "sampled pdf %g != evaluated pdf %g of face %u",
+              selectionPdf, evalPdf, faceIndex);
+      }
+    }
+  }
+}
+
+int main(int argc, const char* argv[])
+{
+  for (uint32_t faceCount : { 1u, 2u, 3u, 17u, 1000u, 20000u })
+  {
+    TestScene scene = _MakeScene(faceCount, faceCount);
+
+    // Trees of a single face select it regardless of its power.
+    scene.powers[0] = std::max(scene.powers[0], 1.0f);
+
+    std::vector<Rp::LightTreeNode> nodes;
+    gi::buildLightTree(scene.powers, scene.faces, nodes);
+
+    int failureCount = s_failureCount;
+    _TestStructure(scene, nodes);
+    _TestSelectionPdf(scene, nodes, faceCount + 1);
+
+    printf("%6u faces: %s\n", faceCount, (failureCount == s_failureCount) ? "passed" : "FAILED");
+  }
+
+  return (s_failureCount == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
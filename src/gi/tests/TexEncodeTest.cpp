@@ -0,0 +1,445 @@
+//
+// Copyright (C) 2019-2022 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+// Decodes the blocks of the CPU block compressor with a reference decoder written after
+// the BC7 and BC6H specifications and checks the reconstruction error. Since the anchor
+// index is stored without its MSB, a block whose anchor index needed the MSB decodes
+// its first texel with a palette entry that is not the nearest one, which is checked too.
+
+#include "texenc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <math.h>
+#include <random>
+#include <vector>
+
+using namespace gi;
+
+namespace
+{
+  int s_failureCount = 0;
+
+#define CHECK(COND, ...)                      \
+  if (!(COND))                                \
+  {                                           \
+    fprintf(stderr, "check failed: " __VA_ARGS__); \
+    fprintf(stderr, "\n");                    \
+    s_failureCount++;                         \
+  }
+
+  const int32_t WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+  class BitReader
+  {
+  public:
+    BitReader(const uint8_t* block)
+      : m_block(block)
+    {
+    }
+
+    uint32_t read(uint32_t bitCount)
+    {
+      uint32_t value = 0;
+      for (uint32_t i = 0; i < bitCount; i++, m_bitOffset++)
+      {
+        value |= uint32_t((m_block[m_bitOffset >> 3] >> (m_bitOffset & 7)) & 1) << i;
+      }
+      return value;
+    }
+
+    uint32_t bitOffset() const { return m_bitOffset; }
+
+  private:
+    const uint8_t* m_block;
+    uint32_t m_bitOffset = 0;
+  };
+
+  // Palette and indices of a single-subset block with 4-bit indices. BC6H scales the
+  // interpolated endpoints to obtain the final values; BC7 uses them as they are.
+  struct DecodedBlock
+  {
+    bool valid;
+    int32_t interpolated[16][4];
+    int32_t palette[16][4];
+    uint32_t indices[16];
+  };
+
+  void _ReadIndices(BitReader& reader, uint32_t indices[16])
+  {
+    indices[0] = reader.read(3);
+    for (uint32_t i = 1; i < 16; i++)
+    {
+      indices[i] = reader.read(4);
+    }
+  }
+
+  DecodedBlock _DecodeBc7Mode6(const uint8_t* block)
+  {
+    DecodedBlock result = {};
+    BitReader reader(block);
+
+    // The mode is the position of the lowest set bit.
+    if (reader.read(7) != (1u << 6))
+    {
+      return result;
+    }
+
+    int32_t bits[2][4];
+    for (int c = 0; c < 4; c++)
+    {
+      bits[0][c] = int32_t(reader.read(7));
+      bits[1][c] = int32_t(reader.read(7));
+    }
+    int32_t pBits[2] = { int32_t(reader.read(1)), int32_t(reader.read(1)) };
+    _ReadIndices(reader, result.indices);
+
+    if (reader.bitOffset() != 128)
+    {
+      return result;
+    }
+
+    for (uint32_t i = 0; i < 16; i++)
+    {
+      for (int c = 0; c < 4; c++)
+      {
+        int32_t e0 = (bits[0][c] << 1) | pBits[0];
+        int32_t e1 = (bits[1][c] << 1) | pBits[1];
+        result.interpolated[i][c] = ((64 - WEIGHTS[i]) * e0 + WEIGHTS[i] * e1 + 32) >> 6;
+        result.palette[i][c] = result.interpolated[i][c];
+      }
+    }
+
+    result.valid = true;
+    return result;
+  }
+
+  // Unsigned BC6H; the palette holds half bit patterns.
+  DecodedBlock _DecodeBc6hMode11(const uint8_t* block)
+  {
+    DecodedBlock result = {};
+    BitReader reader(block);
+
+    if (reader.read(5) != 0x03)
+    {
+      return result;
+    }
+
+    int32_t endpoints[2][3];
+    for (int e = 0; e < 2; e++)
+    {
+      for (int c = 0; c < 3; c++)
+      {
+        int32_t q = int32_t(reader.read(10));
+        endpoints[e][c] = (q == 0) ? 0 : (q == 1023) ? 0xFFFF : (((q << 16) + 0x8000) >> 10);
+      }
+    }
+    _ReadIndices(reader, result.indices);
+
+    if (reader.bitOffset() != 128)
+    {
+      return result;
+    }
+
+    for (uint32_t i = 0; i < 16; i++)
+    {
+      for (int c = 0; c < 3; c++)
+      {
+        result.interpolated[i][c] = ((64 - WEIGHTS[i]) * endpoints[0][c] + WEIGHTS[i] * endpoints[1][c] + 32) >> 6;
+        result.palette[i][c] = (result.interpolated[i][c] * 31) >> 6;
+      }
+    }
+
+    result.valid = true;
+    return result;
+  }
+
+  double _SquaredError(const int32_t interpolated[4], const int32_t texel[4], double texelScale, int channelCount)
+  {
+    double error = 0.0;
+    for (int c = 0; c < channelCount; c++)
+    {
+      double d = interpolated[c] - texel[c] * texelScale;
+      error += d * d;
+    }
+    return error;
+  }
+
+  struct BlockStats
+  {
+    double squaredError = 0.0;      // of the decoded texels
+    double meanSquaredError = 0.0;  // of the block mean, as a baseline
+    int32_t maxChannelError = 0;
+  };
+
+  // Texels are given in the decoded representation: 8-bit values or half bit patterns.
+  // The texel scale maps them to the space of the interpolated endpoints.
+  BlockStats _CheckBlock(const DecodedBlock& block, const int32_t texels[16][4], double texelScale, int channelCount, const char* name)
+  {
+    BlockStats stats;
+
+    CHECK(block.valid, "%s: block has the wrong mode or size", name);
+    if (!block.valid)
+    {
+      return stats;
+    }
+
+    double mean[4] = {};
+    for (uint32_t t = 0; t < 16; t++)
+    {
+      for (int c = 0; c < channelCount; c++)
+      {
+        mean[c] += texels[t][c] / 16.0;
+      }
+    }
+
+    for (uint32_t t = 0; t < 16; t++)
+    {
+      const int32_t* decoded = block.palette[block.indices[t]];
+
+      double bestError = INFINITY;
+      for (uint32_t i = 0; i < 16; i++)
+      {
+        bestError = std::min(bestError, _SquaredError(block.interpolated[i], texels[t], texelScale, channelCount));
+      }
+
+      // The encoder picks the nearest palette entry for every texel; for the anchor
+      // texel, this only holds if the index MSB that is not stored was zero.
+      double error = _SquaredError(block.interpolated[block.indices[t]], texels[t], texelScale, channelCount);
+      CHECK(error <= bestError * 1.0001 + 0.01,
+        "%s: texel %u does not use the nearest palette entry (index %u)", name, t, block.indices[t]);
+
+      for (int c = 0; c < channelCount; c++)
+      {
+        int32_t d = decoded[c] - texels[t][c];
+        stats.squaredError += double(d) * d;
+        stats.maxChannelError = std::max(stats.maxChannelError, abs(d));
+        stats.meanSquaredError += (mean[c] - texels[t][c]) * (mean[c] - texels[t][c]);
+      }
+    }
+
+    return stats;
+  }
+
+  // Constant blocks, ramps starting at either end (the descending ones require the
+  // endpoints to be swapped), two-colour blocks and noise.
+  void _MakeBlock(uint32_t kind, std::mt19937& rng, int32_t maxValue, int32_t texels[16][4])
+  {
+    std::uniform_int_distribution<int32_t> value(0, maxValue);
+
+    int32_t a[4], b[4];
+    for (int c = 0; c < 4; c++)
+    {
+      a[c] = value(rng);
+      b[c] = value(rng);
+    }
+
+    for (uint32_t t = 0; t < 16; t++)
+    {
+      for (int c = 0; c < 4; c++)
+      {
+        switch (kind)
+        {
+        case 0: texels[t][c] = a[c]; break;
+        case 1: texels[t][c] = a[c] + (b[c] - a[c]) * int32_t(t) / 15; break;
+        case 2: texels[t][c] = b[c] + (a[c] - b[c]) * int32_t(t) / 15; break;
+        case 3: texels[t][c] = ((t * 7) % 3 == 0) ? a[c] : b[c]; break;
+        default: texels[t][c] = value(rng); break;
+        }
+      }
+    }
+  }
+
+  void _TestBc7()
+  {
+    std::mt19937 rng(7);
+
+    for (uint32_t kind = 0; kind < 5; kind++)
+    {
+      double error[2] = {};
+
+      for (uint32_t n = 0; n < 200; n++)
+      {
+        int32_t texels[16][4];
+        _MakeBlock(kind, rng, 255, texels);
+
+        uint8_t image[16 * 4];
+        for (uint32_t t = 0; t < 16; t++)
+        {
+          for (int c = 0; c < 4; c++)
+          {
+            image[t * 4 + c] = uint8_t(texels[t][c]);
+          }
+        }
+
+        for (int highQuality = 0; highQuality < 2; highQuality++)
+        {
+          std::vector<uint8_t> blocks;
+          encodeBc7(image, 4, 4, highQuality, blocks);
+          CHECK(blocks.size() == 16, "BC7: block size %zu", blocks.size());
+
+          BlockStats stats = _CheckBlock(_DecodeBc7Mode6(blocks.data()), texels, 1.0, 4, "BC7");
+          error[highQuality] += stats.squaredError;
+
+          // The p-bit is shared by the channels of an endpoint, so a constant colour whose
+          // channels differ in parity is off by one. Ramps and two-colour blocks lie on a line,
+          // where the error is bounded by half the palette spacing plus rounding.
+          if (kind == 0)
+          {
+            CHECK(stats.maxChannelError <= 1, "BC7: constant block error %d", stats.maxChannelError);
+          }
+          else if (kind < 4)
+          {
+            CHECK(stats.maxChannelError <= 12, "BC7: kind %u block error %d", kind, stats.maxChannelError);
+          }
+          CHECK(stats.squaredError <= stats.meanSquaredError + 16.0 * 4.0,
+            "BC7: kind %u block error %.1f exceeds the error of its mean %.1f", kind, stats.squaredError, stats.meanSquaredError);
+        }
+      }
+
+      CHECK(error[1] <= error[0], "BC7: high quality error %.1f exceeds regular error %.1f", error[1], error[0]);
+    }
+  }
+
+  void _TestBc6h()
+  {
+    std::mt19937 rng(6);
+
+    for (uint32_t kind = 0; kind < 5; kind++)
+    {
+      double error[2] = {};
+
+      for (uint32_t n = 0; n < 200; n++)
+      {
+        int32_t texels[16][4];
+        _MakeBlock(kind, rng, 0x7BFF, texels);
+
+        uint16_t image[16 * 4];
+        for (uint32_t t = 0; t < 16; t++)
+        {
+          for (int c = 0; c < 4; c++)
+          {
+            image[t * 4 + c] = uint16_t(texels[t][c]);
+          }
+        }
+
+        for (int highQuality = 0; highQuality < 2; highQuality++)
+        {
+          std::vector<uint8_t> blocks;
+          encodeBc6h((const uint8_t*) image, 4, 4, highQuality, blocks);
+          CHECK(blocks.size() == 16, "BC6H: block size %zu", blocks.size());
+
+          BlockStats stats = _CheckBlock(_DecodeBc6hMode11(blocks.data()), texels, 64.0 / 31.0, 3, "BC6H");
+          error[highQuality] += stats.squaredError;
+
+          // Endpoints have 10 bits, so a constant value is off by at most half a quantization
+          // step, which is 32 units of the 16-bit unquantized range, or 16 half bit patterns.
+          if (kind == 0)
+          {
+            CHECK(stats.maxChannelError <= 16, "BC6H: constant block error %d", stats.maxChannelError);
+          }
+          CHECK(stats.squaredError <= stats.meanSquaredError + 16.0 * 3.0 * 16.0 * 16.0,
+            "BC6H: kind %u block error %.1f exceeds the error of its mean %.1f", kind, stats.squaredError, stats.meanSquaredError);
+        }
+      }
+
+      CHECK(error[1] <= error[0], "BC6H: high quality error %.1f exceeds regular error %.1f", error[1], error[0]);
+    }
+  }
+
+  void _TestBc6hClamping()
+  {
+    // Zero and negative values decode to zero, infinities and NaNs to a finite value.
+    const uint16_t values[] = { 0x0000, 0x8000, 0xBC00, 0x7C00, 0x7E00, 0xFC00 };
+
+    for (uint16_t value : values)
+    {
+      uint16_t image[16 * 4];
+      std::fill(image, image + 16 * 4, value);
+
+      std::vector<uint8_t> blocks;
+      encodeBc6h((const uint8_t*) image, 4, 4, false, blocks);
+
+      DecodedBlock block = _DecodeBc6hMode11(blocks.data());
+      CHECK(block.valid, "BC6H: invalid block for 0x%04X", value);
+
+      int32_t expected = ((value & 0x7FFF) == 0 || (value & 0x8000)) ? 0 : 0x7BFF;
+      for (uint32_t t = 0; block.valid && t < 16; t++)
+      {
+        for (int c = 0; c < 3; c++)
+        {
+          int32_t decoded = block.palette[block.indices[t]][c];
+          CHECK(decoded < 0x7C00 && abs(decoded - expected) <= 16, "BC6H: 0x%04X decoded to 0x%04X", value, decoded);
+        }
+      }
+    }
+  }
+
+  void _TestImageEdges()
+  {
+    // A 6x5 image needs 2x2 blocks; the texels beyond the edge repeat the last row and column.
+    // The colours lie on a line, so that a single endpoint pair fits every block.
+    const uint32_t width = 6;
+    const uint32_t height = 5;
+
+    std::vector<uint8_t> image(width * height * 4);
+    for (uint32_t y = 0; y < height; y++)
+    {
+      for (uint32_t x = 0; x < width; x++)
+      {
+        uint8_t* texel = &image[(y * width + x) * 4];
+        texel[0] = uint8_t(x * 30 + y * 10);
+        texel[1] = texel[0];
+        texel[2] = 128;
+        texel[3] = 255;
+      }
+    }
+
+    std::vector<uint8_t> blocks;
+    encodeBc7(image.data(), width, height, true, blocks);
+    CHECK(blocks.size() == getBcImageSize(width, height) && blocks.size() == 4 * 16, "BC7: image size %zu", blocks.size());
+
+    for (uint32_t y = 0; y < height; y++)
+    {
+      for (uint32_t x = 0; x < width; x++)
+      {
+        DecodedBlock block = _DecodeBc7Mode6(&blocks[((y / 4) * 2 + x / 4) * 16]);
+        const int32_t* decoded = block.palette[block.indices[(y % 4) * 4 + x % 4]];
+        const uint8_t* texel = &image[(y * width + x) * 4];
+
+        for (int c = 0; block.valid && c < 4; c++)
+        {
+          CHECK(abs(decoded[c] - texel[c]) <= 8, "BC7: texel (%u, %u) channel %d decoded to %d instead of %d", x, y, c, decoded[c], texel[c]);
+        }
+      }
+    }
+  }
+}
+
+int main(int argc, const char* argv[])
+{
+  _TestBc7();
+  _TestBc6h();
+  _TestBc6hClamping();
+  _TestImageEdges();
+
+  printf("%s\n", (s_failureCount == 0) ? "passed" : "FAILED");
+
+  return (s_failureCount == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,214 @@
+//
+// Copyright (C) 2019-2022 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+// Measures the cost of the guiding field learner and compares guided against unguided
+// direction sampling at equal time on a synthetic scene in which light arrives through
+// narrow cones, like an interior lit through a door. Unguided directions are sampled
+// uniformly, guided ones by one-sample MIS with the same selection probability as the
+// hit shader. The equal-time error ratio is given for a fixed cost per sample, for
+// instance the cost of tracing the ray, which can be passed in nanoseconds as the first
+// argument.
+
+#include "guiding.h"
+#include "GuidingSampling.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+
+namespace Rp = gtl::shader_interface::rp_main;
+
+using namespace gi::tests;
+
+namespace
+{
+  const float GUIDING_SELECTION_PROB = 0.5f;
+  const float UNIFORM_PDF = 1.0f / (4.0f * GUIDING_PI);
+
+  // Cones cover 0.5% of the sphere and receive nearly all of the radiance.
+  const float LIGHT_COS_THETA = 0.99f;
+
+  glm::vec3 _LightDirection(glm::vec3 position)
+  {
+    return (position.x < 0.0f) ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::normalize(glm::vec3(-1.0f, 0.5f, 0.0f));
+  }
+
+  float _Radiance(glm::vec3 position, glm::vec3 direction)
+  {
+    return (glm::dot(direction, _LightDirection(position)) > LIGHT_COS_THETA) ? 100.0f : 0.01f;
+  }
+
+  double _SecondsSince(std::chrono::steady_clock::time_point start)
+  {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  struct Sampler
+  {
+    const std::vector<Rp::GuidingSpatialNode>& spatialNodes;
+    const std::vector<Rp::GuidingDirectionalNode>& directionalNodes;
+    bool isGuided;
+
+    // Samples a direction and returns its pdf, matching the mixture of the hit shader.
+    glm::vec3 sample(glm::vec3 position, glm::vec3 xi, float& pdf) const
+    {
+      uint32_t tree = isGuided ? guidingFindTree(spatialNodes, directionalNodes, position) : UINT32_MAX;
+      if (tree == UINT32_MAX)
+      {
+        pdf = UNIFORM_PDF;
+        return guidingSquareToDir(glm::vec2(xi.y, xi.z));
+      }
+
+      glm::vec3 dir;
+      float guidingPdfValue;
+      if (xi.x < GUIDING_SELECTION_PROB)
+      {
+        dir = guidingSample(directionalNodes, tree, glm::vec2(xi.y, xi.z), guidingPdfValue);
+      }
+      else
+      {
+        dir = guidingSquareToDir(glm::vec2(xi.y, xi.z));
+        guidingPdfValue = guidingPdf(directionalNodes, tree, dir);
+      }
+
+      pdf = GUIDING_SELECTION_PROB * guidingPdfValue + (1.0f - GUIDING_SELECTION_PROB) * UNIFORM_PDF;
+      return dir;
+    }
+  };
+
+  struct EstimatorStats
+  {
+    double relVariance; // averaged over positions
+    double secondsPerSample;
+  };
+
+  EstimatorStats _MeasureEstimator(const Sampler& sampler, const std::vector<glm::vec3>& positions, uint32_t sampleCount)
+  {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+    double relVarianceSum = 0.0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (glm::vec3 position : positions)
+    {
+      double sum = 0.0;
+      double sumSq = 0.0;
+
+      for (uint32_t i = 0; i < sampleCount; i++)
+      {
+        float pdf;
+        glm::vec3 dir = sampler.sample(position, glm::vec3(uniform(rng), uniform(rng), uniform(rng)), pdf);
+
+        double value = _Radiance(position, dir) / pdf;
+        sum += value;
+        sumSq += value * value;
+      }
+
+      double mean = sum / sampleCount;
+      double variance = std::max(sumSq / sampleCount - mean * mean, 0.0);
+      relVarianceSum += variance / (mean * mean);
+    }
+
+    double seconds = _SecondsSince(start);
+
+    return EstimatorStats{
+      .relVariance = relVarianceSum / positions.size(),
+      .secondsPerSample = seconds / (double(positions.size()) * sampleCount)
+    };
+  }
+}
+
+int main(int argc, const char* argv[])
+{
+  double sampleCostNs = (argc > 1) ? atof(argv[1]) : 0.0;
+
+  gi::GuidingField field(gi::GuidingField::InitParams{
+    .directionalSplitFraction = 0.01f,
+    .maxDirectionalDepth = 20,
+    .spatialSplitThreshold = 4000.0f
+  });
+
+  std::mt19937 rng(2);
+  std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+  std::vector<glm::vec3> positions(256);
+  for (glm::vec3& position : positions)
+  {
+    position = glm::vec3(uniform(rng), uniform(rng), uniform(rng)) * 2.0f - 1.0f;
+  }
+
+  const uint32_t recordsPerPass = 1u << 16;
+  const uint32_t sampleCount = 1024;
+
+  std::vector<Rp::GuidingSpatialNode> spatialNodes;
+  std::vector<Rp::GuidingDirectionalNode> directionalNodes;
+  field.exportNodes(spatialNodes, directionalNodes);
+
+  Sampler unguidedSampler{ spatialNodes, directionalNodes, false };
+  Sampler guidedSampler{ spatialNodes, directionalNodes, true };
+
+  EstimatorStats unguidedStats = _MeasureEstimator(unguidedSampler, positions, sampleCount);
+
+  printf("%9s %8s %12s %12s %10s %12s %12s %12s %12s %14s\n", "iteration", "passes", "record ns", "refine ms", "nodes",
+    "guided relvar", "unguided relvar", "guided ns", "unguided ns", "guided speedup");
+
+  // Iterations double in length and record the directions of the current sampler, as in the renderer.
+  for (uint32_t iteration = 0, passCount = 1; iteration < 8; iteration++, passCount *= 2)
+  {
+    std::vector<Rp::GuidingRecord> records(recordsPerPass);
+    double recordSeconds = 0.0;
+
+    for (uint32_t pass = 0; pass < passCount; pass++)
+    {
+      for (Rp::GuidingRecord& record : records)
+      {
+        record.position = glm::vec3(uniform(rng), uniform(rng), uniform(rng)) * 2.0f - 1.0f;
+        record.direction = guidedSampler.sample(record.position, glm::vec3(uniform(rng), uniform(rng), uniform(rng)), record.pdf);
+        record.radiance = _Radiance(record.position, record.direction);
+      }
+
+      auto start = std::chrono::steady_clock::now();
+      field.addRecords(records.data(), records.size());
+      recordSeconds += _SecondsSince(start);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    field.refine(passCount);
+    double refineSeconds = _SecondsSince(start);
+
+    field.exportNodes(spatialNodes, directionalNodes);
+
+    EstimatorStats guidedStats = _MeasureEstimator(guidedSampler, positions, sampleCount);
+
+    // Efficiency is the inverse of variance times cost; its ratio is the factor by which
+    // the error variance of guiding is lower at equal time.
+    double guidedNs = guidedStats.secondsPerSample * 1e9;
+    double unguidedNs = unguidedStats.secondsPerSample * 1e9;
+    double guidedEfficiency = 1.0 / (guidedStats.relVariance * (guidedNs + sampleCostNs));
+    double unguidedEfficiency = 1.0 / (unguidedStats.relVariance * (unguidedNs + sampleCostNs));
+
+    printf("%9u %8u %12.1f %12.2f %10zu %12.3g %12.3g %12.1f %12.1f %13.2fx\n", iteration, passCount,
+      recordSeconds * 1e9 / (double(recordsPerPass) * passCount), refineSeconds * 1e3, spatialNodes.size() + directionalNodes.size(),
+      guidedStats.relVariance, unguidedStats.relVariance, guidedNs, unguidedNs, guidedEfficiency / unguidedEfficiency);
+  }
+
+  return EXIT_SUCCESS;
+}
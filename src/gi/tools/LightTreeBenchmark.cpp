@@ -0,0 +1,224 @@
+//
+// Copyright (C) 2019-2022 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+// Measures light tree build times and compares light tree sampling against flat power
+// sampling of the emissive faces. Visibility and the receiver's BSDF are ignored, so the
+// comparison isolates light selection. The equal-time error ratio is given for a fixed
+// cost per sample, for instance the cost of tracing a shadow ray, which can be passed in
+// nanoseconds as the first argument.
+
+#include "lightsampling.h"
+#include "LightTreeSampling.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+
+namespace Rp = gtl::shader_interface::rp_main;
+
+using namespace gi::tests;
+
+namespace
+{
+  const float PI = 3.14159265358979323846f;
+
+  // Small one-sided emitters on facades of a city block, like lit windows.
+  void _MakeFaces(uint32_t faceCount, std::vector<Rp::EmissiveFace>& faces, std::vector<float>& powers)
+  {
+    std::mt19937 rng(faceCount);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    std::lognormal_distribution<float> lognormal(0.0f, 1.5f);
+
+    const glm::vec3 normals[] = {
+      glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+      glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+    };
+
+    faces.resize(faceCount);
+    powers.resize(faceCount);
+
+    for (uint32_t i = 0; i < faceCount; i++)
+    {
+      glm::vec3 n = normals[i % 4];
+      glm::vec3 t = glm::cross(n, glm::vec3(0.0f, 1.0f, 0.0f));
+      glm::vec3 b = glm::cross(n, t);
+      glm::vec3 p(uniform(rng) * 1000.0f, uniform(rng) * 100.0f, uniform(rng) * 1000.0f);
+
+      Rp::EmissiveFace& face = faces[i];
+      face = {};
+      face.p0 = p;
+      face.p1 = p + t;
+      face.p2 = p + b;
+
+      powers[i] = lognormal(rng);
+    }
+  }
+
+  double _SecondsSince(std::chrono::steady_clock::time_point start)
+  {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  // Contribution of a uniformly sampled point on the face to the unoccluded irradiance
+  // at the origin, divided by the selection pdf. Faces are Lambertian emitters.
+  float _Estimate(const Rp::EmissiveFace& face, float power, float selectionPdf, glm::vec3 origin, float u, float v)
+  {
+    if (selectionPdf <= 0.0f)
+    {
+      return 0.0f;
+    }
+
+    glm::vec3 n = glm::cross(face.p1 - face.p0, face.p2 - face.p0);
+    float area = 0.5f * glm::length(n);
+    n = glm::normalize(n);
+
+    float su = sqrtf(u);
+    glm::vec3 p = (1.0f - su) * face.p0 + su * (1.0f - v) * face.p1 + su * v * face.p2;
+
+    glm::vec3 toOrigin = origin - p;
+    float distSq = glm::dot(toOrigin, toOrigin);
+    float cosLight = glm::dot(n, toOrigin) / sqrtf(distSq);
+    if (cosLight <= 0.0f)
+    {
+      return 0.0f;
+    }
+
+    float radiance = power / (PI * area);
+    return radiance * cosLight / distSq * area / selectionPdf;
+  }
+
+  struct EstimatorStats
+  {
+    double relVariance; // averaged over shading points
+    double secondsPerSample;
+  };
+
+  template<typename SelectFunc>
+  EstimatorStats _MeasureEstimator(const std::vector<Rp::EmissiveFace>& faces, const std::vector<float>& powers,
+                                   const std::vector<glm::vec3>& origins, uint32_t sampleCount, SelectFunc select)
+  {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+    double relVarianceSum = 0.0;
+    uint32_t originCount = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (glm::vec3 origin : origins)
+    {
+      double sum = 0.0;
+      double sumSq = 0.0;
+
+      for (uint32_t i = 0; i < sampleCount; i++)
+      {
+        float selectionPdf;
+        uint32_t faceIndex = select(uniform(rng), uniform(rng), origin, selectionPdf);
+
+        float value = 0.0f;
+        if (faceIndex != UINT32_MAX)
+        {
+          value = _Estimate(faces[faceIndex], powers[faceIndex], selectionPdf, origin, uniform(rng), uniform(rng));
+        }
+
+        sum += value;
+        sumSq += double(value) * value;
+      }
+
+      double mean = sum / sampleCount;
+      if (mean > 0.0)
+      {
+        double variance = sumSq / sampleCount - mean * mean;
+        relVarianceSum += std::max(variance, 0.0) / (mean * mean);
+        originCount++;
+      }
+    }
+
+    double seconds = _SecondsSince(start);
+
+    return EstimatorStats{
+      .relVariance = relVarianceSum / std::max(originCount, 1u),
+      .secondsPerSample = seconds / (double(origins.size()) * sampleCount)
+    };
+  }
+}
+
+int main(int argc, const char* argv[])
+{
+  double sampleCostNs = (argc > 1) ? atof(argv[1]) : 0.0;
+
+  printf("%10s %12s %12s %12s %12s %12s %12s %12s\n", "faces", "tree build", "alias build", "tree relvar", "flat relvar",
+    "tree ns", "flat ns", "tree speedup");
+
+  for (uint32_t faceCount : { 1000u, 10000u, 100000u, 1000000u })
+  {
+    std::vector<Rp::EmissiveFace> faces;
+    std::vector<float> powers;
+    _MakeFaces(faceCount, faces, powers);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Rp::LightTreeNode> nodes;
+    gi::buildLightTree(powers, faces, nodes);
+    double treeBuildSeconds = _SecondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    std::vector<Rp::AliasEntry> aliasTable;
+    gi::buildAliasTable(powers, aliasTable);
+    double aliasBuildSeconds = _SecondsSince(start);
+
+    std::mt19937 rng(2);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    std::vector<glm::vec3> origins(256);
+    for (glm::vec3& origin : origins)
+    {
+      origin = glm::vec3(uniform(rng) * 1000.0f, uniform(rng) * 100.0f, uniform(rng) * 1000.0f);
+    }
+
+    const uint32_t sampleCount = 1024;
+
+    EstimatorStats treeStats = _MeasureEstimator(faces, powers, origins, sampleCount,
+      [&](float xi0, float xi1, glm::vec3 origin, float& selectionPdf) {
+        return lightTreeSelect(nodes, xi0, origin, selectionPdf);
+      });
+
+    // Matches the alias table path of emissive_face_select().
+    EstimatorStats flatStats = _MeasureEstimator(faces, powers, origins, sampleCount,
+      [&](float xi0, float xi1, glm::vec3 origin, float& selectionPdf) {
+        uint32_t faceIndex = std::min(uint32_t(xi0 * float(faceCount)), faceCount - 1u);
+        if (xi1 >= aliasTable[faceIndex].prob)
+        {
+          faceIndex = aliasTable[faceIndex].alias;
+        }
+        selectionPdf = aliasTable[faceIndex].pdf / float(faceCount);
+        return faceIndex;
+      });
+
+    // Efficiency is the inverse of variance times cost; its ratio is the factor by which
+    // the error variance of the tree is lower at equal time.
+    double treeNs = treeStats.secondsPerSample * 1e9;
+    double flatNs = flatStats.secondsPerSample * 1e9;
+    double treeEfficiency = 1.0 / (treeStats.relVariance * (treeNs + sampleCostNs));
+    double flatEfficiency = 1.0 / (flatStats.relVariance * (flatNs + sampleCostNs));
+
+    printf("%10u %11.3fs %11.3fs %12.3g %12.3g %12.1f %12.1f %11.2fx\n", faceCount, treeBuildSeconds, aliasBuildSeconds,
+      treeStats.relVariance, flatStats.relVariance, treeNs, flatNs, treeEfficiency / flatEfficiency);
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,215 @@
+//
+// Copyright (C) 2023 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+// Precompiles common permutations of the built-in ray generation and miss shaders
+// to SPIR-V and emits them as a C++ source file which is compiled into gi.
+
+#include "gi.h"
+
+#include "sg/BuiltinShaderGen.h"
+#include "sg/GlslangShaderCompiler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+#include <unordered_set>
+
+using namespace gi::sg;
+
+namespace
+{
+  struct BundleEntry
+  {
+    uint64_t sourceHash;
+    std::vector<uint8_t> spv;
+  };
+
+  bool _AddShader(GlslangShaderCompiler& compiler,
+                  GlslangShaderCompiler::ShaderStage stage,
+                  const std::string& source,
+                  std::unordered_set<uint64_t>& hashes,
+                  std::vector<BundleEntry>& entries)
+  {
+    uint64_t hash = hashShaderSource(source);
+    if (hashes.count(hash) > 0)
+    {
+      return true;
+    }
+
+    BundleEntry entry;
+    entry.sourceHash = hash;
+    if (!compiler.compileGlslToSpv(stage, source, entry.spv))
+    {
+      return false;
+    }
+
+    hashes.insert(hash);
+    entries.push_back(std::move(entry));
+    return true;
+  }
+
+  bool _WriteBundleSource(const char* filePath, const std::vector<BundleEntry>& entries)
+  {
+    std::ofstream file(filePath, std::ios_base::out | std::ios_base::trunc);
+    if (!file.is_open())
+    {
+      return false;
+    }
+
+    file << "// Generated by gi-shader-bundler. Do not edit.\n\n";
+    file << "#include \"sg/ShaderBundle.h\"\n\n";
+    file << "namespace gi::sg\n{\n";
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+      const std::vector<uint8_t>& spv = entries[i].spv;
+
+      file << "  alignas(4) static const uint8_t SPV_" << i << "[] = {";
+      for (size_t j = 0; j < spv.size(); j++)
+      {
+        file << ((j % 32) == 0 ? "\n    " : "") << (uint32_t) spv[j] << ",";
+      }
+      file << "\n  };\n\n";
+    }
+
+    file << "  extern const BundledShader BUNDLED_SHADERS[] = {\n";
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+      file << "    { " << entries[i].sourceHash << "ull, SPV_" << i << ", sizeof(SPV_" << i << ") },\n";
+    }
+    file << "  };\n\n";
+    file << "  extern const size_t BUNDLED_SHADER_COUNT = " << entries.size() << ";\n";
+    file << "}\n";
+
+    return file.good();
+  }
+}
+
+int main(int argc, const char* argv[])
+{
+  if (argc != 3)
+  {
+    fprintf(stderr, "usage: %s <shader dir> <output file>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  fs::path shaderPath(argv[1]);
+  const char* outputFilePath = argv[2];
+
+  if (!GlslangShaderCompiler::init())
+  {
+    return EXIT_FAILURE;
+  }
+
+  std::vector<BundleEntry> entries;
+  std::unordered_set<uint64_t> hashes;
+  bool success = true;
+
+  {
+    GlslangShaderCompiler compiler(shaderPath);
+
+    // Only the actual texture counts differ between scenes; they are patched at load time.
+    const uint32_t texCounts[] = { 0, 1 };
+
+    // Ray generation shader: color AOV with the default render settings and common toggles.
+    // Permutations with invocation reordering, adaptive sampling, ReSTIR, Sobol samplers, path
+    // guiding or clock cycle AOVs are compiled on demand.
+    for (bool domeLightEnabled : { false, true })
+    for (bool filterImportanceSampling : { true, false })
+    for (bool nextEventEstimation : { false, true })
+    for (bool progressiveAccumulation : { true, false })
+    for (bool sphereLightsEnabled : { false, true })
+    for (uint32_t texCount2d : texCounts)
+    for (uint32_t texCount3d : texCounts)
+    {
+      if (domeLightEnabled && texCount2d == 0)
+      {
+        continue;
+      }
+
+      RaygenShaderParams params;
+      params.adaptiveSampling = false;
+      params.aovId = GI_AOV_ID_COLOR;
+      params.blueNoiseDither = false;
+      params.domeLightEnabled = domeLightEnabled;
+      params.filterImportanceSampling = filterImportanceSampling;
+      params.materialCount = 0;
+      params.nextEventEstimation = nextEventEstimation;
+      params.pathGuiding = false;
+      params.progressiveAccumulation = progressiveAccumulation;
+      params.reorderInvocations = false;
+      params.restir = false;
+      params.restirSpatialNeighbors = 0;
+      params.shaderClockExts = false;
+      params.sobolSampler = false;
+      params.sphereLightsEnabled = sphereLightsEnabled;
+      params.texCount2d = texCount2d;
+      params.texCount3d = texCount3d;
+      params.virtualTexturing = false;
+
+      std::string source;
+      success &= generateRgenGlsl(shaderPath, "rt_main.rgen", params, true, source) &&
+                 _AddShader(compiler, GlslangShaderCompiler::ShaderStage::RayGen, source, hashes, entries);
+    }
+
+    // Miss shaders
+    for (const char* fileName : { "rt_main.miss", "rt_shadow.miss" })
+    for (bool domeLightEnabled : { false, true })
+    for (bool domeLightCameraVisibility : { true, false })
+    for (bool nextEventEstimation : { false, true })
+    for (bool sphereLightsEnabled : { false, true })
+    for (uint32_t texCount2d : texCounts)
+    for (uint32_t texCount3d : texCounts)
+    {
+      if (domeLightEnabled && texCount2d == 0)
+      {
+        continue;
+      }
+
+      MissShaderParams params;
+      params.domeLightEnabled = domeLightEnabled;
+      params.domeLightCameraVisibility = domeLightCameraVisibility;
+      params.nextEventEstimation = nextEventEstimation;
+      params.sphereLightsEnabled = sphereLightsEnabled;
+      params.texCount2d = texCount2d;
+      params.texCount3d = texCount3d;
+      params.virtualTexturing = false;
+
+      std::string source;
+      success &= generateMissGlsl(shaderPath, fileName, params, true, source) &&
+                 _AddShader(compiler, GlslangShaderCompiler::ShaderStage::Miss, source, hashes, entries);
+    }
+  }
+
+  GlslangShaderCompiler::deinit();
+
+  if (!success)
+  {
+    fprintf(stderr, "failed to compile shader bundle\n");
+    return EXIT_FAILURE;
+  }
+
+  if (!_WriteBundleSource(outputFilePath, entries))
+  {
+    fprintf(stderr, "failed to write shader bundle to %s\n", outputFilePath);
+    return EXIT_FAILURE;
+  }
+
+  printf("bundled %zu shaders\n", entries.size());
+  return EXIT_SUCCESS;
+}
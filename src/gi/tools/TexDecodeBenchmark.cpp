@@ -0,0 +1,286 @@
+//
+// Copyright (C) 2023 Pablo Delgado Krämer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+// Measures texture decode throughput on a directory of PNG, JPEG and EXR images,
+// once serially and once with the batched OpenMP task scheme TexSys uses.
+// The --exr mode only decodes EXR images and reports the time of each decode
+// together with the peak resident set size of the process.
+
+#include <imgio.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace
+{
+  const size_t DECODE_BATCH_SIZE = 16;
+
+  struct EncodedImage
+  {
+    std::string path;
+    std::vector<uint8_t> data;
+  };
+
+  const double BYTES_TO_MIB = 1.0 / (1024.0 * 1024.0);
+
+  bool _IsSupportedExtension(const fs::path& path, bool exrOnly)
+  {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".exr" || (!exrOnly && (ext == ".png" || ext == ".jpg" || ext == ".jpeg"));
+  }
+
+  // Returns 0 if the platform doesn't provide it.
+  uint64_t _GetPeakRssByteSize()
+  {
+#ifdef _WIN32
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+      return 0;
+    }
+#ifdef __APPLE__
+    return uint64_t(usage.ru_maxrss); // bytes
+#else
+    return uint64_t(usage.ru_maxrss) * 1024; // kilobytes
+#endif
+#endif
+  }
+
+  bool _DecodeImage(const EncodedImage& encodedImage, size_t& byteSize, uint32_t* width = nullptr, uint32_t* height = nullptr)
+  {
+    imgio_img img;
+    if (imgio_load_img(encodedImage.data.data(), encodedImage.data.size(), &img) != IMGIO_OK)
+    {
+      fprintf(stderr, "failed to decode %s\n", encodedImage.path.c_str());
+      return false;
+    }
+    byteSize = img.size;
+    if (width && height)
+    {
+      *width = img.width;
+      *height = img.height;
+    }
+    imgio_free_img(&img);
+    return true;
+  }
+
+  double _DecodeSerial(const std::vector<EncodedImage>& images, size_t& byteSize)
+  {
+    auto start = std::chrono::steady_clock::now();
+
+    byteSize = 0;
+    for (const EncodedImage& image : images)
+    {
+      size_t size = 0;
+      _DecodeImage(image, size);
+      byteSize += size;
+    }
+
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  double _DecodeParallel(const std::vector<EncodedImage>& images, size_t& byteSize)
+  {
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<size_t> sizes(images.size(), 0);
+    size_t batchCount = (images.size() + DECODE_BATCH_SIZE - 1) / DECODE_BATCH_SIZE;
+
+#pragma omp parallel
+#pragma omp single
+    for (size_t b = 0; b < batchCount; b++)
+    {
+      size_t batchEnd = std::min((b + 1) * DECODE_BATCH_SIZE, images.size());
+
+      for (size_t i = b * DECODE_BATCH_SIZE; i < batchEnd; i++)
+      {
+#pragma omp task
+        _DecodeImage(images[i], sizes[i]);
+      }
+
+#pragma omp taskwait
+    }
+
+    byteSize = 0;
+    for (size_t size : sizes)
+    {
+      byteSize += size;
+    }
+
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  void _PrintResult(const char* name, double seconds, size_t imageCount, size_t encodedSize, size_t decodedSize)
+  {
+    printf("%-10s %8.3fs %8.1f img/s %8.1f MiB/s encoded %8.1f MiB/s decoded\n", name, seconds,
+      imageCount / seconds, encodedSize * BYTES_TO_MIB / seconds, decodedSize * BYTES_TO_MIB / seconds);
+  }
+
+  void _PrintPeakRss(const char* name, uint64_t peakRss, uint64_t baselineRss)
+  {
+    printf("%-10s peak RSS %8.1f MiB (+%.1f MiB)\n", name, peakRss * BYTES_TO_MIB, (peakRss - baselineRss) * BYTES_TO_MIB);
+  }
+
+  // Peak RSS never decreases, so the serial decodes are measured before the parallel ones,
+  // and each row shows the peak reached up to and including that decode.
+  void _BenchmarkExr(const std::vector<EncodedImage>& images, int iterations)
+  {
+    uint64_t baselineRss = _GetPeakRssByteSize();
+    if (baselineRss == 0)
+    {
+      printf("peak RSS is not available on this platform\n");
+    }
+
+    double serialTime = 0.0;
+    size_t decodedSize = 0;
+
+    for (const EncodedImage& image : images)
+    {
+      double seconds = 0.0;
+      size_t byteSize = 0;
+      uint32_t width = 0;
+      uint32_t height = 0;
+
+      for (int i = 0; i < iterations; i++)
+      {
+        auto start = std::chrono::steady_clock::now();
+        _DecodeImage(image, byteSize, &width, &height);
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      }
+
+      seconds /= iterations;
+      serialTime += seconds;
+      decodedSize += byteSize;
+
+      printf("%8.3fs %5ux%-5u %8.1f MiB decoded %8.1f MiB peak RSS  %s\n", seconds, width, height,
+        byteSize * BYTES_TO_MIB, _GetPeakRssByteSize() * BYTES_TO_MIB, image.path.c_str());
+    }
+
+    uint64_t serialRss = _GetPeakRssByteSize();
+
+    double parallelTime = 0.0;
+    for (int i = 0; i < iterations; i++)
+    {
+      parallelTime += _DecodeParallel(images, decodedSize);
+    }
+    parallelTime /= iterations;
+
+    uint64_t parallelRss = _GetPeakRssByteSize();
+
+    size_t encodedSize = 0;
+    for (const EncodedImage& image : images)
+    {
+      encodedSize += image.data.size();
+    }
+
+    _PrintResult("serial", serialTime, images.size(), encodedSize, decodedSize);
+    _PrintResult("parallel", parallelTime, images.size(), encodedSize, decodedSize);
+    _PrintPeakRss("baseline", baselineRss, baselineRss);
+    _PrintPeakRss("serial", serialRss, baselineRss);
+    _PrintPeakRss("parallel", parallelRss, baselineRss);
+  }
+}
+
+int main(int argc, const char* argv[])
+{
+  bool exrOnly = argc > 1 && strcmp(argv[1], "--exr") == 0;
+  int argOffset = exrOnly ? 1 : 0;
+
+  if (argc < 2 + argOffset)
+  {
+    fprintf(stderr, "usage: %s [--exr] <texture-dir> [iterations]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const char* textureDir = argv[1 + argOffset];
+  int iterations = (argc > 2 + argOffset) ? std::max(atoi(argv[2 + argOffset]), 1) : 1;
+
+  std::vector<EncodedImage> images;
+  size_t encodedSize = 0;
+
+  std::error_code errorCode;
+  for (const auto& entry : fs::recursive_directory_iterator(textureDir, errorCode))
+  {
+    if (!entry.is_regular_file() || !_IsSupportedExtension(entry.path(), exrOnly))
+    {
+      continue;
+    }
+
+    std::ifstream file(entry.path(), std::ios::binary);
+    EncodedImage image;
+    image.path = entry.path().string();
+    image.data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    encodedSize += image.data.size();
+    images.push_back(std::move(image));
+  }
+
+  if (errorCode || images.empty())
+  {
+    fprintf(stderr, "no %s images found in %s\n", exrOnly ? "EXR" : "PNG, JPEG or EXR", textureDir);
+    return EXIT_FAILURE;
+  }
+
+#ifdef _OPENMP
+  int threadCount = omp_get_max_threads();
+#else
+  int threadCount = 1;
+#endif
+  printf("%zu images, %.1f MiB encoded, %d threads\n", images.size(), encodedSize * BYTES_TO_MIB, threadCount);
+
+  if (exrOnly)
+  {
+    _BenchmarkExr(images, iterations);
+    return EXIT_SUCCESS;
+  }
+
+  double serialTime = 0.0;
+  double parallelTime = 0.0;
+  size_t decodedSize = 0;
+
+  for (int i = 0; i < iterations; i++)
+  {
+    serialTime += _DecodeSerial(images, decodedSize);
+    parallelTime += _DecodeParallel(images, decodedSize);
+  }
+
+  _PrintResult("serial", serialTime / iterations, images.size(), encodedSize, decodedSize);
+  _PrintResult("parallel", parallelTime / iterations, images.size(), encodedSize, decodedSize);
+  printf("speedup    %8.2fx\n", serialTime / parallelTime);
+
+  return EXIT_SUCCESS;
+}
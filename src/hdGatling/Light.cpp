@@ -29,6 +29,9 @@
 
 #include <gi.h>
 
+#include <algorithm>
+#include <cmath>
+
 PXR_NAMESPACE_OPEN_SCOPE
 
 //
@@ -54,7 +57,38 @@ void HdGatlingSphereLight::Sync(HdSceneDelegate* sceneDelegate,
     giSetSphereLightPosition(m_giSphereLight, pos.data());
   }
 
-  // FIXME: intensity, radius (with treatAsPoint)
+  if (*dirtyBits & DirtyBits::DirtyParams)
+  {
+    float intensity = sceneDelegate->GetLightParamValue(id, HdLightTokens->intensity).GetWithDefault<float>(1.0f);
+    float exposure = sceneDelegate->GetLightParamValue(id, HdLightTokens->exposure).GetWithDefault<float>(0.0f);
+    GfVec3f color = sceneDelegate->GetLightParamValue(id, HdLightTokens->color).GetWithDefault<GfVec3f>(GfVec3f(1.0f));
+    bool normalize = sceneDelegate->GetLightParamValue(id, HdLightTokens->normalize).GetWithDefault<bool>(false);
+    float radius = sceneDelegate->GetLightParamValue(id, HdLightTokens->radius).GetWithDefault<float>(0.5f);
+    bool treatAsPoint = sceneDelegate->GetLightParamValue(id, HdLightTokens->treatAsPoint).GetWithDefault<bool>(false);
+
+    radius = std::max(radius, 0.0f);
+
+    GfVec3f radiance = color * intensity * powf(2.0f, exposure);
+
+    // Normalization makes the emitted power independent of the surface area.
+    float surfaceArea = 4.0f * float(M_PI) * radius * radius;
+    if (normalize && surfaceArea > 0.0f)
+    {
+      radiance /= surfaceArea;
+    }
+
+    // Point lights keep the intensity of the sphere as seen from afar.
+    if (treatAsPoint)
+    {
+      radiance *= float(M_PI) * radius * radius;
+      radius = 0.0f;
+    }
+
+    giSetSphereLightRadius(m_giSphereLight, radius);
+    giSetSphereLightRadiance(m_giSphereLight, radiance.data());
+  }
+
+  *dirtyBits = DirtyBits::Clean;
 }
 
 void HdGatlingSphereLight::Finalize(HdRenderParam* renderParam)
@@ -45,9 +45,18 @@ HdGatlingRenderDelegate::HdGatlingRenderDelegate(const HdRenderSettingsMap& sett
   m_settingDescriptors.push_back(HdRenderSettingDescriptor{ "Russian roulette inverse minimum terminate probability", HdGatlingSettingsTokens->rr_inv_min_term_prob, VtValue{0.95f} });
   m_settingDescriptors.push_back(HdRenderSettingDescriptor{ "Max sample value", HdGatlingSettingsTokens->max_sample_value, VtValue{10.0f} });
   m_settingDescriptors.push_back(HdRenderSettingDescriptor{ "Filter Importance Sampling", HdGatlingSettingsTokens->filter_importance_sampling, VtValue{true} });
+  m_settingDescriptors.push_back(HdRenderSettingDescriptor{ "Sampler (independent, sobol, sobol-blue-noise)", HdGatlingSettingsTokens->sampler, VtValue{HdGatlingSamplerTokens->independent} });
+  m_settingDescriptors.push_back(HdRenderSettingDescriptor{ "Adaptive sampling", HdGatlingSettingsTokens->adaptive_sampling, VtValue{false} });
+  m_settingDescriptors.push_back(HdRenderSettingDescriptor{ "Adaptive sampling error threshold", HdGatlingSettingsTokens->adaptive_sampling_error, VtValue{0.01f} });
+  m_settingDescriptors.push_back(HdRenderSettingDescriptor{ "Adaptive sampling max samples per pixel", HdGatlingSettingsTokens->adaptive_sampling_max_spp, VtValue{1024} });
+  m_settingDescriptors.push_back(HdRenderSettingDescriptor{ "Next event estimation", HdGatlingSettingsTokens->next_event_estimation, VtValue{false} });
+  m_settingDescriptors.push_back(HdRenderSettingDescriptor{ "Light tree", HdGatlingSettingsTokens->light_tree, VtValue{true} });
+  m_settingDescriptors.push_back(HdRenderSettingDescriptor{ "ReSTIR direct lighting", HdGatlingSettingsTokens->restir, VtValue{false} });
+  m_settingDescriptors.push_back(HdRenderSettingDescriptor{ "ReSTIR spatial neighbors", HdGatlingSettingsTokens->restir_spatial_neighbors, VtValue{4} });
+  m_settingDescriptors.push_back(HdRenderSettingDescriptor{ "Path guiding", HdGatlingSettingsTokens->path_guiding, VtValue{false} });
 
   m_debugSettingDescriptors.push_back(HdRenderSettingDescriptor{ "Progressive accumulation", HdGatlingSettingsTokens->progressive_accumulation, VtValue{true} });
-  m_debugSettingDescriptors.push_back(HdRenderSettingDescriptor{ "Next event estimation", HdGatlingSettingsTokens->next_event_estimation, VtValue{false} });
+  m_debugSettingDescriptors.push_back(HdRenderSettingDescriptor{ "Batch MDL code generation", HdGatlingSettingsTokens->batch_mdl_codegen, VtValue{true} });
 
 #ifndef NDEBUG
   m_settingDescriptors.insert(m_settingDescriptors.end(), m_debugSettingDescriptors.begin(), m_debugSettingDescriptors.end());
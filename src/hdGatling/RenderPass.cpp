@@ -36,6 +36,26 @@ PXR_NAMESPACE_OPEN_SCOPE
 
 namespace
 {
+  // Settings that are baked into the shader cache. All other settings are runtime
+  // parameters which are passed to giRender and don't require shader recompilation.
+  const TfTokenVector& _GetShaderCacheSettingTokens()
+  {
+    static const TfTokenVector tokens = {
+      HdGatlingSettingsTokens->adaptive_sampling,
+      HdGatlingSettingsTokens->batch_mdl_codegen,
+      HdGatlingSettingsTokens->filter_importance_sampling,
+      HdGatlingSettingsTokens->light_tree,
+      HdGatlingSettingsTokens->next_event_estimation,
+      HdGatlingSettingsTokens->path_guiding,
+      HdGatlingSettingsTokens->progressive_accumulation,
+      HdGatlingSettingsTokens->restir,
+      HdGatlingSettingsTokens->restir_spatial_neighbors,
+      HdGatlingSettingsTokens->sampler,
+      HdRenderSettingsTokens->domeLightCameraVisibility
+    };
+    return tokens;
+  }
+
   std::string _MakeMaterialXColorMaterialSrc(const GfVec3f& color, const char* name)
   {
     // Prefer UsdPreviewSurface over MDL diffuse or unlit because we want to give a good first
@@ -260,6 +280,7 @@ HdGatlingRenderPass::HdGatlingRenderPass(HdRenderIndex* index,
   , m_lastRenderSettingsVersion(UINT32_MAX)
   , m_lastVisChangeCount(UINT32_MAX)
   , m_lastBackgroundColor(GfVec4f(0.0f, 0.0f, 0.0f, 0.0f))
+  , m_lastNextEventEstimation(false)
   , m_geomCache(nullptr)
   , m_shaderCache(nullptr)
 {
@@ -618,6 +639,27 @@ const HdRenderPassAovBinding* _FilterAovBinding(const HdRenderPassAovBindingVect
   return nullptr;
 }
 
+// Accepts tokens and strings, since settings may be authored either way.
+GiSampler _GetSampler(const VtValue& value)
+{
+  TfToken name = value.IsHolding<std::string>() ? TfToken(value.UncheckedGet<std::string>()) : value.GetWithDefault<TfToken>();
+
+  if (name == HdGatlingSamplerTokens->sobol)
+  {
+    return GI_SAMPLER_SOBOL;
+  }
+  if (name == HdGatlingSamplerTokens->sobol_blue_noise)
+  {
+    return GI_SAMPLER_SOBOL_BLUE_NOISE;
+  }
+  if (name != HdGatlingSamplerTokens->independent)
+  {
+    TF_RUNTIME_ERROR(TfStringPrintf("Invalid sampler %s", name.GetText()));
+  }
+
+  return GI_SAMPLER_INDEPENDENT;
+}
+
 GiAovId _GetAovId(const TfToken& aovName)
 {
   GiAovId id = GI_AOV_ID_COLOR;
@@ -636,6 +678,22 @@ GiAovId _GetAovId(const TfToken& aovName)
   return id;
 }
 
+std::vector<VtValue> HdGatlingRenderPass::_GetShaderCacheSettingValues() const
+{
+  const TfTokenVector& tokens = _GetShaderCacheSettingTokens();
+
+  std::vector<VtValue> values;
+  values.reserve(tokens.size());
+
+  for (const TfToken& token : tokens)
+  {
+    auto valueIt = m_settings.find(token);
+    values.push_back((valueIt != m_settings.end()) ? valueIt->second : VtValue());
+  }
+
+  return values;
+}
+
 void HdGatlingRenderPass::_Execute(const HdRenderPassStateSharedPtr& renderPassState,
                                    const TfTokenVector& renderTags)
 {
@@ -685,13 +743,22 @@ void HdGatlingRenderPass::_Execute(const HdRenderPassStateSharedPtr& renderPassS
   uint32_t visibilityChangeCount = changeTracker.GetVisibilityChangeCount();
   uint32_t renderSettingsStateVersion = renderDelegate->GetRenderSettingsVersion();
   GiAovId aovId = _GetAovId(aovBinding->aovName);
+  bool nextEventEstimation = m_settings.find(HdGatlingSettingsTokens->next_event_estimation)->second.Get<bool>();
 
   bool sceneChanged = (sceneStateVersion != m_lastSceneStateVersion);
   bool sprimsChanged = (sprimIndexVersion != m_lastSprimIndexVersion);
   bool renderSettingsChanged = (renderSettingsStateVersion != m_lastRenderSettingsVersion);
+  bool shaderCacheSettingsChanged = false;
+  if (renderSettingsChanged)
+  {
+    std::vector<VtValue> shaderCacheSettingValues = _GetShaderCacheSettingValues();
+    shaderCacheSettingsChanged = (shaderCacheSettingValues != m_lastShaderCacheSettingValues);
+    m_lastShaderCacheSettingValues = std::move(shaderCacheSettingValues);
+  }
   bool visibilityChanged = (m_lastVisChangeCount != visibilityChangeCount);
   bool backgroundColorChanged = (backgroundColor != m_lastBackgroundColor);
   bool aovChanged = (aovId != m_lastAovId);
+  bool nextEventEstimationChanged = (nextEventEstimation != m_lastNextEventEstimation);
 
   if (sceneChanged || renderSettingsChanged || visibilityChanged || backgroundColorChanged || aovChanged)
   {
@@ -704,10 +771,11 @@ void HdGatlingRenderPass::_Execute(const HdRenderPassStateSharedPtr& renderPassS
   m_lastVisChangeCount = visibilityChangeCount;
   m_lastBackgroundColor = backgroundColor;
   m_lastAovId = aovId;
+  m_lastNextEventEstimation = nextEventEstimation;
 
   bool rebuildShaderCache = !m_shaderCache || aovChanged || giShaderCacheNeedsRebuild() ||
-                            renderSettingsChanged || sprimsChanged /*dome light could have been added/removed*/;
-  bool rebuildGeomCache = !m_geomCache || visibilityChanged;
+                            shaderCacheSettingsChanged || sprimsChanged /*dome light could have been added/removed*/;
+  bool rebuildGeomCache = !m_geomCache || visibilityChanged || nextEventEstimationChanged /*emissive faces*/;
 
   if (rebuildShaderCache || rebuildGeomCache)
   {
@@ -736,14 +804,21 @@ void HdGatlingRenderPass::_Execute(const HdRenderPassStateSharedPtr& renderPassS
       auto domeLightCameraVisibilityValueIt = m_settings.find(HdRenderSettingsTokens->domeLightCameraVisibility);
 
       GiShaderCacheParams shaderParams;
+      shaderParams.adaptiveSampling = m_settings.find(HdGatlingSettingsTokens->adaptive_sampling)->second.Get<bool>();
       shaderParams.aovId = aovId;
+      shaderParams.batchMdlCodeGen = m_settings.find(HdGatlingSettingsTokens->batch_mdl_codegen)->second.Get<bool>();
       shaderParams.domeLight = renderParam->ActiveDomeLight();
       shaderParams.domeLightCameraVisibility = (domeLightCameraVisibilityValueIt == m_settings.end()) || domeLightCameraVisibilityValueIt->second.GetWithDefault<bool>(true);
       shaderParams.filterImportanceSampling = m_settings.find(HdGatlingSettingsTokens->filter_importance_sampling)->second.Get<bool>();
+      shaderParams.lightTree = m_settings.find(HdGatlingSettingsTokens->light_tree)->second.Get<bool>();
       shaderParams.materialCount = materials.size();
       shaderParams.materials = materials.data();
-      shaderParams.nextEventEstimation = m_settings.find(HdGatlingSettingsTokens->next_event_estimation)->second.Get<bool>();
+      shaderParams.nextEventEstimation = nextEventEstimation;
+      shaderParams.pathGuiding = m_settings.find(HdGatlingSettingsTokens->path_guiding)->second.Get<bool>();
       shaderParams.progressiveAccumulation = m_settings.find(HdGatlingSettingsTokens->progressive_accumulation)->second.Get<bool>();
+      shaderParams.restir = m_settings.find(HdGatlingSettingsTokens->restir)->second.Get<bool>();
+      shaderParams.restirSpatialNeighbors = std::max(0, m_settings.find(HdGatlingSettingsTokens->restir_spatial_neighbors)->second.Get<int>());
+      shaderParams.sampler = _GetSampler(m_settings.find(HdGatlingSettingsTokens->sampler)->second);
       shaderParams.scene = m_scene;
 
       m_shaderCache = giCreateShaderCache(&shaderParams);
@@ -763,6 +838,7 @@ void HdGatlingRenderPass::_Execute(const HdRenderPassStateSharedPtr& renderPassS
       GiGeomCacheParams geomParams;
       geomParams.meshInstanceCount = instances.size();
       geomParams.meshInstances = instances.data();
+      geomParams.nextEventEstimation = nextEventEstimation;
       geomParams.shaderCache = m_shaderCache;
 
       m_geomCache = giCreateGeomCache(&geomParams);
@@ -790,8 +866,11 @@ void HdGatlingRenderPass::_Execute(const HdRenderPassStateSharedPtr& renderPassS
   // Workaround for bug https://github.com/PixarAnimationStudios/USD/issues/913
   VtValue rr_inv_min_term_prob = m_settings.find(HdGatlingSettingsTokens->rr_inv_min_term_prob)->second;
   VtValue max_sample_value = m_settings.find(HdGatlingSettingsTokens->max_sample_value)->second;
+  VtValue adaptive_sampling_error = m_settings.find(HdGatlingSettingsTokens->adaptive_sampling_error)->second;
   renderParams.rrInvMinTermProb = float(rr_inv_min_term_prob.Cast<double>().Get<double>());
   renderParams.maxSampleValue = float(max_sample_value.Cast<double>().Get<double>());
+  renderParams.adaptiveSamplingErrorThreshold = float(adaptive_sampling_error.Cast<double>().Get<double>());
+  renderParams.adaptiveSamplingMaxSpp = m_settings.find(HdGatlingSettingsTokens->adaptive_sampling_max_spp)->second.Get<int>();
   renderParams.scene = m_scene;
   for (uint32_t i = 0; i < 4; i++)
   {
@@ -806,7 +885,8 @@ void HdGatlingRenderPass::_Execute(const HdRenderPassStateSharedPtr& renderPassS
 
   renderBuffer->Unmap();
 
-  m_isConverged = true;
+  // Without adaptive sampling, a single pass is rendered.
+  m_isConverged = (giGetActivePixelCount() == 0);
 }
 
 PXR_NAMESPACE_CLOSE_SCOPE
@@ -64,6 +64,8 @@ private:
 
   void _ClearMaterials();
 
+  std::vector<VtValue> _GetShaderCacheSettingValues() const;
+
 private:
   GiScene* m_scene;
   const HdRenderSettingsMap& m_settings;
@@ -74,9 +76,11 @@ private:
   uint32_t m_lastSceneStateVersion;
   uint32_t m_lastSprimIndexVersion;
   uint32_t m_lastRenderSettingsVersion;
+  std::vector<VtValue> m_lastShaderCacheSettingValues;
   uint32_t m_lastVisChangeCount;
   GfVec4f m_lastBackgroundColor;
   GiAovId m_lastAovId;
+  bool m_lastNextEventEstimation;
   GiGeomCache* m_geomCache;
   GiShaderCache* m_shaderCache;
   GfMatrix4d m_rootMatrix;
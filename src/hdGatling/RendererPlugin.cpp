@@ -30,8 +30,29 @@
 
 #include <gi.h>
 
+#include <filesystem>
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
 PXR_NAMESPACE_OPEN_SCOPE
 
+// HDR textures are stored as RGBA16F by default; the shared-exponent format halves their memory footprint.
+const char* ENVVAR_HDR_TEXTURE_FORMAT_E5B9G9R9 = "HDGATLING_HDR_TEXTURE_FORMAT_E5B9G9R9";
+const char* ENVVAR_DISABLE_TEXTURE_MIPS = "HDGATLING_DISABLE_TEXTURE_MIPS";
+const char* ENVVAR_TEXTURE_GPU_BUDGET_MIB = "HDGATLING_TEXTURE_GPU_BUDGET_MIB";
+const char* ENVVAR_TEXTURE_CPU_BUDGET_MIB = "HDGATLING_TEXTURE_CPU_BUDGET_MIB";
+// Either 'none' (default), 'fast' or 'high' (quality). Compressed textures are cached on disk.
+const char* ENVVAR_TEXTURE_COMPRESSION = "HDGATLING_TEXTURE_COMPRESSION";
+const char* ENVVAR_TEXTURE_CACHE_DIR = "HDGATLING_TEXTURE_CACHE_DIR";
+const char* ENVVAR_MAX_TEXTURE_DIMENSION = "HDGATLING_MAX_TEXTURE_DIMENSION";
+const char* ENVVAR_MAX_TEXTURE_SIZE_MIB = "HDGATLING_MAX_TEXTURE_SIZE_MIB";
+const char* ENVVAR_TEXTURE_DEDUPLICATION = "HDGATLING_TEXTURE_DEDUPLICATION";
+// Enables virtual texturing with a tile pool of the given size.
+const char* ENVVAR_VIRTUAL_TEXTURE_POOL_MIB = "HDGATLING_VIRTUAL_TEXTURE_POOL_MIB";
+
 class UsdzAssetReader : public GiAssetReader
 {
 private:
@@ -87,6 +108,89 @@ TF_REGISTRY_FUNCTION(TfType)
   HdRendererPluginRegistry::Define<HdGatlingRendererPlugin>();
 }
 
+// Parses a non-negative integer. Malformed or out-of-range values are reported and
+// replaced by 0, which means 'unlimited' or 'disabled' for all texture settings.
+uint64_t _ReadUintFromEnv(const char* envVar, uint64_t maxValue)
+{
+  const char* value = getenv(envVar);
+  if (!value || *value == '\0')
+  {
+    return 0;
+  }
+
+  errno = 0;
+  char* end = nullptr;
+  unsigned long long result = strtoull(value, &end, 10);
+
+  bool isValid = isdigit((unsigned char) value[0]) && *end == '\0' && errno != ERANGE && result <= maxValue;
+  if (!isValid)
+  {
+    TF_WARN("ignoring invalid value '%s' of %s", value, envVar);
+    return 0;
+  }
+
+  return result;
+}
+
+uint64_t _ReadMiBFromEnv(const char* envVar)
+{
+  const uint64_t BYTES_PER_MIB = 1024 * 1024;
+  return _ReadUintFromEnv(envVar, UINT64_MAX / BYTES_PER_MIB) * BYTES_PER_MIB;
+}
+
+GiTextureCompression _ReadTextureCompressionFromEnv()
+{
+  const char* value = getenv(ENVVAR_TEXTURE_COMPRESSION);
+  if (!value || strcmp(value, "none") == 0)
+  {
+    return GI_TEXTURE_COMPRESSION_NONE;
+  }
+  if (strcmp(value, "fast") == 0)
+  {
+    return GI_TEXTURE_COMPRESSION_BC_FAST;
+  }
+  if (strcmp(value, "high") == 0)
+  {
+    return GI_TEXTURE_COMPRESSION_BC_HIGH_QUALITY;
+  }
+  TF_WARN("unknown texture compression setting '%s', falling back to 'none'", value);
+  return GI_TEXTURE_COMPRESSION_NONE;
+}
+
+// Texture settings are consumed by giInitialize, which runs once per process before any
+// render delegate exists, so they can't be render settings. All of them are read here.
+struct _TextureSettings
+{
+  GiHdrTextureFormat hdrTextureFormat;
+  bool generateMips;
+  uint64_t gpuByteBudget;
+  uint64_t cpuByteBudget;
+  GiTextureCompression compression;
+  std::string cachePath;
+  uint32_t maxDimension;
+  uint64_t maxByteSize;
+  bool deduplicate;
+  uint64_t virtualTexturePoolByteSize;
+};
+
+_TextureSettings _ReadTextureSettingsFromEnv()
+{
+  const char* cacheDir = getenv(ENVVAR_TEXTURE_CACHE_DIR);
+
+  return _TextureSettings {
+    .hdrTextureFormat = getenv(ENVVAR_HDR_TEXTURE_FORMAT_E5B9G9R9) ? GI_HDR_TEXTURE_FORMAT_E5B9G9R9 : GI_HDR_TEXTURE_FORMAT_RGBA16F,
+    .generateMips = !getenv(ENVVAR_DISABLE_TEXTURE_MIPS),
+    .gpuByteBudget = _ReadMiBFromEnv(ENVVAR_TEXTURE_GPU_BUDGET_MIB),
+    .cpuByteBudget = _ReadMiBFromEnv(ENVVAR_TEXTURE_CPU_BUDGET_MIB),
+    .compression = _ReadTextureCompressionFromEnv(),
+    .cachePath = (cacheDir && *cacheDir) ? cacheDir : (std::filesystem::temp_directory_path() / "gatling_texture_cache").string(),
+    .maxDimension = (uint32_t) _ReadUintFromEnv(ENVVAR_MAX_TEXTURE_DIMENSION, UINT32_MAX),
+    .maxByteSize = _ReadMiBFromEnv(ENVVAR_MAX_TEXTURE_SIZE_MIB),
+    .deduplicate = getenv(ENVVAR_TEXTURE_DEDUPLICATION) != nullptr,
+    .virtualTexturePoolByteSize = _ReadMiBFromEnv(ENVVAR_VIRTUAL_TEXTURE_POOL_MIB)
+  };
+}
+
 bool _TryInitGi(const std::vector<std::string>& mtlxSearchPaths)
 {
   PlugPluginPtr plugin = PLUG_THIS_PLUGIN;
@@ -105,11 +209,23 @@ bool _TryInitGi(const std::vector<std::string>& mtlxSearchPaths)
     s += "/mdl";
   }
 
+  _TextureSettings textureSettings = _ReadTextureSettingsFromEnv();
+
   GiInitParams params = {
     .resourcePath = resourcePath.c_str(),
     .shaderPath = shaderPath.c_str(),
     .mdlSearchPaths = mdlSearchPaths,
-    .mtlxSearchPaths = mtlxSearchPaths
+    .mtlxSearchPaths = mtlxSearchPaths,
+    .hdrTextureFormat = textureSettings.hdrTextureFormat,
+    .generateTextureMips = textureSettings.generateMips,
+    .textureGpuByteBudget = textureSettings.gpuByteBudget,
+    .textureCpuByteBudget = textureSettings.cpuByteBudget,
+    .textureCompression = textureSettings.compression,
+    .textureCachePath = textureSettings.cachePath.c_str(),
+    .maxTextureDimension = textureSettings.maxDimension,
+    .maxTextureByteSize = textureSettings.maxByteSize,
+    .deduplicateTextures = textureSettings.deduplicate,
+    .virtualTexturePoolByteSize = textureSettings.virtualTexturePoolByteSize
   };
 
   return giInitialize(&params) == GI_OK;
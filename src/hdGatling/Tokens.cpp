@@ -27,5 +27,6 @@ TF_DEFINE_PUBLIC_TOKENS(HdGatlingRenderContexts, HD_GATLING_RENDER_CONTEXT_TOKEN
 TF_DEFINE_PUBLIC_TOKENS(HdGatlingNodeContexts, HD_GATLING_NODE_CONTEXT_TOKENS);
 TF_DEFINE_PUBLIC_TOKENS(HdGatlingNodeMetadata, HD_GATLING_NODE_METADATA_TOKENS);
 TF_DEFINE_PUBLIC_TOKENS(HdGatlingAovTokens, HD_GATLING_AOV_TOKENS);
+TF_DEFINE_PUBLIC_TOKENS(HdGatlingSamplerTokens, HD_GATLING_SAMPLER_TOKENS);
 
 PXR_NAMESPACE_CLOSE_SCOPE
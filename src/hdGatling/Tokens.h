@@ -28,8 +28,17 @@ PXR_NAMESPACE_OPEN_SCOPE
   ((rr_inv_min_term_prob, "rr-inv-min-term-prob"))             \
   ((max_sample_value, "max-sample-value"))                     \
   ((next_event_estimation, "next-event-estimation"))           \
+  ((light_tree, "light-tree"))                                 \
+  ((restir, "restir"))                                         \
+  ((restir_spatial_neighbors, "restir-spatial-neighbors"))     \
   ((progressive_accumulation, "progressive-accumulation"))     \
-  ((filter_importance_sampling, "filter-importance-sampling"))
+  ((filter_importance_sampling, "filter-importance-sampling")) \
+  ((adaptive_sampling, "adaptive-sampling"))                   \
+  ((adaptive_sampling_error, "adaptive-sampling-error"))       \
+  ((adaptive_sampling_max_spp, "adaptive-sampling-max-spp"))   \
+  ((sampler, "sampler"))                                       \
+  ((path_guiding, "path-guiding"))                             \
+  ((batch_mdl_codegen, "batch-mdl-codegen"))
 
 // mtlx node identifier is given by UsdMtlx.
 #define HD_GATLING_NODE_IDENTIFIER_TOKENS            \
@@ -55,6 +64,11 @@ PXR_NAMESPACE_OPEN_SCOPE
 #define HD_GATLING_NODE_METADATA_TOKENS              \
   (subIdentifier)
 
+#define HD_GATLING_SAMPLER_TOKENS                    \
+  (independent)                                      \
+  (sobol)                                            \
+  ((sobol_blue_noise, "sobol-blue-noise"))
+
 #define HD_GATLING_AOV_TOKENS                        \
   ((debug_nee, "debug:nee"))                         \
   ((debug_barycentrics, "debug:barycentrics"))       \
@@ -73,5 +87,6 @@ TF_DECLARE_PUBLIC_TOKENS(HdGatlingRenderContexts, HD_GATLING_RENDER_CONTEXT_TOKE
 TF_DECLARE_PUBLIC_TOKENS(HdGatlingNodeContexts, HD_GATLING_NODE_CONTEXT_TOKENS);
 TF_DECLARE_PUBLIC_TOKENS(HdGatlingNodeMetadata, HD_GATLING_NODE_METADATA_TOKENS);
 TF_DECLARE_PUBLIC_TOKENS(HdGatlingAovTokens, HD_GATLING_AOV_TOKENS);
+TF_DECLARE_PUBLIC_TOKENS(HdGatlingSamplerTokens, HD_GATLING_SAMPLER_TOKENS);
 
 PXR_NAMESPACE_CLOSE_SCOPE
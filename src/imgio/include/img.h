@@ -23,12 +23,42 @@
 #include <stddef.h>
 #include <stdint.h>
 
+/* Single-channel formats hold luminance, two-channel formats luminance and alpha. */
+enum imgio_format
+{
+  IMGIO_FORMAT_RGBA8_UNORM = 0,
+  IMGIO_FORMAT_RGBA16_FLOAT,
+  IMGIO_FORMAT_RGBA32_FLOAT,
+  IMGIO_FORMAT_R8_UNORM,
+  IMGIO_FORMAT_RG8_UNORM,
+  IMGIO_FORMAT_R16_UNORM,
+  IMGIO_FORMAT_R16_FLOAT,
+  /* Block-compressed formats are only produced by the KTX2 and DDS loaders. */
+  IMGIO_FORMAT_BC1_RGB_UNORM,
+  IMGIO_FORMAT_BC1_RGBA_UNORM,
+  IMGIO_FORMAT_BC2_UNORM,
+  IMGIO_FORMAT_BC3_UNORM,
+  IMGIO_FORMAT_BC4_UNORM,
+  IMGIO_FORMAT_BC5_UNORM,
+  IMGIO_FORMAT_BC6H_UFLOAT,
+  IMGIO_FORMAT_BC7_UNORM
+};
+
+#define IMGIO_MAX_LEVEL_COUNT 16
+
 struct imgio_img
 {
   uint8_t* data;
   size_t size;
   uint32_t width;
   uint32_t height;
+  imgio_format format;
+  /* Properties of the encoded image, which may differ from the decoded format. */
+  uint32_t channel_count;
+  uint32_t bit_depth;
+  /* Mip levels are stored consecutively, starting with the most detailed one. */
+  uint32_t level_count;
+  size_t level_offsets[IMGIO_MAX_LEVEL_COUNT];
 };
 
 #endif
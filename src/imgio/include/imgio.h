@@ -23,14 +23,36 @@
 #include "img.h"
 #include "error_codes.h"
 
+#include <stdbool.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 int imgio_load_img(const void* data, size_t size, imgio_img* img);
 
+/* Decoders that support it (JPEG, mip-mapped EXR) decode at a reduced resolution, so that
+ * both dimensions are at most max_dimension if possible. Other images are decoded at full
+ * resolution. A max_dimension of 0 disables downscaling. */
+int imgio_load_img_scaled(const void* data, size_t size, uint32_t max_dimension, imgio_img* img);
+
 void imgio_free_img(imgio_img* img);
 
+/* Reads the properties of the decoded image without decoding it; data is left unset.
+ * Only PNG and JPEG images are supported, other encodings return
+ * IMGIO_ERR_UNSUPPORTED_ENCODING and need to be loaded with imgio_load_img_scaled. */
+int imgio_read_info(const void* data, size_t size, uint32_t max_dimension, imgio_img* img);
+
+/* Decodes an image supported by imgio_read_info into caller-provided memory, for
+ * instance a mapped staging buffer. Rows are row_pitch bytes apart. */
+int imgio_decode_into(const void* data, size_t size, uint32_t max_dimension, uint8_t* dst, size_t row_pitch);
+
+/* Returns the byte size of an image level, or 0 for an invalid format. Sizes that
+ * can't be represented, which only occur for corrupt dimensions, return SIZE_MAX. */
+size_t imgio_get_level_size(imgio_format format, uint32_t width, uint32_t height);
+
+bool imgio_is_block_compressed(imgio_format format);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,285 @@
+/*
+ * This file is part of gatling.
+ *
+ * Copyright (C) 2019-2022 Pablo Delgado Krämer
+ *
+ * gatling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "dds.h"
+
+#include "imgio.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// https://learn.microsoft.com/en-us/windows/win32/direct3ddds/dds-header
+
+#define DDS_FOURCC(a, b, c, d) ((uint32_t) (a) | ((uint32_t) (b) << 8) | ((uint32_t) (c) << 16) | ((uint32_t) (d) << 24))
+
+const uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+const uint32_t DDPF_FOURCC = 0x4;
+const uint32_t DDPF_RGB = 0x40;
+const uint32_t DDSCAPS2_CUBEMAP = 0x200;
+const uint32_t DDSCAPS2_VOLUME = 0x200000;
+const uint32_t DDS_RESOURCE_DIMENSION_TEXTURE2D = 3;
+const uint32_t DDS_RESOURCE_MISC_TEXTURECUBE = 0x4;
+
+struct DdsPixelFormat
+{
+  uint32_t size;
+  uint32_t flags;
+  uint32_t fourCC;
+  uint32_t rgbBitCount;
+  uint32_t rBitMask;
+  uint32_t gBitMask;
+  uint32_t bBitMask;
+  uint32_t aBitMask;
+};
+
+struct DdsHeader
+{
+  uint32_t size;
+  uint32_t flags;
+  uint32_t height;
+  uint32_t width;
+  uint32_t pitchOrLinearSize;
+  uint32_t depth;
+  uint32_t mipMapCount;
+  uint32_t reserved1[11];
+  DdsPixelFormat pixelFormat;
+  uint32_t caps;
+  uint32_t caps2;
+  uint32_t caps3;
+  uint32_t caps4;
+  uint32_t reserved2;
+};
+
+struct DdsHeaderDxt10
+{
+  uint32_t dxgiFormat;
+  uint32_t resourceDimension;
+  uint32_t miscFlag;
+  uint32_t arraySize;
+  uint32_t miscFlags2;
+};
+
+static_assert(sizeof(DdsHeader) == 124, "DDS header must not be padded");
+
+// sRGB formats are treated like their UNORM counterparts, as all other 8-bit images are.
+static bool dds_translate_dxgi_format(uint32_t dxgi_format, imgio_format* format)
+{
+  switch (dxgi_format)
+  {
+  case 28: /* R8G8B8A8_UNORM */
+  case 29: /* R8G8B8A8_UNORM_SRGB */
+    *format = IMGIO_FORMAT_RGBA8_UNORM; return true;
+  case 10: /* R16G16B16A16_FLOAT */
+    *format = IMGIO_FORMAT_RGBA16_FLOAT; return true;
+  case 2: /* R32G32B32A32_FLOAT */
+    *format = IMGIO_FORMAT_RGBA32_FLOAT; return true;
+  case 61: /* R8_UNORM */
+    *format = IMGIO_FORMAT_R8_UNORM; return true;
+  case 56: /* R16_UNORM */
+    *format = IMGIO_FORMAT_R16_UNORM; return true;
+  case 54: /* R16_FLOAT */
+    *format = IMGIO_FORMAT_R16_FLOAT; return true;
+  case 71: /* BC1_UNORM */
+  case 72: /* BC1_UNORM_SRGB */
+    *format = IMGIO_FORMAT_BC1_RGBA_UNORM; return true;
+  case 74: /* BC2_UNORM */
+  case 75: /* BC2_UNORM_SRGB */
+    *format = IMGIO_FORMAT_BC2_UNORM; return true;
+  case 77: /* BC3_UNORM */
+  case 78: /* BC3_UNORM_SRGB */
+    *format = IMGIO_FORMAT_BC3_UNORM; return true;
+  case 80: /* BC4_UNORM */
+    *format = IMGIO_FORMAT_BC4_UNORM; return true;
+  case 83: /* BC5_UNORM */
+    *format = IMGIO_FORMAT_BC5_UNORM; return true;
+  case 95: /* BC6H_UF16 */
+    *format = IMGIO_FORMAT_BC6H_UFLOAT; return true;
+  case 98: /* BC7_UNORM */
+  case 99: /* BC7_UNORM_SRGB */
+    *format = IMGIO_FORMAT_BC7_UNORM; return true;
+  default:
+    return false;
+  }
+}
+
+static bool dds_translate_legacy_format(const DdsPixelFormat* pf, imgio_format* format)
+{
+  if (pf->flags & DDPF_FOURCC)
+  {
+    switch (pf->fourCC)
+    {
+    case DDS_FOURCC('D', 'X', 'T', '1'):
+      *format = IMGIO_FORMAT_BC1_RGBA_UNORM; return true;
+    case DDS_FOURCC('D', 'X', 'T', '2'):
+    case DDS_FOURCC('D', 'X', 'T', '3'):
+      *format = IMGIO_FORMAT_BC2_UNORM; return true;
+    case DDS_FOURCC('D', 'X', 'T', '4'):
+    case DDS_FOURCC('D', 'X', 'T', '5'):
+      *format = IMGIO_FORMAT_BC3_UNORM; return true;
+    case DDS_FOURCC('A', 'T', 'I', '1'):
+    case DDS_FOURCC('B', 'C', '4', 'U'):
+      *format = IMGIO_FORMAT_BC4_UNORM; return true;
+    case DDS_FOURCC('A', 'T', 'I', '2'):
+    case DDS_FOURCC('B', 'C', '5', 'U'):
+      *format = IMGIO_FORMAT_BC5_UNORM; return true;
+    case 113: /* D3DFMT_A16B16G16R16F */
+      *format = IMGIO_FORMAT_RGBA16_FLOAT; return true;
+    case 116: /* D3DFMT_A32B32G32R32F */
+      *format = IMGIO_FORMAT_RGBA32_FLOAT; return true;
+    default:
+      return false;
+    }
+  }
+
+  if ((pf->flags & DDPF_RGB) && pf->rgbBitCount == 32 &&
+      pf->rBitMask == 0x000000FF && pf->gBitMask == 0x0000FF00 &&
+      pf->bBitMask == 0x00FF0000 && pf->aBitMask == 0xFF000000)
+  {
+    *format = IMGIO_FORMAT_RGBA8_UNORM;
+    return true;
+  }
+
+  return false;
+}
+
+static uint32_t dds_get_full_level_count(uint32_t width, uint32_t height)
+{
+  uint32_t max_dimension = (width > height) ? width : height;
+
+  uint32_t count = 0;
+  for (; max_dimension > 0; max_dimension >>= 1)
+  {
+    count++;
+  }
+  return count;
+}
+
+static void dds_get_format_properties(imgio_format format, uint32_t* channel_count, uint32_t* bit_depth)
+{
+  *channel_count = 4;
+  *bit_depth = 8;
+
+  switch (format)
+  {
+  case IMGIO_FORMAT_RGBA16_FLOAT: *bit_depth = 16; break;
+  case IMGIO_FORMAT_RGBA32_FLOAT: *bit_depth = 32; break;
+  case IMGIO_FORMAT_R8_UNORM:
+  case IMGIO_FORMAT_BC4_UNORM: *channel_count = 1; break;
+  case IMGIO_FORMAT_R16_UNORM:
+  case IMGIO_FORMAT_R16_FLOAT: *channel_count = 1; *bit_depth = 16; break;
+  case IMGIO_FORMAT_BC5_UNORM: *channel_count = 2; break;
+  case IMGIO_FORMAT_BC6H_UFLOAT: *channel_count = 3; *bit_depth = 16; break;
+  default: break;
+  }
+}
+
+int imgio_dds_decode(size_t size, const void* data, imgio_img* img)
+{
+  const uint8_t* bytes = (const uint8_t*) data;
+
+  if (size < 4 || memcmp(bytes, "DDS ", 4))
+  {
+    return IMGIO_ERR_UNSUPPORTED_ENCODING;
+  }
+
+  if (size < 4 + sizeof(DdsHeader))
+  {
+    return IMGIO_ERR_CORRUPT_DATA;
+  }
+
+  DdsHeader header;
+  memcpy(&header, &bytes[4], sizeof(header));
+
+  size_t data_offset = 4 + sizeof(DdsHeader);
+
+  imgio_format format;
+  bool is_supported;
+
+  if ((header.pixelFormat.flags & DDPF_FOURCC) && header.pixelFormat.fourCC == DDS_FOURCC('D', 'X', '1', '0'))
+  {
+    if (size < data_offset + sizeof(DdsHeaderDxt10))
+    {
+      return IMGIO_ERR_CORRUPT_DATA;
+    }
+
+    DdsHeaderDxt10 header10;
+    memcpy(&header10, &bytes[data_offset], sizeof(header10));
+    data_offset += sizeof(DdsHeaderDxt10);
+
+    is_supported = dds_translate_dxgi_format(header10.dxgiFormat, &format) &&
+                   header10.resourceDimension == DDS_RESOURCE_DIMENSION_TEXTURE2D &&
+                   header10.arraySize <= 1 && !(header10.miscFlag & DDS_RESOURCE_MISC_TEXTURECUBE);
+  }
+  else
+  {
+    is_supported = dds_translate_legacy_format(&header.pixelFormat, &format);
+  }
+
+  // Only single 2D images are supported.
+  if (!is_supported || (header.caps2 & (DDSCAPS2_CUBEMAP | DDSCAPS2_VOLUME)) ||
+      header.width == 0 || header.height == 0)
+  {
+    return IMGIO_ERR_DECODE;
+  }
+
+  uint32_t file_level_count = ((header.flags & DDSD_MIPMAPCOUNT) && header.mipMapCount > 0) ? header.mipMapCount : 1;
+  if (file_level_count > dds_get_full_level_count(header.width, header.height))
+  {
+    return IMGIO_ERR_CORRUPT_DATA;
+  }
+
+  // Excess levels are the least detailed ones and can be dropped.
+  uint32_t level_count = (file_level_count < IMGIO_MAX_LEVEL_COUNT) ? file_level_count : IMGIO_MAX_LEVEL_COUNT;
+
+  // Levels are stored consecutively, like ours. Each level is checked against the
+  // remaining data before it is added, so that huge dimensions can't overflow the sum.
+  size_t available_size = size - data_offset;
+  size_t total_size = 0;
+  for (uint32_t i = 0; i < level_count; i++)
+  {
+    uint32_t width = (header.width >> i) ? (header.width >> i) : 1;
+    uint32_t height = (header.height >> i) ? (header.height >> i) : 1;
+    size_t level_size = imgio_get_level_size(format, width, height);
+
+    if (level_size > (available_size - total_size))
+    {
+      return IMGIO_ERR_CORRUPT_DATA;
+    }
+
+    img->level_offsets[i] = total_size;
+    total_size += level_size;
+  }
+
+  img->data = (uint8_t*) malloc(total_size);
+  if (!img->data)
+  {
+    return IMGIO_ERR_UNKNOWN;
+  }
+
+  memcpy(img->data, &bytes[data_offset], total_size);
+
+  img->size = total_size;
+  img->width = header.width;
+  img->height = header.height;
+  img->format = format;
+  img->level_count = level_count;
+  dds_get_format_properties(format, &img->channel_count, &img->bit_depth);
+
+  return IMGIO_OK;
+}
@@ -23,12 +23,20 @@
 #include "error_codes.h"
 
 #include <ImfRgbaFile.h>
+#include <ImfTiledRgbaFile.h>
+#include <ImfInputFile.h>
+#include <ImfChannelList.h>
+#include <ImfFrameBuffer.h>
 #include <ImfIO.h>
-#include <ImfArray.h>
 #include <ImfRgba.h>
+#include <ImfThreading.h>
 
 #include <algorithm>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
 #include <assert.h>
+#include <string.h>
 
 class MemStream : public Imf::IStream
 {
@@ -58,6 +66,24 @@ public:
     return true;
   }
 
+  // Lets OpenEXR read compressed chunks in place instead of copying them.
+  bool isMemoryMapped() const override
+  {
+    return true;
+  }
+
+  char* readMemoryMapped(int n) override
+  {
+    assert(m_data);
+    if (m_pos + n > m_size)
+    {
+      throw std::out_of_range("read past end of EXR data");
+    }
+    char* result = &m_data[m_pos];
+    m_pos += n;
+    return result;
+  }
+
   uint64_t tellg() override
   {
     return m_pos;
@@ -69,13 +95,18 @@ public:
   }
 };
 
-uint8_t _FloatToByte(float value)
+// Line buffers and tiles are decompressed in parallel on OpenEXR's global thread pool
+// and written straight into the destination, without full-size intermediates.
+static int exr_get_thread_count()
 {
-  int result = std::floor(255 * value + 0.499999f);
-  return std::min(255, std::max(0, result));
+  static std::once_flag flag;
+  std::call_once(flag, []() {
+    Imf::setGlobalThreadCount(std::max(std::thread::hardware_concurrency(), 1u));
+  });
+  return Imf::globalThreadCount();
 }
 
-int imgio_exr_decode(size_t size, const void* data, imgio_img* img)
+int imgio_exr_decode(size_t size, const void* data, uint32_t max_dimension, imgio_img* img)
 {
   // Do the signature check manually because we can't detect
   // a mismatch based on the exception-based API.
@@ -92,35 +123,104 @@ int imgio_exr_decode(size_t size, const void* data, imgio_img* img)
 
   img->data = nullptr;
 
+  int threadCount = exr_get_thread_count();
+
   try
   {
+    bool isMipmapped = false;
+
+    {
+      MemStream stream((char*) data, size);
+
+      Imf::InputFile file(stream, threadCount);
+
+      const Imf::Header& header = file.header();
+      const Imf::ChannelList& channels = header.channels();
+
+      isMipmapped = header.hasTileDescription() && header.tileDescription().mode == Imf::MIPMAP_LEVELS;
+
+      img->channel_count = 0;
+      img->bit_depth = 16;
+
+      for (auto it = channels.begin(); it != channels.end(); ++it)
+      {
+        img->channel_count++;
+        img->bit_depth = std::max(img->bit_depth, (it.channel().type == Imf::HALF) ? 16u : 32u);
+      }
+
+      // A single channel that isn't part of an RGBA layout (e.g. Y or Z) is decoded to
+      // a half-float luminance image. All other layouts go through the RGBA interface.
+      auto channelIt = channels.begin();
+      const char* channelName = (img->channel_count == 1) ? channelIt.name() : nullptr;
+
+      bool isLuminance = channelName &&
+        strcmp(channelName, "R") && strcmp(channelName, "G") &&
+        strcmp(channelName, "B") && strcmp(channelName, "A");
+
+      if (isLuminance)
+      {
+        const Imath::Box2i& dw = file.header().dataWindow();
+        img->width = (dw.max.x - dw.min.x + 1);
+        img->height = (dw.max.y - dw.min.y + 1);
+        img->size = img->width * img->height * sizeof(uint16_t);
+        img->data = (uint8_t*) malloc(img->size);
+        img->format = IMGIO_FORMAT_R16_FLOAT;
+
+        uint16_t* pixels = (uint16_t*) img->data;
+        char* base = (char*) (pixels - dw.min.x - dw.min.y * img->width);
+
+        Imf::FrameBuffer frameBuffer;
+        frameBuffer.insert(channelName, Imf::Slice(Imf::HALF, base, sizeof(uint16_t), sizeof(uint16_t) * img->width));
+        file.setFrameBuffer(frameBuffer);
+        file.readPixels(dw.min.y, dw.max.y);
+
+        return IMGIO_OK;
+      }
+    }
+
+    // Lower-resolution levels of mip-mapped files can be read directly.
+    if (isMipmapped && max_dimension > 0)
+    {
+      MemStream stream((char*) data, size);
+
+      Imf::TiledRgbaInputFile file(stream, threadCount);
+
+      int level = 0;
+      while ((level + 1) < file.numLevels() &&
+             uint32_t(std::max(file.levelWidth(level), file.levelHeight(level))) > max_dimension)
+      {
+        level++;
+      }
+
+      const Imath::Box2i dw = file.dataWindowForLevel(level);
+      img->width = (dw.max.x - dw.min.x + 1);
+      img->height = (dw.max.y - dw.min.y + 1);
+      img->size = img->width * img->height * sizeof(Imf::Rgba);
+      img->data = (uint8_t*) malloc(img->size);
+      img->format = IMGIO_FORMAT_RGBA16_FLOAT;
+
+      Imf::Rgba* pixels = (Imf::Rgba*) img->data;
+      file.setFrameBuffer(pixels - dw.min.x - dw.min.y * img->width, 1, img->width);
+      file.readTiles(0, file.numXTiles(level) - 1, 0, file.numYTiles(level) - 1, level);
+
+      return IMGIO_OK;
+    }
+
     MemStream stream((char*) data, size);
 
-    Imf::RgbaInputFile file(stream);
+    Imf::RgbaInputFile file(stream, threadCount);
 
     const Imath::Box2i& dw = file.dataWindow();
     img->width = (dw.max.x - dw.min.x + 1);
     img->height = (dw.max.y - dw.min.y + 1);
-    img->size = img->width * img->height * 4;
+    img->size = img->width * img->height * sizeof(Imf::Rgba);
     img->data = (uint8_t*) malloc(img->size);
+    img->format = IMGIO_FORMAT_RGBA16_FLOAT;
 
-    Imf::Array2D<Imf::Rgba> tmpPixels(img->height, img->width); // values are 16-bit floats
-    file.setFrameBuffer(&tmpPixels[0][0] - dw.min.x - dw.min.y * img->width, 1, img->width);
+    // Imf::Rgba consists of four 16-bit floats, so we can decode straight into the image.
+    Imf::Rgba* pixels = (Imf::Rgba*) img->data;
+    file.setFrameBuffer(pixels - dw.min.x - dw.min.y * img->width, 1, img->width);
     file.readPixels(dw.min.y, dw.max.y);
-
-    for (long h = 0; h < tmpPixels.height(); h++)
-    {
-      for (long w = 0; w < tmpPixels.width(); w++)
-      {
-        const Imf::Rgba& value = tmpPixels[h][w];
-
-        uint64_t offset = (w + h * img->width) * 4;
-        img->data[offset + 0] = _FloatToByte(value.r);
-        img->data[offset + 1] = _FloatToByte(value.g);
-        img->data[offset + 2] = _FloatToByte(value.b);
-        img->data[offset + 3] = _FloatToByte(value.a);
-      }
-    }
   }
   catch (std::exception& ex)
   {
@@ -21,9 +21,10 @@
 #define IMGIO_EXR_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 struct imgio_img;
 
-int imgio_exr_decode(size_t size, const void* data, imgio_img* img);
+int imgio_exr_decode(size_t size, const void* data, uint32_t max_dimension, imgio_img* img);
 
 #endif
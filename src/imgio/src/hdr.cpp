@@ -30,7 +30,6 @@
 #include <algorithm>
 #include <float.h>
 
-// FIXME: don't downcast to uint8_t; store as RGBA16F / E5B9G9R9_UFLOAT_PACK32 / ASTC_HDR
 int imgio_hdr_decode(size_t size, const void* data, imgio_img* img)
 {
   if (!stbi_is_hdr_from_memory((const stbi_uc*) data, size))
@@ -45,21 +44,12 @@ int imgio_hdr_decode(size_t size, const void* data, imgio_img* img)
     return IMGIO_ERR_DECODE;
   }
 
-  img->size = img->width * img->height * 4;
-  img->data = (uint8_t*) malloc(img->size);
+  // stb_image allocates with malloc, so imgio_free_img can release the data.
+  img->size = img->width * img->height * 4 * sizeof(float);
+  img->data = (uint8_t*) hdrData;
+  img->format = IMGIO_FORMAT_RGBA32_FLOAT;
+  img->channel_count = num_components;
+  img->bit_depth = 32;
 
-  for (uint32_t i = 0; i < img->width; i++)
-  {
-    for (uint32_t j = 0; j < img->height; j++)
-    {
-      for (uint32_t k = 0; k < 4; k++)
-      {
-        uint32_t cIndex = (i + j * img->width) * 4 + k;
-        img->data[cIndex] = uint8_t(std::min(int(hdrData[cIndex] * 255.0), 255));
-      }
-    }
-  }
-
-  delete hdrData;
   return IMGIO_OK;
 }
@@ -19,25 +19,47 @@
 
 #include "imgio.h"
 
+#include "ktx2.h"
+#include "dds.h"
 #include "png.h"
 #include "jpeg.h"
 #include "exr.h"
 #include "hdr.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 
 int imgio_load_img(const void* data, size_t size, imgio_img* img)
 {
-  int r = imgio_png_decode(size, data, img);
+  return imgio_load_img_scaled(data, size, 0, img);
+}
+
+int imgio_load_img_scaled(const void* data, size_t size, uint32_t max_dimension, imgio_img* img)
+{
+  img->level_count = 1;
+  img->level_offsets[0] = 0;
+
+  // Containers come first since their signature checks are cheap.
+  int r = imgio_ktx2_decode(size, data, img);
+
+  if (r == IMGIO_ERR_UNSUPPORTED_ENCODING)
+  {
+    r = imgio_dds_decode(size, data, img);
+  }
+
+  if (r == IMGIO_ERR_UNSUPPORTED_ENCODING)
+  {
+    r = imgio_png_decode(size, data, img);
+  }
 
   if (r == IMGIO_ERR_UNSUPPORTED_ENCODING)
   {
-    r = imgio_jpeg_decode(size, data, img);
+    r = imgio_jpeg_decode(size, data, max_dimension, img);
   }
 
   if (r == IMGIO_ERR_UNSUPPORTED_ENCODING)
   {
-    r = imgio_exr_decode(size, data, img);
+    r = imgio_exr_decode(size, data, max_dimension, img);
   }
 
   if (r == IMGIO_ERR_UNSUPPORTED_ENCODING)
@@ -52,3 +74,73 @@ void imgio_free_img(imgio_img* img)
 {
   free(img->data);
 }
+
+int imgio_read_info(const void* data, size_t size, uint32_t max_dimension, imgio_img* img)
+{
+  img->data = NULL;
+  img->level_count = 1;
+  img->level_offsets[0] = 0;
+
+  int r = imgio_png_read_info(size, data, img);
+
+  if (r == IMGIO_ERR_UNSUPPORTED_ENCODING)
+  {
+    r = imgio_jpeg_read_info(size, data, max_dimension, img);
+  }
+
+  return r;
+}
+
+int imgio_decode_into(const void* data, size_t size, uint32_t max_dimension, uint8_t* dst, size_t row_pitch)
+{
+  int r = imgio_png_decode_into(size, data, dst, row_pitch);
+
+  if (r == IMGIO_ERR_UNSUPPORTED_ENCODING)
+  {
+    r = imgio_jpeg_decode_into(size, data, max_dimension, dst, row_pitch);
+  }
+
+  return r;
+}
+
+size_t imgio_get_level_size(imgio_format format, uint32_t width, uint32_t height)
+{
+  /* The products of 32-bit dimensions fit into 64 bits, the byte sizes may not. */
+  uint64_t texel_count = (uint64_t) width * height;
+  uint64_t block_count = (uint64_t) ((width + 3ull) / 4) * ((height + 3ull) / 4);
+
+  uint64_t count;
+  uint64_t byte_size;
+
+  switch (format)
+  {
+  case IMGIO_FORMAT_RGBA8_UNORM: count = texel_count; byte_size = 4; break;
+  case IMGIO_FORMAT_RGBA16_FLOAT: count = texel_count; byte_size = 8; break;
+  case IMGIO_FORMAT_RGBA32_FLOAT: count = texel_count; byte_size = 16; break;
+  case IMGIO_FORMAT_R8_UNORM: count = texel_count; byte_size = 1; break;
+  case IMGIO_FORMAT_RG8_UNORM:
+  case IMGIO_FORMAT_R16_UNORM:
+  case IMGIO_FORMAT_R16_FLOAT: count = texel_count; byte_size = 2; break;
+  case IMGIO_FORMAT_BC1_RGB_UNORM:
+  case IMGIO_FORMAT_BC1_RGBA_UNORM:
+  case IMGIO_FORMAT_BC4_UNORM: count = block_count; byte_size = 8; break;
+  case IMGIO_FORMAT_BC2_UNORM:
+  case IMGIO_FORMAT_BC3_UNORM:
+  case IMGIO_FORMAT_BC5_UNORM:
+  case IMGIO_FORMAT_BC6H_UFLOAT:
+  case IMGIO_FORMAT_BC7_UNORM: count = block_count; byte_size = 16; break;
+  default: return 0;
+  }
+
+  if (count > SIZE_MAX / byte_size)
+  {
+    return SIZE_MAX;
+  }
+
+  return (size_t) (count * byte_size);
+}
+
+bool imgio_is_block_compressed(imgio_format format)
+{
+  return format >= IMGIO_FORMAT_BC1_RGB_UNORM && format <= IMGIO_FORMAT_BC7_UNORM;
+}
@@ -25,7 +25,10 @@
 #include <stdlib.h>
 #include <turbojpeg.h>
 
-int imgio_jpeg_decode(size_t size, const void* data, imgio_img* img)
+// Reads the header if dst is null and no allocation is requested, decodes into dst with
+// the given row pitch if it is non-null, or into newly allocated img->data otherwise.
+static int jpeg_decode(size_t size, const void* data, uint32_t max_dimension, imgio_img* img,
+                       bool allocate, uint8_t* dst, size_t row_pitch)
 {
   tjhandle instance = tjInitDecompress();
   if (!instance)
@@ -43,20 +46,97 @@ int imgio_jpeg_decode(size_t size, const void* data, imgio_img* img)
     return IMGIO_ERR_UNSUPPORTED_ENCODING;
   }
 
-  int pixelFormat = TJPF_RGBA;
+  // Downscaling happens in the DCT domain. We pick the largest scaling factor
+  // for which the image fits, or the smallest one if none does.
+  if (max_dimension > 0 && (img->width > max_dimension || img->height > max_dimension))
+  {
+    int factorCount;
+    tjscalingfactor* factors = tjGetScalingFactors(&factorCount);
+
+    int bestIndex = -1;
+    int smallestIndex = -1;
+
+    for (int i = 0; factors && i < factorCount; i++)
+    {
+      tjscalingfactor f = factors[i];
+      if (f.num > f.denom)
+      {
+        continue;
+      }
+
+      uint32_t width = TJSCALED(img->width, f);
+      uint32_t height = TJSCALED(img->height, f);
+
+      if (smallestIndex < 0 || width < TJSCALED(img->width, factors[smallestIndex]))
+      {
+        smallestIndex = i;
+      }
+
+      if (width <= max_dimension && height <= max_dimension &&
+          (bestIndex < 0 || width > TJSCALED(img->width, factors[bestIndex])))
+      {
+        bestIndex = i;
+      }
+    }
+
+    int index = (bestIndex >= 0) ? bestIndex : smallestIndex;
+    if (index >= 0)
+    {
+      uint32_t width = TJSCALED(img->width, factors[index]);
+      uint32_t height = TJSCALED(img->height, factors[index]);
+      img->width = width;
+      img->height = height;
+    }
+  }
+
+  // Grayscale images are decoded to a single channel.
+  bool isGray = (colorspace == TJCS_GRAY);
+  int pixelFormat = isGray ? TJPF_GRAY : TJPF_RGBA;
+  img->format = isGray ? IMGIO_FORMAT_R8_UNORM : IMGIO_FORMAT_RGBA8_UNORM;
+  img->channel_count = (colorspace == TJCS_CMYK || colorspace == TJCS_YCCK) ? 4 : (isGray ? 1 : 3);
+  img->bit_depth = 8;
   img->size = img->width * img->height * tjPixelSize[pixelFormat];
-  img->data = (uint8_t*) malloc(img->size);
+
+  if (!dst && !allocate)
+  {
+    tjDestroy(instance);
+    return IMGIO_OK;
+  }
+
+  if (!dst)
+  {
+    img->data = (uint8_t*) malloc(img->size);
+  }
 
   int result = tjDecompress2(instance, (const unsigned char*) data, (unsigned long) size,
-                             (unsigned char*) img->data, (int) img->width, 0,
+                             dst ? dst : (unsigned char*) img->data, (int) img->width, (int) row_pitch,
                              (int) img->height, pixelFormat, TJFLAG_ACCURATEDCT);
   tjDestroy(instance);
 
   if (result < 0)
   {
-    free(img->data);
+    if (!dst)
+    {
+      free(img->data);
+    }
     return IMGIO_ERR_DECODE;
   }
 
   return IMGIO_OK;
 }
+
+int imgio_jpeg_decode(size_t size, const void* data, uint32_t max_dimension, imgio_img* img)
+{
+  return jpeg_decode(size, data, max_dimension, img, true, NULL, 0);
+}
+
+int imgio_jpeg_read_info(size_t size, const void* data, uint32_t max_dimension, imgio_img* img)
+{
+  return jpeg_decode(size, data, max_dimension, img, false, NULL, 0);
+}
+
+int imgio_jpeg_decode_into(size_t size, const void* data, uint32_t max_dimension, uint8_t* dst, size_t row_pitch)
+{
+  imgio_img img;
+  return jpeg_decode(size, data, max_dimension, &img, false, dst, row_pitch);
+}
@@ -21,9 +21,14 @@
 #define IMGIO_JPEG_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 struct imgio_img;
 
-int imgio_jpeg_decode(size_t size, const void* data, imgio_img* img);
+int imgio_jpeg_decode(size_t size, const void* data, uint32_t max_dimension, imgio_img* img);
+
+int imgio_jpeg_read_info(size_t size, const void* data, uint32_t max_dimension, imgio_img* img);
+
+int imgio_jpeg_decode_into(size_t size, const void* data, uint32_t max_dimension, uint8_t* dst, size_t row_pitch);
 
 #endif
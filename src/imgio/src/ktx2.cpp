@@ -0,0 +1,200 @@
+/*
+ * This file is part of gatling.
+ *
+ * Copyright (C) 2019-2022 Pablo Delgado Krämer
+ *
+ * gatling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ktx2.h"
+
+#include "imgio.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html
+
+struct Ktx2Header
+{
+  uint8_t identifier[12];
+  uint32_t vkFormat;
+  uint32_t typeSize;
+  uint32_t pixelWidth;
+  uint32_t pixelHeight;
+  uint32_t pixelDepth;
+  uint32_t layerCount;
+  uint32_t faceCount;
+  uint32_t levelCount;
+  uint32_t supercompressionScheme;
+  uint32_t dfdByteOffset;
+  uint32_t dfdByteLength;
+  uint32_t kvdByteOffset;
+  uint32_t kvdByteLength;
+  uint64_t sgdByteOffset;
+  uint64_t sgdByteLength;
+};
+
+struct Ktx2LevelIndex
+{
+  uint64_t byteOffset;
+  uint64_t byteLength;
+  uint64_t uncompressedByteLength;
+};
+
+static_assert(sizeof(Ktx2Header) == 80, "KTX2 header must not be padded");
+
+// sRGB formats are treated like their UNORM counterparts, as all other 8-bit images are.
+static bool ktx2_translate_format(uint32_t vk_format, imgio_format* format, uint32_t* channel_count, uint32_t* bit_depth)
+{
+  *bit_depth = 8;
+
+  switch (vk_format)
+  {
+  case 37: /* R8G8B8A8_UNORM */
+  case 43: /* R8G8B8A8_SRGB */
+    *format = IMGIO_FORMAT_RGBA8_UNORM; *channel_count = 4; return true;
+  case 97: /* R16G16B16A16_SFLOAT */
+    *format = IMGIO_FORMAT_RGBA16_FLOAT; *channel_count = 4; *bit_depth = 16; return true;
+  case 109: /* R32G32B32A32_SFLOAT */
+    *format = IMGIO_FORMAT_RGBA32_FLOAT; *channel_count = 4; *bit_depth = 32; return true;
+  case 9: /* R8_UNORM */
+    *format = IMGIO_FORMAT_R8_UNORM; *channel_count = 1; return true;
+  case 70: /* R16_UNORM */
+    *format = IMGIO_FORMAT_R16_UNORM; *channel_count = 1; *bit_depth = 16; return true;
+  case 76: /* R16_SFLOAT */
+    *format = IMGIO_FORMAT_R16_FLOAT; *channel_count = 1; *bit_depth = 16; return true;
+  case 131: /* BC1_RGB_UNORM_BLOCK */
+  case 132: /* BC1_RGB_SRGB_BLOCK */
+    *format = IMGIO_FORMAT_BC1_RGB_UNORM; *channel_count = 3; return true;
+  case 133: /* BC1_RGBA_UNORM_BLOCK */
+  case 134: /* BC1_RGBA_SRGB_BLOCK */
+    *format = IMGIO_FORMAT_BC1_RGBA_UNORM; *channel_count = 4; return true;
+  case 135: /* BC2_UNORM_BLOCK */
+  case 136: /* BC2_SRGB_BLOCK */
+    *format = IMGIO_FORMAT_BC2_UNORM; *channel_count = 4; return true;
+  case 137: /* BC3_UNORM_BLOCK */
+  case 138: /* BC3_SRGB_BLOCK */
+    *format = IMGIO_FORMAT_BC3_UNORM; *channel_count = 4; return true;
+  case 139: /* BC4_UNORM_BLOCK */
+    *format = IMGIO_FORMAT_BC4_UNORM; *channel_count = 1; return true;
+  case 141: /* BC5_UNORM_BLOCK */
+    *format = IMGIO_FORMAT_BC5_UNORM; *channel_count = 2; return true;
+  case 143: /* BC6H_UFLOAT_BLOCK */
+    *format = IMGIO_FORMAT_BC6H_UFLOAT; *channel_count = 3; *bit_depth = 16; return true;
+  case 145: /* BC7_UNORM_BLOCK */
+  case 146: /* BC7_SRGB_BLOCK */
+    *format = IMGIO_FORMAT_BC7_UNORM; *channel_count = 4; return true;
+  default:
+    return false;
+  }
+}
+
+static uint32_t ktx2_get_full_level_count(uint32_t width, uint32_t height)
+{
+  uint32_t max_dimension = (width > height) ? width : height;
+
+  uint32_t count = 0;
+  for (; max_dimension > 0; max_dimension >>= 1)
+  {
+    count++;
+  }
+  return count;
+}
+
+int imgio_ktx2_decode(size_t size, const void* data, imgio_img* img)
+{
+  const uint8_t IDENTIFIER[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+  if (size < sizeof(Ktx2Header) || memcmp(data, IDENTIFIER, sizeof(IDENTIFIER)))
+  {
+    return IMGIO_ERR_UNSUPPORTED_ENCODING;
+  }
+
+  const uint8_t* bytes = (const uint8_t*) data;
+
+  Ktx2Header header;
+  memcpy(&header, bytes, sizeof(header));
+
+  // Only uncompressed payloads of single 2D images are supported. ASTC and
+  // supercompressed (Basis, Zstandard) files need to be transcoded offline.
+  imgio_format format;
+  uint32_t channel_count;
+  uint32_t bit_depth;
+  if (!ktx2_translate_format(header.vkFormat, &format, &channel_count, &bit_depth) ||
+      header.supercompressionScheme != 0 || header.pixelDepth > 1 || header.layerCount > 1 ||
+      header.faceCount != 1 || header.pixelWidth == 0 || header.pixelHeight == 0)
+  {
+    return IMGIO_ERR_DECODE;
+  }
+
+  // A level count of 0 requests mip generation at load time.
+  uint32_t file_level_count = (header.levelCount > 0) ? header.levelCount : 1;
+  if (file_level_count > ktx2_get_full_level_count(header.pixelWidth, header.pixelHeight) ||
+      file_level_count > (size - sizeof(Ktx2Header)) / sizeof(Ktx2LevelIndex))
+  {
+    return IMGIO_ERR_CORRUPT_DATA;
+  }
+
+  // Excess levels are the least detailed ones and can be dropped.
+  uint32_t level_count = (file_level_count < IMGIO_MAX_LEVEL_COUNT) ? file_level_count : IMGIO_MAX_LEVEL_COUNT;
+
+  uint64_t src_offsets[IMGIO_MAX_LEVEL_COUNT];
+  size_t level_sizes[IMGIO_MAX_LEVEL_COUNT];
+  size_t total_size = 0;
+
+  for (uint32_t i = 0; i < level_count; i++)
+  {
+    Ktx2LevelIndex index;
+    memcpy(&index, &bytes[sizeof(Ktx2Header) + i * sizeof(Ktx2LevelIndex)], sizeof(index));
+
+    uint32_t width = (header.pixelWidth >> i) ? (header.pixelWidth >> i) : 1;
+    uint32_t height = (header.pixelHeight >> i) ? (header.pixelHeight >> i) : 1;
+    size_t level_size = imgio_get_level_size(format, width, height);
+
+    // Each level lies within the file, which also bounds the total size.
+    if (index.byteLength != level_size || index.byteOffset > size || index.byteLength > (size - index.byteOffset) ||
+        level_size > (SIZE_MAX - total_size))
+    {
+      return IMGIO_ERR_CORRUPT_DATA;
+    }
+
+    src_offsets[i] = index.byteOffset;
+    level_sizes[i] = level_size;
+    img->level_offsets[i] = total_size;
+    total_size += level_size;
+  }
+
+  img->data = (uint8_t*) malloc(total_size);
+  if (!img->data)
+  {
+    return IMGIO_ERR_UNKNOWN;
+  }
+
+  for (uint32_t i = 0; i < level_count; i++)
+  {
+    memcpy(&img->data[img->level_offsets[i]], &bytes[src_offsets[i]], level_sizes[i]);
+  }
+
+  img->size = total_size;
+  img->width = header.pixelWidth;
+  img->height = header.pixelHeight;
+  img->format = format;
+  img->channel_count = channel_count;
+  img->bit_depth = bit_depth;
+  img->level_count = level_count;
+
+  return IMGIO_OK;
+}
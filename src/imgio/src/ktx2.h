@@ -0,0 +1,29 @@
+/*
+ * This file is part of gatling.
+ *
+ * Copyright (C) 2019-2022 Pablo Delgado Krämer
+ *
+ * gatling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMGIO_KTX2_H
+#define IMGIO_KTX2_H
+
+#include <stddef.h>
+
+struct imgio_img;
+
+int imgio_ktx2_decode(size_t size, const void* data, imgio_img* img);
+
+#endif
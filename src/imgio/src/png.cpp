@@ -25,9 +25,17 @@
 #include <stdlib.h>
 #include <spng.h>
 
-int imgio_png_decode(size_t size, const void* data, imgio_img* img)
+/* Reads the header if dst is null and no allocation is requested, decodes into dst with
+ * the given row pitch if it is non-null, or into newly allocated img->data otherwise. */
+static int png_decode(size_t size, const void* data, imgio_img* img, bool allocate, uint8_t* dst, size_t row_pitch)
 {
   int err;
+  spng_ihdr ihdr;
+  spng_trns trns;
+  bool has_trns;
+  int fmt;
+  size_t row_size;
+  spng_row_info row_info;
 
   spng_ctx* ctx = spng_ctx_new(0);
 
@@ -37,39 +45,96 @@ int imgio_png_decode(size_t size, const void* data, imgio_img* img)
     goto buffer_fail;
   }
 
-  err = spng_decoded_image_size(ctx, SPNG_FMT_RGBA8, &img->size);
+  err = spng_get_ihdr(ctx, &ihdr);
   if (err != SPNG_OK)
   {
-    goto decode_size_fail;
+    goto ihdr_fail;
   }
 
-  img->data = (uint8_t*) malloc(img->size);
+  has_trns = spng_get_trns(ctx, &trns) == SPNG_OK;
 
-  err = spng_decode_image(ctx, img->data, img->size, SPNG_FMT_RGBA8, 0);
-  if (err != SPNG_OK)
+  switch (ihdr.color_type)
   {
-    goto decode_fail;
+  case SPNG_COLOR_TYPE_GRAYSCALE: img->channel_count = has_trns ? 2 : 1; break;
+  case SPNG_COLOR_TYPE_GRAYSCALE_ALPHA: img->channel_count = 2; break;
+  case SPNG_COLOR_TYPE_TRUECOLOR_ALPHA: img->channel_count = 4; break;
+  default: img->channel_count = has_trns ? 4 : 3; break;
   }
+  img->bit_depth = ihdr.bit_depth;
 
-  spng_ihdr ihdr;
-  err = spng_get_ihdr(ctx, &ihdr);
+  /* Grayscale images keep their channel count. The native PNG format is host-endian. */
+  fmt = SPNG_FMT_RGBA8;
+  img->format = IMGIO_FORMAT_RGBA8_UNORM;
+
+  if (ihdr.color_type == SPNG_COLOR_TYPE_GRAYSCALE && !has_trns)
+  {
+    fmt = (ihdr.bit_depth == 16) ? SPNG_FMT_PNG : SPNG_FMT_G8;
+    img->format = (ihdr.bit_depth == 16) ? IMGIO_FORMAT_R16_UNORM : IMGIO_FORMAT_R8_UNORM;
+  }
+  else if (ihdr.color_type == SPNG_COLOR_TYPE_GRAYSCALE_ALPHA && ihdr.bit_depth == 8)
+  {
+    fmt = SPNG_FMT_PNG;
+    img->format = IMGIO_FORMAT_RG8_UNORM;
+  }
+
+  err = spng_decoded_image_size(ctx, fmt, &img->size);
   if (err != SPNG_OK)
   {
-    goto ihdr_fail;
+    goto decode_size_fail;
   }
 
   img->width = ihdr.width;
   img->height = ihdr.height;
 
+  if (dst)
+  {
+    /* Rows of interlaced images are visited multiple times and out of order. */
+    err = spng_decode_image(ctx, NULL, 0, fmt, SPNG_DECODE_PROGRESSIVE);
+    if (err != SPNG_OK)
+    {
+      goto progressive_decode_fail;
+    }
+
+    row_size = img->size / ihdr.height;
+
+    do
+    {
+      err = spng_get_row_info(ctx, &row_info);
+      if (err != SPNG_OK)
+      {
+        break;
+      }
+
+      err = spng_decode_row(ctx, &dst[row_info.row_num * row_pitch], row_size);
+    }
+    while (err == SPNG_OK);
+
+    if (err != SPNG_EOI)
+    {
+      goto progressive_decode_fail;
+    }
+  }
+  else if (allocate)
+  {
+    img->data = (uint8_t*) malloc(img->size);
+
+    err = spng_decode_image(ctx, img->data, img->size, fmt, 0);
+    if (err != SPNG_OK)
+    {
+      goto decode_fail;
+    }
+  }
+
   spng_ctx_free(ctx);
 
   return IMGIO_OK;
 
-ihdr_fail:
 decode_fail:
   free(img->data);
 
+progressive_decode_fail:
 decode_size_fail:
+ihdr_fail:
 buffer_fail:
   spng_ctx_free(ctx);
 
@@ -86,3 +151,19 @@ buffer_fail:
     return IMGIO_ERR_DECODE;
   }
 }
+
+int imgio_png_decode(size_t size, const void* data, imgio_img* img)
+{
+  return png_decode(size, data, img, true, NULL, 0);
+}
+
+int imgio_png_read_info(size_t size, const void* data, imgio_img* img)
+{
+  return png_decode(size, data, img, false, NULL, 0);
+}
+
+int imgio_png_decode_into(size_t size, const void* data, uint8_t* dst, size_t row_pitch)
+{
+  imgio_img img;
+  return png_decode(size, data, &img, false, dst, row_pitch);
+}
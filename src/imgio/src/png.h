@@ -21,9 +21,14 @@
 #define IMGIO_PNG_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 struct imgio_img;
 
 int imgio_png_decode(size_t size, const void* data, imgio_img* img);
 
+int imgio_png_read_info(size_t size, const void* data, imgio_img* img);
+
+int imgio_png_decode_into(size_t size, const void* data, uint8_t* dst, size_t row_pitch);
+
 #endif
@@ -0,0 +1,362 @@
+/*
+ * This file is part of gatling.
+ *
+ * Copyright (C) 2019-2022 Pablo Delgado Krämer
+ *
+ * gatling is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Feeds hand-assembled DDS and KTX2 files to the container parsers: valid files, every
+// truncation of them, mip counts beyond the full chain, cube maps, arrays and volumes,
+// and dimensions whose byte size doesn't fit into size_t.
+
+#include "dds.h"
+#include "ktx2.h"
+
+#include "imgio.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+namespace
+{
+  int s_failureCount = 0;
+
+#define CHECK(COND, ...)                      \
+  if (!(COND))                                \
+  {                                           \
+    fprintf(stderr, "check failed: " __VA_ARGS__); \
+    fprintf(stderr, "\n");                    \
+    s_failureCount++;                         \
+  }
+
+  const uint32_t DDS_FLAGS_OFFSET = 8;
+  const uint32_t DDS_HEIGHT_OFFSET = 12;
+  const uint32_t DDS_WIDTH_OFFSET = 16;
+  const uint32_t DDS_MIP_COUNT_OFFSET = 28;
+  const uint32_t DDS_PF_FLAGS_OFFSET = 80;
+  const uint32_t DDS_PF_FOURCC_OFFSET = 84;
+  const uint32_t DDS_CAPS2_OFFSET = 112;
+  const uint32_t DDS_DXGI_FORMAT_OFFSET = 128;
+  const uint32_t DDS_DIMENSION_OFFSET = 132;
+  const uint32_t DDS_MISC_FLAG_OFFSET = 136;
+  const uint32_t DDS_ARRAY_SIZE_OFFSET = 140;
+  const uint32_t DDS_DXT10_DATA_OFFSET = 148;
+
+  const uint32_t KTX2_VK_FORMAT_OFFSET = 12;
+  const uint32_t KTX2_WIDTH_OFFSET = 20;
+  const uint32_t KTX2_HEIGHT_OFFSET = 24;
+  const uint32_t KTX2_DEPTH_OFFSET = 28;
+  const uint32_t KTX2_LAYER_COUNT_OFFSET = 32;
+  const uint32_t KTX2_FACE_COUNT_OFFSET = 36;
+  const uint32_t KTX2_LEVEL_COUNT_OFFSET = 40;
+  const uint32_t KTX2_LEVEL_INDEX_OFFSET = 80;
+
+  void _Write32(std::vector<uint8_t>& file, size_t offset, uint32_t value)
+  {
+    memcpy(&file[offset], &value, sizeof(value));
+  }
+
+  void _Write64(std::vector<uint8_t>& file, size_t offset, uint64_t value)
+  {
+    memcpy(&file[offset], &value, sizeof(value));
+  }
+
+  uint32_t _GetLevelDimension(uint32_t size, uint32_t level)
+  {
+    return (size >> level) ? (size >> level) : 1;
+  }
+
+  // RGBA8 image with a DX10 header and consecutive levels filled with their index.
+  std::vector<uint8_t> _MakeDds(uint32_t width, uint32_t height, uint32_t levelCount)
+  {
+    size_t dataSize = 0;
+    for (uint32_t i = 0; i < levelCount; i++)
+    {
+      dataSize += imgio_get_level_size(IMGIO_FORMAT_RGBA8_UNORM, _GetLevelDimension(width, i), _GetLevelDimension(height, i));
+    }
+
+    std::vector<uint8_t> file(DDS_DXT10_DATA_OFFSET, 0);
+    memcpy(file.data(), "DDS ", 4);
+    _Write32(file, 4, 124);
+    _Write32(file, DDS_FLAGS_OFFSET, 0x1007 | 0x20000);
+    _Write32(file, DDS_HEIGHT_OFFSET, height);
+    _Write32(file, DDS_WIDTH_OFFSET, width);
+    _Write32(file, DDS_MIP_COUNT_OFFSET, levelCount);
+    _Write32(file, 76, 32);
+    _Write32(file, DDS_PF_FLAGS_OFFSET, 0x4);
+    memcpy(&file[DDS_PF_FOURCC_OFFSET], "DX10", 4);
+    _Write32(file, DDS_DXGI_FORMAT_OFFSET, 28);
+    _Write32(file, DDS_DIMENSION_OFFSET, 3);
+    _Write32(file, DDS_ARRAY_SIZE_OFFSET, 1);
+
+    for (uint32_t i = 0; i < levelCount; i++)
+    {
+      size_t levelSize = imgio_get_level_size(IMGIO_FORMAT_RGBA8_UNORM, _GetLevelDimension(width, i), _GetLevelDimension(height, i));
+      file.insert(file.end(), levelSize, uint8_t(i + 1));
+    }
+
+    return file;
+  }
+
+  // RGBA8 image with levels stored from the least detailed to the most detailed one, as
+  // the specification recommends, and filled with their index.
+  std::vector<uint8_t> _MakeKtx2(uint32_t width, uint32_t height, uint32_t levelCount)
+  {
+    const uint8_t IDENTIFIER[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+    std::vector<uint8_t> file(KTX2_LEVEL_INDEX_OFFSET + levelCount * 24, 0);
+    memcpy(file.data(), IDENTIFIER, sizeof(IDENTIFIER));
+    _Write32(file, KTX2_VK_FORMAT_OFFSET, 37);
+    _Write32(file, 16, 1);
+    _Write32(file, KTX2_WIDTH_OFFSET, width);
+    _Write32(file, KTX2_HEIGHT_OFFSET, height);
+    _Write32(file, KTX2_FACE_COUNT_OFFSET, 1);
+    _Write32(file, KTX2_LEVEL_COUNT_OFFSET, levelCount);
+
+    for (uint32_t i = levelCount; i-- > 0;)
+    {
+      size_t levelSize = imgio_get_level_size(IMGIO_FORMAT_RGBA8_UNORM, _GetLevelDimension(width, i), _GetLevelDimension(height, i));
+      _Write64(file, KTX2_LEVEL_INDEX_OFFSET + i * 24 + 0, file.size());
+      _Write64(file, KTX2_LEVEL_INDEX_OFFSET + i * 24 + 8, levelSize);
+      _Write64(file, KTX2_LEVEL_INDEX_OFFSET + i * 24 + 16, levelSize);
+      file.insert(file.end(), levelSize, uint8_t(i + 1));
+    }
+
+    return file;
+  }
+
+  typedef int (*DecodeFunc)(size_t size, const void* data, imgio_img* img);
+
+  int _Decode(DecodeFunc decode, const std::vector<uint8_t>& file, imgio_img& img)
+  {
+    memset(&img, 0, sizeof(img));
+
+    // A copy of exactly the file size lets the address sanitizer catch overreads.
+    uint8_t* data = (uint8_t*) malloc(file.size() ? file.size() : 1);
+    if (!file.empty())
+    {
+      memcpy(data, file.data(), file.size());
+    }
+    int result = decode(file.size(), data, &img);
+    free(data);
+
+    return result;
+  }
+
+  void _CheckValid(const char* name, DecodeFunc decode, const std::vector<uint8_t>& file, uint32_t width, uint32_t height, uint32_t levelCount)
+  {
+    imgio_img img;
+    int result = _Decode(decode, file, img);
+
+    CHECK(result == IMGIO_OK, "%s: result %d", name, result);
+    if (result != IMGIO_OK)
+    {
+      return;
+    }
+
+    CHECK(img.width == width && img.height == height && img.format == IMGIO_FORMAT_RGBA8_UNORM,
+      "%s: decoded a %ux%u image of format %d", name, img.width, img.height, int(img.format));
+    CHECK(img.level_count == levelCount, "%s: %u levels instead of %u", name, img.level_count, levelCount);
+
+    size_t offset = 0;
+    for (uint32_t i = 0; i < img.level_count; i++)
+    {
+      size_t levelSize = imgio_get_level_size(img.format, _GetLevelDimension(width, i), _GetLevelDimension(height, i));
+
+      CHECK(img.level_offsets[i] == offset, "%s: level %u at offset %zu instead of %zu", name, i, img.level_offsets[i], offset);
+      CHECK(img.data[offset] == i + 1 && img.data[offset + levelSize - 1] == i + 1, "%s: level %u has the wrong data", name, i);
+      offset += levelSize;
+    }
+    CHECK(img.size == offset, "%s: size %zu instead of %zu", name, img.size, offset);
+
+    imgio_free_img(&img);
+  }
+
+  void _CheckRejected(const char* name, DecodeFunc decode, const std::vector<uint8_t>& file, int expected)
+  {
+    imgio_img img;
+    int result = _Decode(decode, file, img);
+
+    CHECK(result == expected, "%s: result %d instead of %d", name, result, expected);
+    CHECK(!img.data, "%s: data allocated", name);
+
+    if (result == IMGIO_OK)
+    {
+      imgio_free_img(&img);
+    }
+  }
+
+  void _CheckTruncations(const char* name, DecodeFunc decode, const std::vector<uint8_t>& file)
+  {
+    for (size_t size = 0; size < file.size(); size++)
+    {
+      imgio_img img;
+      int result = _Decode(decode, std::vector<uint8_t>(file.begin(), file.begin() + size), img);
+
+      CHECK(result != IMGIO_OK, "%s: file truncated to %zu bytes decoded", name, size);
+      if (result == IMGIO_OK)
+      {
+        imgio_free_img(&img);
+      }
+    }
+  }
+
+  void _TestDds()
+  {
+    _CheckValid("DDS", imgio_dds_decode, _MakeDds(5, 3, 3), 5, 3, 3);
+    _CheckValid("DDS full chain", imgio_dds_decode, _MakeDds(8, 2, 4), 8, 2, 4);
+    _CheckTruncations("DDS", imgio_dds_decode, _MakeDds(5, 3, 3));
+
+    // Mip counts beyond the 1x1 level.
+    std::vector<uint8_t> file = _MakeDds(8, 2, 4);
+    _Write32(file, DDS_MIP_COUNT_OFFSET, 5);
+    file.insert(file.end(), 4, 5);
+    _CheckRejected("DDS mip count beyond the chain", imgio_dds_decode, file, IMGIO_ERR_CORRUPT_DATA);
+    _Write32(file, DDS_MIP_COUNT_OFFSET, 0xFFFFFFFF);
+    _CheckRejected("DDS maximum mip count", imgio_dds_decode, file, IMGIO_ERR_CORRUPT_DATA);
+
+    // Levels exceeding IMGIO_MAX_LEVEL_COUNT are the least detailed ones and are dropped.
+    _CheckValid("DDS long chain", imgio_dds_decode, _MakeDds(1 << 17, 1, 18), 1 << 17, 1, IMGIO_MAX_LEVEL_COUNT);
+
+    // Only single 2D images are supported.
+    file = _MakeDds(4, 4, 1);
+    _Write32(file, DDS_CAPS2_OFFSET, 0x200 | 0xFC00);
+    _CheckRejected("DDS cube map", imgio_dds_decode, file, IMGIO_ERR_DECODE);
+
+    file = _MakeDds(4, 4, 1);
+    _Write32(file, DDS_CAPS2_OFFSET, 0x200000);
+    _CheckRejected("DDS volume", imgio_dds_decode, file, IMGIO_ERR_DECODE);
+
+    file = _MakeDds(4, 4, 1);
+    _Write32(file, DDS_DIMENSION_OFFSET, 4);
+    _CheckRejected("DDS 3D texture", imgio_dds_decode, file, IMGIO_ERR_DECODE);
+
+    file = _MakeDds(4, 4, 1);
+    _Write32(file, DDS_ARRAY_SIZE_OFFSET, 6);
+    _CheckRejected("DDS array", imgio_dds_decode, file, IMGIO_ERR_DECODE);
+
+    file = _MakeDds(4, 4, 1);
+    _Write32(file, DDS_MISC_FLAG_OFFSET, 0x4);
+    _CheckRejected("DDS DX10 cube map", imgio_dds_decode, file, IMGIO_ERR_DECODE);
+
+    file = _MakeDds(4, 4, 1);
+    _Write32(file, DDS_WIDTH_OFFSET, 0);
+    _CheckRejected("DDS zero width", imgio_dds_decode, file, IMGIO_ERR_DECODE);
+
+    // The byte size of 2^31 x 2^31 RGBA8 texels is 2^64, which wraps to zero in 64 bits.
+    file = _MakeDds(4, 4, 1);
+    _Write32(file, DDS_WIDTH_OFFSET, 0x80000000);
+    _Write32(file, DDS_HEIGHT_OFFSET, 0x80000000);
+    _Write32(file, DDS_MIP_COUNT_OFFSET, 1);
+    _CheckRejected("DDS wrapping size", imgio_dds_decode, file, IMGIO_ERR_CORRUPT_DATA);
+
+    file = _MakeDds(4, 4, 1);
+    _Write32(file, DDS_WIDTH_OFFSET, 0xFFFFFFFF);
+    _Write32(file, DDS_HEIGHT_OFFSET, 0xFFFFFFFF);
+    _Write32(file, DDS_MIP_COUNT_OFFSET, 32);
+    _Write32(file, DDS_DXGI_FORMAT_OFFSET, 2); // R32G32B32A32_FLOAT
+    _CheckRejected("DDS maximum dimensions", imgio_dds_decode, file, IMGIO_ERR_CORRUPT_DATA);
+
+    // Legacy headers take the same path.
+    file = _MakeDds(8, 8, 1);
+    file.erase(file.begin() + DDS_DIMENSION_OFFSET - 4, file.begin() + DDS_DXT10_DATA_OFFSET);
+    memcpy(&file[DDS_PF_FOURCC_OFFSET], "DXT1", 4);
+    file.resize(128 + 32);
+    _Write32(file, DDS_WIDTH_OFFSET, 0x10000000);
+    _Write32(file, DDS_HEIGHT_OFFSET, 0x10000000);
+    _CheckRejected("DDS legacy huge dimensions", imgio_dds_decode, file, IMGIO_ERR_CORRUPT_DATA);
+    _CheckRejected("not a DDS file", imgio_dds_decode, _MakeKtx2(4, 4, 1), IMGIO_ERR_UNSUPPORTED_ENCODING);
+  }
+
+  void _TestKtx2()
+  {
+    _CheckValid("KTX2", imgio_ktx2_decode, _MakeKtx2(5, 3, 3), 5, 3, 3);
+    _CheckValid("KTX2 full chain", imgio_ktx2_decode, _MakeKtx2(2, 8, 4), 2, 8, 4);
+    _CheckTruncations("KTX2", imgio_ktx2_decode, _MakeKtx2(5, 3, 3));
+
+    // A level count of zero requests mip generation, but the base level must be present.
+    std::vector<uint8_t> file = _MakeKtx2(4, 4, 1);
+    _Write32(file, KTX2_LEVEL_COUNT_OFFSET, 0);
+    _CheckValid("KTX2 level count zero", imgio_ktx2_decode, file, 4, 4, 1);
+
+    file = _MakeKtx2(2, 8, 4);
+    _Write32(file, KTX2_LEVEL_COUNT_OFFSET, 5);
+    file.resize(file.size() + 24, 0);
+    _CheckRejected("KTX2 level count beyond the chain", imgio_ktx2_decode, file, IMGIO_ERR_CORRUPT_DATA);
+    _Write32(file, KTX2_LEVEL_COUNT_OFFSET, 0xFFFFFFFF);
+    _CheckRejected("KTX2 maximum level count", imgio_ktx2_decode, file, IMGIO_ERR_CORRUPT_DATA);
+
+    _CheckValid("KTX2 long chain", imgio_ktx2_decode, _MakeKtx2(1, 1 << 17, 18), 1, 1 << 17, IMGIO_MAX_LEVEL_COUNT);
+
+    file = _MakeKtx2(4, 4, 1);
+    _Write32(file, KTX2_FACE_COUNT_OFFSET, 6);
+    _CheckRejected("KTX2 cube map", imgio_ktx2_decode, file, IMGIO_ERR_DECODE);
+
+    file = _MakeKtx2(4, 4, 1);
+    _Write32(file, KTX2_LAYER_COUNT_OFFSET, 2);
+    _CheckRejected("KTX2 array", imgio_ktx2_decode, file, IMGIO_ERR_DECODE);
+
+    file = _MakeKtx2(4, 4, 1);
+    _Write32(file, KTX2_DEPTH_OFFSET, 4);
+    _CheckRejected("KTX2 volume", imgio_ktx2_decode, file, IMGIO_ERR_DECODE);
+
+    file = _MakeKtx2(4, 4, 1);
+    _Write32(file, KTX2_HEIGHT_OFFSET, 0);
+    _CheckRejected("KTX2 zero height", imgio_ktx2_decode, file, IMGIO_ERR_DECODE);
+
+    // A level index can't claim the wrapped size of huge dimensions.
+    file = _MakeKtx2(4, 4, 1);
+    _Write32(file, KTX2_WIDTH_OFFSET, 0x80000000);
+    _Write32(file, KTX2_HEIGHT_OFFSET, 0x80000000);
+    _Write64(file, KTX2_LEVEL_INDEX_OFFSET + 8, 0);
+    _Write64(file, KTX2_LEVEL_INDEX_OFFSET + 16, 0);
+    _CheckRejected("KTX2 wrapping size", imgio_ktx2_decode, file, IMGIO_ERR_CORRUPT_DATA);
+
+    file = _MakeKtx2(4, 4, 1);
+    _Write32(file, KTX2_WIDTH_OFFSET, 0xFFFFFFFF);
+    _Write32(file, KTX2_HEIGHT_OFFSET, 0xFFFFFFFF);
+    _Write32(file, KTX2_VK_FORMAT_OFFSET, 109); // R32G32B32A32_SFLOAT
+    _Write64(file, KTX2_LEVEL_INDEX_OFFSET + 8, UINT64_MAX);
+    _CheckRejected("KTX2 maximum dimensions", imgio_ktx2_decode, file, IMGIO_ERR_CORRUPT_DATA);
+
+    file = _MakeKtx2(4, 4, 1);
+    _Write64(file, KTX2_LEVEL_INDEX_OFFSET, UINT64_MAX - 8);
+    _CheckRejected("KTX2 level offset beyond the file", imgio_ktx2_decode, file, IMGIO_ERR_CORRUPT_DATA);
+
+    _CheckRejected("not a KTX2 file", imgio_ktx2_decode, _MakeDds(4, 4, 1), IMGIO_ERR_UNSUPPORTED_ENCODING);
+  }
+
+  void _TestLevelSize()
+  {
+    CHECK(imgio_get_level_size(IMGIO_FORMAT_RGBA32_FLOAT, 0xFFFFFFFF, 0xFFFFFFFF) == SIZE_MAX, "maximum RGBA32F size not saturated");
+    CHECK(imgio_get_level_size(IMGIO_FORMAT_RGBA8_UNORM, 0x80000000, 0x80000000) == SIZE_MAX, "2^64 byte size not saturated");
+    CHECK(imgio_get_level_size(IMGIO_FORMAT_BC1_RGB_UNORM, 0xFFFFFFFF, 0xFFFFFFFF) == size_t(0x40000000ull * 0x40000000ull * 8) || sizeof(size_t) < 8,
+      "maximum BC1 size");
+    CHECK(imgio_get_level_size(IMGIO_FORMAT_BC7_UNORM, 5, 3) == 2 * 1 * 16, "BC7 size of a 5x3 level");
+  }
+}
+
+int main(int argc, const char* argv[])
+{
+  _TestLevelSize();
+  _TestDds();
+  _TestKtx2();
+
+  printf("%s\n", (s_failureCount == 0) ? "passed" : "FAILED");
+
+  return (s_failureCount == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}